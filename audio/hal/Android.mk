@@ -12,13 +12,19 @@ LOCAL_SRC_FILES := \
         dsp/drc.c \
         dsp/drc_kernel.c \
         dsp/drc_math.c \
+        dsp/dsp_arena.c \
+        dsp/dsp_cpu.c \
+        dsp/dsp_kernels.c \
         dsp/dsp_util.c \
         dsp/eq2.c \
+        dsp/eq2_fixed.c \
         dsp/eq.c \
+        dsp/src.c \
 	cras_dsp.c \
 	cras_dsp_ini.c \
 	cras_dsp_mod_builtin.c \
 	cras_dsp_pipeline.c \
+	cras_dsp_pool.c \
 	cras_expr.c \
 	iniparser.c \
 	dictionary.c
@@ -48,4 +54,305 @@ LOCAL_MODULE_RELATIVE_PATH := hw
 
 LOCAL_MODULE_TAGS := optional
 
+# The eq2 cascades of speakerdsp.ini, specialized by gen_eq2_fixed.
+LOCAL_MODULE_CLASS := SHARED_LIBRARIES
+intermediates := $(call local-intermediates-dir)
+GEN := $(intermediates)/eq2_fixed_table.c
+$(GEN): PRIVATE_INI := $(LOCAL_PATH)/../../speakerdsp.ini
+$(GEN): PRIVATE_CUSTOM_TOOL = $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed $(PRIVATE_INI) > $@
+$(GEN): $(LOCAL_PATH)/../../speakerdsp.ini $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed
+	$(transform-generated-source)
+LOCAL_GENERATED_SOURCES += $(GEN)
+
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	gen_eq2_fixed.c \
+	dsp/biquad.c \
+	cras_dsp_ini.c \
+	cras_expr.c \
+	iniparser.c \
+	dictionary.c
+
+LOCAL_C_INCLUDES += \
+	device/google/dragon/audio/hal/dsp
+
+LOCAL_MODULE := gen_eq2_fixed
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+dsp_bench_src_files := \
+	dsp/tests/dsp_bench.c \
+	dsp/biquad.c \
+	dsp/crossover.c \
+	dsp/crossover2.c \
+	dsp/drc.c \
+	dsp/drc_kernel.c \
+	dsp/drc_math.c \
+	dsp/dsp_arena.c \
+	dsp/dsp_cpu.c \
+	dsp/dsp_kernels.c \
+	dsp/dsp_util.c \
+	dsp/eq2.c \
+	dsp/eq2_fixed.c \
+	dsp/eq.c \
+	dsp/src.c \
+	cras_dsp_ini.c \
+	cras_dsp_mod_builtin.c \
+	cras_dsp_pipeline.c \
+	cras_dsp_pool.c \
+	cras_expr.c \
+	iniparser.c \
+	dictionary.c
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(dsp_bench_src_files)
+
+LOCAL_C_INCLUDES += \
+	device/google/dragon/audio/hal/dsp
+
+LOCAL_LDLIBS := -lm -lpthread
+
+LOCAL_MODULE := dsp_bench
+
+LOCAL_MODULE_TAGS := optional
+
+# The pipeline needs the same generated eq2 cascades as the HAL.
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_IS_HOST_MODULE := true
+intermediates := $(call local-intermediates-dir)
+GEN := $(intermediates)/eq2_fixed_table.c
+$(GEN): PRIVATE_INI := $(LOCAL_PATH)/../../speakerdsp.ini
+$(GEN): PRIVATE_CUSTOM_TOOL = $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed $(PRIVATE_INI) > $@
+$(GEN): $(LOCAL_PATH)/../../speakerdsp.ini $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed
+	$(transform-generated-source)
+LOCAL_GENERATED_SOURCES += $(GEN)
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# The same benchmark on the device, where the 32-bit build runs the NEON
+# kernels and the 64-bit one the ASIMD kernels:
+#    dsp_bench -c neon > neon.json
+#    dsp_bench64 -c asimd > asimd.json
+include $(CLEAR_VARS)
+
+LOCAL_ARM_MODE := arm
+
+LOCAL_SRC_FILES := $(dsp_bench_src_files)
+
+LOCAL_C_INCLUDES += \
+	device/google/dragon/audio/hal/dsp
+
+LOCAL_MULTILIB := both
+LOCAL_MODULE_STEM_32 := dsp_bench
+LOCAL_MODULE_STEM_64 := dsp_bench64
+
+LOCAL_MODULE := dsp_bench_device
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_CLASS := EXECUTABLES
+intermediates := $(call local-generated-sources-dir)
+GEN := $(intermediates)/eq2_fixed_table.c
+$(GEN): PRIVATE_INI := $(LOCAL_PATH)/../../speakerdsp.ini
+$(GEN): PRIVATE_CUSTOM_TOOL = $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed $(PRIVATE_INI) > $@
+$(GEN): $(LOCAL_PATH)/../../speakerdsp.ini $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed
+	$(transform-generated-source)
+LOCAL_GENERATED_SOURCES += $(GEN)
+
+include $(BUILD_EXECUTABLE)
+
+# Host tests of the DSP pipeline code above the kernels, in tests/. Each
+# runs on its own and exits non-zero on a failure.
+cras_dsp_test_src_files := \
+	dsp/biquad.c \
+	dsp/crossover.c \
+	dsp/crossover2.c \
+	dsp/drc.c \
+	dsp/drc_kernel.c \
+	dsp/drc_math.c \
+	dsp/dsp_arena.c \
+	dsp/dsp_cpu.c \
+	dsp/dsp_kernels.c \
+	dsp/dsp_util.c \
+	dsp/eq2.c \
+	dsp/eq2_fixed.c \
+	dsp/eq.c \
+	dsp/src.c \
+	cras_dsp.c \
+	cras_dsp_ini.c \
+	cras_dsp_mod_builtin.c \
+	cras_dsp_pipeline.c \
+	cras_dsp_pool.c \
+	cras_expr.c \
+	iniparser.c \
+	dictionary.c
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	tests/cras_dsp_ini_test.c \
+	$(cras_dsp_test_src_files)
+
+LOCAL_C_INCLUDES += \
+	device/google/dragon/audio/hal/dsp
+
+LOCAL_SHARED_LIBRARIES := liblog
+
+LOCAL_LDLIBS := -lm -lpthread
+
+LOCAL_MODULE := cras_dsp_ini_test
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_IS_HOST_MODULE := true
+intermediates := $(call local-intermediates-dir)
+GEN := $(intermediates)/eq2_fixed_table.c
+$(GEN): PRIVATE_INI := $(LOCAL_PATH)/../../speakerdsp.ini
+$(GEN): PRIVATE_CUSTOM_TOOL = $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed $(PRIVATE_INI) > $@
+$(GEN): $(LOCAL_PATH)/../../speakerdsp.ini $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed
+	$(transform-generated-source)
+LOCAL_GENERATED_SOURCES += $(GEN)
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	tests/cras_dsp_test.c \
+	$(cras_dsp_test_src_files)
+
+LOCAL_C_INCLUDES += \
+	device/google/dragon/audio/hal/dsp
+
+LOCAL_SHARED_LIBRARIES := liblog
+
+LOCAL_LDLIBS := -lm -lpthread
+
+LOCAL_MODULE := cras_dsp_test
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_IS_HOST_MODULE := true
+intermediates := $(call local-intermediates-dir)
+GEN := $(intermediates)/eq2_fixed_table.c
+$(GEN): PRIVATE_INI := $(LOCAL_PATH)/../../speakerdsp.ini
+$(GEN): PRIVATE_CUSTOM_TOOL = $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed $(PRIVATE_INI) > $@
+$(GEN): $(LOCAL_PATH)/../../speakerdsp.ini $(HOST_OUT_EXECUTABLES)/gen_eq2_fixed
+	$(transform-generated-source)
+LOCAL_GENERATED_SOURCES += $(GEN)
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# golden_test checks every backend of the DSP kernels against the outputs
+# in dsp/tests/golden. Each build runs all the backends its CPU has, but a
+# few inline helpers are still picked at compile time, so the host builds
+# both without and with SSE3, and the device both for armv7 and aarch64.
+# The compiler must not fuse the multiply-adds of the C code, which is the
+# reference every backend is held to.
+golden_test_src_files := \
+	dsp/tests/golden_test.c \
+	dsp/biquad.c \
+	dsp/crossover.c \
+	dsp/crossover2.c \
+	dsp/drc.c \
+	dsp/drc_kernel.c \
+	dsp/drc_math.c \
+	dsp/dsp_arena.c \
+	dsp/dsp_cpu.c \
+	dsp/dsp_kernels.c \
+	dsp/dsp_util.c \
+	dsp/eq2.c \
+	dsp/eq.c \
+	dsp/src.c
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(golden_test_src_files)
+
+LOCAL_C_INCLUDES += \
+	device/google/dragon/audio/hal/dsp
+
+LOCAL_CFLAGS := -mno-sse3 -ffp-contract=off
+
+LOCAL_LDLIBS := -lm
+
+LOCAL_MULTILIB := 64
+
+LOCAL_MODULE := golden_test_generic
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(golden_test_src_files)
+
+LOCAL_C_INCLUDES += \
+	device/google/dragon/audio/hal/dsp
+
+LOCAL_CFLAGS := -msse3 -ffp-contract=off
+
+LOCAL_LDLIBS := -lm
+
+LOCAL_MULTILIB := 64
+
+LOCAL_MODULE := golden_test_sse3
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# The AArch64 kernels on the host, on the intrinsics emulated by
+# dsp/tests/neon_emul/arm_neon.h. The sources take the AArch64 paths, and
+# dsp_cpu_features() reports ASIMD, so golden_test runs the asimd backend
+# with its fused multiply-adds as on the device. The 32-bit NEON kernels
+# are mostly inline assembly and only run in the device golden_test.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(golden_test_src_files)
+
+LOCAL_C_INCLUDES += \
+	device/google/dragon/audio/hal/dsp/tests/neon_emul \
+	device/google/dragon/audio/hal/dsp
+
+LOCAL_CFLAGS := -D__aarch64__ -DDSP_ASIMD_EMUL -ffp-contract=off
+
+LOCAL_LDLIBS := -lm
+
+LOCAL_MULTILIB := 64
+
+LOCAL_MODULE := golden_test_asimd_emul
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_ARM_MODE := arm
+
+LOCAL_SRC_FILES := $(golden_test_src_files)
+
+LOCAL_C_INCLUDES += \
+	device/google/dragon/audio/hal/dsp
+
+LOCAL_CFLAGS := -ffp-contract=off
+
+LOCAL_MULTILIB := both
+LOCAL_MODULE_STEM_32 := golden_test
+LOCAL_MODULE_STEM_64 := golden_test64
+
+LOCAL_MODULE := golden_test
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
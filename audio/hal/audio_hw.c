@@ -144,6 +144,7 @@ struct pcm_device_profile pcm_device_playback_spk = {
     .type = PCM_PLAYBACK,
     .devices = AUDIO_DEVICE_OUT_SPEAKER,
     .dsp_name = "speaker_eq",
+    .mmap = true,
 };
 
 static struct pcm_device_profile pcm_device_hotword_streaming = {
@@ -859,6 +860,13 @@ static int select_devices(struct audio_device *adev,
 
 static ssize_t read_frames(struct stream_in *in, void *buffer, ssize_t frames);
 static int do_in_standby_l(struct stream_in *in);
+static struct cras_dsp_context *get_dsp_context(struct pcm_device_profile *profile,
+                                                int purpose);
+static struct pipeline *get_dsp_pipeline(struct pcm_device *iodev,
+					 audio_format_t format,
+					 size_t channels, unsigned int rate);
+static void apply_dsp(struct pipeline *pipeline, uint8_t *buf,
+		      audio_format_t format, size_t frames);
 
 #define MAX_NUM_CHANNEL_CONFIGS 10
 
@@ -913,6 +921,7 @@ static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
 {
     struct stream_in *in;
     struct pcm_device *pcm_device;
+    struct pipeline *pipeline;
 
     if (buffer_provider == NULL || buffer == NULL)
         return -EINVAL;
@@ -947,6 +956,14 @@ static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
             buffer->frame_count = 0;
             return in->read_status;
         }
+
+        pipeline = get_dsp_pipeline(pcm_device, AUDIO_FORMAT_PCM_16_BIT,
+                                    in->config.channels, in->config.rate);
+        if (pipeline) {
+            apply_dsp(pipeline, (uint8_t *)in->read_buf, AUDIO_FORMAT_PCM_16_BIT,
+                      in->config.period_size);
+            cras_dsp_put_pipeline(pcm_device->dsp_context);
+        }
         in->read_buf_frames = in->config.period_size;
     }
 
@@ -1181,6 +1198,11 @@ int start_input_stream(struct stream_in *in)
             ret = -EIO;
             goto error_open;
         }
+        /* The capture pipeline runs on the samples as they are read, at the
+         * rate of the device. */
+        if (pcm_profile->dsp_name)
+            pcm_device->dsp_context = get_dsp_context(pcm_profile,
+                                                      DSP_PURPOSE_CAPTURE);
     }
 
     /* force read and proc buffer reallocation in case of frame size or
@@ -1302,6 +1324,59 @@ static int out_close_pcm_devices(struct stream_out *out)
     return 0;
 }
 
+static const char * const dsp_purpose_names[DSP_PURPOSE_MAX] = {
+    [DSP_PURPOSE_PLAYBACK] = "playback",
+    [DSP_PURPOSE_VOICE_COMM] = "voice-comm",
+    [DSP_PURPOSE_CAPTURE] = "capture",
+};
+
+/*
+ * Returns the DSP context of the profile for the purpose. It is created, and
+ * its pipeline requested from the DSP worker thread, on first use only, so
+ * leaving standby does not rebuild the pipeline.
+ */
+static struct cras_dsp_context *get_dsp_context(struct pcm_device_profile *profile,
+                                                int purpose)
+{
+    struct cras_dsp_context *ctx = profile->dsp_contexts[purpose];
+
+    if (ctx)
+        return ctx;
+
+    ctx = cras_dsp_context_new(profile->config.rate, dsp_purpose_names[purpose]);
+    if (!ctx)
+        return NULL;
+    cras_dsp_set_variable(ctx, "dsp_name", profile->dsp_name);
+    /* Run the pipeline once per period, as the device consumes it. */
+    cras_dsp_set_block_size(ctx, profile->config.period_size);
+    cras_dsp_load_pipeline(ctx);
+    profile->dsp_contexts[purpose] = ctx;
+    return ctx;
+}
+
+/*
+ * Sets the volume which selects the tunings of the playback DSP pipelines.
+ * The contexts are shared by the streams of a profile, so the volume is
+ * kept for the device. AudioFlinger applies the volume of the primary output
+ * in software and never calls out_set_volume() for it, so on that output the
+ * volume only changes through the "dsp_volume" parameter. Called with
+ * adev->lock held.
+ */
+static void set_dsp_volume_l(struct audio_device *adev, float volume)
+{
+    int i, purpose;
+
+    adev->dsp_volume = volume;
+    for (i = 0; pcm_devices[i] != NULL; i++) {
+        if (pcm_devices[i]->type != PCM_PLAYBACK)
+            continue;
+        for (purpose = 0; purpose < DSP_PURPOSE_MAX; purpose++) {
+            if (pcm_devices[i]->dsp_contexts[purpose])
+                cras_dsp_set_volume(pcm_devices[i]->dsp_contexts[purpose], volume);
+        }
+    }
+}
+
 static int out_open_pcm_devices(struct stream_out *out)
 {
     struct pcm_device *pcm_device;
@@ -1315,18 +1390,22 @@ static int out_open_pcm_devices(struct stream_out *out)
               __func__, pcm_device->pcm_profile->card, pcm_device->pcm_profile->device);
 
         if (pcm_device->pcm_profile->dsp_name) {
-            pcm_device->dsp_context = cras_dsp_context_new(pcm_device->pcm_profile->config.rate,
+            pcm_device->dsp_context = get_dsp_context(pcm_device->pcm_profile,
                     (adev->mode == AUDIO_MODE_IN_CALL || adev->mode == AUDIO_MODE_IN_COMMUNICATION)
-                        ? "voice-comm" : "playback");
+                        ? DSP_PURPOSE_VOICE_COMM : DSP_PURPOSE_PLAYBACK);
             if (pcm_device->dsp_context) {
-                cras_dsp_set_variable(pcm_device->dsp_context, "dsp_name",
-                                      pcm_device->pcm_profile->dsp_name);
-                cras_dsp_load_pipeline(pcm_device->dsp_context);
+                cras_dsp_set_volume(pcm_device->dsp_context, adev->dsp_volume);
+                /* A pipeline with a rate converter takes the samples at the
+                 * stream rate, so the resampler below is only used until it
+                 * has been loaded for this rate. */
+                cras_dsp_set_input_rate(pcm_device->dsp_context, out->sample_rate);
             }
         }
 
         pcm_device->pcm = pcm_open(pcm_device->pcm_profile->card, pcm_device->pcm_profile->device,
-                               PCM_OUT | PCM_MONOTONIC, &pcm_device->pcm_profile->config);
+                               PCM_OUT | PCM_MONOTONIC |
+                                   (pcm_device->pcm_profile->mmap ? PCM_MMAP : 0),
+                               &pcm_device->pcm_profile->config);
 
         if (pcm_device->pcm && !pcm_is_ready(pcm_device->pcm)) {
             ALOGE("%s: %s", __func__, pcm_get_error(pcm_device->pcm));
@@ -1334,6 +1413,14 @@ static int out_open_pcm_devices(struct stream_out *out)
             ret = -EIO;
             goto error_open;
         }
+        /* Prepare now, so pcm_start() does not drop what is already in the
+         * mmap buffer by preparing again. */
+        pcm_device->mmap_started = false;
+        if (pcm_device->pcm_profile->mmap && pcm_prepare(pcm_device->pcm) != 0) {
+            ALOGE("%s: %s", __func__, pcm_get_error(pcm_device->pcm));
+            ret = -EIO;
+            goto error_open;
+        }
         /*
         * If the stream rate differs from the PCM rate, we need to
         * create a resampler.
@@ -1621,9 +1708,17 @@ static int out_standby(struct audio_stream *stream)
 
 static int out_dump(const struct audio_stream *stream, int fd)
 {
-    (void)stream;
-    (void)fd;
+    struct stream_out *out = (struct stream_out *)stream;
+    struct pcm_device *pcm_device;
+    struct listnode *node;
 
+    lock_output_stream(out);
+    list_for_each(node, &out->pcm_dev_list) {
+        pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
+        if (pcm_device->dsp_context)
+            cras_dsp_context_dump(pcm_device->dsp_context, fd);
+    }
+    pthread_mutex_unlock(&out->lock);
     return 0;
 }
 
@@ -1736,12 +1831,40 @@ static char* out_get_parameters(const struct audio_stream *stream, const char *k
     return str;
 }
 
+/*
+ * Returns the delay the DSP pipelines of the stream add, such as the
+ * lookahead of the DRC, in microseconds. The devices of a stream play at the
+ * same time, so this is the longest of them. Must be called with out->lock.
+ */
+static int64_t out_get_dsp_delay_us(struct stream_out *out)
+{
+    struct pcm_device *pcm_device;
+    struct listnode *node;
+    int64_t delay_us = 0;
+
+    list_for_each(node, &out->pcm_dev_list) {
+        pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
+        if (pcm_device->dsp_context) {
+            int64_t us = cras_dsp_get_delay(pcm_device->dsp_context) * 1000000LL /
+                         pcm_device->pcm_profile->config.rate;
+            if (us > delay_us)
+                delay_us = us;
+        }
+    }
+    return delay_us;
+}
+
 static uint32_t out_get_latency(const struct audio_stream_out *stream)
 {
     struct stream_out *out = (struct stream_out *)stream;
+    int64_t dsp_delay_us;
+
+    lock_output_stream(out);
+    dsp_delay_us = out_get_dsp_delay_us(out);
+    pthread_mutex_unlock(&out->lock);
 
     return (out->config.period_count * out->config.period_size * 1000) /
-           (out->config.rate);
+           (out->config.rate) + dsp_delay_us / 1000;
 }
 
 static int out_set_volume(struct audio_stream_out *stream, float left,
@@ -1751,6 +1874,12 @@ static int out_set_volume(struct audio_stream_out *stream, float left,
     struct audio_device *adev = out->dev;
     (void)right;
 
+    /* Only the outputs which leave the volume to the HAL get here, see
+     * set_dsp_volume_l() for the others. */
+    pthread_mutex_lock(&adev->lock);
+    set_dsp_volume_l(adev, left);
+    pthread_mutex_unlock(&adev->lock);
+
     if (out->usecase == USECASE_AUDIO_PLAYBACK_MULTI_CH) {
         /* only take left channel into account: the API is for stereo anyway */
         out->muted = (left == 0.0f);
@@ -1760,25 +1889,178 @@ static int out_set_volume(struct audio_stream_out *stream, float left,
     return -ENOSYS;
 }
 
-/* Applies the DSP to the samples for the iodev if applicable. */
-static void apply_dsp(struct pcm_device *iodev, uint8_t *buf, size_t frames)
+/* Maps a PCM audio format to the DSP sample format. Returns -1 if the DSP
+ * cannot process samples in that format. */
+static int get_dsp_sample_format(audio_format_t format)
+{
+	switch (format) {
+	case AUDIO_FORMAT_PCM_16_BIT:
+		return DSP_SAMPLE_FORMAT_S16_LE;
+	case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+		return DSP_SAMPLE_FORMAT_S24_3LE;
+	case AUDIO_FORMAT_PCM_8_24_BIT:
+		return DSP_SAMPLE_FORMAT_S24_LE;
+	case AUDIO_FORMAT_PCM_32_BIT:
+		return DSP_SAMPLE_FORMAT_S32_LE;
+	case AUDIO_FORMAT_PCM_FLOAT:
+		return DSP_SAMPLE_FORMAT_FLOAT_LE;
+	default:
+		return -1;
+	}
+}
+
+/* Locks the DSP pipeline of the iodev if it can process the samples of a
+ * stream. Returns NULL if there is none, or if it takes another number of
+ * channels, or a rate which is neither the stream's nor the device's, as it
+ * may while it is reloaded for a new stream. The pipeline must be released
+ * with cras_dsp_put_pipeline(). */
+static struct pipeline *get_dsp_pipeline(struct pcm_device *iodev,
+					 audio_format_t format,
+					 size_t channels, unsigned int rate)
 {
 	struct cras_dsp_context *ctx;
 	struct pipeline *pipeline;
+	unsigned int input_rate;
 
 	ctx = iodev->dsp_context;
 	if (!ctx)
-		return;
+		return NULL;
+
+	if (get_dsp_sample_format(format) < 0) {
+		ALOGV("%s: DSP skipped for format %#x", __func__, format);
+		return NULL;
+	}
 
 	pipeline = cras_dsp_get_pipeline(ctx);
+	if (!pipeline)
+		return NULL;
+
+	input_rate = cras_dsp_pipeline_get_input_rate(pipeline);
+	if (cras_dsp_pipeline_get_num_input_channels(pipeline) != (int)channels ||
+	    (input_rate != rate &&
+	     input_rate != iodev->pcm_profile->config.rate)) {
+		ALOGV("%s: pipeline does not take %zu channels at %u Hz",
+		      __func__, channels, rate);
+		cras_dsp_put_pipeline(ctx);
+		return NULL;
+	}
+	return pipeline;
+}
+
+/* Returns true if the pipeline converts the samples to the rate of the
+ * iodev. */
+static bool dsp_converts_rate(struct pcm_device *iodev,
+			      struct pipeline *pipeline)
+{
+	return pipeline && cras_dsp_pipeline_get_input_rate(pipeline) !=
+		(int)iodev->pcm_profile->config.rate;
+}
+
+/* Applies the DSP to the samples for the iodev if applicable. */
+static void apply_dsp(struct pipeline *pipeline, uint8_t *buf,
+		      audio_format_t format, size_t frames)
+{
 	if (!pipeline)
 		return;
 
-	cras_dsp_pipeline_apply(pipeline,
-				buf,
-				frames);
+	cras_dsp_pipeline_apply_format(pipeline,
+				       buf,
+				       get_dsp_sample_format(format),
+				       frames);
+}
+
+/*
+ * Writes frames to a PCM opened with PCM_MMAP. The DSP pipeline, or the channel
+ * adjustment if there is no DSP, writes straight into the mmap buffer, so the
+ * samples are only touched once on their way to the device.
+ */
+static int out_write_mmap(struct pcm_device *pcm_device, struct pipeline *pipeline,
+                          const uint8_t *data, audio_format_t format,
+                          size_t src_channels, size_t frames)
+{
+    struct pcm *pcm = pcm_device->pcm;
+    struct pcm_config *config = &pcm_device->pcm_profile->config;
+    size_t bytes_per_sample = audio_bytes_per_sample(format);
+    size_t src_frame_size = src_channels * bytes_per_sample;
+    unsigned int buffer_size = pcm_get_buffer_size(pcm);
+    int wait_ms = config->period_size * 2000 / config->rate;
+    int dsp_format = get_dsp_sample_format(format);
+    int ret = 0;
+
+    while (frames > 0) {
+        unsigned int offset, chunk;
+        void *area;
+        uint8_t *dst;
+        int avail = pcm_mmap_avail(pcm);
+
+        if (avail < 0) {
+            ret = avail;
+            break;
+        }
+
+        /* The buffer ran dry since the last write. Let the pipeline keep
+         * the time of its last block, to show if a module was too slow.
+         * The device stopped in XRUN, so stop and prepare it again and let
+         * the start threshold restart it, as pcm_write() does on EPIPE.
+         * tinyalsa skips pcm_prepare() on a handle it thinks is prepared,
+         * and only pcm_stop() clears that. */
+        if (pcm_device->mmap_started && (unsigned int)avail >= buffer_size) {
+            cras_dsp_pipeline_note_xrun(pipeline);
+            pcm_device->mmap_started = false;
+            if (pcm_stop(pcm) != 0 || pcm_prepare(pcm) != 0) {
+                ret = -EIO;
+                break;
+            }
+            continue;
+        }
+
+        /* Start the device at the start threshold, as pcm_write() does. */
+        if (!pcm_device->mmap_started &&
+                buffer_size - avail >= config->start_threshold) {
+            if (pcm_start(pcm) != 0) {
+                ret = -EIO;
+                break;
+            }
+            pcm_device->mmap_started = true;
+        }
+
+        if (avail == 0) {
+            if (!pcm_device->mmap_started) {
+                ret = -EIO;
+                break;
+            }
+            if (pcm_wait(pcm, wait_ms) < 0) {
+                ret = -EIO;
+                break;
+            }
+            continue;
+        }
+
+        chunk = frames;
+        if (pcm_mmap_begin(pcm, &area, &offset, &chunk) != 0 || chunk == 0) {
+            ret = -EIO;
+            break;
+        }
+        dst = (uint8_t *)area + pcm_frames_to_bytes(pcm, offset);
+
+        if (pipeline)
+            cras_dsp_pipeline_apply_to(pipeline, data, dst, config->channels,
+                                       dsp_format, chunk);
+        else if (src_channels != config->channels)
+            adjust_channels(data, src_channels, dst, config->channels,
+                            bytes_per_sample, chunk * src_frame_size);
+        else
+            memcpy(dst, data, chunk * src_frame_size);
 
-	cras_dsp_put_pipeline(ctx);
+        if (pcm_mmap_commit(pcm, offset, chunk) < 0) {
+            ret = -EIO;
+            break;
+        }
+        data += chunk * src_frame_size;
+        frames -= chunk;
+    }
+
+    return ret;
 }
 
 static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
@@ -1811,8 +2093,16 @@ false_alarm:
     if (out->muted)
         memset((void *)buffer, 0, bytes);
     list_for_each(node, &out->pcm_dev_list) {
+        size_t src_channels = audio_channel_count_from_out_mask(out->channel_mask);
+        struct pipeline *pipeline;
+        bool dsp_converts;
+
         pcm_device = node_to_item(node, struct pcm_device, stream_list_node);
-        if (pcm_device->resampler) {
+        pipeline = get_dsp_pipeline(pcm_device, out->format, src_channels,
+                                    out->sample_rate);
+        /* The pipeline converts the rate in float, with no resampler. */
+        dsp_converts = dsp_converts_rate(pcm_device, pipeline);
+        if (pcm_device->resampler && !dsp_converts) {
             if (bytes * pcm_device->pcm_profile->config.rate / out->sample_rate + frame_size
                     > pcm_device->res_byte_count) {
                 pcm_device->res_byte_count =
@@ -1831,26 +2121,63 @@ false_alarm:
             ALOGVV("%s: resampler output frames_= %zu", __func__, frames_wr);
         }
         if (pcm_device->pcm) {
-            size_t src_channels = audio_channel_count_from_out_mask(out->channel_mask);
             size_t dst_channels = pcm_device->pcm_profile->config.channels;
-            bool channel_remapping_needed = (dst_channels != src_channels);
+            bool channel_remapping_needed;
+            size_t audio_frame_size = frame_size;
             unsigned audio_bytes;
             const void *audio_data;
 
             ALOGVV("%s: writing buffer (%zd bytes) to pcm device", __func__, bytes);
-            if (pcm_device->resampler && pcm_device->res_buffer) {
+            if (dsp_converts) {
+                /* Convert into the buffer of the resampler, which then holds
+                 * the frames as the device takes them. */
+                size_t dst_frame_size = dst_channels * audio_bytes_per_sample(out->format);
+                size_t res_byte_count = (bytes / frame_size *
+                        pcm_device->pcm_profile->config.rate / out->sample_rate + 1) *
+                        dst_frame_size;
+                unsigned int in_frames = bytes / frame_size;
+                unsigned int out_frames;
+
+                if (res_byte_count > pcm_device->res_byte_count) {
+                    pcm_device->res_byte_count = res_byte_count;
+                    pcm_device->res_buffer =
+                        realloc(pcm_device->res_buffer, pcm_device->res_byte_count);
+                }
+                out_frames = pcm_device->res_byte_count / dst_frame_size;
+                cras_dsp_pipeline_convert_to(pipeline, buffer, &in_frames,
+                                             pcm_device->res_buffer, dst_channels,
+                                             get_dsp_sample_format(out->format),
+                                             &out_frames);
+                cras_dsp_put_pipeline(pcm_device->dsp_context);
+                pipeline = NULL;
+                audio_data = pcm_device->res_buffer;
+                audio_bytes = out_frames * dst_frame_size;
+                audio_frame_size = dst_frame_size;
+                src_channels = dst_channels;
+            } else if (pcm_device->resampler && pcm_device->res_buffer) {
                 audio_data = pcm_device->res_buffer;
                 audio_bytes = frames_wr * frame_size;
             } else {
                 audio_data = buffer;
                 audio_bytes = bytes;
             }
+            channel_remapping_needed = (dst_channels != src_channels);
+
+            if (pcm_device->pcm_profile->mmap) {
+                pcm_device->status = out_write_mmap(pcm_device, pipeline, audio_data,
+                                                    out->format, src_channels,
+                                                    audio_bytes / audio_frame_size);
+                if (pipeline)
+                    cras_dsp_put_pipeline(pcm_device->dsp_context);
+                if (pcm_device->status != 0)
+                    ret = pcm_device->status;
+                continue;
+            }
 
-            /*
-             * This can only be S16_LE stereo because of the supported formats,
-             * 4 bytes per frame.
-             */
-            apply_dsp(pcm_device, audio_data, audio_bytes/4);
+            /* The DSP works in the format of the stream, so high resolution
+             * and float samples are not truncated to 16 bits first. */
+            apply_dsp(pipeline, (uint8_t *)audio_data, out->format,
+                      audio_bytes / frame_size);
 
             if (channel_remapping_needed) {
                 const void *remapped_audio_data;
@@ -1876,6 +2203,8 @@ false_alarm:
             if (pcm_device->status != 0)
                 ret = pcm_device->status;
         }
+        if (pipeline)
+            cras_dsp_put_pipeline(pcm_device->dsp_context);
     }
     if (ret == 0)
         out->written += bytes / frame_size;
@@ -1946,9 +2275,11 @@ static int out_get_presentation_position(const struct audio_stream_out *stream,
             size_t kernel_buffer_size = out->config.period_size * out->config.period_count;
             int64_t signed_frames = out->written - kernel_buffer_size + avail;
             /* This adjustment accounts for buffering after app processor.
-               It is based on estimated DSP latency per use case, rather than exact. */
+               It is based on estimated DSP latency per use case, rather than exact,
+               plus the delay of our own DSP pipelines. */
             signed_frames -=
-                (render_latency(out->usecase) * out->sample_rate / 1000000LL);
+                ((render_latency(out->usecase) + out_get_dsp_delay_us(out)) *
+                 out->sample_rate / 1000000LL);
 
             /* It would be unusual for this value to be negative, but check just in case ... */
             if (signed_frames >= 0) {
@@ -2401,6 +2732,7 @@ static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
     char *str;
     char value[32];
     int val;
+    float volume;
     int ret;
 
     ALOGV("%s: enter: %s", __func__, kvpairs);
@@ -2484,18 +2816,53 @@ static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
         pthread_mutex_unlock(&adev->lock);
     }
 
+    /* The volume of the music stream on the speaker, from 0 to 1, which
+     * selects the DSP tunings, see set_dsp_volume_l(). */
+    ret = str_parms_get_float(parms, "dsp_volume", &volume);
+    if (ret >= 0) {
+        pthread_mutex_lock(&adev->lock);
+        set_dsp_volume_l(adev, volume);
+        pthread_mutex_unlock(&adev->lock);
+    }
+
+    /* Re-read the DSP ini, e.g. after retuning the speaker. The pipelines
+     * are rebuilt here and swapped in without stopping playback. */
+    ret = str_parms_get_str(parms, "dsp_reload", value, sizeof(value));
+    if (ret >= 0)
+        cras_dsp_reload_ini();
+
     str_parms_destroy(parms);
     ALOGV("%s: exit with code(%d)", __func__, ret);
     return ret;
 }
 
+/* The size of the reply to the "dsp_stats" key, enough for a few dozen
+ * modules. */
+#define DSP_STATS_REPLY_SIZE 2048
+
 static char* adev_get_parameters(const struct audio_hw_device *dev,
                                  const char *keys)
 {
+    struct str_parms *query = str_parms_create_str(keys);
+    struct str_parms *reply;
+    char *str;
     (void)dev;
-    (void)keys;
 
-    return strdup("");
+    /* The p50/p99/max/xrun run time of every DSP module in microseconds,
+     * so the module which eats the budget can be found in the field. */
+    if (str_parms_has_key(query, "dsp_stats")) {
+        char stats[DSP_STATS_REPLY_SIZE];
+
+        reply = str_parms_create();
+        cras_dsp_format_stats(stats, sizeof(stats));
+        str_parms_add_str(reply, "dsp_stats", stats);
+        str = str_parms_to_str(reply);
+        str_parms_destroy(reply);
+    } else {
+        str = strdup("");
+    }
+    str_parms_destroy(query);
+    return str;
 }
 
 static int adev_init_check(const struct audio_hw_device *dev)
@@ -2696,14 +3063,26 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
 static int adev_dump(const audio_hw_device_t *device, int fd)
 {
     (void)device;
-    (void)fd;
 
+    cras_dsp_dump_info(fd);
     return 0;
 }
 
 static int adev_close(hw_device_t *device)
 {
     struct audio_device *adev = (struct audio_device *)device;
+    int i, purpose;
+
+    for (i = 0; pcm_devices[i] != NULL; i++) {
+        for (purpose = 0; purpose < DSP_PURPOSE_MAX; purpose++) {
+            if (pcm_devices[i]->dsp_contexts[purpose]) {
+                cras_dsp_context_free(pcm_devices[i]->dsp_contexts[purpose]);
+                pcm_devices[i]->dsp_contexts[purpose] = NULL;
+            }
+        }
+    }
+    cras_dsp_stop();
+
     free(adev->snd_dev_ref_cnt);
     free_mixer_list(adev);
     free(device);
@@ -2749,6 +3128,7 @@ static int adev_open(const hw_module_t *module, const char *name,
     adev->active_input = NULL;
     adev->primary_output = NULL;
     adev->voice_volume = 1.0f;
+    adev->dsp_volume = 1.0f;
     adev->tty_mode = TTY_MODE_OFF;
     adev->bluetooth_nrec = true;
     adev->in_call = false;
@@ -2806,6 +3186,13 @@ static int adev_open(const hw_module_t *module, const char *name,
 
     cras_dsp_init("/system/etc/cras/speakerdsp.ini");
 
+    /* Have the worker build the playback pipelines now, so they are ready
+     * before the first write. */
+    for (i = 0; pcm_devices[i] != NULL; i++) {
+        if (pcm_devices[i]->type == PCM_PLAYBACK && pcm_devices[i]->dsp_name)
+            get_dsp_context(pcm_devices[i], DSP_PURPOSE_PLAYBACK);
+    }
+
     ALOGV("%s: exit", __func__);
     return 0;
 }
@@ -180,6 +180,14 @@ typedef enum {
     PCM_HOTWORD_STREAMING = 0x8
 } usecase_type_t;
 
+/* The purposes a DSP pipeline can be created for, see dsp_purpose_names. */
+enum {
+    DSP_PURPOSE_PLAYBACK,
+    DSP_PURPOSE_VOICE_COMM,
+    DSP_PURPOSE_CAPTURE,
+    DSP_PURPOSE_MAX,
+};
+
 struct pcm_device_profile {
     struct pcm_config config;
     int               card;
@@ -188,6 +196,11 @@ struct pcm_device_profile {
     usecase_type_t    type;
     audio_devices_t   devices;
     const char*       dsp_name;
+    /* Open the PCM with PCM_MMAP and write to the mmap buffer directly */
+    bool              mmap;
+    /* DSP contexts, created on first use and kept across standby so the
+     * pipeline is built only once. Indexed by DSP_PURPOSE_*. */
+    struct cras_dsp_context* dsp_contexts[DSP_PURPOSE_MAX];
 };
 
 struct pcm_device {
@@ -201,6 +214,8 @@ struct pcm_device {
     size_t                     res_byte_count;
     struct cras_dsp_context*   dsp_context;
     int                        sound_trigger_handle;
+    /* PCM_MMAP only: whether pcm_start() has been called since pcm_open() */
+    bool                       mmap_started;
 };
 
 struct stream_out {
@@ -293,6 +308,8 @@ struct audio_device {
     struct stream_out*      primary_output;
     int                     in_call;
     float                   voice_volume;
+    /* volume the DSP tunings are selected for, see set_dsp_volume_l() */
+    float                   dsp_volume;
     bool                    mic_mute;
     int                     tty_mode;
     bool                    bluetooth_nrec;
@@ -4,10 +4,17 @@
  */
 
 #include <cutils/log.h>
+#include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include <unistd.h>
 #include "cras_expr.h"
 #include "cras_dsp_ini.h"
 #include "cras_dsp_pipeline.h"
+#include "dsp_kernels.h"
 #include "dsp_util.h"
 #include "utlist.h"
 
@@ -20,20 +27,65 @@
  *
  * (1) The client asks to (re-)load it with cras_load_pipeline().
  * (2) The client asks to reload the ini with cras_reload_ini().
+ * (3) A variable of a loaded context changes, see cras_dsp_set_variable().
  *
+ * The pipeline is published RCU style, so the audio thread never waits
+ * for a reload. The new pipeline is built completely and then swapped in
+ * with an atomic exchange. cras_dsp_get_pipeline() counts the reader in
+ * readers before it loads the pointer, and cras_dsp_put_pipeline() counts
+ * it out. The old pipeline is freed once the count has dropped to zero (a
+ * quiescent point), which means every reader has dropped any reference it
+ * got before the swap. Any number of threads may read at once, since the
+ * contexts are shared by the streams of a profile. A reader only holds the
+ * pipeline for one period, so the count drops to zero between periods.
+ *
+ * Pipelines are built on a worker thread, including the prepare stage of
+ * every module, so the audio thread only ever processes samples.
  */
 struct cras_dsp_context {
-	struct pipeline *pipeline;
+	_Atomic(struct pipeline *) pipeline;
+	/* The number of threads between cras_dsp_get_pipeline() and
+	 * cras_dsp_put_pipeline(). */
+	atomic_uint readers;
+	/* The delay of the pipeline, so it can be read without entering the
+	 * read side. */
+	atomic_int delay;
 
 	struct cras_expr_env env;
 	int sample_rate;
+	/* The block size of the pipelines, 0 for the default. */
+	int block_size;
+	/* The volume the tunings of the pipelines are selected for. */
+	float volume;
+	/* The rate of the samples given to the pipelines, 0 for sample_rate. */
+	int input_rate;
 	const char *purpose;
+	/* The client has loaded the pipeline, so a change of a variable
+	 * loads it again. */
+	int load_requested;
+	/* A load has been requested but the worker has not started it. */
+	int load_pending;
+	/* The worker is building a pipeline for this context. */
+	int loading;
 	struct cras_dsp_context *prev, *next;
 };
 
+/* How often to check if the readers have passed a quiescent point. */
+#define QUIESCENT_POLL_US 1000
+
 static const char *ini_filename;
 static struct ini *ini;
 static struct cras_dsp_context *context_list;
+/* Protects the ini, the context list and the variables and load state of
+ * the contexts. The worker drops it while it builds a pipeline, so it is
+ * only held briefly. */
+static pthread_mutex_t control_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Signaled when there is work for the worker, and when it finishes some. */
+static pthread_cond_t control_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t worker_thread;
+static int worker_running;
+static int worker_stop;
+static int reload_ini_pending;
 
 static void initialize_environment(struct cras_expr_env *env)
 {
@@ -43,6 +95,10 @@ static void initialize_environment(struct cras_expr_env *env)
 	cras_expr_env_set_variable_string(env, "dsp_name", "");
 }
 
+/* Builds and prepares a pipeline for the context. Called with control_lock
+ * held; the lock is dropped while the modules are instantiated, which is
+ * the expensive part. The graph is created with the lock held because it
+ * reads the variables of the context. */
 static struct pipeline *prepare_pipeline(struct cras_dsp_context *ctx)
 {
 	struct pipeline *pipeline;
@@ -57,8 +113,13 @@ static struct pipeline *prepare_pipeline(struct cras_dsp_context *ctx)
 		ALOGI("pipeline created");
 	} else {
 		ALOGI("cannot create pipeline");
-		goto bail;
+		return NULL;
 	}
+	cras_dsp_pipeline_set_block_size(pipeline, ctx->block_size);
+	cras_dsp_pipeline_set_input_rate(pipeline, ctx->input_rate);
+	cras_dsp_pipeline_set_volume(pipeline, ctx->volume);
+
+	pthread_mutex_unlock(&control_lock);
 
 	if (cras_dsp_pipeline_load(pipeline) != 0) {
 		ALOGE("cannot load pipeline");
@@ -77,35 +138,64 @@ static struct pipeline *prepare_pipeline(struct cras_dsp_context *ctx)
 		goto bail;
 	}
 
+	pthread_mutex_lock(&control_lock);
+	/* The volume may have changed while the lock was dropped. */
+	cras_dsp_pipeline_set_volume(pipeline, ctx->volume);
 	return pipeline;
 
 bail:
-	if (pipeline)
-		cras_dsp_pipeline_free(pipeline);
+	cras_dsp_pipeline_free(pipeline);
+	pthread_mutex_lock(&control_lock);
 	return NULL;
 }
 
-/* Exported functions */
-void cras_dsp_set_variable(struct cras_dsp_context *ctx, const char *key,
-			     const char *value)
+/* Waits until no reader uses any pipeline it got from the context before
+ * this call. A reader which comes later gets the new pipeline, so waiting
+ * for a moment without readers is enough. Only the caller waits; the
+ * readers do not. */
+static void wait_for_quiescent(struct cras_dsp_context *ctx)
 {
-	cras_expr_env_set_variable_string(&ctx->env, key, value);
+	while (atomic_load(&ctx->readers) != 0)
+		usleep(QUIESCENT_POLL_US);
 }
 
-void cras_dsp_load_pipeline(struct cras_dsp_context *ctx)
+/* Publishes a new pipeline (which may be NULL) in the context, and frees
+ * the old one after the audio thread is done with it. Called with
+ * control_lock held; the lock is dropped while waiting. */
+static void publish_pipeline(struct cras_dsp_context *ctx,
+			     struct pipeline *pipeline)
 {
-	struct pipeline *pipeline, *old_pipeline;
-
-	pipeline = prepare_pipeline(ctx);
-
-	old_pipeline = ctx->pipeline;
-	ctx->pipeline = pipeline;
+	struct pipeline *old_pipeline;
+
+	atomic_store(&ctx->delay,
+		     pipeline ? cras_dsp_pipeline_get_delay(pipeline) : 0);
+	old_pipeline = atomic_exchange(&ctx->pipeline, pipeline);
+	if (!old_pipeline)
+		return;
+
+	pthread_mutex_unlock(&control_lock);
+	wait_for_quiescent(ctx);
+	cras_dsp_pipeline_free(old_pipeline);
+	pthread_mutex_lock(&control_lock);
+}
 
-	if (old_pipeline)
-		cras_dsp_pipeline_free(old_pipeline);
+/* Loads the pipeline of a context. Called with control_lock held. The
+ * context is marked as loading, so cras_dsp_context_free() waits for it
+ * while the lock is dropped. */
+static void load_pipeline_locked(struct cras_dsp_context *ctx)
+{
+	ctx->load_pending = 0;
+	ctx->loading = 1;
+	publish_pipeline(ctx, prepare_pipeline(ctx));
+	ctx->loading = 0;
+	pthread_cond_broadcast(&control_cond);
 }
 
-void cras_dsp_reload_ini()
+/* Reads the ini file again and rebuilds all pipelines from it. Called with
+ * control_lock held. The pipelines refer to the plugins of the ini they
+ * were created from, so the old ini is freed after all of them are
+ * replaced. */
+static void reload_ini_locked()
 {
 	struct ini *old_ini = ini;
 	struct cras_dsp_context *ctx;
@@ -115,27 +205,174 @@ void cras_dsp_reload_ini()
 		ALOGE("cannot create dsp ini");
 
 	DL_FOREACH(context_list, ctx) {
-		cras_dsp_load_pipeline(ctx);
+		load_pipeline_locked(ctx);
 	}
 
 	if (old_ini)
 		cras_dsp_ini_free(old_ini);
 }
 
+/* Returns a context which has a load pending, or NULL. */
+static struct cras_dsp_context *find_pending_context()
+{
+	struct cras_dsp_context *ctx;
+
+	DL_FOREACH(context_list, ctx) {
+		if (ctx->load_pending)
+			return ctx;
+	}
+	return NULL;
+}
+
+/* Returns a context which the worker is loading, or NULL. */
+static struct cras_dsp_context *find_loading_context()
+{
+	struct cras_dsp_context *ctx;
+
+	DL_FOREACH(context_list, ctx) {
+		if (ctx->loading)
+			return ctx;
+	}
+	return NULL;
+}
+
+static void *dsp_worker(void *arg)
+{
+	struct cras_dsp_context *ctx;
+
+	pthread_mutex_lock(&control_lock);
+	while (!worker_stop) {
+		if (reload_ini_pending) {
+			reload_ini_pending = 0;
+			reload_ini_locked();
+			pthread_cond_broadcast(&control_cond);
+			continue;
+		}
+
+		ctx = find_pending_context();
+		if (ctx) {
+			load_pipeline_locked(ctx);
+			continue;
+		}
+
+		pthread_cond_wait(&control_cond, &control_lock);
+	}
+	pthread_mutex_unlock(&control_lock);
+	return NULL;
+}
+
+/* Loads the pipeline of a context on the worker, or now if there is no
+ * worker. Called with control_lock held. */
+static void request_load_locked(struct cras_dsp_context *ctx)
+{
+	if (worker_running) {
+		ctx->load_pending = 1;
+		pthread_cond_broadcast(&control_cond);
+	} else {
+		load_pipeline_locked(ctx);
+	}
+}
+
+/* Returns 1 if a variable of the environment is set to the string. */
+static int variable_is_string(struct cras_expr_env *env, const char *key,
+			      const char *str)
+{
+	const struct cras_expr_value *value =
+		cras_expr_env_get_variable(env, key);
+
+	return value && value->type == CRAS_EXPR_VALUE_TYPE_STRING &&
+		strcmp(value->u.string, str) == 0;
+}
+
+/* Exported functions */
+void cras_dsp_set_variable(struct cras_dsp_context *ctx, const char *key,
+			     const char *value)
+{
+	pthread_mutex_lock(&control_lock);
+	if (!variable_is_string(&ctx->env, key, value)) {
+		cras_expr_env_set_variable_string(&ctx->env, key, value);
+		/* The variables decide which plugins are disabled, and so
+		 * if the pipeline can be bypassed. */
+		if (ctx->load_requested)
+			request_load_locked(ctx);
+	}
+	pthread_mutex_unlock(&control_lock);
+}
+
+void cras_dsp_set_block_size(struct cras_dsp_context *ctx, int frames)
+{
+	pthread_mutex_lock(&control_lock);
+	ctx->block_size = frames;
+	pthread_mutex_unlock(&control_lock);
+}
+
+void cras_dsp_set_input_rate(struct cras_dsp_context *ctx, int rate)
+{
+	if (rate == ctx->sample_rate)
+		rate = 0;
+
+	pthread_mutex_lock(&control_lock);
+	if (rate != ctx->input_rate) {
+		ctx->input_rate = rate;
+		request_load_locked(ctx);
+	}
+	pthread_mutex_unlock(&control_lock);
+}
+
+void cras_dsp_load_pipeline(struct cras_dsp_context *ctx)
+{
+	pthread_mutex_lock(&control_lock);
+	ctx->load_requested = 1;
+	request_load_locked(ctx);
+	pthread_mutex_unlock(&control_lock);
+}
+
+void cras_dsp_reload_ini()
+{
+	pthread_mutex_lock(&control_lock);
+	if (worker_running) {
+		reload_ini_pending = 1;
+		pthread_cond_broadcast(&control_cond);
+	} else {
+		reload_ini_locked();
+	}
+	pthread_mutex_unlock(&control_lock);
+}
+
 void cras_dsp_init(const char *filename)
 {
 	dsp_enable_flush_denormal_to_zero();
+	dsp_kernels_select(~0U);
+	ALOGI("dsp kernels for cpu features 0x%x", dsp_get_kernels()->features);
 	ini_filename = strdup(filename);
-	cras_dsp_reload_ini();
+
+	pthread_mutex_lock(&control_lock);
+	reload_ini_locked();
+	worker_stop = 0;
+	worker_running = pthread_create(&worker_thread, NULL, dsp_worker,
+					NULL) == 0;
+	if (!worker_running)
+		ALOGE("cannot start dsp worker, loading synchronously");
+	pthread_mutex_unlock(&control_lock);
 }
 
 void cras_dsp_stop()
 {
+	pthread_mutex_lock(&control_lock);
+	if (worker_running) {
+		worker_stop = 1;
+		pthread_cond_broadcast(&control_cond);
+		pthread_mutex_unlock(&control_lock);
+		pthread_join(worker_thread, NULL);
+		pthread_mutex_lock(&control_lock);
+		worker_running = 0;
+	}
 	free((char *)ini_filename);
 	if (ini) {
 		cras_dsp_ini_free(ini);
 		ini = NULL;
 	}
+	pthread_mutex_unlock(&control_lock);
 }
 
 struct cras_dsp_context *cras_dsp_context_new(int sample_rate,
@@ -145,20 +382,24 @@ struct cras_dsp_context *cras_dsp_context_new(int sample_rate,
 
 	initialize_environment(&ctx->env);
 	ctx->sample_rate = sample_rate;
+	ctx->volume = 1.0f;
 	ctx->purpose = strdup(purpose);
 
+	pthread_mutex_lock(&control_lock);
 	DL_APPEND(context_list, ctx);
+	pthread_mutex_unlock(&control_lock);
 	return ctx;
 }
 
 void cras_dsp_context_free(struct cras_dsp_context *ctx)
 {
+	pthread_mutex_lock(&control_lock);
+	while (ctx->loading)
+		pthread_cond_wait(&control_cond, &control_lock);
 	DL_DELETE(context_list, ctx);
+	publish_pipeline(ctx, NULL);
+	pthread_mutex_unlock(&control_lock);
 
-	if (ctx->pipeline) {
-		cras_dsp_pipeline_free(ctx->pipeline);
-		ctx->pipeline = NULL;
-	}
 	cras_expr_env_free(&ctx->env);
 	free((char *)ctx->purpose);
 	free(ctx);
@@ -166,23 +407,140 @@ void cras_dsp_context_free(struct cras_dsp_context *ctx)
 
 struct pipeline *cras_dsp_get_pipeline(struct cras_dsp_context *ctx)
 {
-	return ctx->pipeline;
+	/* Enter the read side before loading the pointer. Both are
+	 * sequentially consistent, so either the reloader sees the reader
+	 * and waits, or this sees the new pipeline. */
+	atomic_fetch_add(&ctx->readers, 1);
+	return atomic_load(&ctx->pipeline);
 }
 
 void cras_dsp_put_pipeline(struct cras_dsp_context *ctx)
 {
+	atomic_fetch_sub_explicit(&ctx->readers, 1, memory_order_release);
 }
 
 unsigned int cras_dsp_num_output_channels(const struct cras_dsp_context *ctx)
 {
-	return cras_dsp_pipeline_get_num_output_channels(ctx->pipeline);
+	struct cras_dsp_context *c = (struct cras_dsp_context *)ctx;
+	struct pipeline *pipeline = cras_dsp_get_pipeline(c);
+	unsigned int channels = 0;
+
+	if (pipeline)
+		channels = cras_dsp_pipeline_get_num_output_channels(pipeline);
+	cras_dsp_put_pipeline(c);
+	return channels;
 }
 
 unsigned int cras_dsp_num_input_channels(const struct cras_dsp_context *ctx)
 {
-	return cras_dsp_pipeline_get_num_input_channels(ctx->pipeline);
+	struct cras_dsp_context *c = (struct cras_dsp_context *)ctx;
+	struct pipeline *pipeline = cras_dsp_get_pipeline(c);
+	unsigned int channels = 0;
+
+	if (pipeline)
+		channels = cras_dsp_pipeline_get_num_input_channels(pipeline);
+	cras_dsp_put_pipeline(c);
+	return channels;
+}
+
+int cras_dsp_get_delay(struct cras_dsp_context *ctx)
+{
+	return atomic_load_explicit(&ctx->delay, memory_order_relaxed);
+}
+
+void cras_dsp_set_volume(struct cras_dsp_context *ctx, float volume)
+{
+	struct pipeline *pipeline;
+
+	pthread_mutex_lock(&control_lock);
+	ctx->volume = volume;
+	pipeline = atomic_load(&ctx->pipeline);
+	if (pipeline)
+		cras_dsp_pipeline_set_volume(pipeline, volume);
+	pthread_mutex_unlock(&control_lock);
+}
+
+int cras_dsp_set_control(struct cras_dsp_context *ctx, const char *title,
+			 int port, float value)
+{
+	struct pipeline *pipeline;
+	int rc = -1;
+
+	/* The lock keeps the pipeline from being replaced and freed. */
+	pthread_mutex_lock(&control_lock);
+	pipeline = atomic_load(&ctx->pipeline);
+	if (pipeline)
+		rc = cras_dsp_pipeline_set_control(pipeline, title, port,
+						   value);
+	pthread_mutex_unlock(&control_lock);
+	return rc;
+}
+
+/* Dumps the pipeline of a context. Called with control_lock held, which
+ * keeps the pipeline from being freed: a pipeline is only freed after it
+ * has been replaced, and it is replaced with the lock held. */
+static void dump_context_locked(struct cras_dsp_context *ctx, int fd)
+{
+	struct pipeline *pipeline = atomic_load(&ctx->pipeline);
+
+	dprintf(fd, "dsp context %s, %d Hz:%s\n", ctx->purpose,
+		ctx->sample_rate, pipeline ? "" : " no pipeline");
+	if (pipeline)
+		cras_dsp_pipeline_dump(fd, pipeline);
+}
+
+void cras_dsp_context_dump(struct cras_dsp_context *ctx, int fd)
+{
+	pthread_mutex_lock(&control_lock);
+	dump_context_locked(ctx, fd);
+	pthread_mutex_unlock(&control_lock);
+}
+
+void cras_dsp_dump_info(int fd)
+{
+	struct cras_dsp_context *ctx;
+
+	pthread_mutex_lock(&control_lock);
+	dprintf(fd, "dsp ini %s\n", ini_filename ? ini_filename : "(none)");
+	DL_FOREACH(context_list, ctx) {
+		dump_context_locked(ctx, fd);
+	}
+	pthread_mutex_unlock(&control_lock);
+}
+
+int cras_dsp_format_stats(char *buf, size_t size)
+{
+	struct cras_dsp_context *ctx;
+	struct pipeline *pipeline;
+	size_t used;
+	int n, len = 0;
+
+	if (size)
+		buf[0] = '\0';
+
+	pthread_mutex_lock(&control_lock);
+	DL_FOREACH(context_list, ctx) {
+		pipeline = atomic_load(&ctx->pipeline);
+		if (!pipeline)
+			continue;
+		used = MIN((size_t)len, size);
+		if (len)
+			len += snprintf(buf + used, size - used, ",");
+		used = MIN((size_t)len, size);
+		n = cras_dsp_pipeline_format_stats(pipeline, buf + used,
+						   size - used);
+		if (n > 0)
+			len += n;
+	}
+	pthread_mutex_unlock(&control_lock);
+	return len;
 }
 
 void cras_dsp_sync()
 {
+	pthread_mutex_lock(&control_lock);
+	while (reload_ini_pending || find_pending_context() ||
+	       find_loading_context())
+		pthread_cond_wait(&control_cond, &control_lock);
+	pthread_mutex_unlock(&control_lock);
 }
@@ -40,18 +40,43 @@ struct cras_dsp_context *cras_dsp_context_new(int sample_rate,
 /* Frees a dsp context. */
 void cras_dsp_context_free(struct cras_dsp_context *ctx);
 
-/* Sets a configuration variable in the context. */
+/* Sets a configuration variable in the context. Once the pipeline has been
+ * loaded with cras_dsp_load_pipeline(), a change of the value loads it
+ * again, so the plugins the variable disables, and if the pipeline is
+ * bypassed, follow it. */
 void cras_dsp_set_variable(struct cras_dsp_context *ctx, const char *key,
 			   const char *value);
 
-/* Loads the pipeline to the context. This should be called again when
- * new values of configuration variables may change the plugin
- * graph. The actual loading happens in another thread to avoid
- * blocking the audio thread. */
+/* Sets the most frames the pipelines of the context run at a time, see
+ * cras_dsp_pipeline_set_block_size(). It applies to the pipelines loaded
+ * after this call.
+ * Args:
+ *    frames - The block size, usually the period size of the device, or 0
+ *        for the default.
+ */
+void cras_dsp_set_block_size(struct cras_dsp_context *ctx, int frames);
+
+/* Sets the sampling rate of the samples given to the pipeline of the
+ * context, see cras_dsp_pipeline_set_input_rate(). If the rate changes,
+ * the pipeline is loaded again, as the converter is built for the rate.
+ * Until then cras_dsp_pipeline_get_input_rate() tells the rate the current
+ * pipeline takes.
+ * Args:
+ *    ctx - The context whose pipeline takes the samples.
+ *    rate - The rate of the samples.
+ */
+void cras_dsp_set_input_rate(struct cras_dsp_context *ctx, int rate);
+
+/* Loads the pipeline to the context. A change of a configuration variable
+ * loads it again after this, see cras_dsp_set_variable(). The actual
+ * loading happens in another thread to avoid blocking the audio thread. */
 void cras_dsp_load_pipeline(struct cras_dsp_context *ctx);
 
 /* Locks the pipeline in the context for access. Returns NULL if the
- * pipeline is still being loaded or cannot be loaded. */
+ * pipeline is still being loaded or cannot be loaded. Any number of
+ * threads may hold the pipeline at once, and a thread may take it again
+ * while it holds it. A reload frees the old pipeline at the first moment
+ * no thread holds it, so it must only be held briefly, like for a period. */
 struct pipeline *cras_dsp_get_pipeline(struct cras_dsp_context *ctx);
 
 /* Releases the pipeline in the context. This must be called in pair
@@ -69,6 +94,53 @@ unsigned int cras_dsp_num_output_channels(const struct cras_dsp_context *ctx);
 /* Number of channels input. */
 unsigned int cras_dsp_num_input_channels(const struct cras_dsp_context *ctx);
 
+/* Returns the delay the pipeline in the context adds to the audio, in
+ * frames at the sample rate of the context, or 0 if it has no pipeline.
+ * It is kept when the pipeline is published, so any thread can call this
+ * without locking the pipeline. */
+int cras_dsp_get_delay(struct cras_dsp_context *ctx);
+
+/* Sets the volume of the stream the context processes, which selects the
+ * tuning of each plugin, see cras_dsp_pipeline_set_volume(). It is kept for
+ * the pipelines loaded later. The volume is 1 until this is called.
+ * Args:
+ *    ctx - The context whose pipeline is tuned.
+ *    volume - The volume, from 0 to 1.
+ */
+void cras_dsp_set_volume(struct cras_dsp_context *ctx, float volume);
+
+/* Changes an input control port of the pipeline in the context while it
+ * runs, see cras_dsp_pipeline_set_control(). The value is not kept when the
+ * pipeline is loaded again, which takes the values of the ini file.
+ * Args:
+ *    ctx - The context whose pipeline is changed.
+ *    title - The title of the plugin in the ini file.
+ *    port - The index of the port in the plugin.
+ *    value - The new value.
+ * Returns:
+ *    0 if success. -1 if there is no pipeline or no such port.
+ */
+int cras_dsp_set_control(struct cras_dsp_context *ctx, const char *title,
+			 int port, float value);
+
+/* Writes the run time statistics of the pipeline in the context to a file
+ * descriptor, see cras_dsp_pipeline_dump(). */
+void cras_dsp_context_dump(struct cras_dsp_context *ctx, int fd);
+
+/* Writes the ini file name and the statistics of the pipelines of all
+ * contexts to a file descriptor. */
+void cras_dsp_dump_info(int fd);
+
+/* Formats the module statistics of the pipelines of all contexts, see
+ * cras_dsp_pipeline_format_stats().
+ * Args:
+ *    buf - The buffer to write to.
+ *    size - The size of the buffer.
+ * Returns:
+ *    The length of the full string, like snprintf().
+ */
+int cras_dsp_format_stats(char *buf, size_t size);
+
 /* Wait for the previous asynchronous requests to finish. The
  * asynchronous requests include:
  *
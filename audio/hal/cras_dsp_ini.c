@@ -10,6 +10,8 @@
 #define MAX_INI_KEY_LENGTH 64  /* names like "output_source:output_0" */
 #define MAX_NR_PORT 128	/* the max number of ports for a plugin */
 #define MAX_PORT_NAME_LENGTH 20 /* names like "output_32" */
+#define MAX_NR_TUNING 16 /* the max number of tunings for a plugin */
+#define MAX_TUNING_KEY_LENGTH 32 /* names like "tuning_15_input_127" */
 
 /* Format of the ini file (See dsp.ini.sample for an example).
 
@@ -55,6 +57,24 @@
   port 4 of plugin1 --> port 0 of plugin2
   port 5 of plugin1 --> port 2 of plugin3
 
+- Each plugin can have tunings, which give other values to its input
+  control ports depending on the volume of the stream. The tunings are
+  numbered from 0. Tuning k is used from the volume "tuning_k_volume", a
+  linear value from 0 to 1, up to the volume of the next tuning, and sets
+  port n to "tuning_k_input_n". Ports a tuning does not set, and all ports
+  below the lowest tuning volume, keep their "input_n" value. For example,
+  the following fragment
+
+  [drc]
+  ...
+  input_7=-24
+  tuning_0_volume=0.5
+  tuning_0_input_7=-36
+
+  uses a threshold of -24 dB below half volume and -36 dB from there up.
+  The pipeline moves to the values of another tuning while it runs, see
+  cras_dsp_pipeline_set_volume().
+
 */
 
 static const char *getstring(struct ini *ini, const char *sec_name,
@@ -139,6 +159,75 @@ static int parse_ports(struct ini *ini, const char *sec_name,
 	return 0;
 }
 
+static int compare_tunings(const void *a, const void *b)
+{
+	const struct tuning *ta = (const struct tuning *)a;
+	const struct tuning *tb = (const struct tuning *)b;
+
+	if (ta->volume < tb->volume)
+		return -1;
+	return ta->volume > tb->volume;
+}
+
+/* Reads the tunings of a plugin into full tables of port values, so a
+ * change of volume only has to pick one. Must be called after
+ * parse_ports(). */
+static int parse_tunings(struct ini *ini, const char *sec_name,
+			 struct plugin *plugin)
+{
+	char key[MAX_TUNING_KEY_LENGTH];
+	const char *str;
+	char *endptr;
+	int i, k;
+	struct port *port;
+	struct tuning *tuning;
+
+	for (k = 0; k < MAX_NR_TUNING; k++) {
+		snprintf(key, sizeof(key), "tuning_%d_volume", k);
+		str = getstring(ini, sec_name, key);
+		if (str == NULL)
+			break; /* no more tunings */
+
+		tuning = ARRAY_APPEND_ZERO(&plugin->tunings);
+		tuning->volume = strtof(str, &endptr);
+		if (endptr == str) {
+			syslog(LOG_ERR, "cannot parse volume from '%s'", str);
+			return -1;
+		}
+		tuning->values = calloc(ARRAY_COUNT(&plugin->ports),
+					sizeof(float));
+		if (!tuning->values)
+			return -1;
+
+		FOR_ARRAY_ELEMENT(&plugin->ports, i, port) {
+			tuning->values[i] = port->init_value;
+			snprintf(key, sizeof(key), "tuning_%d_input_%d", k, i);
+			str = getstring(ini, sec_name, key);
+			if (str == NULL)
+				continue;
+			if (port->direction != PORT_INPUT ||
+			    port->type != PORT_CONTROL ||
+			    port->flow_id != INVALID_FLOW_ID) {
+				syslog(LOG_ERR, "%s:%s is not a control value",
+				       sec_name, key);
+				return -1;
+			}
+			tuning->values[i] = strtof(str, &endptr);
+			if (endptr == str) {
+				syslog(LOG_ERR, "cannot parse number from '%s'",
+				       str);
+				return -1;
+			}
+		}
+	}
+
+	if (ARRAY_COUNT(&plugin->tunings))
+		qsort(ARRAY_ELEMENT(&plugin->tunings, 0),
+		      ARRAY_COUNT(&plugin->tunings), sizeof(struct tuning),
+		      compare_tunings);
+	return 0;
+}
+
 static int parse_plugin_section(struct ini *ini, const char *sec_name,
 				struct plugin *p)
 {
@@ -160,6 +249,11 @@ static int parse_plugin_section(struct ini *ini, const char *sec_name,
 		return -1;
 	}
 
+	if (parse_tunings(ini, sec_name, p) < 0) {
+		syslog(LOG_ERR, "Failed to parse tunings: %s", sec_name);
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -239,8 +333,14 @@ void cras_dsp_ini_free(struct ini *ini)
 
 	/* free plugins */
 	FOR_ARRAY_ELEMENT(&ini->plugins, i, p) {
+		struct tuning *tuning;
+		int j;
+
 		cras_expr_expression_free(p->disable_expr);
 		ARRAY_FREE(&p->ports);
+		FOR_ARRAY_ELEMENT(&p->tunings, j, tuning)
+			free(tuning->values);
+		ARRAY_FREE(&p->tunings);
 	}
 	ARRAY_FREE(&ini->plugins);
 	ARRAY_FREE(&ini->flows);
@@ -253,6 +353,18 @@ void cras_dsp_ini_free(struct ini *ini)
 	free(ini);
 }
 
+int cras_dsp_ini_find_tuning(const struct plugin *plugin, float volume)
+{
+	int i;
+
+	/* The tunings are sorted, so the last one not above the volume is
+	 * the one to use. */
+	for (i = ARRAY_COUNT(&plugin->tunings) - 1; i >= 0; i--)
+		if (ARRAY_ELEMENT(&plugin->tunings, i)->volume <= volume)
+			break;
+	return i;
+}
+
 static const char *port_direction_str(enum port_direction port_direction)
 {
 	switch (port_direction) {
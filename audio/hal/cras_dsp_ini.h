@@ -41,6 +41,17 @@ struct port {
 
 DECLARE_ARRAY_TYPE(struct port, port_array)
 
+/* A set of port values a plugin uses from a volume up. */
+struct tuning {
+	/* The lowest volume, from 0 to 1, the tuning is used for */
+	float volume;
+	/* The value of each port of the plugin. Ports the tuning does not
+	 * set have their init_value. */
+	float *values;
+};
+
+DECLARE_ARRAY_TYPE(struct tuning, tuning_array)
+
 struct plugin {
 	const char *title;
 	const char *library;  /* file name like "plugin.so" */
@@ -49,6 +60,7 @@ struct plugin {
 	struct cras_expr_expression *disable_expr;  /* the disable expression of
 					     this plugin */
 	port_array ports;
+	tuning_array tunings;  /* sorted by volume */
 };
 
 struct flow {
@@ -74,6 +86,16 @@ struct ini *cras_dsp_ini_create(const char *ini_filename);
 /* Frees the dsp structure. */
 void cras_dsp_ini_free(struct ini *ini);
 
+/* Finds the tuning a plugin uses at a volume.
+ * Args:
+ *    plugin - The plugin to look in.
+ *    volume - The volume of the stream, from 0 to 1.
+ * Returns:
+ *    The index of the tuning with the highest volume not above volume, or
+ *    -1 if the plugin uses the values of its ports at that volume.
+ */
+int cras_dsp_ini_find_tuning(const struct plugin *plugin, float volume);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -9,6 +9,8 @@
 #include "dsp_util.h"
 #include "eq.h"
 #include "eq2.h"
+#include "eq2_fixed.h"
+#include "src.h"
 
 /*
  *  empty module functions (for source and sink)
@@ -27,6 +29,15 @@ static int empty_get_delay(struct dsp_module *module)
 	return 0;
 }
 
+static void empty_prepare(struct dsp_module *module) {}
+
+static void empty_update(struct dsp_module *module, int fade_frames) {}
+
+static size_t empty_get_arena_size(struct dsp_module *module)
+{
+	return 0;
+}
+
 static void empty_run(struct dsp_module *module, unsigned long sample_count) {}
 
 static void empty_deinstantiate(struct dsp_module *module) {}
@@ -43,10 +54,20 @@ static void empty_init_module(struct dsp_module *module)
 	module->instantiate = &empty_instantiate;
 	module->connect_port = &empty_connect_port;
 	module->get_delay = &empty_get_delay;
+	module->prepare = &empty_prepare;
+	module->update = &empty_update;
 	module->run = &empty_run;
+	module->run_q31 = &empty_run;
 	module->deinstantiate = &empty_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
+	module->get_arena_size = &empty_get_arena_size;
+}
+
+/* The arena space of modules which only keep four port pointers. */
+static size_t ports4_get_arena_size(struct dsp_module *module)
+{
+	return dsp_arena_size(4 * sizeof(float *));
 }
 
 /*
@@ -55,7 +76,7 @@ static void empty_init_module(struct dsp_module *module)
 static int invert_lr_instantiate(struct dsp_module *module,
 				 unsigned long sample_rate)
 {
-	module->data = calloc(4, sizeof(float*));
+	module->data = dsp_arena_calloc(module->arena, 4 * sizeof(float *));
 	return 0;
 }
 
@@ -79,9 +100,18 @@ static void invert_lr_run(struct dsp_module *module,
 	}
 }
 
+static void invert_lr_run_q31(struct dsp_module *module,
+			      unsigned long sample_count)
+{
+	int32_t **ports = (int32_t **)module->data;
+
+	dsp_util_invert_lr_q31(ports[0], ports[1], ports[2], ports[3],
+			       sample_count);
+}
+
 static void invert_lr_deinstantiate(struct dsp_module *module)
 {
-	free(module->data);
+	dsp_arena_release(module->arena, module->data);
 }
 
 static void invert_lr_init_module(struct dsp_module *module)
@@ -89,10 +119,14 @@ static void invert_lr_init_module(struct dsp_module *module)
 	module->instantiate = &invert_lr_instantiate;
 	module->connect_port = &invert_lr_connect_port;
 	module->get_delay = &empty_get_delay;
+	module->prepare = &empty_prepare;
+	module->update = &empty_update;
 	module->run = &invert_lr_run;
+	module->run_q31 = &invert_lr_run_q31;
 	module->deinstantiate = &invert_lr_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
+	module->get_arena_size = &ports4_get_arena_size;
 }
 
 /*
@@ -101,7 +135,7 @@ static void invert_lr_init_module(struct dsp_module *module)
 static int mix_stereo_instantiate(struct dsp_module *module,
 				  unsigned long sample_rate)
 {
-	module->data = calloc(4, sizeof(float*));
+	module->data = dsp_arena_calloc(module->arena, 4 * sizeof(float *));
 	return 0;
 }
 
@@ -127,9 +161,18 @@ static void mix_stereo_run(struct dsp_module *module,
 	}
 }
 
+static void mix_stereo_run_q31(struct dsp_module *module,
+			       unsigned long sample_count)
+{
+	int32_t **ports = (int32_t **)module->data;
+
+	dsp_util_mix_stereo_q31(ports[0], ports[1], ports[2], ports[3],
+				sample_count);
+}
+
 static void mix_stereo_deinstantiate(struct dsp_module *module)
 {
-	free(module->data);
+	dsp_arena_release(module->arena, module->data);
 }
 
 static void mix_stereo_init_module(struct dsp_module *module)
@@ -137,10 +180,14 @@ static void mix_stereo_init_module(struct dsp_module *module)
 	module->instantiate = &mix_stereo_instantiate;
 	module->connect_port = &mix_stereo_connect_port;
 	module->get_delay = &empty_get_delay;
+	module->prepare = &empty_prepare;
+	module->update = &empty_update;
 	module->run = &mix_stereo_run;
+	module->run_q31 = &mix_stereo_run_q31;
 	module->deinstantiate = &mix_stereo_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
+	module->get_arena_size = &ports4_get_arena_size;
 }
 
 /*
@@ -148,7 +195,7 @@ static void mix_stereo_init_module(struct dsp_module *module)
  */
 struct eq_data {
 	int sample_rate;
-	struct eq *eq;  /* Initialized in the first call of eq_run() */
+	struct eq *eq;  /* Initialized in eq_prepare() */
 
 	/* One port for input, one for output, and 4 parameters per eq */
 	float *ports[2 + MAX_BIQUADS_PER_EQ * 4];
@@ -158,7 +205,8 @@ static int eq_instantiate(struct dsp_module *module, unsigned long sample_rate)
 {
 	struct eq_data *data;
 
-	module->data = calloc(1, sizeof(struct eq_data));
+	module->data = dsp_arena_calloc(module->arena,
+					sizeof(struct eq_data));
 	data = (struct eq_data *) module->data;
 	data->sample_rate = (int) sample_rate;
 	return 0;
@@ -171,37 +219,89 @@ static void eq_connect_port(struct dsp_module *module,
 	data->ports[port] = data_location;
 }
 
-static void eq_run(struct dsp_module *module, unsigned long sample_count)
+static void eq_prepare(struct dsp_module *module)
 {
 	struct eq_data *data = (struct eq_data *) module->data;
-	if (!data->eq) {
-		float nyquist = data->sample_rate / 2;
-		int i;
+	float nyquist = data->sample_rate / 2;
+	int i;
 
-		data->eq = eq_new();
-		for (i = 2; i < 2 + MAX_BIQUADS_PER_EQ * 4; i += 4) {
-			if (!data->ports[i])
-				break;
-			int type = (int) *data->ports[i];
-			float freq = *data->ports[i+1];
-			float Q = *data->ports[i+2];
-			float gain = *data->ports[i+3];
-			eq_append_biquad(data->eq, type, freq / nyquist, Q,
-					 gain);
-		}
+	if (data->eq)
+		return;
+
+	/* The single channel eq is used on the voice path, use the block
+	 * engine to keep its cost low. */
+	data->eq = eq_new_in_arena(module->arena, EQ_ENGINE_BLOCK4);
+	for (i = 2; i < 2 + MAX_BIQUADS_PER_EQ * 4; i += 4) {
+		if (!data->ports[i])
+			break;
+		int type = (int) *data->ports[i];
+		float freq = *data->ports[i+1];
+		float Q = *data->ports[i+2];
+		float gain = *data->ports[i+3];
+		eq_append_biquad(data->eq, type, freq / nyquist, Q, gain);
+	}
+}
+
+static void eq_update(struct dsp_module *module, int fade_frames)
+{
+	struct eq_data *data = (struct eq_data *) module->data;
+	float nyquist = data->sample_rate / 2;
+	int i;
+
+	for (i = 2; i < 2 + MAX_BIQUADS_PER_EQ * 4; i += 4) {
+		if (!data->ports[i])
+			break;
+		int type = (int) *data->ports[i];
+		float freq = *data->ports[i+1];
+		float Q = *data->ports[i+2];
+		float gain = *data->ports[i+3];
+		eq_set_biquad(data->eq, (i - 2) / 4, type, freq / nyquist, Q,
+			      gain, fade_frames);
 	}
+}
+
+static void eq_run(struct dsp_module *module, unsigned long sample_count)
+{
+	struct eq_data *data = (struct eq_data *) module->data;
+	if (!data->eq)
+		eq_prepare(module);
 	if (data->ports[0] != data->ports[1])
 		memcpy(data->ports[1], data->ports[0],
 		       sizeof(float) * sample_count);
 	eq_process(data->eq, data->ports[1], (int) sample_count);
 }
 
+static void eq_run_q31(struct dsp_module *module, unsigned long sample_count)
+{
+	struct eq_data *data = (struct eq_data *) module->data;
+	if (!data->eq)
+		eq_prepare(module);
+	if (data->ports[0] != data->ports[1])
+		memcpy(data->ports[1], data->ports[0],
+		       sizeof(int32_t) * sample_count);
+	eq_process_q31(data->eq, (int32_t *)data->ports[1],
+		       (int) sample_count);
+}
+
 static void eq_deinstantiate(struct dsp_module *module)
 {
 	struct eq_data *data = (struct eq_data *) module->data;
 	if (data->eq)
 		eq_free(data->eq);
-	free(data);
+	dsp_arena_release(module->arena, data);
+}
+
+static int eq_get_properties(struct dsp_module *module)
+{
+	struct eq_data *data = (struct eq_data *) module->data;
+	if (data && data->eq && eq_is_identity(data->eq))
+		return MODULE_IDENTITY;
+	return 0;
+}
+
+static size_t eq_get_arena_size(struct dsp_module *module)
+{
+	return dsp_arena_size(sizeof(struct eq_data)) + eq_arena_size();
 }
 
 static void eq_init_module(struct dsp_module *module)
@@ -209,10 +309,14 @@ static void eq_init_module(struct dsp_module *module)
 	module->instantiate = &eq_instantiate;
 	module->connect_port = &eq_connect_port;
 	module->get_delay = &empty_get_delay;
+	module->prepare = &eq_prepare;
+	module->update = &eq_update;
 	module->run = &eq_run;
+	module->run_q31 = &eq_run_q31;
 	module->deinstantiate = &eq_deinstantiate;
 	module->free_module = &empty_free_module;
-	module->get_properties = &empty_get_properties;
+	module->get_properties = &eq_get_properties;
+	module->get_arena_size = &eq_get_arena_size;
 }
 
 /*
@@ -220,7 +324,11 @@ static void eq_init_module(struct dsp_module *module)
  */
 struct eq2_data {
 	int sample_rate;
-	struct eq2 *eq2;  /* Initialized in the first call of eq2_run() */
+	/* Initialized in eq2_prepare(). fixed is used if the parameters
+	 * match a generated eq2, eq2 otherwise or once they change. */
+	struct eq2 *eq2;
+	const struct eq2_fixed *fixed;
+	float fixed_state[EQ2_FIXED_STATE_SIZE];
 
 	/* Two ports for input, two for output, and 8 parameters per eq pair */
 	float *ports[4 + MAX_BIQUADS_PER_EQ2 * 8];
@@ -230,7 +338,8 @@ static int eq2_instantiate(struct dsp_module *module, unsigned long sample_rate)
 {
 	struct eq2_data *data;
 
-	module->data = calloc(1, sizeof(struct eq2_data));
+	module->data = dsp_arena_calloc(module->arena,
+					sizeof(struct eq2_data));
 	data = (struct eq2_data *) module->data;
 	data->sample_rate = (int) sample_rate;
 	return 0;
@@ -243,28 +352,103 @@ static void eq2_connect_port(struct dsp_module *module,
 	data->ports[port] = data_location;
 }
 
-static void eq2_run(struct dsp_module *module, unsigned long sample_count)
+static void eq2_prepare(struct dsp_module *module)
+{
+	struct eq2_data *data = (struct eq2_data *) module->data;
+	float nyquist = data->sample_rate / 2;
+	float params[EQ2_FIXED_MAX_PARAMS];
+	int n = 0;
+	int i, channel;
+
+	if (data->eq2)
+		return;
+
+	for (i = 4; i < 4 + MAX_BIQUADS_PER_EQ2 * 8; i += 8) {
+		if (!data->ports[i])
+			break;
+		for (channel = 0; channel < 8; channel++)
+			params[n++] = *data->ports[i + channel];
+	}
+
+	/* The generic eq2 is allocated even if a generated one is used, so
+	 * eq2_update() can switch to it on the audio thread. */
+	data->eq2 = eq2_new_in_arena(module->arena);
+	data->fixed = eq2_fixed_find(data->sample_rate, params, n);
+	if (data->fixed)
+		return;
+
+	for (i = 0; i < n; i += 8) {
+		for (channel = 0; channel < 2; channel++) {
+			float *p = &params[i + channel * 4];
+			int type = (int) p[0];
+			float freq = p[1];
+			float Q = p[2];
+			float gain = p[3];
+			eq2_append_biquad(data->eq2, channel, type,
+					  freq / nyquist, Q, gain);
+		}
+	}
+}
+
+/* Moves from the generated eq2 to the generic one, with the same biquads
+ * and state. The generated code leaves out the identity biquads, so signal k
+ * of its state is the output of the k-th biquad which is not an identity,
+ * and signal 0 is the input. */
+static void eq2_leave_fixed(struct eq2_data *data)
+{
+	const float *params = data->fixed->params;
+	const float *s = data->fixed_state;
+	float nyquist = data->sample_rate / 2;
+	int i, k, channel;
+
+	for (channel = 0; channel < 2; channel++) {
+		k = 0;
+		for (i = 0; i < data->fixed->num_params; i += 8) {
+			const float *p = &params[i + channel * 4];
+			struct biquad bq;
+
+			biquad_set(&bq, (int) p[0], p[1] / nyquist, p[2], p[3]);
+			bq.x1 = s[4 * k + channel];
+			bq.x2 = s[4 * k + 2 + channel];
+			if (!biquad_is_identity(&bq))
+				k++;
+			bq.y1 = s[4 * k + channel];
+			bq.y2 = s[4 * k + 2 + channel];
+			eq2_append_biquad_direct(data->eq2, channel, &bq);
+		}
+	}
+	data->fixed = NULL;
+}
+
+static void eq2_update(struct dsp_module *module, int fade_frames)
 {
 	struct eq2_data *data = (struct eq2_data *) module->data;
-	if (!data->eq2) {
-		float nyquist = data->sample_rate / 2;
-		int i, channel;
-
-		data->eq2 = eq2_new();
-		for (i = 4; i < 4 + MAX_BIQUADS_PER_EQ2 * 8; i += 8) {
-			if (!data->ports[i])
-				break;
-			for (channel = 0; channel < 2; channel++) {
-				int k = i + channel * 4;
-				int type = (int) *data->ports[k];
-				float freq = *data->ports[k+1];
-				float Q = *data->ports[k+2];
-				float gain = *data->ports[k+3];
-				eq2_append_biquad(data->eq2, channel, type,
-						  freq / nyquist, Q, gain);
-			}
+	float nyquist = data->sample_rate / 2;
+	int i, channel;
+
+	if (data->fixed)
+		eq2_leave_fixed(data);
+
+	for (i = 4; i < 4 + MAX_BIQUADS_PER_EQ2 * 8; i += 8) {
+		if (!data->ports[i])
+			break;
+		for (channel = 0; channel < 2; channel++) {
+			float **p = &data->ports[i + channel * 4];
+			int type = (int) *p[0];
+			float freq = *p[1];
+			float Q = *p[2];
+			float gain = *p[3];
+			eq2_set_biquad(data->eq2, (i - 4) / 8, channel, type,
+				       freq / nyquist, Q, gain, fade_frames);
 		}
 	}
+}
+
+static void eq2_run(struct dsp_module *module, unsigned long sample_count)
+{
+	struct eq2_data *data = (struct eq2_data *) module->data;
+	if (!data->eq2)
+		eq2_prepare(module);
 
 
 	if (data->ports[0] != data->ports[2])
@@ -274,8 +458,12 @@ static void eq2_run(struct dsp_module *module, unsigned long sample_count)
 		memcpy(data->ports[3], data->ports[1],
 		       sizeof(float) * sample_count);
 
-	eq2_process(data->eq2, data->ports[2], data->ports[3],
-		    (int) sample_count);
+	if (data->fixed)
+		data->fixed->process(data->fixed_state, data->ports[2],
+				     data->ports[3], (int) sample_count);
+	else
+		eq2_process(data->eq2, data->ports[2], data->ports[3],
+			    (int) sample_count);
 }
 
 static void eq2_deinstantiate(struct dsp_module *module)
@@ -283,7 +471,20 @@ static void eq2_deinstantiate(struct dsp_module *module)
 	struct eq2_data *data = (struct eq2_data *) module->data;
 	if (data->eq2)
 		eq2_free(data->eq2);
-	free(data);
+	dsp_arena_release(module->arena, data);
+}
+
+static int eq2_get_properties(struct dsp_module *module)
+{
+	struct eq2_data *data = (struct eq2_data *) module->data;
+	if (data && data->eq2 && !data->fixed && eq2_is_identity(data->eq2))
+		return MODULE_IDENTITY;
+	return 0;
+}
+
+static size_t eq2_get_arena_size(struct dsp_module *module)
+{
+	return dsp_arena_size(sizeof(struct eq2_data)) + eq2_arena_size();
 }
 
 static void eq2_init_module(struct dsp_module *module)
@@ -291,10 +492,13 @@ static void eq2_init_module(struct dsp_module *module)
 	module->instantiate = &eq2_instantiate;
 	module->connect_port = &eq2_connect_port;
 	module->get_delay = &empty_get_delay;
+	module->prepare = &eq2_prepare;
+	module->update = &eq2_update;
 	module->run = &eq2_run;
 	module->deinstantiate = &eq2_deinstantiate;
 	module->free_module = &empty_free_module;
-	module->get_properties = &empty_get_properties;
+	module->get_properties = &eq2_get_properties;
+	module->get_arena_size = &eq2_get_arena_size;
 }
 
 /*
@@ -302,18 +506,25 @@ static void eq2_init_module(struct dsp_module *module)
  */
 struct drc_data {
 	int sample_rate;
-	struct drc *drc;  /* Initialized in the first call of drc_run() */
+	struct drc *drc;  /* Initialized in drc_prepare() */
 
 	/* Two ports for input, two for output, one for disable_emphasis,
-	 * and 8 parameters each band */
-	float *ports[4 + 1 + 8 * 3];
+	 * 8 parameters each band, and the optional detector, rms_window and
+	 * pre_delay of all bands */
+	float *ports[4 + 1 + 8 * 3 + 3];
 };
 
+/* The ports after the band parameters. They can be left out of the ini. */
+#define DRC_PORT_DETECTOR (4 + 1 + 8 * 3)
+#define DRC_PORT_RMS_WINDOW (DRC_PORT_DETECTOR + 1)
+#define DRC_PORT_PRE_DELAY (DRC_PORT_DETECTOR + 2)
+
 static int drc_instantiate(struct dsp_module *module, unsigned long sample_rate)
 {
 	struct drc_data *data;
 
-	module->data = calloc(1, sizeof(struct drc_data));
+	module->data = dsp_arena_calloc(module->arena,
+					sizeof(struct drc_data));
 	data = (struct drc_data *) module->data;
 	data->sample_rate = (int) sample_rate;
 	return 0;
@@ -329,41 +540,88 @@ static void drc_connect_port(struct dsp_module *module,
 static int drc_get_delay(struct dsp_module *module)
 {
 	struct drc_data *data = (struct drc_data *) module->data;
+
+	/* The kernels round the lookahead down, so ask them once they are
+	 * set up. */
+	if (data->drc)
+		return drc_get_delay_frames(data->drc);
+	if (data->ports[DRC_PORT_PRE_DELAY])
+		return *data->ports[DRC_PORT_PRE_DELAY] * data->sample_rate;
 	return DRC_DEFAULT_PRE_DELAY * data->sample_rate;
 }
 
-static void drc_run(struct dsp_module *module, unsigned long sample_count)
+/* Sets the band parameters of the DRC from the control ports. */
+static void drc_set_params_from_ports(struct drc_data *data)
+{
+	struct drc *drc = data->drc;
+	float nyquist = data->sample_rate / 2;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		int k = 5 + i * 8;
+		float f = *data->ports[k];
+		float enable = *data->ports[k+1];
+		float threshold = *data->ports[k+2];
+		float knee = *data->ports[k+3];
+		float ratio = *data->ports[k+4];
+		float attack = *data->ports[k+5];
+		float release = *data->ports[k+6];
+		float boost = *data->ports[k+7];
+		drc_set_param(drc, i, PARAM_CROSSOVER_LOWER_FREQ, f / nyquist);
+		drc_set_param(drc, i, PARAM_ENABLED, enable);
+		drc_set_param(drc, i, PARAM_THRESHOLD, threshold);
+		drc_set_param(drc, i, PARAM_KNEE, knee);
+		drc_set_param(drc, i, PARAM_RATIO, ratio);
+		drc_set_param(drc, i, PARAM_ATTACK, attack);
+		drc_set_param(drc, i, PARAM_RELEASE, release);
+		drc_set_param(drc, i, PARAM_POST_GAIN, boost);
+		if (data->ports[DRC_PORT_DETECTOR])
+			drc_set_param(drc, i, PARAM_DETECTOR,
+				      *data->ports[DRC_PORT_DETECTOR]);
+		if (data->ports[DRC_PORT_RMS_WINDOW])
+			drc_set_param(drc, i, PARAM_RMS_WINDOW,
+				      *data->ports[DRC_PORT_RMS_WINDOW]);
+	}
+}
+
+static void drc_prepare(struct dsp_module *module)
 {
 	struct drc_data *data = (struct drc_data *) module->data;
-	if (!data->drc) {
+
+	if (data->drc)
+		return;
+
+	data->drc = drc_new_in_arena(module->arena, data->sample_rate);
+	data->drc->emphasis_disabled = (int) *data->ports[4];
+	drc_set_params_from_ports(data);
+	/* The bands are summed, so they must have the same lookahead. A
+	 * shorter one lowers the latency, and suits the RMS detector, which
+	 * reacts slower than the peak detectors anyway. */
+	if (data->ports[DRC_PORT_PRE_DELAY]) {
 		int i;
-		float nyquist = data->sample_rate / 2;
-		struct drc *drc = drc_new(data->sample_rate);
-
-		data->drc = drc;
-		drc->emphasis_disabled = (int) *data->ports[4];
-		for (i = 0; i < 3; i++) {
-			int k = 5 + i * 8;
-			float f = *data->ports[k];
-			float enable = *data->ports[k+1];
-			float threshold = *data->ports[k+2];
-			float knee = *data->ports[k+3];
-			float ratio = *data->ports[k+4];
-			float attack = *data->ports[k+5];
-			float release = *data->ports[k+6];
-			float boost = *data->ports[k+7];
-			drc_set_param(drc, i, PARAM_CROSSOVER_LOWER_FREQ,
-				      f / nyquist);
-			drc_set_param(drc, i, PARAM_ENABLED, enable);
-			drc_set_param(drc, i, PARAM_THRESHOLD, threshold);
-			drc_set_param(drc, i, PARAM_KNEE, knee);
-			drc_set_param(drc, i, PARAM_RATIO, ratio);
-			drc_set_param(drc, i, PARAM_ATTACK, attack);
-			drc_set_param(drc, i, PARAM_RELEASE, release);
-			drc_set_param(drc, i, PARAM_POST_GAIN, boost);
-		}
-		drc_init(drc);
+		for (i = 0; i < DRC_NUM_KERNELS; i++)
+			drc_set_param(data->drc, i, PARAM_PRE_DELAY,
+				      *data->ports[DRC_PORT_PRE_DELAY]);
 	}
+	drc_init(data->drc);
+}
+
+/* Only the band parameters and the detector change while running;
+ * switching the emphasis filters would click, and a new pre_delay would
+ * change the delay of the pipeline. */
+static void drc_update(struct dsp_module *module, int fade_frames)
+{
+	struct drc_data *data = (struct drc_data *) module->data;
+
+	drc_set_params_from_ports(data);
+	drc_update_params(data->drc, fade_frames);
+}
+
+static void drc_run(struct dsp_module *module, unsigned long sample_count)
+{
+	struct drc_data *data = (struct drc_data *) module->data;
+	if (!data->drc)
+		drc_prepare(module);
 	if (data->ports[0] != data->ports[2])
 		memcpy(data->ports[2], data->ports[0],
 		       sizeof(float) * sample_count);
@@ -379,7 +637,12 @@ static void drc_deinstantiate(struct dsp_module *module)
 	struct drc_data *data = (struct drc_data *) module->data;
 	if (data->drc)
 		drc_free(data->drc);
-	free(data);
+	dsp_arena_release(module->arena, data);
+}
+
+static size_t drc_get_arena_size(struct dsp_module *module)
+{
+	return dsp_arena_size(sizeof(struct drc_data)) + drc_arena_size();
 }
 
 static void drc_init_module(struct dsp_module *module)
@@ -387,10 +650,148 @@ static void drc_init_module(struct dsp_module *module)
 	module->instantiate = &drc_instantiate;
 	module->connect_port = &drc_connect_port;
 	module->get_delay = &drc_get_delay;
+	module->prepare = &drc_prepare;
+	module->update = &drc_update;
 	module->run = &drc_run;
 	module->deinstantiate = &drc_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
+	module->get_arena_size = &drc_get_arena_size;
+}
+
+/*
+ *  src module functions
+ */
+struct src_data {
+	int sample_rate;
+	int input_rate;
+	struct src *src;  /* NULL if the rates are the same */
+
+	/* Two ports for input, two for output, and the optional quality */
+	float *ports[4 + 1];
+};
+
+static int src_mod_instantiate(struct dsp_module *module,
+			   unsigned long sample_rate)
+{
+	struct src_data *data;
+
+	module->data = dsp_arena_calloc(module->arena,
+					sizeof(struct src_data));
+	data = (struct src_data *) module->data;
+	data->sample_rate = (int) sample_rate;
+	data->input_rate = (int) sample_rate;
+	return 0;
+}
+
+static void src_mod_connect_port(struct dsp_module *module,
+			     unsigned long port, float *data_location)
+{
+	struct src_data *data = (struct src_data *) module->data;
+	data->ports[port] = data_location;
+}
+
+static int src_mod_get_quality(struct src_data *data)
+{
+	if (!data->ports[4])
+		return SRC_QUALITY_MEDIUM;
+	return (int) *data->ports[4];
+}
+
+static int src_mod_set_input_rate(struct dsp_module *module,
+			      unsigned long input_rate)
+{
+	struct src_data *data = (struct src_data *) module->data;
+
+	if ((int) input_rate != data->sample_rate &&
+	    !src_arena_size(input_rate, data->sample_rate,
+			    src_mod_get_quality(data)))
+		return -1;
+	data->input_rate = (int) input_rate;
+	return 0;
+}
+
+static int src_mod_get_delay(struct dsp_module *module)
+{
+	struct src_data *data = (struct src_data *) module->data;
+	return data->src ? src_get_delay(data->src) : 0;
+}
+
+static void src_mod_prepare(struct dsp_module *module)
+{
+	struct src_data *data = (struct src_data *) module->data;
+
+	if (data->src || data->input_rate == data->sample_rate)
+		return;
+	data->src = src_new_in_arena(module->arena, data->input_rate,
+				     data->sample_rate,
+				     src_mod_get_quality(data));
+}
+
+static int src_mod_get_output_frames(struct dsp_module *module,
+				     int sample_count)
+{
+	struct src_data *data = (struct src_data *) module->data;
+	return data->src ? src_get_output_frames(data->src, sample_count) :
+		sample_count;
+}
+
+static void src_mod_run(struct dsp_module *module,
+			unsigned long sample_count)
+{
+	struct src_data *data = (struct src_data *) module->data;
+
+	if (data->src) {
+		src_process(data->src, data->ports[0], data->ports[1],
+			    (int) sample_count, data->ports[2],
+			    data->ports[3]);
+		return;
+	}
+	memcpy(data->ports[2], data->ports[0], sizeof(float) * sample_count);
+	memcpy(data->ports[3], data->ports[1], sizeof(float) * sample_count);
+}
+
+static void src_mod_deinstantiate(struct dsp_module *module)
+{
+	struct src_data *data = (struct src_data *) module->data;
+	if (data->src)
+		src_free(data->src);
+	dsp_arena_release(module->arena, data);
+}
+
+/* The output of a converter runs ahead of its input, so it cannot be
+ * written in place. */
+static int src_mod_get_properties(struct dsp_module *module)
+{
+	struct src_data *data = (struct src_data *) module->data;
+	if (data && !data->src && data->input_rate == data->sample_rate)
+		return MODULE_INPLACE_BROKEN | MODULE_IDENTITY;
+	return MODULE_INPLACE_BROKEN;
+}
+
+/* The converter depends on the rates, which are only known once the
+ * pipeline is instantiated. Make room for the common one from 44.1 kHz to
+ * 48 kHz; a larger one comes from the heap. */
+static size_t src_mod_get_arena_size(struct dsp_module *module)
+{
+	return dsp_arena_size(sizeof(struct src_data)) +
+		src_arena_size(44100, 48000, SRC_QUALITY_MEDIUM);
+}
+
+static void src_mod_init_module(struct dsp_module *module)
+{
+	module->instantiate = &src_mod_instantiate;
+	module->connect_port = &src_mod_connect_port;
+	module->get_delay = &src_mod_get_delay;
+	module->prepare = &src_mod_prepare;
+	module->update = &empty_update;
+	module->run = &src_mod_run;
+	module->deinstantiate = &src_mod_deinstantiate;
+	module->free_module = &empty_free_module;
+	module->get_properties = &src_mod_get_properties;
+	module->get_arena_size = &src_mod_get_arena_size;
+	module->set_input_rate = &src_mod_set_input_rate;
+	module->get_output_frames = &src_mod_get_output_frames;
 }
 
 /*
@@ -414,6 +815,8 @@ struct dsp_module *cras_dsp_module_load_builtin(struct plugin *plugin)
 		eq2_init_module(module);
 	} else if (strcmp(plugin->label, "drc") == 0) {
 		drc_init_module(module);
+	} else if (strcmp(plugin->label, "src") == 0) {
+		src_mod_init_module(module);
 	} else {
 		empty_init_module(module);
 	}
@@ -11,12 +11,19 @@ extern "C" {
 #endif
 
 #include "cras_dsp_ini.h"
+#include "dsp_arena.h"
 
 /* Holds the functions we can use on a dsp module. */
 struct dsp_module {
 	/* Opaque data used by the implementation of this module */
 	void *data;
 
+	/* The arena of the pipeline. The module allocates its data and
+	 * state from it with dsp_arena_calloc(), and releases them with
+	 * dsp_arena_release(). It is NULL if the module is used outside a
+	 * pipeline, in which case the memory comes from the heap. */
+	struct dsp_arena *arena;
+
 	/* Initializes the module for a given sampling rate. To change
 	 * the sampling rate, deinstantiate() must be called before
 	 * calling instantiate again.
@@ -44,6 +51,24 @@ struct dsp_module {
 	 */
 	int (*get_delay)(struct dsp_module *mod);
 
+	/* Builds the processing state of the module (filters, coefficients,
+	 * buffers) from the values of its control ports. This is called
+	 * once after instantiate() and after all ports have been connected,
+	 * on the thread that loads the pipeline, so that run() only has to
+	 * process samples.
+	 */
+	void (*prepare)(struct dsp_module *mod);
+
+	/* Tells the module the values of its input control ports have
+	 * changed. It is called on the audio thread between two run() calls,
+	 * so it must not allocate or block. The module moves to the new
+	 * values over fade_frames frames and keeps its filter state, so
+	 * there is no click.
+	 * Args:
+	 *    fade_frames - The number of frames the change takes.
+	 */
+	void (*update)(struct dsp_module *mod, int fade_frames);
+
 	/* Processes a block of samples using this module. The memory
 	 * location for the input and output data are assigned by the
 	 * connect_port() call.
@@ -52,6 +77,15 @@ struct dsp_module {
 	 */
 	void (*run)(struct dsp_module *mod, unsigned long sample_count);
 
+	/* Same as run(), but the audio ports hold Q31 fixed point samples,
+	 * int32_t where INT32_MIN is -1.0, in place of the floats. It is
+	 * NULL if the module only processes float samples. A pipeline runs
+	 * all its modules with either run() or run_q31().
+	 * Args:
+	 *    sample_count - The number of samples to be processed.
+	 */
+	void (*run_q31)(struct dsp_module *mod, unsigned long sample_count);
+
 	/* Free resources used by the module. This module can be used
 	 * again by calling instantiate() */
 	void (*deinstantiate)(struct dsp_module *mod);
@@ -63,12 +97,45 @@ struct dsp_module {
 	void (*free_module)(struct dsp_module *mod);
 
 	/* Returns special properties of this module, see the enum
-	 * below for details */
+	 * below for details. It is called when the pipeline is loaded, and
+	 * again after prepare(), when the properties can also depend on the
+	 * values of the control ports. */
 	int (*get_properties)(struct dsp_module *mod);
+
+	/* Returns the number of bytes of arena space instantiate() and
+	 * prepare() take, as a sum of dsp_arena_size() of each allocation.
+	 * It is used to size the arena before the pipeline is instantiated.
+	 * An allocation which does not fit falls back to the heap, so the
+	 * value does not have to be exact.
+	 */
+	size_t (*get_arena_size)(struct dsp_module *mod);
+
+	/* These two are only set by a module which converts the sampling
+	 * rate, and are NULL for the others. Such a module reads the source
+	 * of the pipeline at the input rate, and its outputs are at the rate
+	 * given to instantiate(), like the rest of the pipeline. The
+	 * sample_count of its run() counts the input frames. */
+
+	/* Sets the rate of the input. It is called after the ports have
+	 * been connected and before prepare().
+	 * Args:
+	 *    input_rate - The sampling rate of the input.
+	 * Returns:
+	 *    0 if successful. -1 if the module cannot convert from this rate.
+	 */
+	int (*set_input_rate)(struct dsp_module *mod, unsigned long input_rate);
+
+	/* Returns the number of frames the next run() outputs when it is
+	 * given sample_count input frames. */
+	int (*get_output_frames)(struct dsp_module *mod, int sample_count);
 };
 
 enum {
-	MODULE_INPLACE_BROKEN = 1  /* See ladspa.h for explanation */
+	MODULE_INPLACE_BROKEN = 1, /* See ladspa.h for explanation */
+	/* run() copies each audio input to the audio output of the same
+	 * position and changes nothing, so the pipeline can skip it. Only
+	 * reported after prepare(). */
+	MODULE_IDENTITY = 2
 };
 
 struct dsp_module *cras_dsp_module_load_builtin(struct plugin *plugin);
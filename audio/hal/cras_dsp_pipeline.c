@@ -4,12 +4,18 @@
  */
 
 #include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
 #include <sys/param.h>
 #include <syslog.h>
+#include <time.h>
+#include <unistd.h>
 
 //#include "cras_util.h"
 #include "cras_dsp_module.h"
 #include "cras_dsp_pipeline.h"
+#include "cras_dsp_pool.h"
 #include "dsp_util.h"
 
 /* We have a static representation of the dsp graph in a "struct ini",
@@ -57,11 +63,38 @@ struct control_port {
 	struct plugin *plugin;  /* the plugin corresponds to the instance */
 	int original_index;  /* the port index in the plugin */
 	float value;  /* the value of the control port */
+	/* The value set with cras_dsp_pipeline_set_control(), which the
+	 * audio thread moves to value before the next block. */
+	_Atomic(float) pending;
 };
 
 DECLARE_ARRAY_TYPE(struct audio_port, audio_port_array);
 DECLARE_ARRAY_TYPE(struct control_port, control_port_array);
 
+/* The run time histogram of an instance has four buckets per power of two
+ * nanoseconds, so a percentile read from it is within 25% of the actual
+ * value. Times up to 2^33 ns have their own bucket. */
+#define STATS_BUCKETS 128
+
+/* How long a change of a control value takes, in milliseconds. It is long
+ * enough for an eq or a compressor to change without a click. */
+#define CONTROL_FADE_MS 50
+
+/* The run time statistics of an instance. The times are the thread CPU
+ * time of run(), in nanoseconds. They are updated by the audio thread and
+ * read without synchronization by the dump, which may see a block counted
+ * in one field but not yet in another. */
+struct instance_stats {
+	int64_t blocks;
+	int64_t total_time;
+	int64_t max_time;
+	/* The time of the last block. */
+	int64_t last_time;
+	/* The longest last block seen when an xrun was reported. */
+	int64_t xrun_time;
+	uint32_t histogram[STATS_BUCKETS];
+};
+
 /* An instance is a dynamic representation of a plugin. We only create
  * an instance when a plugin is needed (data actually flows through it
  * and it is not disabled). An instance also contains a pointer to a
@@ -92,6 +125,22 @@ struct instance {
 	/* This is the total buffering delay from source to this instance. It is
 	 * in number of frames. */
 	int total_delay;
+
+	/* How long run() takes */
+	struct instance_stats stats;
+
+	/* Set when a value of an input control port is pending */
+	atomic_int controls_changed;
+
+	/* The index of the tuning of the plugin in use, or -1 if the ports
+	 * have the values of the plugin. */
+	int tuning;
+
+	/* The number of instances this instance takes input from, and the
+	 * indices of the instances which take input from this instance. */
+	int num_upstream;
+	int *downstream;
+	int num_downstream;
 };
 
 DECLARE_ARRAY_TYPE(struct instance, instance_array)
@@ -116,20 +165,49 @@ struct pipeline {
 	/* The audio data buffers */
 	float **buffers;
 
+	/* The most frames the modules run at a time, and the size of each
+	 * audio buffer. */
+	int block_size;
+
+	/* The memory of the audio data buffers and the state of the
+	 * modules. It is sized when the pipeline is loaded, so a pipeline
+	 * takes one allocation and is freed at once. */
+	struct dsp_arena *arena;
+
+	/* The arena position after the audio buffers, where the module state
+	 * starts. */
+	size_t arena_mark;
+
 	/* The instance where the audio data flow in */
 	struct instance *source_instance;
 
 	/* The instance where the audio data flow out */
 	struct instance *sink_instance;
 
+	/* The instance which converts the sampling rate of the source to the
+	 * rate of the rest of the pipeline, or NULL if there is none. */
+	struct instance *src_instance;
+
 	/* The number of audio channels for this pipeline */
 	int input_channels;
 	int output_channels;
 
+	/* Set when the modules run on Q31 fixed point samples with
+	 * run_q31(), which is tried for the purposes in q31_purposes. */
+	int q31;
+
 	/* The audio sampling rate for this pipleine. It is zero if
 	 * cras_dsp_pipeline_instantiate() has not been called. */
 	int sample_rate;
 
+	/* The rate of the source from cras_dsp_pipeline_set_input_rate(), or
+	 * 0 for sample_rate. */
+	int input_rate;
+
+	/* The rate the source runs at once instantiated. It is sample_rate
+	 * unless src_instance converts from input_rate. */
+	int source_rate;
+
 	/* The total time it takes to run the pipeline, in nanoseconds. */
 	int64_t total_time;
 
@@ -142,6 +220,48 @@ struct pipeline {
 
 	/* The total number of sample frames the pipeline processed */
 	int64_t total_samples;
+
+	/* The number of xruns reported with cras_dsp_pipeline_note_xrun() */
+	int64_t xruns;
+
+	/* Set when the instantiated pipeline passes every source channel to
+	 * the sink channel of the same index unchanged, for example when the
+	 * disable expressions leave only the source and the sink. The
+	 * samples are then copied without running the modules. */
+	int bypass;
+
+	/* Set when an instance has a pending control value */
+	atomic_int controls_changed;
+
+	/* ancestors[i * n + j] is 1 if instance i uses the output of
+	 * instance j, directly or through other instances, for n instances. */
+	char *ancestors;
+
+	/* The most instances which do not depend on each other, as found
+	 * by grouping them by the longest path from the source. */
+	int width;
+
+	/* Whether independent instances run in parallel. The buffers are
+	 * assigned so that instances which may run at the same time never
+	 * share one. */
+	int parallel;
+
+	/* The worker pool which runs the instances if parallel is set. If it
+	 * cannot be created, the instances run one by one. */
+	struct cras_dsp_pool *pool;
+
+	/* The state of the block the pool runs: the number of upstream
+	 * instances each instance still waits for, the queue of instances
+	 * which are ready to run, and the number of instances done. */
+	atomic_int *pending;
+	atomic_int *ready;
+	atomic_int ready_head;
+	atomic_int ready_tail;
+	atomic_int done;
+	int block_samples;
+	/* The input frames of the block, which src_instance converts to
+	 * block_samples frames. */
+	int block_in_samples;
 };
 
 static struct instance *find_instance_by_plugin(instance_array *instances,
@@ -311,6 +431,7 @@ static int topological_sort(struct pipeline *pipeline,
 
 	instance = ARRAY_APPEND_ZERO(&pipeline->instances);
 	instance->plugin = plugin;
+	instance->tuning = -1;
 
 	/* constructs audio and control ports for the instance */
 	FOR_ARRAY_ELEMENT(&plugin->ports, i, port) {
@@ -354,6 +475,7 @@ static int topological_sort(struct pipeline *pipeline,
 			control_port->plugin = plugin;
 			control_port->original_index = i;
 			control_port->value = port->init_value;
+			atomic_init(&control_port->pending, port->init_value);
 			if (need_connect) {
 				struct control_port *from;
 				from = find_output_control_port(
@@ -398,12 +520,19 @@ static struct plugin *find_enabled_builtin_plugin(struct ini *ini,
 	return found;
 }
 
+/* The purposes whose pipelines run on Q31 samples if all their modules can.
+ * Capture reads 16-bit samples from the microphones for as long as a call
+ * lasts, and the integer path spares converting each of them to float and
+ * back. */
+static const char *const q31_purposes[] = { "capture" };
+
 struct pipeline *cras_dsp_pipeline_create(struct ini *ini,
 					  struct cras_expr_env *env,
 					  const char *purpose)
 {
 	struct pipeline *pipeline;
 	int n;
+	size_t i;
 	char *visited;
 	int rc;
 	struct plugin *source = find_enabled_builtin_plugin(
@@ -426,6 +555,11 @@ struct pipeline *cras_dsp_pipeline_create(struct ini *ini,
 
 	pipeline->ini = ini;
 	pipeline->purpose = purpose;
+	pipeline->block_size = DSP_BUFFER_SIZE;
+	for (i = 0; i < sizeof(q31_purposes) / sizeof(q31_purposes[0]); i++)
+		if (strcmp(purpose, q31_purposes[i]) == 0)
+			pipeline->q31 = 1;
+
 	/* create instances for needed plugins, in the order of dependency */
 	n = ARRAY_COUNT(&ini->plugins);
 	visited = calloc(1, n);
@@ -474,26 +608,187 @@ static int load_module(struct plugin *plugin, struct instance *instance)
 	return 0;
 }
 
-static void use_buffers(char *busy, audio_port_array *audio_ports)
+/* Finds the instance which converts the sampling rate, if any. It must
+ * take all its input from the source, and be the only instance which reads
+ * the source, as it is the only one which runs at the rate of the source.
+ * Returns -1 if the graph does not allow that. */
+static int find_src_instance(struct pipeline *pipeline)
+{
+	int i, j;
+	struct instance *instance;
+	struct audio_port *audio_port;
+
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		if (!instance->module->set_input_rate)
+			continue;
+		if (pipeline->src_instance) {
+			syslog(LOG_ERR, "two rate converters: %s and %s",
+			       pipeline->src_instance->plugin->title,
+			       instance->plugin->title);
+			return -1;
+		}
+		pipeline->src_instance = instance;
+	}
+	if (!pipeline->src_instance)
+		return 0;
+
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		FOR_ARRAY_ELEMENT(&instance->input_audio_ports, j,
+				  audio_port) {
+			int from_source = audio_port->peer->plugin ==
+				pipeline->source_instance->plugin;
+			if (from_source == (instance == pipeline->src_instance))
+				continue;
+			syslog(LOG_ERR, "%s must be the only reader of %s",
+			       pipeline->src_instance->plugin->title,
+			       pipeline->source_instance->plugin->title);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Marks the instance of a plugin as a direct upstream instance. */
+static void mark_upstream(struct pipeline *pipeline, struct plugin *plugin,
+			  char *direct)
+{
+	struct instance *upstream;
+
+	upstream = find_instance_by_plugin(&pipeline->instances, plugin);
+	if (upstream)
+		direct[ARRAY_INDEX(&pipeline->instances, upstream)] = 1;
+}
+
+/* Finds the upstream and downstream instances and the ancestors of each
+ * instance, and how many instances can run at the same time. The instances
+ * are sorted, so the upstream instances of an instance come before it. */
+static int build_graph(struct pipeline *pipeline)
+{
+	int n = ARRAY_COUNT(&pipeline->instances);
+	int i, j, k, rc = -1;
+	struct instance *instance;
+	char *direct = calloc(n, 1);
+	int *level = calloc(n, sizeof(*level));
+	int *level_count = calloc(n, sizeof(*level_count));
+
+	pipeline->ancestors = calloc(n, n);
+	if (!direct || !level || !level_count || !pipeline->ancestors)
+		goto exit;
+
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		char *ancestors = &pipeline->ancestors[i * n];
+		struct audio_port *audio_port;
+		struct control_port *control_port;
+
+		memset(direct, 0, n);
+		FOR_ARRAY_ELEMENT(&instance->input_audio_ports, j, audio_port) {
+			mark_upstream(pipeline, audio_port->peer->plugin,
+				      direct);
+		}
+		FOR_ARRAY_ELEMENT(&instance->input_control_ports, j,
+				  control_port) {
+			if (control_port->peer)
+				mark_upstream(pipeline,
+					      control_port->peer->plugin,
+					      direct);
+		}
+
+		for (j = 0; j < i; j++) {
+			struct instance *upstream;
+			int *downstream;
+
+			if (!direct[j])
+				continue;
+			upstream = ARRAY_ELEMENT(&pipeline->instances, j);
+			downstream = realloc(upstream->downstream,
+					     (upstream->num_downstream + 1) *
+					     sizeof(*downstream));
+			if (!downstream)
+				goto exit;
+			downstream[upstream->num_downstream++] = i;
+			upstream->downstream = downstream;
+			instance->num_upstream++;
+
+			ancestors[j] = 1;
+			for (k = 0; k < j; k++)
+				ancestors[k] |= pipeline->ancestors[j * n + k];
+			level[i] = MAX(level[i], level[j] + 1);
+		}
+
+		level_count[level[i]]++;
+		pipeline->width = MAX(pipeline->width, level_count[level[i]]);
+	}
+	rc = 0;
+
+exit:
+	if (rc)
+		syslog(LOG_ERR, "failed to build the pipeline graph");
+	free(direct);
+	free(level);
+	free(level_count);
+	return rc;
+}
+
+/* Returns 1 if the instance at index may write to a buffer whose data was
+ * last read by the instance at reader. When instances run in parallel,
+ * the reader must have finished before the instance starts, which is only
+ * certain if the reader is an ancestor. */
+static int can_reuse_buffer(struct pipeline *pipeline, int index, int reader)
+{
+	int n = ARRAY_COUNT(&pipeline->instances);
+
+	return !pipeline->parallel || reader < 0 || reader == index ||
+		pipeline->ancestors[index * n + reader];
+}
+
+static void use_buffers(struct pipeline *pipeline, int index, char *busy,
+			int *reader, audio_port_array *audio_ports)
 {
 	int i, k = 0;
 	struct audio_port *audio_port;
 
 	FOR_ARRAY_ELEMENT(audio_ports, i, audio_port) {
-		while (busy[k])
+		while (busy[k] || !can_reuse_buffer(pipeline, index, reader[k]))
 			k++;
 		audio_port->buf_index = k;
 		busy[k] = 1;
+		pipeline->peak_buf = MAX(pipeline->peak_buf, k + 1);
 	}
 }
 
-static void unuse_buffers(char *busy, audio_port_array *audio_ports)
+static void unuse_buffers(int index, char *busy, int *reader,
+			  audio_port_array *audio_ports)
 {
 	int i;
 	struct audio_port *audio_port;
 
 	FOR_ARRAY_ELEMENT(audio_ports, i, audio_port) {
 		busy[audio_port->buf_index] = 0;
+		reader[audio_port->buf_index] = index;
+	}
+}
+
+/* Creates the arena of the pipeline. It holds the buffer array, peak_buf
+ * audio buffers and the state of every module, as hinted by the modules. */
+static void create_arena(struct pipeline *pipeline, int peak_buf)
+{
+	int i;
+	struct instance *instance;
+	size_t size;
+
+	size = dsp_arena_size(peak_buf * sizeof(float *)) +
+		peak_buf * dsp_arena_size(pipeline->block_size * sizeof(float));
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		struct dsp_module *module = instance->module;
+		size += module->get_arena_size(module);
+	}
+
+	pipeline->arena = dsp_arena_new(size);
+	if (!pipeline->arena)
+		syslog(LOG_WARNING, "failed to allocate %zu byte arena", size);
+
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		instance->module->arena = pipeline->arena;
 	}
 }
 
@@ -502,47 +797,30 @@ static int allocate_buffers(struct pipeline *pipeline)
 {
 	int i;
 	struct instance *instance;
-	int need_buf = 0, peak_buf = 0;
+	int max_buf = 0;
 	char *busy;
+	int *reader;
 
-	/* first figure out how many buffers do we need */
+	/* There cannot be more buffers than output ports. */
 	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
-		int in = ARRAY_COUNT(&instance->input_audio_ports);
-		int out = ARRAY_COUNT(&instance->output_audio_ports);
-
-		if (instance->properties & MODULE_INPLACE_BROKEN) {
-			/* We cannot reuse input buffer as output
-			 * buffer, so we need to use extra buffers */
-			need_buf += out;
-			peak_buf = MAX(peak_buf, need_buf);
-			need_buf -= in;
-		} else {
-			need_buf += out - in;
-			peak_buf = MAX(peak_buf, need_buf);
-		}
+		max_buf += ARRAY_COUNT(&instance->output_audio_ports);
 	}
 
-	/* then allocate the buffers */
-	pipeline->peak_buf = peak_buf;
-	pipeline->buffers = (float **)calloc(peak_buf, sizeof(float *));
-
-	if (!pipeline->buffers) {
+	/* First assign buffer index for each instance's input/output ports.
+	 * This also finds the number of buffers needed. reader records the
+	 * instance which read each free buffer last. */
+	busy = calloc(max_buf + 1, sizeof(*busy));
+	reader = calloc(max_buf + 1, sizeof(*reader));
+	if (!busy || !reader) {
+		free(busy);
+		free(reader);
 		syslog(LOG_ERR, "failed to allocate buffers");
 		return -1;
 	}
+	for (i = 0; i <= max_buf; i++)
+		reader[i] = -1;
 
-	for (i = 0; i < peak_buf; i++) {
-		size_t size = DSP_BUFFER_SIZE * sizeof(float);
-		float *buf = calloc(1, size);
-		if (!buf) {
-			syslog(LOG_ERR, "failed to allocate buf");
-			return -1;
-		}
-		pipeline->buffers[i] = buf;
-	}
-
-	/* Now assign buffer index for each instance's input/output ports */
-	busy = calloc(peak_buf, sizeof(*busy));
+	pipeline->peak_buf = 0;
 	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
 		int j;
 		struct audio_port *audio_port;
@@ -579,14 +857,40 @@ static int allocate_buffers(struct pipeline *pipeline)
 		 * output buffers before freeing the input buffers.
 		 */
 		if (instance->properties & MODULE_INPLACE_BROKEN) {
-			use_buffers(busy, &instance->output_audio_ports);
-			unuse_buffers(busy, &instance->input_audio_ports);
+			use_buffers(pipeline, i, busy, reader,
+				    &instance->output_audio_ports);
+			unuse_buffers(i, busy, reader,
+				      &instance->input_audio_ports);
 		} else {
-			unuse_buffers(busy, &instance->input_audio_ports);
-			use_buffers(busy, &instance->output_audio_ports);
+			unuse_buffers(i, busy, reader,
+				      &instance->input_audio_ports);
+			use_buffers(pipeline, i, busy, reader,
+				    &instance->output_audio_ports);
 		}
 	}
 	free(busy);
+	free(reader);
+
+	/* then allocate the buffers */
+	create_arena(pipeline, pipeline->peak_buf);
+	pipeline->buffers = (float **)dsp_arena_calloc(
+		pipeline->arena, pipeline->peak_buf * sizeof(float *));
+
+	if (!pipeline->buffers) {
+		syslog(LOG_ERR, "failed to allocate buffers");
+		return -1;
+	}
+
+	for (i = 0; i < pipeline->peak_buf; i++) {
+		size_t size = pipeline->block_size * sizeof(float);
+		float *buf = (float *)dsp_arena_calloc(pipeline->arena, size);
+		if (!buf) {
+			syslog(LOG_ERR, "failed to allocate buf");
+			return -1;
+		}
+		pipeline->buffers[i] = buf;
+	}
+	pipeline->arena_mark = dsp_arena_mark(pipeline->arena);
 
 	return 0;
 }
@@ -602,6 +906,26 @@ int cras_dsp_pipeline_load(struct pipeline *pipeline)
 			return -1;
 	}
 
+	/* Fall back to float if a module only processes float. */
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		if (pipeline->q31 && !instance->module->run_q31) {
+			syslog(LOG_INFO, "%s pipeline runs in float for %s",
+			       pipeline->purpose, instance->plugin->label);
+			pipeline->q31 = 0;
+		}
+	}
+
+	if (find_src_instance(pipeline) != 0)
+		return -1;
+
+	if (build_graph(pipeline) != 0)
+		return -1;
+
+	/* Only use the workers if some instances are independent and there
+	 * is a core to run them on. */
+	pipeline->parallel = pipeline->width > 1 &&
+		sysconf(_SC_NPROCESSORS_CONF) > 1;
+
 	if (allocate_buffers(pipeline) != 0)
 		return -1;
 
@@ -633,6 +957,101 @@ static void calculate_audio_delay(struct pipeline *pipeline)
 	}
 }
 
+/* Returns the source channel which reaches an audio input port, following
+ * the instances which pass their inputs through unchanged, or -1 if the
+ * data is changed on the way. */
+static int find_source_channel(struct pipeline *pipeline,
+			       struct audio_port *audio_port)
+{
+	for (;;) {
+		struct audio_port *peer = audio_port->peer;
+		struct instance *upstream = find_instance_by_plugin(
+			&pipeline->instances, peer->plugin);
+		int index;
+
+		if (upstream == pipeline->source_instance)
+			return peer->original_index;
+		if (!(upstream->properties & MODULE_IDENTITY))
+			return -1;
+
+		/* An identity module passes its k-th input to its k-th
+		 * output. */
+		index = peer - ARRAY_ELEMENT(&upstream->output_audio_ports, 0);
+		if (index >= ARRAY_COUNT(&upstream->input_audio_ports))
+			return -1;
+		audio_port = ARRAY_ELEMENT(&upstream->input_audio_ports, index);
+	}
+}
+
+/* Checks if every sink channel gets the source channel of the same index
+ * unchanged, so the pipeline can be bypassed. */
+static int is_identity(struct pipeline *pipeline)
+{
+	int i;
+	struct audio_port *audio_port;
+
+	FOR_ARRAY_ELEMENT(&pipeline->sink_instance->input_audio_ports, i,
+			  audio_port) {
+		if (find_source_channel(pipeline, audio_port) !=
+		    audio_port->original_index)
+			return 0;
+	}
+	return 1;
+}
+
+static void stop_pool(struct pipeline *pipeline)
+{
+	cras_dsp_pool_destroy(pipeline->pool);
+	pipeline->pool = NULL;
+	free(pipeline->pending);
+	pipeline->pending = NULL;
+	free(pipeline->ready);
+	pipeline->ready = NULL;
+}
+
+/* Starts the workers which run the independent instances. One thread is
+ * used per independent instance, up to one per core, and the audio thread
+ * is one of them. If they cannot be started the pipeline runs serially. */
+static void start_pool(struct pipeline *pipeline)
+{
+	int n = ARRAY_COUNT(&pipeline->instances);
+	long num_threads = sysconf(_SC_NPROCESSORS_CONF);
+
+	num_threads = MIN(num_threads, pipeline->width);
+	num_threads = MIN(num_threads, CRAS_DSP_POOL_MAX_THREADS);
+
+	pipeline->pending = calloc(n, sizeof(*pipeline->pending));
+	pipeline->ready = calloc(n, sizeof(*pipeline->ready));
+	if (pipeline->pending && pipeline->ready)
+		pipeline->pool = cras_dsp_pool_create(num_threads - 1);
+	if (!pipeline->pool) {
+		syslog(LOG_WARNING, "cannot start dsp pool, running serially");
+		stop_pool(pipeline);
+		return;
+	}
+	syslog(LOG_DEBUG, "running %s on %ld threads", pipeline->purpose,
+	       num_threads);
+}
+
+/* Tells the converter the rate of the source. If it cannot convert from
+ * that rate, the source runs at the rate of the pipeline, so the caller
+ * converts the samples as it would without the converter. */
+static void set_source_rate(struct pipeline *pipeline)
+{
+	struct dsp_module *module = pipeline->src_instance->module;
+	int rate = pipeline->input_rate ? pipeline->input_rate :
+		pipeline->sample_rate;
+
+	if (module->set_input_rate(module, rate) == 0) {
+		pipeline->source_rate = rate;
+		return;
+	}
+	syslog(LOG_WARNING, "%s cannot convert %d Hz to %d Hz",
+	       pipeline->src_instance->plugin->title, rate,
+	       pipeline->sample_rate);
+	module->set_input_rate(module, pipeline->sample_rate);
+}
+
 int cras_dsp_pipeline_instantiate(struct pipeline *pipeline, int sample_rate)
 {
 	int i;
@@ -646,6 +1065,7 @@ int cras_dsp_pipeline_instantiate(struct pipeline *pipeline, int sample_rate)
 		syslog(LOG_DEBUG, "instantiate %s", instance->plugin->label);
 	}
 	pipeline->sample_rate = sample_rate;
+	pipeline->source_rate = sample_rate;
 
 	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
 		audio_port_array *audio_in = &instance->input_audio_ports;
@@ -704,9 +1124,23 @@ int cras_dsp_pipeline_instantiate(struct pipeline *pipeline, int sample_rate)
 			       control_port->value, instance->plugin->title,
 			       control_port->original_index);
 		}
+
+		if (instance == pipeline->src_instance)
+			set_source_rate(pipeline);
+
+		/* All ports are connected, so the module can build its
+		 * state now instead of in the first run(). The properties
+		 * can depend on the control values from now on. */
+		module->prepare(module);
+		instance->properties = module->get_properties(module);
 	}
 
 	calculate_audio_delay(pipeline);
+	pipeline->bypass = is_identity(pipeline);
+	if (pipeline->bypass)
+		syslog(LOG_DEBUG, "%s pipeline is bypassed", pipeline->purpose);
+	else if (pipeline->parallel)
+		start_pool(pipeline);
 	return 0;
 }
 
@@ -715,6 +1149,8 @@ void cras_dsp_pipeline_deinstantiate(struct pipeline *pipeline)
 	int i;
 	struct instance *instance;
 
+	stop_pool(pipeline);
+
 	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
 		struct dsp_module *module = instance->module;
 		if (instance->instantiated) {
@@ -722,7 +1158,11 @@ void cras_dsp_pipeline_deinstantiate(struct pipeline *pipeline)
 			instance->instantiated = 0;
 		}
 	}
+	/* The module state can be carved again by the next instantiate. */
+	dsp_arena_reset(pipeline->arena, pipeline->arena_mark);
 	pipeline->sample_rate = 0;
+	pipeline->source_rate = 0;
+	pipeline->bypass = 0;
 }
 
 int cras_dsp_pipeline_get_delay(struct pipeline *pipeline)
@@ -730,6 +1170,86 @@ int cras_dsp_pipeline_get_delay(struct pipeline *pipeline)
 	return pipeline->sink_instance->total_delay;
 }
 
+int cras_dsp_pipeline_is_bypassed(struct pipeline *pipeline)
+{
+	return pipeline->bypass;
+}
+
+int cras_dsp_pipeline_set_control(struct pipeline *pipeline,
+				  const char *title, int port, float value)
+{
+	int i, j;
+	struct instance *instance;
+	struct control_port *control_port;
+
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		if (!instance->plugin->title ||
+		    strcmp(instance->plugin->title, title) != 0)
+			continue;
+		FOR_ARRAY_ELEMENT(&instance->input_control_ports, j,
+				  control_port) {
+			/* A port connected to another plugin takes the value
+			 * of that plugin. */
+			if (control_port->original_index != port ||
+			    control_port->peer)
+				continue;
+			atomic_store(&control_port->pending, value);
+			atomic_store(&instance->controls_changed, 1);
+			atomic_store(&pipeline->controls_changed, 1);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void cras_dsp_pipeline_set_volume(struct pipeline *pipeline, float volume)
+{
+	int i, j;
+	struct instance *instance;
+	struct control_port *control_port;
+
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		struct plugin *plugin = instance->plugin;
+		int tuning = cras_dsp_ini_find_tuning(plugin, volume);
+		const float *values;
+
+		if (tuning == instance->tuning)
+			continue;
+		instance->tuning = tuning;
+		values = tuning >= 0 ?
+			ARRAY_ELEMENT(&plugin->tunings, tuning)->values : NULL;
+
+		FOR_ARRAY_ELEMENT(&instance->input_control_ports, j,
+				  control_port) {
+			int index = control_port->original_index;
+			float value = values ? values[index] :
+				ARRAY_ELEMENT(&plugin->ports, index)->init_value;
+
+			if (control_port->peer)
+				continue;
+			/* Before instantiate the modules read the values
+			 * when they are prepared. */
+			if (!pipeline->sample_rate)
+				control_port->value = value;
+			atomic_store(&control_port->pending, value);
+		}
+		if (pipeline->sample_rate) {
+			atomic_store(&instance->controls_changed, 1);
+			atomic_store(&pipeline->controls_changed, 1);
+		}
+	}
+}
+
+void cras_dsp_pipeline_set_input_rate(struct pipeline *pipeline, int rate)
+{
+	pipeline->input_rate = rate;
+}
+
+int cras_dsp_pipeline_get_input_rate(struct pipeline *pipeline)
+{
+	return pipeline->source_rate;
+}
+
 int cras_dsp_pipeline_get_sample_rate(struct pipeline *pipeline)
 {
 	return pipeline->sample_rate;
@@ -750,6 +1270,22 @@ int cras_dsp_pipeline_get_peak_audio_buffers(struct pipeline *pipeline)
 	return pipeline->peak_buf;
 }
 
+void cras_dsp_pipeline_set_block_size(struct pipeline *pipeline, int frames)
+{
+	if (pipeline->buffers) {
+		syslog(LOG_WARNING, "block size set after the pipeline loaded");
+		return;
+	}
+	if (frames <= 0 || frames > DSP_BUFFER_SIZE)
+		frames = DSP_BUFFER_SIZE;
+	pipeline->block_size = frames;
+}
+
+int cras_dsp_pipeline_get_block_size(struct pipeline *pipeline)
+{
+	return pipeline->block_size;
+}
+
 static float *find_buffer(struct pipeline *pipeline,
 			  audio_port_array *audio_ports,
 			  int index)
@@ -764,6 +1300,11 @@ static float *find_buffer(struct pipeline *pipeline,
 	return NULL;
 }
 
+int cras_dsp_pipeline_is_q31(struct pipeline *pipeline)
+{
+	return pipeline->q31;
+}
+
 float *cras_dsp_pipeline_get_source_buffer(struct pipeline *pipeline, int index)
 {
 	return find_buffer(pipeline,
@@ -778,15 +1319,343 @@ float *cras_dsp_pipeline_get_sink_buffer(struct pipeline *pipeline, int index)
 			   index);
 }
 
-void cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count)
+static int64_t thread_time_ns()
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp);
+	return tp.tv_sec * 1000000000LL + tp.tv_nsec;
+}
+
+static void subtract_timespecs(const struct timespec *end,
+			       const struct timespec *beg,
+			       struct timespec *diff)
+{
+	diff->tv_sec = end->tv_sec - beg->tv_sec;
+	diff->tv_nsec = end->tv_nsec - beg->tv_nsec;
+	if (diff->tv_nsec < 0) {
+		diff->tv_sec--;
+		diff->tv_nsec += 1000000000L;
+	}
+}
+
+/* Returns the histogram bucket of a run time. Times below eight nanoseconds
+ * have one bucket each, then every power of two is split in four. */
+static int stats_bucket(int64_t t)
+{
+	int k, bucket;
+
+	if (t < 8)
+		return t < 0 ? 0 : (int)t;
+	k = 63 - __builtin_clzll((uint64_t)t);
+	bucket = 4 * (k - 1) + (int)((t >> (k - 2)) & 3);
+	return MIN(bucket, STATS_BUCKETS - 1);
+}
+
+/* Returns the (exclusive) upper bound of the times in a histogram bucket. */
+static int64_t stats_bucket_limit(int bucket)
+{
+	int k = bucket / 4 + 1;
+
+	if (bucket < 8)
+		return bucket + 1;
+	return (int64_t)(5 + bucket % 4) << (k - 2);
+}
+
+static void stats_add(struct instance_stats *stats, int64_t t)
+{
+	stats->blocks++;
+	stats->total_time += t;
+	stats->max_time = MAX(stats->max_time, t);
+	stats->last_time = t;
+	stats->histogram[stats_bucket(t)]++;
+}
+
+/* Returns the run time which the given fraction of the blocks did not
+ * exceed, as read from the histogram. */
+static int64_t stats_percentile(const struct instance_stats *stats,
+				double fraction)
+{
+	int64_t target = (int64_t)(fraction * stats->blocks + 0.5);
+	int64_t count = 0;
+	int i;
+
+	if (stats->blocks == 0)
+		return 0;
+	target = MAX(target, 1);
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		count += stats->histogram[i];
+		if (count >= target)
+			return MIN(stats_bucket_limit(i), stats->max_time);
+	}
+	return stats->max_time;
+}
+
+static void push_ready(struct pipeline *pipeline, int index)
+{
+	int slot = atomic_fetch_add(&pipeline->ready_tail, 1);
+	atomic_store(&pipeline->ready[slot], index);
+}
+
+/* Takes an instance from the ready queue. Each instance is queued once per
+ * block, so a slot is written once and the queue never wraps. Returns the
+ * index of the instance, or -1 if none is ready. */
+static int pop_ready(struct pipeline *pipeline)
+{
+	int head = atomic_load(&pipeline->ready_head);
+	int index;
+
+	if (head >= atomic_load(&pipeline->ready_tail))
+		return -1;
+	/* The slot may be taken but not yet written. */
+	index = atomic_load(&pipeline->ready[head]);
+	if (index < 0)
+		return -1;
+	if (!atomic_compare_exchange_weak(&pipeline->ready_head, &head,
+					  head + 1))
+		return -1;
+	return index;
+}
+
+/* Runs an instance on float or Q31 samples, as the pipeline does. */
+static inline void run_instance(struct pipeline *pipeline,
+				struct instance *instance,
+				unsigned long sample_count)
+{
+	struct dsp_module *module = instance->module;
+
+	if (pipeline->q31)
+		module->run_q31(module, sample_count);
+	else
+		module->run(module, sample_count);
+}
+
+/* Runs instances as they become ready until all instances of the block are
+ * done. This runs on the audio thread and on every worker of the pool. */
+static void run_ready_instances(void *arg)
+{
+	struct pipeline *pipeline = (struct pipeline *)arg;
+	int n = ARRAY_COUNT(&pipeline->instances);
+	struct instance *instance;
+	int64_t begin;
+	int index, i, spins = 0;
+
+	while (atomic_load(&pipeline->done) < n) {
+		index = pop_ready(pipeline);
+		if (index < 0) {
+			cras_dsp_pool_spin(&spins);
+			continue;
+		}
+		spins = 0;
+
+		instance = ARRAY_ELEMENT(&pipeline->instances, index);
+		begin = thread_time_ns();
+		run_instance(pipeline, instance,
+			     instance == pipeline->src_instance ?
+			     pipeline->block_in_samples :
+			     pipeline->block_samples);
+		stats_add(&instance->stats, thread_time_ns() - begin);
+
+		for (i = 0; i < instance->num_downstream; i++) {
+			int downstream = instance->downstream[i];
+			if (atomic_fetch_sub(&pipeline->pending[downstream],
+					     1) == 1)
+				push_ready(pipeline, downstream);
+		}
+		atomic_fetch_add(&pipeline->done, 1);
+	}
+}
+
+static void run_parallel(struct pipeline *pipeline, int in_count,
+			 int sample_count)
 {
 	int i;
 	struct instance *instance;
 
+	pipeline->block_in_samples = in_count;
+	pipeline->block_samples = sample_count;
+	atomic_store(&pipeline->ready_head, 0);
+	atomic_store(&pipeline->ready_tail, 0);
+	atomic_store(&pipeline->done, 0);
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		atomic_store(&pipeline->pending[i], instance->num_upstream);
+		atomic_store(&pipeline->ready[i], -1);
+	}
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		if (instance->num_upstream == 0)
+			push_ready(pipeline, i);
+	}
+
+	cras_dsp_pool_run(pipeline->pool, run_ready_instances, pipeline);
+}
+
+/* Moves the pending control values to the ports the modules read, and
+ * lets the modules fade to them. A pipeline which was bypassed when it was
+ * instantiated has no worker pool, so it runs serially once a change makes
+ * it process the audio. */
+static void apply_control_changes(struct pipeline *pipeline)
+{
+	int i, j;
+	struct instance *instance;
+	struct control_port *control_port;
+	int fade_frames = pipeline->sample_rate * CONTROL_FADE_MS / 1000;
+
+	if (!atomic_exchange(&pipeline->controls_changed, 0))
+		return;
+
 	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
 		struct dsp_module *module = instance->module;
-		module->run(module, sample_count);
+
+		if (!atomic_exchange(&instance->controls_changed, 0))
+			continue;
+		FOR_ARRAY_ELEMENT(&instance->input_control_ports, j,
+				  control_port)
+			control_port->value =
+				atomic_load(&control_port->pending);
+		module->update(module, fade_frames);
+		instance->properties = module->get_properties(module);
 	}
+	/* A module is not an identity while it fades, so a pipeline which
+	 * fades to an identity keeps running until the next change. */
+	pipeline->bypass = is_identity(pipeline);
+}
+
+int cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count)
+{
+	int i;
+	struct instance *instance;
+	int64_t begin, end;
+	int out_count = sample_count;
+
+	apply_control_changes(pipeline);
+
+	if (pipeline->src_instance) {
+		struct dsp_module *module = pipeline->src_instance->module;
+		out_count = module->get_output_frames(module, sample_count);
+	}
+
+	if (pipeline->pool) {
+		run_parallel(pipeline, sample_count, out_count);
+		return out_count;
+	}
+
+	begin = thread_time_ns();
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		run_instance(pipeline, instance,
+			     instance == pipeline->src_instance ?
+			     sample_count : out_count);
+		end = thread_time_ns();
+		stats_add(&instance->stats, end - begin);
+		begin = end;
+	}
+	return out_count;
+}
+
+void cras_dsp_pipeline_note_xrun(struct pipeline *pipeline)
+{
+	int i;
+	struct instance *instance;
+
+	if (!pipeline)
+		return;
+
+	pipeline->xruns++;
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		struct instance_stats *stats = &instance->stats;
+		stats->xrun_time = MAX(stats->xrun_time, stats->last_time);
+	}
+}
+
+/* Converts nanoseconds to microseconds for printing. */
+static double ns_to_us(int64_t t)
+{
+	return t / 1000.0;
+}
+
+void cras_dsp_pipeline_dump(int fd, struct pipeline *pipeline)
+{
+	int i, j;
+	struct instance *instance;
+	double audio_time;
+
+	dprintf(fd, "pipeline %s: %d Hz, %d in, %d out, delay %d frames%s%s\n",
+		pipeline->purpose, pipeline->sample_rate,
+		pipeline->input_channels, pipeline->output_channels,
+		cras_dsp_pipeline_get_delay(pipeline),
+		pipeline->q31 ? ", Q31" : "",
+		pipeline->bypass ? ", bypassed" : "");
+	if (pipeline->source_rate != pipeline->sample_rate)
+		dprintf(fd, "  converted from %d Hz by %s\n",
+			pipeline->source_rate,
+			pipeline->src_instance->plugin->title);
+	dprintf(fd, "  blocks %" PRId64 ", frames %" PRId64
+		", xruns %" PRId64 "\n", pipeline->total_blocks,
+		pipeline->total_samples, pipeline->xruns);
+	if (pipeline->total_blocks)
+		dprintf(fd, "  apply time (us): min %.1f avg %.1f max %.1f\n",
+			ns_to_us(pipeline->min_time),
+			ns_to_us(pipeline->total_time /
+				 pipeline->total_blocks),
+			ns_to_us(pipeline->max_time));
+
+	/* The real time the processed frames take to play, in nanoseconds,
+	 * to show the share of it each module uses. */
+	audio_time = pipeline->sample_rate ?
+		pipeline->total_samples * 1e9 / pipeline->sample_rate : 0;
+
+	dprintf(fd, "  %-20s %8s %8s %8s %8s %8s %6s\n", "module (us)", "p50",
+		"p99", "max", "avg", "xrun", "load");
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		struct instance_stats *stats = &instance->stats;
+
+		dprintf(fd, "  %-20s %8.1f %8.1f %8.1f %8.1f %8.1f %5.2f%%\n",
+			instance->plugin->title,
+			ns_to_us(stats_percentile(stats, 0.5)),
+			ns_to_us(stats_percentile(stats, 0.99)),
+			ns_to_us(stats->max_time),
+			ns_to_us(stats->blocks ?
+				 stats->total_time / stats->blocks : 0),
+			ns_to_us(stats->xrun_time),
+			audio_time ? stats->total_time * 100 / audio_time : 0);
+	}
+
+	/* The histograms, as the upper limit of each used bucket in
+	 * nanoseconds and the number of blocks in it. */
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		struct instance_stats *stats = &instance->stats;
+
+		dprintf(fd, "  %s histogram (ns):", instance->plugin->title);
+		for (j = 0; j < STATS_BUCKETS; j++)
+			if (stats->histogram[j])
+				dprintf(fd, " <%" PRId64 ":%u",
+					stats_bucket_limit(j),
+					stats->histogram[j]);
+		dprintf(fd, "\n");
+	}
+}
+
+int cras_dsp_pipeline_format_stats(struct pipeline *pipeline, char *buf,
+				   size_t size)
+{
+	int i, n, len = 0;
+	struct instance *instance;
+
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		struct instance_stats *stats = &instance->stats;
+		size_t used = MIN((size_t)len, size);
+
+		n = snprintf(buf + used, size - used,
+			     "%s%s/%s:%.1f/%.1f/%.1f/%.1f", len ? "," : "",
+			     pipeline->purpose, instance->plugin->title,
+			     ns_to_us(stats_percentile(stats, 0.5)),
+			     ns_to_us(stats_percentile(stats, 0.99)),
+			     ns_to_us(stats->max_time),
+			     ns_to_us(stats->xrun_time));
+		if (n < 0)
+			return n;
+		len += n;
+	}
+	return len;
 }
 
 void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
@@ -815,51 +1684,150 @@ void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
 void cras_dsp_pipeline_apply(struct pipeline *pipeline,
 			     uint8_t *buf, unsigned int frames)
 {
-	size_t remaining;
-	size_t chunk;
+	cras_dsp_pipeline_apply_format(pipeline, buf, DSP_SAMPLE_FORMAT_S16_LE,
+				       frames);
+}
+
+void cras_dsp_pipeline_apply_format(struct pipeline *pipeline, uint8_t *buf,
+				    enum dsp_sample_format format,
+				    unsigned int frames)
+{
+	if (!pipeline)
+		return;
+
+	cras_dsp_pipeline_apply_to(pipeline, buf, buf,
+				   pipeline->output_channels, format, frames);
+}
+
+/* Fills the output channels which the pipeline does not produce. */
+static float zero_buffer[DSP_BUFFER_SIZE];
+
+/* Returns how many input frames the pipeline takes in the next block, so
+ * that neither the input nor the output of the block is larger than the
+ * block size or than what is left. */
+static unsigned int next_block_frames(struct pipeline *pipeline,
+				      unsigned int in_left,
+				      unsigned int out_left)
+{
+	unsigned int block_size = pipeline->block_size;
+	unsigned int out_limit = MIN(out_left, block_size);
+	unsigned int chunk = MIN(in_left, block_size);
+	struct dsp_module *module;
+
+	if (!pipeline->src_instance)
+		return MIN(chunk, out_limit);
+
+	/* Start from the ratio of the rates and correct the rounding. */
+	module = pipeline->src_instance->module;
+	chunk = MIN(chunk, (uint64_t)out_limit * pipeline->source_rate /
+		    pipeline->sample_rate + 1);
+	while (chunk > 0 &&
+	       module->get_output_frames(module, chunk) > (int)out_limit)
+		chunk--;
+	return chunk;
+}
+
+void cras_dsp_pipeline_apply_to(struct pipeline *pipeline, const uint8_t *in,
+				uint8_t *out, unsigned int out_channels,
+				enum dsp_sample_format format,
+				unsigned int frames)
+{
+	unsigned int in_frames = frames;
+	unsigned int out_frames = frames;
+
+	cras_dsp_pipeline_convert_to(pipeline, in, &in_frames, out,
+				     out_channels, format, &out_frames);
+}
+
+void cras_dsp_pipeline_convert_to(struct pipeline *pipeline,
+				  const uint8_t *in, unsigned int *in_frames,
+				  uint8_t *out, unsigned int out_channels,
+				  enum dsp_sample_format format,
+				  unsigned int *out_frames)
+{
+	unsigned int in_left = *in_frames;
+	unsigned int out_left = *out_frames;
+	unsigned int chunk, produced;
 	size_t i;
-	int16_t *target;
-	unsigned int input_channels = pipeline->input_channels;
-	unsigned int output_channels = pipeline->output_channels;
-	float *source[input_channels];
-	float *sink[output_channels];
-	//struct timespec begin, end, delta;
+	unsigned int input_channels;
+	size_t sample_bytes = dsp_util_sample_bytes(format);
+	struct timespec begin, end, delta;
+
+	if (!pipeline || in_left == 0 || out_left == 0) {
+		*in_frames = 0;
+		*out_frames = 0;
+		return;
+	}
 
-	if (!pipeline || frames == 0)
+	input_channels = pipeline->input_channels;
+	apply_control_changes(pipeline);
+
+	/* Nothing to run, so only move the samples if they have to. In place
+	 * the output frames must not be wider than the input frames, or they
+	 * would overwrite input not read yet. */
+	if (pipeline->bypass && (in != out || out_channels <= input_channels)) {
+		unsigned int channels = MIN(out_channels,
+					    (unsigned int)pipeline->output_channels);
+		unsigned int frames = MIN(in_left, out_left);
+		dsp_util_copy_channels(in, input_channels, out, out_channels,
+				       channels, format, frames);
+		*in_frames = frames;
+		*out_frames = frames;
 		return;
+	}
 
-	//clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+	float *source[input_channels];
+	float *sink[out_channels];
 
-	target = (int16_t *)buf;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
 
 	/* get pointers to source and sink buffers */
 	for (i = 0; i < input_channels; i++)
 		source[i] = cras_dsp_pipeline_get_source_buffer(pipeline, i);
-	for (i = 0; i < output_channels; i++)
-		sink[i] = cras_dsp_pipeline_get_sink_buffer(pipeline, i);
-
-	remaining = frames;
-
-	/* process at most DSP_BUFFER_SIZE frames each loop */
-	while (remaining > 0) {
-		chunk = MIN(remaining, (size_t)DSP_BUFFER_SIZE);
+	for (i = 0; i < out_channels; i++)
+		sink[i] = i < (size_t)pipeline->output_channels ?
+			cras_dsp_pipeline_get_sink_buffer(pipeline, i) :
+			zero_buffer;
+
+	/* process at most one block each loop */
+	while (in_left > 0 && out_left > 0) {
+		chunk = next_block_frames(pipeline, in_left, out_left);
+		if (chunk == 0)
+			break;
 
-		/* deinterleave and convert to float */
-		dsp_util_deinterleave(target, source, input_channels, chunk);
+		/* deinterleave and convert to float or Q31 */
+		if (pipeline->q31)
+			dsp_util_deinterleave_q31(in, (int32_t **)source,
+						  input_channels, format,
+						  chunk);
+		else
+			dsp_util_deinterleave_format(in, source,
+						     input_channels, format,
+						     chunk);
 
 		/* Run the pipeline */
-		cras_dsp_pipeline_run(pipeline, chunk);
-
-		/* interleave and convert back to int16_t */
-		dsp_util_interleave(sink, target, output_channels, chunk);
-
-		target += chunk * output_channels;
-		remaining -= chunk;
+		produced = cras_dsp_pipeline_run(pipeline, chunk);
+
+		/* interleave and convert back to the sample format */
+		if (pipeline->q31)
+			dsp_util_interleave_q31((int32_t **)sink, out,
+						out_channels, format,
+						produced);
+		else
+			dsp_util_interleave_format(sink, out, out_channels,
+						   format, produced);
+
+		in += chunk * input_channels * sample_bytes;
+		out += produced * out_channels * sample_bytes;
+		in_left -= chunk;
+		out_left -= produced;
 	}
+	*in_frames -= in_left;
+	*out_frames -= out_left;
 
-	//clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
-	//subtract_timespecs(&end, &begin, &delta);
-	//cras_dsp_pipeline_add_statistic(pipeline, &delta, frames);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+	subtract_timespecs(&end, &begin, &delta);
+	cras_dsp_pipeline_add_statistic(pipeline, &delta, *out_frames);
 }
 
 void cras_dsp_pipeline_free(struct pipeline *pipeline)
@@ -867,6 +1835,8 @@ void cras_dsp_pipeline_free(struct pipeline *pipeline)
 	int i;
 	struct instance *instance;
 
+	stop_pool(pipeline);
+
 	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
 		struct dsp_module *module = instance->module;
 		instance->plugin = NULL;
@@ -883,13 +1853,20 @@ void cras_dsp_pipeline_free(struct pipeline *pipeline)
 			module->free_module(module);
 			instance->module = NULL;
 		}
+		free(instance->downstream);
 	}
 
+	free(pipeline->ancestors);
+
 	pipeline->ini = NULL;
 	ARRAY_FREE(&pipeline->instances);
 
-	for (i = 0; i < pipeline->peak_buf; i++)
-		free(pipeline->buffers[i]);
-	free(pipeline->buffers);
+	if (pipeline->buffers) {
+		for (i = 0; i < pipeline->peak_buf; i++)
+			dsp_arena_release(pipeline->arena,
+					  pipeline->buffers[i]);
+		dsp_arena_release(pipeline->arena, pipeline->buffers);
+	}
+	dsp_arena_free(pipeline->arena);
 	free(pipeline);
 }
@@ -10,9 +10,11 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "cras_dsp_ini.h"
+#include "dsp_util.h"
 
 /* These are the functions to create and use dsp pipelines. A dsp
  * pipeline is a collection of dsp plugins that process audio
@@ -24,14 +26,17 @@ extern "C" {
  */
 
 /* The maximum number of samples that cras_dsp_pipeline_run() can
- * accept. Beyond this the user should break the samples into several
- * blocks and call cras_dsp_pipeline_run() several times.
+ * accept, and the default block size of a pipeline. Beyond the block size
+ * the user should break the samples into several blocks and call
+ * cras_dsp_pipeline_run() several times.
  */
 #define DSP_BUFFER_SIZE 2048
 
 struct pipeline;
 
-/* Creates a pipeline from the given ini file.
+/* Creates a pipeline from the given ini file. A "capture" pipeline runs on
+ * Q31 fixed point samples if all its modules can, see run_q31 in struct
+ * dsp_module, and on float samples otherwise.
  * Args:
  *    ini - The ini file the pipeline is created from.
  *    env - The expression environment for evaluating disable expression.
@@ -54,6 +59,36 @@ void cras_dsp_pipeline_free(struct pipeline *pipeline);
  */
 int cras_dsp_pipeline_load(struct pipeline *pipeline);
 
+/* Sets the most frames the pipeline runs at a time. A pipeline which runs
+ * at the period size of the device keeps its buffers small enough to stay
+ * in the cache, and cras_dsp_pipeline_apply() then runs it once per period.
+ * Must be called before cras_dsp_pipeline_load(), which sizes the buffers.
+ * Args:
+ *    frames - The block size, up to DSP_BUFFER_SIZE. 0 or a larger value
+ *        selects DSP_BUFFER_SIZE.
+ */
+void cras_dsp_pipeline_set_block_size(struct pipeline *pipeline, int frames);
+
+/* Returns the block size of the pipeline, see
+ * cras_dsp_pipeline_set_block_size(). */
+int cras_dsp_pipeline_get_block_size(struct pipeline *pipeline);
+
+/* Sets the sampling rate of the samples given to the pipeline. If the
+ * pipeline has a module which converts the sampling rate, such as the
+ * builtin "src", the module converts them to the rate given to
+ * cras_dsp_pipeline_instantiate(); otherwise the rate is ignored. Must be
+ * called before cras_dsp_pipeline_instantiate().
+ * Args:
+ *    rate - The input rate, or 0 for the rate of the pipeline.
+ */
+void cras_dsp_pipeline_set_input_rate(struct pipeline *pipeline, int rate);
+
+/* Returns the sampling rate the source of the pipeline takes, which is the
+ * rate set with cras_dsp_pipeline_set_input_rate() if the pipeline converts
+ * from it, or the rate of the pipeline otherwise. Returns 0 if the pipeline
+ * has not been instantiated. */
+int cras_dsp_pipeline_get_input_rate(struct pipeline *pipeline);
+
 /* Instantiates the pipeline given the sampling rate.
  * Args:
  *    sample_rate - The audio sampling rate.
@@ -67,19 +102,57 @@ int cras_dsp_pipeline_instantiate(struct pipeline *pipeline, int sample_rate);
  * cras_dsp_pipeline_instantiate(). */
 void cras_dsp_pipeline_deinstantiate(struct pipeline *pipeline);
 
-/* Returns the buffering delay of the pipeline. This should only be called
- * after a pipeline has been instantiated.
+/* Returns the buffering delay of the pipeline, which is the longest
+ * algorithmic delay, such as the lookahead of a compressor, on any path
+ * from the source to the sink. This should only be called after a pipeline
+ * has been instantiated.
  * Returns:
  *    The buffering delay in frames.
  */
 int cras_dsp_pipeline_get_delay(struct pipeline *pipeline);
 
+/* Returns 1 if the pipeline leaves the audio as it is, so applying it only
+ * copies the samples, or 0 if it runs its modules. This is known once the
+ * pipeline has been instantiated. */
+int cras_dsp_pipeline_is_bypassed(struct pipeline *pipeline);
+
+/* Changes the value of an input control port of an instantiated pipeline
+ * while it runs. The value is taken by the audio thread before the next
+ * block, and the module fades to it without being rebuilt. It must not be
+ * called by two threads at the same time.
+ * Args:
+ *    title - The title of the plugin in the ini file.
+ *    port - The index of the port in the plugin.
+ *    value - The new value.
+ * Returns:
+ *    0 if success. -1 if the plugin is not in the pipeline, or the port is
+ *    not an input control port with a constant value.
+ */
+int cras_dsp_pipeline_set_control(struct pipeline *pipeline,
+				  const char *title, int port, float value);
+
+/* Selects the tuning of each plugin for a volume, see cras_dsp_ini.c for
+ * the tunings in the ini file. If the pipeline is instantiated, the modules
+ * fade to the values of their new tuning as with
+ * cras_dsp_pipeline_set_control(), otherwise the values are used when the
+ * pipeline is instantiated. Only plugins whose tuning changes are touched,
+ * so it is cheap to call for every volume change.
+ * Args:
+ *    volume - The volume of the stream, from 0 to 1.
+ */
+void cras_dsp_pipeline_set_volume(struct pipeline *pipeline, float volume);
+
 /* Returns the number of input/output audio channels this pipeline expects */
 int cras_dsp_pipeline_get_num_input_channels(struct pipeline *pipeline);
 int cras_dsp_pipeline_get_num_output_channels(struct pipeline *pipeline);
 
+/* Returns 1 if the pipeline runs on Q31 fixed point samples. Its source
+ * and sink buffers then hold int32_t samples in place of floats. Valid
+ * once the pipeline is loaded. */
+int cras_dsp_pipeline_is_q31(struct pipeline *pipeline);
+
 /* Returns the pointer to the input buffer for a channel of this
- * pipeline. The size of the buffer is DSP_BUFFER_SIZE samples, and
+ * pipeline. The size of the buffer is the block size of the pipeline, and
  * the number of samples acually used should be passed to
  * cras_dsp_pipeline_run().
  *
@@ -91,7 +164,7 @@ float *cras_dsp_pipeline_get_source_buffer(struct pipeline *pipeline,
 					   int index);
 
 /* Returns the pointer to the output buffer for a channel of this
- * pipeline. The size of the buffer is DSP_BUFFER_SIZE samples.
+ * pipeline. The size of the buffer is the block size of the pipeline.
  *
  * Args:
  *    index - The channel index. The valid value is 0 to
@@ -108,8 +181,13 @@ int cras_dsp_pipeline_get_peak_audio_buffers(struct pipeline *pipeline);
 int cras_dsp_pipeline_get_sample_rate(struct pipeline *pipeline);
 
 /* Processes a block of audio samples. sample_count should be no more
- * than DSP_BUFFER_SIZE */
-void cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count);
+ * than the block size of the pipeline, and it must not make a pipeline
+ * which converts the sampling rate output more than the block size.
+ * Returns:
+ *    The number of frames in the sink buffers, which is sample_count
+ *    unless the pipeline converts the sampling rate.
+ */
+int cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count);
 
 /* Add a statistic of running time for the pipeline.
  *
@@ -122,6 +200,28 @@ void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
 				     const struct timespec *time_delta,
 				     int samples);
 
+/* Records that the device had an xrun. The time the modules took in the
+ * last block is kept as the xrun time of each module if it is the longest
+ * so far, to show which module was slow when the output ran dry.
+ */
+void cras_dsp_pipeline_note_xrun(struct pipeline *pipeline);
+
+/* Writes the run time statistics of the pipeline and the p50, p99, max,
+ * average and xrun times and histogram of every module to a file
+ * descriptor as text. */
+void cras_dsp_pipeline_dump(int fd, struct pipeline *pipeline);
+
+/* Formats the p50, p99, max and xrun times of every module as a comma
+ * separated list of purpose/title:p50/p99/max/xrun, in microseconds.
+ * Args:
+ *    buf - The buffer to write to.
+ *    size - The size of the buffer.
+ * Returns:
+ *    The length of the full string, like snprintf().
+ */
+int cras_dsp_pipeline_format_stats(struct pipeline *pipeline, char *buf,
+				   size_t size);
+
 /* Runs the specified pipeline across the given interleaved buffer in place.
  * Args:
  *    pipeline - The pipeline to run.
@@ -131,6 +231,61 @@ void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
 void cras_dsp_pipeline_apply(struct pipeline *pipeline,
 			     uint8_t *buf, unsigned int frames);
 
+/* Same as cras_dsp_pipeline_apply(), but for samples in the given format.
+ * Float samples go to the pipeline without any conversion, and the samples
+ * of the wider integer formats keep their full resolution.
+ * Args:
+ *    pipeline - The pipeline to run.
+ *    buf - The samples to be processed, interleaved.
+ *    format - The format of the samples in buf.
+ *    frames - the numver of samples in the buffer.
+ */
+void cras_dsp_pipeline_apply_format(struct pipeline *pipeline, uint8_t *buf,
+				    enum dsp_sample_format format,
+				    unsigned int frames);
+
+/* Runs the specified pipeline from one interleaved buffer to another, so the
+ * output can go straight into a device buffer. The output frames can have a
+ * different number of channels than the pipeline outputs: extra channels
+ * are filled with zeros, and outputs beyond out_channels are dropped. This
+ * is for a pipeline whose input and output rates are the same, see
+ * cras_dsp_pipeline_convert_to() for the others.
+ * Args:
+ *    pipeline - The pipeline to run.
+ *    in - The samples to be processed, interleaved, with as many channels
+ *         as the pipeline has inputs.
+ *    out - The buffer to write the processed samples to, interleaved.
+ *    out_channels - The number of channels per frame in out.
+ *    format - The format of the samples in both in and out.
+ *    frames - The number of frames to process.
+ */
+void cras_dsp_pipeline_apply_to(struct pipeline *pipeline, const uint8_t *in,
+				uint8_t *out, unsigned int out_channels,
+				enum dsp_sample_format format,
+				unsigned int frames);
+
+/* Same as cras_dsp_pipeline_apply_to(), for a pipeline which may convert
+ * the sampling rate of the samples. The input frames are taken until
+ * either the input runs out or the output is full. The pipeline keeps the
+ * input it needs for later output frames, so all of the input is taken
+ * unless the output is full. The input and the output must not overlap.
+ * Args:
+ *    pipeline - The pipeline to run.
+ *    in - The samples to be processed, interleaved, at the input rate.
+ *    in_frames - The number of frames in in. Set to the number of frames
+ *        taken.
+ *    out - The buffer to write the processed samples to, interleaved.
+ *    out_channels - The number of channels per frame in out.
+ *    format - The format of the samples in both in and out.
+ *    out_frames - The number of frames out has room for. Set to the
+ *        number of frames written.
+ */
+void cras_dsp_pipeline_convert_to(struct pipeline *pipeline,
+				  const uint8_t *in, unsigned int *in_frames,
+				  uint8_t *out, unsigned int out_channels,
+				  enum dsp_sample_format format,
+				  unsigned int *out_frames);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,227 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#define _GNU_SOURCE
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "cras_dsp_pool.h"
+
+/* The priority of the workers. It is the lowest real-time priority above
+ * the normal threads; the audio threads of the framework use 2 and 3. */
+#define POOL_RT_PRIORITY 2
+
+/* How many times an idle worker checks for a new block before it sleeps
+ * on the futex. This only helps when blocks come back to back. */
+#define POOL_SPIN_COUNT 100
+
+/* How many times cras_dsp_pool_spin() spins before it starts to sleep,
+ * some tens of microseconds, and how long it sleeps then. */
+#define POOL_BACKOFF_SPINS 10000
+#define POOL_BACKOFF_US 20
+
+struct pool_worker {
+	struct cras_dsp_pool *pool;
+	pthread_t thread;
+	int cpu;
+};
+
+struct cras_dsp_pool {
+	int num_workers;
+	struct pool_worker workers[CRAS_DSP_POOL_MAX_THREADS];
+
+	/* The function of the current block and its argument. */
+	void (*func)(void *arg);
+	void *arg;
+
+	/* Incremented for each block, and to stop the workers. The workers
+	 * sleep on it. */
+	atomic_uint generation;
+	/* The number of workers which may sleep on generation. */
+	atomic_int sleepers;
+	/* The number of workers in func. */
+	atomic_int active;
+	/* Set when the caller has returned from func, so late workers do not
+	 * enter it. */
+	atomic_int closed;
+	atomic_int stop;
+};
+
+static inline void cpu_relax()
+{
+#if defined(__arm__) || defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#elif defined(__i386__) || defined(__x86_64__)
+	__asm__ __volatile__("pause" ::: "memory");
+#endif
+}
+
+void cras_dsp_pool_spin(int *spins)
+{
+	if ((*spins)++ < POOL_BACKOFF_SPINS)
+		cpu_relax();
+	else
+		usleep(POOL_BACKOFF_US);
+}
+
+static void futex_wait(atomic_uint *addr, unsigned int value)
+{
+	syscall(__NR_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake_all(atomic_uint *addr)
+{
+	syscall(__NR_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Pins the calling worker to its core and raises its priority. Neither is
+ * needed to run correctly, so failures are only logged. */
+static void setup_worker(struct pool_worker *worker)
+{
+	struct sched_param param = { .sched_priority = POOL_RT_PRIORITY };
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(worker->cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+		syslog(LOG_WARNING, "cannot pin dsp worker to cpu %d",
+		       worker->cpu);
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+		syslog(LOG_WARNING, "cannot set dsp worker priority");
+}
+
+/* Waits until the generation is no longer seen, and returns it. The
+ * sleepers count is raised before the futex checks the generation, so
+ * either the caller of cras_dsp_pool_run() sees the sleeper and wakes it,
+ * or the futex sees the new generation and does not sleep. */
+static unsigned int wait_for_block(struct cras_dsp_pool *pool,
+				   unsigned int seen)
+{
+	unsigned int generation;
+	int spins = 0;
+
+	while ((generation = atomic_load(&pool->generation)) == seen) {
+		if (spins++ < POOL_SPIN_COUNT) {
+			cpu_relax();
+			continue;
+		}
+		atomic_fetch_add(&pool->sleepers, 1);
+		futex_wait(&pool->generation, seen);
+		atomic_fetch_sub(&pool->sleepers, 1);
+	}
+	return generation;
+}
+
+static void *pool_worker_thread(void *arg)
+{
+	struct pool_worker *worker = (struct pool_worker *)arg;
+	struct cras_dsp_pool *pool = worker->pool;
+	unsigned int seen = 0;
+
+	setup_worker(worker);
+
+	for (;;) {
+		seen = wait_for_block(pool, seen);
+		if (atomic_load(&pool->stop))
+			break;
+
+		/* Enter before checking closed. Either the caller sees this
+		 * worker as active and waits for it, or this worker sees the
+		 * block closed and stays out. */
+		atomic_fetch_add(&pool->active, 1);
+		if (!atomic_load(&pool->closed))
+			pool->func(pool->arg);
+		atomic_fetch_sub(&pool->active, 1);
+	}
+	return NULL;
+}
+
+static void wake_workers(struct cras_dsp_pool *pool)
+{
+	atomic_fetch_add(&pool->generation, 1);
+	if (atomic_load(&pool->sleepers))
+		futex_wake_all(&pool->generation);
+}
+
+static void stop_workers(struct cras_dsp_pool *pool, int num_started)
+{
+	int i;
+
+	atomic_store(&pool->stop, 1);
+	wake_workers(pool);
+	for (i = 0; i < num_started; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+}
+
+struct cras_dsp_pool *cras_dsp_pool_create(int num_workers)
+{
+	struct cras_dsp_pool *pool;
+	long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	int i;
+
+	if (num_workers <= 0 || num_workers >= CRAS_DSP_POOL_MAX_THREADS)
+		return NULL;
+
+	pool = (struct cras_dsp_pool *)calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->num_workers = num_workers;
+	atomic_init(&pool->generation, 0);
+	atomic_init(&pool->sleepers, 0);
+	atomic_init(&pool->active, 0);
+	atomic_init(&pool->closed, 1);
+	atomic_init(&pool->stop, 0);
+
+	/* Leave the first core to the audio thread. */
+	for (i = 0; i < num_workers; i++) {
+		struct pool_worker *worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->cpu = num_cpus > 1 ? (i + 1) % num_cpus : 0;
+		if (pthread_create(&worker->thread, NULL, pool_worker_thread,
+				   worker) != 0) {
+			syslog(LOG_ERR, "cannot start dsp worker %d", i);
+			stop_workers(pool, i);
+			free(pool);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+void cras_dsp_pool_destroy(struct cras_dsp_pool *pool)
+{
+	if (!pool)
+		return;
+	stop_workers(pool, pool->num_workers);
+	free(pool);
+}
+
+void cras_dsp_pool_run(struct cras_dsp_pool *pool, void (*func)(void *arg),
+		       void *arg)
+{
+	int spins = 0;
+
+	pool->func = func;
+	pool->arg = arg;
+	atomic_store(&pool->closed, 0);
+	wake_workers(pool);
+
+	func(arg);
+
+	/* func has returned, so the work is done. Keep out the workers which
+	 * have not started, and wait for those in func to leave it. */
+	atomic_store(&pool->closed, 1);
+	while (atomic_load(&pool->active))
+		cras_dsp_pool_spin(&spins);
+}
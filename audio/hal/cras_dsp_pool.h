@@ -0,0 +1,63 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CRAS_DSP_POOL_H_
+#define CRAS_DSP_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A small pool of worker threads which help the audio thread run a
+ * pipeline. The audio thread hands a function to the pool for each block;
+ * the workers and the audio thread all call it, and the audio thread
+ * returns when every participant has left it. No lock is taken for a
+ * block: idle workers sleep on a futex and are woken only if they went to
+ * sleep, and the end of the block is a spin on an atomic counter. */
+
+/* The most threads which work on a block, including the audio thread. */
+#define CRAS_DSP_POOL_MAX_THREADS 4
+
+struct cras_dsp_pool;
+
+/* Creates a pool. The workers are pinned to their own cores and ask for a
+ * real-time priority, so they are not preempted by the threads the audio
+ * thread preempts.
+ * Args:
+ *    num_workers - The number of worker threads, not counting the caller
+ *        of cras_dsp_pool_run().
+ * Returns:
+ *    The pool, or NULL if the workers cannot be started.
+ */
+struct cras_dsp_pool *cras_dsp_pool_create(int num_workers);
+
+/* Stops the workers and frees the pool. */
+void cras_dsp_pool_destroy(struct cras_dsp_pool *pool);
+
+/* Runs a function on all workers and the calling thread at the same time,
+ * and returns after every worker which started it has returned. A worker
+ * which wakes up after the calling thread has returned from func does not
+ * call it, so func must do all the work itself if no worker shows up, and
+ * should return once the work is done.
+ * Args:
+ *    func - The function to run.
+ *    arg - The argument to func.
+ */
+void cras_dsp_pool_run(struct cras_dsp_pool *pool, void (*func)(void *arg),
+		       void *arg);
+
+/* Waits a little in a spin loop. The first calls only tell the core that
+ * the caller spins; after that each call sleeps, so the thread the caller
+ * waits for can run even if it shares the core and has a lower priority.
+ * Args:
+ *    spins - The number of calls so far, set to 0 when the loop starts.
+ */
+void cras_dsp_pool_spin(int *spins);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CRAS_DSP_POOL_H_ */
@@ -283,6 +283,12 @@ void cras_expr_env_set_variable_string(struct cras_expr_env *env,
 	value_set_string(value, str);
 }
 
+const struct cras_expr_value *cras_expr_env_get_variable(
+	struct cras_expr_env *env, const char *name)
+{
+	return find_value(env, name);
+}
+
 void cras_expr_env_free(struct cras_expr_env *env)
 {
 	int i;
@@ -78,6 +78,10 @@ void cras_expr_env_set_variable_integer(struct cras_expr_env *env,
 					const char *name, int integer);
 void cras_expr_env_set_variable_string(struct cras_expr_env *env,
 				       const char *name, const char *str);
+/* Returns the value of a variable in the environment, or NULL if it is not
+ * set. */
+const struct cras_expr_value *cras_expr_env_get_variable(
+	struct cras_expr_env *env, const char *name);
 void cras_expr_env_free(struct cras_expr_env *env);
 
 struct cras_expr_expression *cras_expr_expression_parse(const char *str);
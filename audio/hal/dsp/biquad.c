@@ -366,3 +366,25 @@ void biquad_set(struct biquad *bq, enum biquad_type type, double freq, double Q,
 		break;
 	}
 }
+
+int biquad_is_identity(const struct biquad *bq)
+{
+	return bq->b0 == 1 && bq->b1 == bq->a1 && bq->b2 == bq->a2;
+}
+
+void biquad_step_to(struct biquad *bq, const struct biquad *target, int steps)
+{
+	if (steps <= 1) {
+		bq->b0 = target->b0;
+		bq->b1 = target->b1;
+		bq->b2 = target->b2;
+		bq->a1 = target->a1;
+		bq->a2 = target->a2;
+		return;
+	}
+	bq->b0 += (target->b0 - bq->b0) / steps;
+	bq->b1 += (target->b1 - bq->b1) / steps;
+	bq->b2 += (target->b2 - bq->b2) / steps;
+	bq->a1 += (target->a1 - bq->a1) / steps;
+	bq->a2 += (target->a2 - bq->a2) / steps;
+}
@@ -50,6 +50,35 @@ enum biquad_type {
 void biquad_set(struct biquad *bq, enum biquad_type type, double freq, double Q,
 		double gain);
 
+/* Returns 1 if the biquad passes its input through unchanged, which is when
+ * the numerator and the denominator of its z-transform are the same, as for
+ * BQ_NONE or a shelf or peaking filter with 0 dB gain. Returns 0 otherwise.
+ */
+int biquad_is_identity(const struct biquad *bq);
+
+/* Moves the coefficients of a biquad a part of the way to those of another
+ * one, and keeps its state. Calling this with steps, steps - 1, ..., 1 moves
+ * it all the way in a straight line. The biquads with stable poles form a
+ * convex set (a triangle in (a1, a2)), so every biquad on the way between two
+ * stable ones is stable too.
+ * Args:
+ *    bq - The biquad to change.
+ *    target - The biquad with the coefficients to move to.
+ *    steps - The number of steps left, 1 to move all the way.
+ */
+void biquad_step_to(struct biquad *bq, const struct biquad *target, int steps);
+
+/* The number of frames the EQs process between two steps when they move
+ * their biquads to new parameters. */
+#define BIQUAD_FADE_FRAMES 32
+
+/* Returns the number of steps of BIQUAD_FADE_FRAMES a fade of the given
+ * length takes, 0 to change at once. */
+static inline int biquad_fade_steps(int fade_frames)
+{
+	return (fade_frames + BIQUAD_FADE_FRAMES - 1) / BIQUAD_FADE_FRAMES;
+}
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -6,12 +6,14 @@
 #include <string.h>
 #include "crossover2.h"
 #include "biquad.h"
+#include "dsp_cpu.h"
+#include "dsp_kernels.h"
 
-static void lr42_set(struct lr42 *lr42, enum biquad_type type, float freq)
+static void lr42_set_coefficients(struct lr42 *lr42, enum biquad_type type,
+				  float freq)
 {
 	struct biquad q;
 	biquad_set(&q, type, freq, 0, 0);
-	memset(lr42, 0, sizeof(*lr42));
 	lr42->b0 = q.b0;
 	lr42->b1 = q.b1;
 	lr42->b2 = q.b2;
@@ -19,6 +21,12 @@ static void lr42_set(struct lr42 *lr42, enum biquad_type type, float freq)
 	lr42->a2 = q.a2;
 }
 
+static void lr42_set(struct lr42 *lr42, enum biquad_type type, float freq)
+{
+	memset(lr42, 0, sizeof(*lr42));
+	lr42_set_coefficients(lr42, type, freq);
+}
+
 /* Split input data using two LR4 filters, put the result into the input array
  * and another array.
  *
@@ -28,9 +36,9 @@ static void lr42_set(struct lr42 *lr42, enum biquad_type type, float freq)
  */
 #if defined(__ARM_NEON__)
 #include <arm_neon.h>
-static void lr42_split(struct lr42 *lp, struct lr42 *hp, int count,
-		       float *data0L, float *data0R,
-		       float *data1L, float *data1R)
+static void lr42_split_neon(struct lr42 *lp, struct lr42 *hp, int count,
+			    float *data0L, float *data0R,
+			    float *data1L, float *data1R)
 {
 	float32x4_t x1 = {lp->x1L, hp->x1L, lp->x1R, hp->x1R};
 	float32x4_t x2 = {lp->x2L, hp->x2L, lp->x2R, hp->x2R};
@@ -112,11 +120,14 @@ static void lr42_split(struct lr42 *lp, struct lr42 *hp, int count,
 	hp->z1L = z1[1]; hp->z1R = z1[3];
 	hp->z2L = z2[1]; hp->z2R = z2[3];
 }
-#elif defined(__SSE3__) && defined(__x86_64__)
+#endif
+
+#if defined(__x86_64__)
 #include <emmintrin.h>
-static void lr42_split(struct lr42 *lp, struct lr42 *hp, int count,
-		       float *data0L, float *data0R,
-		       float *data1L, float *data1R)
+__attribute__((target("sse3")))
+static void lr42_split_sse3(struct lr42 *lp, struct lr42 *hp, int count,
+			    float *data0L, float *data0R,
+			    float *data1L, float *data1R)
 {
 	__m128 x1 = {lp->x1L, hp->x1L, lp->x1R, hp->x1R};
 	__m128 x2 = {lp->x2L, hp->x2L, lp->x2R, hp->x2R};
@@ -215,7 +226,8 @@ static void lr42_split(struct lr42 *lp, struct lr42 *hp, int count,
 	hp->z1L = z1[1]; hp->z1R = z1[3];
 	hp->z2L = z2[1]; hp->z2R = z2[3];
 }
-#else
+#endif
+
 static void lr42_split(struct lr42 *lp, struct lr42 *hp, int count,
 		       float *data0L, float *data0R,
 		       float *data1L, float *data1R)
@@ -302,7 +314,6 @@ static void lr42_split(struct lr42 *lp, struct lr42 *hp, int count,
 	hp->z1L = hz1L;	hp->z1R = hz1R;
 	hp->z2L = hz2L;	hp->z2R = hz2R;
 }
-#endif
 
 /* Split input data using two LR4 filters and sum them back to the original
  * data array.
@@ -313,8 +324,8 @@ static void lr42_split(struct lr42 *lp, struct lr42 *hp, int count,
  */
 #if defined(__ARM_NEON__)
 #include <arm_neon.h>
-static void lr42_merge(struct lr42 *lp, struct lr42 *hp, int count,
-		       float *dataL, float *dataR)
+static void lr42_merge_neon(struct lr42 *lp, struct lr42 *hp, int count,
+			    float *dataL, float *dataR)
 {
 	float32x4_t x1 = {lp->x1L, hp->x1L, lp->x1R, hp->x1R};
 	float32x4_t x2 = {lp->x2L, hp->x2L, lp->x2R, hp->x2R};
@@ -391,10 +402,13 @@ static void lr42_merge(struct lr42 *lp, struct lr42 *hp, int count,
 	hp->z1L = z1[1]; hp->z1R = z1[3];
 	hp->z2L = z2[1]; hp->z2R = z2[3];
 }
-#elif defined(__SSE3__) && defined(__x86_64__)
+#endif
+
+#if defined(__x86_64__)
 #include <emmintrin.h>
-static void lr42_merge(struct lr42 *lp, struct lr42 *hp, int count,
-		       float *dataL, float *dataR)
+__attribute__((target("sse3")))
+static void lr42_merge_sse3(struct lr42 *lp, struct lr42 *hp, int count,
+			    float *dataL, float *dataR)
 {
 	__m128 x1 = {lp->x1L, hp->x1L, lp->x1R, hp->x1R};
 	__m128 x2 = {lp->x2L, hp->x2L, lp->x2R, hp->x2R};
@@ -486,7 +500,8 @@ static void lr42_merge(struct lr42 *lp, struct lr42 *hp, int count,
 	hp->z1L = z1[1]; hp->z1R = z1[3];
 	hp->z2L = z2[1]; hp->z2R = z2[3];
 }
-#else
+#endif
+
 static void lr42_merge(struct lr42 *lp, struct lr42 *hp, int count,
 		       float *dataL, float *dataR)
 {
@@ -570,8 +585,252 @@ static void lr42_merge(struct lr42 *lp, struct lr42 *hp, int count,
 	hp->z1L = hz1L;	hp->z1R = hz1R;
 	hp->z2L = hz2L;	hp->z2R = hz2R;
 }
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+/* Runs both stages of the lp and hp filters with AVX2, as a pipeline: lanes
+ * 0 to 3 run the first stage of {lpL, hpL, lpR, hpR} on sample i, and lanes
+ * 4 to 7 the second stage of the same filters on sample i - 1, which is fed
+ * the output of the first stage one step before. So the loop takes one more
+ * step than there are samples, and the first and last steps only update the
+ * stage which has a sample. Each lane sums the same products in the same
+ * order as the C code, so the output is the same.
+ *
+ * It splits the input like lr42_split(), or sums the two outputs back into
+ * data0L and data0R like lr42_merge() if data1L is NULL.
+ */
+__attribute__((target("avx2")))
+static inline void lr42_process_avx2(struct lr42 *lp, struct lr42 *hp,
+				     int count, float *data0L, float *data0R,
+				     float *data1L, float *data1R)
+{
+	__m256 in1 = _mm256_setr_ps(lp->x1L, hp->x1L, lp->x1R, hp->x1R,
+				    lp->y1L, hp->y1L, lp->y1R, hp->y1R);
+	__m256 in2 = _mm256_setr_ps(lp->x2L, hp->x2L, lp->x2R, hp->x2R,
+				    lp->y2L, hp->y2L, lp->y2R, hp->y2R);
+	__m256 out1 = _mm256_setr_ps(lp->y1L, hp->y1L, lp->y1R, hp->y1R,
+				     lp->z1L, hp->z1L, lp->z1R, hp->z1R);
+	__m256 out2 = _mm256_setr_ps(lp->y2L, hp->y2L, lp->y2R, hp->y2R,
+				     lp->z2L, hp->z2L, lp->z2R, hp->z2R);
+	__m256 b0 = _mm256_setr_ps(lp->b0, hp->b0, lp->b0, hp->b0,
+				   lp->b0, hp->b0, lp->b0, hp->b0);
+	__m256 b1 = _mm256_setr_ps(lp->b1, hp->b1, lp->b1, hp->b1,
+				   lp->b1, hp->b1, lp->b1, hp->b1);
+	__m256 b2 = _mm256_setr_ps(lp->b2, hp->b2, lp->b2, hp->b2,
+				   lp->b2, hp->b2, lp->b2, hp->b2);
+	__m256 a1 = _mm256_setr_ps(lp->a1, hp->a1, lp->a1, hp->a1,
+				   lp->a1, hp->a1, lp->a1, hp->a1);
+	__m256 a2 = _mm256_setr_ps(lp->a2, hp->a2, lp->a2, hp->a2,
+				   lp->a2, hp->a2, lp->a2, hp->a2);
+	__m256 in, out = _mm256_setzero_ps();
+	float s[8] __attribute__ ((aligned (32)));
+	int i;
+
+	for (i = 0; i <= count; i++) {
+		__m128 x = _mm_setzero_ps();
+
+		if (i < count)
+			x = _mm_setr_ps(data0L[i], data0L[i],
+					data0R[i], data0R[i]);
+		in = _mm256_insertf128_ps(_mm256_castps128_ps256(x),
+					  _mm256_castps256_ps128(out), 1);
+		out = _mm256_mul_ps(b0, in);
+		out = _mm256_add_ps(out, _mm256_mul_ps(b1, in1));
+		out = _mm256_add_ps(out, _mm256_mul_ps(b2, in2));
+		out = _mm256_sub_ps(out, _mm256_mul_ps(a1, out1));
+		out = _mm256_sub_ps(out, _mm256_mul_ps(a2, out2));
+
+		if (i > 0 && i < count) {
+			in2 = in1;
+			in1 = in;
+			out2 = out1;
+			out1 = out;
+		} else if (i == 0) {
+			/* Only the first stage has a sample. The blend masks
+			 * must be constants, even without optimization. */
+			in2 = _mm256_blend_ps(in2, in1, 0x0f);
+			in1 = _mm256_blend_ps(in1, in, 0x0f);
+			out2 = _mm256_blend_ps(out2, out1, 0x0f);
+			out1 = _mm256_blend_ps(out1, out, 0x0f);
+		} else {
+			/* Only the second stage has a sample. */
+			in2 = _mm256_blend_ps(in2, in1, 0xf0);
+			in1 = _mm256_blend_ps(in1, in, 0xf0);
+			out2 = _mm256_blend_ps(out2, out1, 0xf0);
+			out1 = _mm256_blend_ps(out1, out, 0xf0);
+		}
+
+		if (i == 0)
+			continue;
+		_mm256_store_ps(s, out);
+		if (data1L) {
+			data0L[i - 1] = s[4];
+			data1L[i - 1] = s[5];
+			data0R[i - 1] = s[6];
+			data1R[i - 1] = s[7];
+		} else {
+			data0L[i - 1] = s[5] + s[4];
+			data0R[i - 1] = s[7] + s[6];
+		}
+	}
+
+	_mm256_store_ps(s, in1);
+	lp->x1L = s[0]; hp->x1L = s[1]; lp->x1R = s[2]; hp->x1R = s[3];
+	_mm256_store_ps(s, in2);
+	lp->x2L = s[0]; hp->x2L = s[1]; lp->x2R = s[2]; hp->x2R = s[3];
+	_mm256_store_ps(s, out1);
+	lp->y1L = s[0]; hp->y1L = s[1]; lp->y1R = s[2]; hp->y1R = s[3];
+	lp->z1L = s[4]; hp->z1L = s[5]; lp->z1R = s[6]; hp->z1R = s[7];
+	_mm256_store_ps(s, out2);
+	lp->y2L = s[0]; hp->y2L = s[1]; lp->y2R = s[2]; hp->y2R = s[3];
+	lp->z2L = s[4]; hp->z2L = s[5]; lp->z2R = s[6]; hp->z2R = s[7];
+}
+
+__attribute__((target("avx2")))
+static void lr42_split_avx2(struct lr42 *lp, struct lr42 *hp, int count,
+			    float *data0L, float *data0R,
+			    float *data1L, float *data1R)
+{
+	lr42_process_avx2(lp, hp, count, data0L, data0R, data1L, data1R);
+}
+
+__attribute__((target("avx2")))
+static void lr42_merge_avx2(struct lr42 *lp, struct lr42 *hp, int count,
+			    float *dataL, float *dataR)
+{
+	lr42_process_avx2(lp, hp, count, dataL, dataR, NULL, NULL);
+}
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+/* Runs both stages of the lp and hp filters with ASIMD, as a pipeline like
+ * lr42_process_avx2(): the lanes of y run the first stage of {lpL, hpL, lpR,
+ * hpR} on sample i, and those of z the second stage on sample i - 1. The two
+ * stages are independent within a step, and their products are summed with
+ * fused multiply-adds.
+ *
+ * It splits the input like lr42_split(), or sums the two outputs back into
+ * data0L and data0R like lr42_merge() if data1L is NULL.
+ */
+static inline void lr42_process_asimd(struct lr42 *lp, struct lr42 *hp,
+				      int count, float *data0L, float *data0R,
+				      float *data1L, float *data1R)
+{
+	float32x4_t x1 = {lp->x1L, hp->x1L, lp->x1R, hp->x1R};
+	float32x4_t x2 = {lp->x2L, hp->x2L, lp->x2R, hp->x2R};
+	float32x4_t y1 = {lp->y1L, hp->y1L, lp->y1R, hp->y1R};
+	float32x4_t y2 = {lp->y2L, hp->y2L, lp->y2R, hp->y2R};
+	float32x4_t z1 = {lp->z1L, hp->z1L, lp->z1R, hp->z1R};
+	float32x4_t z2 = {lp->z2L, hp->z2L, lp->z2R, hp->z2R};
+	float32x4_t b0 = {lp->b0, hp->b0, lp->b0, hp->b0};
+	float32x4_t b1 = {lp->b1, hp->b1, lp->b1, hp->b1};
+	float32x4_t b2 = {lp->b2, hp->b2, lp->b2, hp->b2};
+	float32x4_t a1 = {lp->a1, hp->a1, lp->a1, hp->a1};
+	float32x4_t a2 = {lp->a2, hp->a2, lp->a2, hp->a2};
+	/* The input of the second stage lags one sample behind y1 and y2. */
+	float32x4_t w1 = y1, w2 = y2;
+	float32x4_t x, y, z;
+	int i;
+
+	for (i = 0; i <= count; i++) {
+		if (i > 0) {
+			z = vmulq_f32(b0, y1);
+			z = vfmaq_f32(z, b1, w1);
+			z = vfmaq_f32(z, b2, w2);
+			z = vfmsq_f32(z, a1, z1);
+			z = vfmsq_f32(z, a2, z2);
+			w2 = w1;
+			w1 = y1;
+			z2 = z1;
+			z1 = z;
+			if (data1L) {
+				data0L[i - 1] = vgetq_lane_f32(z, 0);
+				data1L[i - 1] = vgetq_lane_f32(z, 1);
+				data0R[i - 1] = vgetq_lane_f32(z, 2);
+				data1R[i - 1] = vgetq_lane_f32(z, 3);
+			} else {
+				float32x2_t s = vpadd_f32(vget_low_f32(z),
+							  vget_high_f32(z));
+				data0L[i - 1] = vget_lane_f32(s, 0);
+				data0R[i - 1] = vget_lane_f32(s, 1);
+			}
+		}
+		if (i < count) {
+			x = vcombine_f32(vdup_n_f32(data0L[i]),
+					 vdup_n_f32(data0R[i]));
+			y = vmulq_f32(b0, x);
+			y = vfmaq_f32(y, b1, x1);
+			y = vfmaq_f32(y, b2, x2);
+			y = vfmsq_f32(y, a1, y1);
+			y = vfmsq_f32(y, a2, y2);
+			x2 = x1;
+			x1 = x;
+			y2 = y1;
+			y1 = y;
+		}
+	}
+
+	lp->x1L = vgetq_lane_f32(x1, 0); hp->x1L = vgetq_lane_f32(x1, 1);
+	lp->x1R = vgetq_lane_f32(x1, 2); hp->x1R = vgetq_lane_f32(x1, 3);
+	lp->x2L = vgetq_lane_f32(x2, 0); hp->x2L = vgetq_lane_f32(x2, 1);
+	lp->x2R = vgetq_lane_f32(x2, 2); hp->x2R = vgetq_lane_f32(x2, 3);
+	lp->y1L = vgetq_lane_f32(y1, 0); hp->y1L = vgetq_lane_f32(y1, 1);
+	lp->y1R = vgetq_lane_f32(y1, 2); hp->y1R = vgetq_lane_f32(y1, 3);
+	lp->y2L = vgetq_lane_f32(y2, 0); hp->y2L = vgetq_lane_f32(y2, 1);
+	lp->y2R = vgetq_lane_f32(y2, 2); hp->y2R = vgetq_lane_f32(y2, 3);
+	lp->z1L = vgetq_lane_f32(z1, 0); hp->z1L = vgetq_lane_f32(z1, 1);
+	lp->z1R = vgetq_lane_f32(z1, 2); hp->z1R = vgetq_lane_f32(z1, 3);
+	lp->z2L = vgetq_lane_f32(z2, 0); hp->z2L = vgetq_lane_f32(z2, 1);
+	lp->z2R = vgetq_lane_f32(z2, 2); hp->z2R = vgetq_lane_f32(z2, 3);
+}
+
+static void lr42_split_asimd(struct lr42 *lp, struct lr42 *hp, int count,
+			     float *data0L, float *data0R,
+			     float *data1L, float *data1R)
+{
+	lr42_process_asimd(lp, hp, count, data0L, data0R, data1L, data1R);
+}
+
+static void lr42_merge_asimd(struct lr42 *lp, struct lr42 *hp, int count,
+			     float *dataL, float *dataR)
+{
+	lr42_process_asimd(lp, hp, count, dataL, dataR, NULL, NULL);
+}
 #endif
 
+/* Moves the coefficients of an LR4 filter one step of steps to those of
+ * target, as biquad_step_to() does. */
+static void lr42_step_to(struct lr42 *lr42, const struct lr42 *target,
+			 int steps)
+{
+	if (steps <= 1) {
+		lr42->b0 = target->b0;
+		lr42->b1 = target->b1;
+		lr42->b2 = target->b2;
+		lr42->a1 = target->a1;
+		lr42->a2 = target->a2;
+		return;
+	}
+	lr42->b0 += (target->b0 - lr42->b0) / steps;
+	lr42->b1 += (target->b1 - lr42->b1) / steps;
+	lr42->b2 += (target->b2 - lr42->b2) / steps;
+	lr42->a1 += (target->a1 - lr42->a1) / steps;
+	lr42->a2 += (target->a2 - lr42->a2) / steps;
+}
+
+/* Moves all filters one step to their targets. */
+static void crossover2_step_fade(struct crossover2 *xo2)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		lr42_step_to(&xo2->lp[i], &xo2->lp_target[i], xo2->fade_steps);
+		lr42_step_to(&xo2->hp[i], &xo2->hp_target[i], xo2->fade_steps);
+	}
+	xo2->fade_steps--;
+}
+
 void crossover2_init(struct crossover2 *xo2, float freq1, float freq2)
 {
 	int i;
@@ -579,7 +838,43 @@ void crossover2_init(struct crossover2 *xo2, float freq1, float freq2)
 		float f = (i == 0) ? freq1 : freq2;
 		lr42_set(&xo2->lp[i], BQ_LOWPASS, f);
 		lr42_set(&xo2->hp[i], BQ_HIGHPASS, f);
+		xo2->lp_target[i] = xo2->lp[i];
+		xo2->hp_target[i] = xo2->hp[i];
 	}
+	xo2->fade_steps = 0;
+}
+
+void crossover2_set_freqs(struct crossover2 *xo2, float freq1, float freq2,
+			  int fade_frames)
+{
+	int i;
+	for (i = 0; i < 3; i++) {
+		float f = (i == 0) ? freq1 : freq2;
+		lr42_set_coefficients(&xo2->lp_target[i], BQ_LOWPASS, f);
+		lr42_set_coefficients(&xo2->hp_target[i], BQ_HIGHPASS, f);
+	}
+	xo2->fade_steps = biquad_fade_steps(fade_frames);
+	if (!xo2->fade_steps) {
+		xo2->fade_steps = 1;
+		crossover2_step_fade(xo2);
+	}
+}
+
+static void crossover2_process_chunk(struct crossover2 *xo2, int count,
+				     float *data0L, float *data0R,
+				     float *data1L, float *data1R,
+				     float *data2L, float *data2R)
+{
+	const struct dsp_kernels *k = dsp_get_kernels();
+
+	if (!count)
+		return;
+
+	k->lr42_split(&xo2->lp[0], &xo2->hp[0], count, data0L, data0R,
+		      data1L, data1R);
+	k->lr42_merge(&xo2->lp[1], &xo2->hp[1], count, data0L, data0R);
+	k->lr42_split(&xo2->lp[2], &xo2->hp[2], count, data1L, data1R,
+		      data2L, data2R);
 }
 
 void crossover2_process(struct crossover2 *xo2, int count,
@@ -587,12 +882,51 @@ void crossover2_process(struct crossover2 *xo2, int count,
 			float *data1L, float *data1R,
 			float *data2L, float *data2R)
 {
-	if (!count)
-		return;
+	/* While fading, change the coefficients every BIQUAD_FADE_FRAMES
+	 * frames, as eq2_process() does. */
+	while (xo2->fade_steps > 0 && count > 0) {
+		int chunk = count < BIQUAD_FADE_FRAMES ?
+			count : BIQUAD_FADE_FRAMES;
+		crossover2_step_fade(xo2);
+		crossover2_process_chunk(xo2, chunk, data0L, data0R, data1L,
+					 data1R, data2L, data2R);
+		data0L += chunk;
+		data0R += chunk;
+		data1L += chunk;
+		data1R += chunk;
+		data2L += chunk;
+		data2R += chunk;
+		count -= chunk;
+	}
+	crossover2_process_chunk(xo2, count, data0L, data0R, data1L, data1R,
+				 data2L, data2R);
+}
 
-	lr42_split(&xo2->lp[0], &xo2->hp[0], count, data0L, data0R,
-		   data1L, data1R);
-	lr42_merge(&xo2->lp[1], &xo2->hp[1], count, data0L, data0R);
-	lr42_split(&xo2->lp[2], &xo2->hp[2], count, data1L, data1R,
-		   data2L, data2R);
+void crossover2_select_kernels(struct dsp_kernels *kernels,
+			       unsigned int features)
+{
+	kernels->lr42_split = lr42_split;
+	kernels->lr42_merge = lr42_merge;
+#if defined(__ARM_NEON__)
+	if (features & DSP_CPU_NEON) {
+		kernels->lr42_split = lr42_split_neon;
+		kernels->lr42_merge = lr42_merge_neon;
+	}
+#endif
+#if defined(__aarch64__)
+	if (features & DSP_CPU_ASIMD) {
+		kernels->lr42_split = lr42_split_asimd;
+		kernels->lr42_merge = lr42_merge_asimd;
+	}
+#endif
+#if defined(__x86_64__)
+	if (features & DSP_CPU_SSE3) {
+		kernels->lr42_split = lr42_split_sse3;
+		kernels->lr42_merge = lr42_merge_sse3;
+	}
+	if (features & DSP_CPU_AVX2) {
+		kernels->lr42_split = lr42_split_avx2;
+		kernels->lr42_merge = lr42_merge_avx2;
+	}
+#endif
 }
@@ -45,6 +45,10 @@ struct lr42 {
  */
 struct crossover2 {
 	struct lr42 lp[3], hp[3];
+	/* The coefficients the filters fade to after crossover2_set_freqs(),
+	 * and the number of steps of BIQUAD_FADE_FRAMES left. */
+	struct lr42 lp_target[3], hp_target[3];
+	int fade_steps;
 };
 
 /* Initializes a crossover2 filter
@@ -55,6 +59,20 @@ struct crossover2 {
  */
 void crossover2_init(struct crossover2 *xo2, float freq1, float freq2);
 
+/* Changes the frequencies of a crossover2 filter which is running. Unlike
+ * crossover2_init(), the state of the filters is kept, so the bands do not
+ * restart from silence, and the coefficients move to the new ones in steps
+ * as those of an EQ2 do, so the change does not click.
+ * Args:
+ *    xo2 - The crossover2 filter to change.
+ *    freq1 - The normalized frequency splits low and mid band.
+ *    freq2 - The normalized frequency splits mid and high band.
+ *    fade_frames - The number of frames the change takes, 0 to change at
+ *        once.
+ */
+void crossover2_set_freqs(struct crossover2 *xo2, float freq1, float freq2,
+			  int fade_frames);
+
 /* Splits input samples to three bands.
  * Args:
  *    xo2 - The crossover2 filter to use.
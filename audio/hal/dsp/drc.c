@@ -10,22 +10,31 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "drc.h"
 #include "drc_math.h"
+#include "dsp_cpu.h"
+#include "dsp_kernels.h"
 
 static void set_default_parameters(struct drc *drc);
-static void init_data_buffer(struct drc *drc);
 static void init_emphasis_eq(struct drc *drc);
 static void init_crossover(struct drc *drc);
 static void init_kernel(struct drc *drc);
-static void free_data_buffer(struct drc *drc);
+static void set_kernel_parameters(struct drc *drc, int i);
 static void free_emphasis_eq(struct drc *drc);
 static void free_kernel(struct drc *drc);
 
 struct drc *drc_new(float sample_rate)
 {
-	struct drc *drc = (struct drc *)calloc(1, sizeof(struct drc));
+	return drc_new_in_arena(NULL, sample_rate);
+}
+
+struct drc *drc_new_in_arena(struct dsp_arena *arena, float sample_rate)
+{
+	struct drc *drc = (struct drc *)dsp_arena_calloc(arena,
+							 sizeof(struct drc));
+	drc->arena = arena;
 	drc->sample_rate = sample_rate;
 	set_default_parameters(drc);
 	return drc;
@@ -33,41 +42,36 @@ struct drc *drc_new(float sample_rate)
 
 void drc_init(struct drc *drc)
 {
-	init_data_buffer(drc);
 	init_emphasis_eq(drc);
 	init_crossover(drc);
 	init_kernel(drc);
 }
 
-void drc_free(struct drc *drc)
-{
-	free_kernel(drc);
-	free_emphasis_eq(drc);
-	free_data_buffer(drc);
-	free(drc);
-}
-
-/* Allocates temporary buffers used during drc_process(). */
-static void init_data_buffer(struct drc *drc)
+void drc_update_params(struct drc *drc, int fade_frames)
 {
+	float freq1 = drc->parameters[1][PARAM_CROSSOVER_LOWER_FREQ];
+	float freq2 = drc->parameters[2][PARAM_CROSSOVER_LOWER_FREQ];
 	int i;
-	size_t size = sizeof(float) * DRC_PROCESS_MAX_FRAMES;
 
-	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
-		drc->data1[i] = (float *)calloc(1, size);
-		drc->data2[i] = (float *)calloc(1, size);
+	crossover2_set_freqs(&drc->xo2, freq1, freq2, fade_frames);
+	for (i = 0; i < DRC_NUM_KERNELS; i++) {
+		float from_gain = drc->kernel[i].master_linear_gain;
+		set_kernel_parameters(drc, i);
+		dk_ramp_master_gain(&drc->kernel[i], from_gain, fade_frames);
 	}
 }
 
-/* Frees temporary buffers */
-static void free_data_buffer(struct drc *drc)
+void drc_free(struct drc *drc)
 {
-	int i;
+	free_kernel(drc);
+	free_emphasis_eq(drc);
+	dsp_arena_release(drc->arena, drc);
+}
 
-	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
-		free(drc->data1[i]);
-		free(drc->data2[i]);
-	}
+size_t drc_arena_size()
+{
+	return dsp_arena_size(sizeof(struct drc)) + 2 * eq2_arena_size() +
+		DRC_NUM_KERNELS * dk_arena_size();
 }
 
 void drc_set_param(struct drc *drc, int index, unsigned paramID, float value)
@@ -108,6 +112,8 @@ static void set_default_parameters(struct drc *drc)
 		 * signal */
 		param[PARAM_POST_GAIN] = 0; /* dB */
 		param[PARAM_ENABLED] = 0;
+		param[PARAM_DETECTOR] = DK_DETECTOR_LINKED;
+		param[PARAM_RMS_WINDOW] = 0.01f; /* seconds */
 	}
 
 	drc->parameters[0][PARAM_CROSSOVER_LOWER_FREQ] = 0;
@@ -174,12 +180,16 @@ static void init_emphasis_eq(struct drc *drc)
 	struct biquad d;
 	int i, j;
 
+	/* Only the coefficients are calculated below, start from zero state. */
+	memset(&e, 0, sizeof(e));
+	memset(&d, 0, sizeof(d));
+
 	float stage_gain = drc_get_param(drc, 0, PARAM_FILTER_STAGE_GAIN);
 	float stage_ratio = drc_get_param(drc, 0, PARAM_FILTER_STAGE_RATIO);
 	float anchor_freq = drc_get_param(drc, 0,  PARAM_FILTER_ANCHOR);
 
-	drc->emphasis_eq = eq2_new();
-	drc->deemphasis_eq = eq2_new();
+	drc->emphasis_eq = eq2_new_in_arena(drc->arena);
+	drc->deemphasis_eq = eq2_new_in_arena(drc->arena);
 
 	for (i = 0; i < 2; i++) {
 		emphasis_stage_pair_biquads(stage_gain, anchor_freq,
@@ -209,42 +219,55 @@ static void init_crossover(struct drc *drc)
 	crossover2_init(&drc->xo2, freq1, freq2);
 }
 
+/* Sets the parameters of a compressor kernel from the DRC parameters */
+static void set_kernel_parameters(struct drc *drc, int i)
+{
+	float db_threshold = drc_get_param(drc, i, PARAM_THRESHOLD);
+	float db_knee = drc_get_param(drc, i, PARAM_KNEE);
+	float ratio = drc_get_param(drc, i, PARAM_RATIO);
+	float attack_time = drc_get_param(drc, i, PARAM_ATTACK);
+	float release_time = drc_get_param(drc, i, PARAM_RELEASE);
+	float pre_delay_time = drc_get_param(drc, i, PARAM_PRE_DELAY);
+	float releaseZone1 = drc_get_param(drc, i, PARAM_RELEASE_ZONE1);
+	float releaseZone2 = drc_get_param(drc, i, PARAM_RELEASE_ZONE2);
+	float releaseZone3 = drc_get_param(drc, i, PARAM_RELEASE_ZONE3);
+	float releaseZone4 = drc_get_param(drc, i, PARAM_RELEASE_ZONE4);
+	float db_post_gain = drc_get_param(drc, i, PARAM_POST_GAIN);
+	int enabled = drc_get_param(drc, i, PARAM_ENABLED);
+	int detector = drc_get_param(drc, i, PARAM_DETECTOR);
+	float rms_window = drc_get_param(drc, i, PARAM_RMS_WINDOW);
+
+	dk_set_parameters(&drc->kernel[i],
+			  db_threshold,
+			  db_knee,
+			  ratio,
+			  attack_time,
+			  release_time,
+			  pre_delay_time,
+			  db_post_gain,
+			  releaseZone1,
+			  releaseZone2,
+			  releaseZone3,
+			  releaseZone4
+		);
+
+	dk_set_enabled(&drc->kernel[i], enabled);
+	dk_set_detector(&drc->kernel[i], detector, rms_window);
+}
+
 /* Initializes the compressor kernels */
 static void init_kernel(struct drc *drc)
 {
 	int i;
 
 	for (i = 0; i < DRC_NUM_KERNELS; i++) {
-		dk_init(&drc->kernel[i], drc->sample_rate);
-
-		float db_threshold = drc_get_param(drc, i, PARAM_THRESHOLD);
-		float db_knee = drc_get_param(drc, i, PARAM_KNEE);
-		float ratio = drc_get_param(drc, i, PARAM_RATIO);
-		float attack_time = drc_get_param(drc, i, PARAM_ATTACK);
-		float release_time = drc_get_param(drc, i, PARAM_RELEASE);
-		float pre_delay_time = drc_get_param(drc, i, PARAM_PRE_DELAY);
-		float releaseZone1 = drc_get_param(drc, i, PARAM_RELEASE_ZONE1);
-		float releaseZone2 = drc_get_param(drc, i, PARAM_RELEASE_ZONE2);
-		float releaseZone3 = drc_get_param(drc, i, PARAM_RELEASE_ZONE3);
-		float releaseZone4 = drc_get_param(drc, i, PARAM_RELEASE_ZONE4);
-		float db_post_gain = drc_get_param(drc, i, PARAM_POST_GAIN);
-		int enabled = drc_get_param(drc, i, PARAM_ENABLED);
-
-		dk_set_parameters(&drc->kernel[i],
-				  db_threshold,
-				  db_knee,
-				  ratio,
-				  attack_time,
-				  release_time,
-				  pre_delay_time,
-				  db_post_gain,
-				  releaseZone1,
-				  releaseZone2,
-				  releaseZone3,
-				  releaseZone4
-			);
-
-		dk_set_enabled(&drc->kernel[i], enabled);
+		dk_init_in_arena(&drc->kernel[i], drc->arena,
+				 drc->sample_rate);
+		/* Keep the channels interleaved in the pre-delay buffer, so
+		 * a shared gain is applied to both in one pass. The other
+		 * detectors read the frames from it too. */
+		dk_set_interleaved(&drc->kernel[i], 1);
+		set_kernel_parameters(drc, i);
 	}
 }
 
@@ -258,7 +281,7 @@ static void free_kernel(struct drc *drc)
 
 #if defined(__ARM_NEON__)
 #include <arm_neon.h>
-static void sum3(float *data, float *data1, float *data2, int n)
+static void sum3_neon(float *data, float *data1, float *data2, int n)
 {
 	float32x4_t x, y, z;
 	int count = n / 4;
@@ -297,9 +320,12 @@ static void sum3(float *data, float *data1, float *data2, int n)
 	for (i = 0; i < n; i++)
 		data[i] += data1[i] + data2[i];
 }
-#elif defined(__SSE3__)
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
 #include <emmintrin.h>
-static void sum3(float *data, float *data1, float *data2, int n)
+__attribute__((target("sse3")))
+static void sum3_sse3(float *data, float *data1, float *data2, int n)
 {
 	__m128 x, y, z;
 	int count = n / 4;
@@ -341,20 +367,74 @@ static void sum3(float *data, float *data1, float *data2, int n)
 	for (i = 0; i < n; i++)
 		data[i] += data1[i] + data2[i];
 }
-#else
+#endif
+
 static void sum3(float *data, float *data1, float *data2, int n)
 {
 	int i;
 	for (i = 0; i < n; i++)
 		data[i] += data1[i] + data2[i];
 }
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+__attribute__((target("avx2")))
+static void sum3_avx2(float *data, float *data1, float *data2, int n)
+{
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_add_ps(_mm256_loadu_ps(data1 + i),
+					 _mm256_loadu_ps(data2 + i));
+		_mm256_storeu_ps(data + i,
+				 _mm256_add_ps(_mm256_loadu_ps(data + i), x));
+	}
+	for (; i < n; i++)
+		data[i] += data1[i] + data2[i];
+}
+
+/* The last frames are summed with a mask rather than one by one. */
+__attribute__((target("avx512f")))
+static void sum3_avx512(float *data, float *data1, float *data2, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i += 16) {
+		__mmask16 m = n - i >= 16 ? 0xffff : (1 << (n - i)) - 1;
+		__m512 x = _mm512_add_ps(_mm512_maskz_loadu_ps(m, data1 + i),
+					 _mm512_maskz_loadu_ps(m, data2 + i));
+		_mm512_mask_storeu_ps(data + i, m, _mm512_add_ps(
+			_mm512_maskz_loadu_ps(m, data + i), x));
+	}
+}
 #endif
 
-void drc_process(struct drc *drc, float **data, int frames)
+void drc_select_kernels(struct dsp_kernels *kernels, unsigned int features)
 {
+	kernels->sum3 = sum3;
+#if defined(__ARM_NEON__)
+	if (features & DSP_CPU_NEON)
+		kernels->sum3 = sum3_neon;
+#endif
+#if defined(__i386__) || defined(__x86_64__)
+	if (features & DSP_CPU_SSE3)
+		kernels->sum3 = sum3_sse3;
+#endif
+#if defined(__x86_64__)
+	if (features & DSP_CPU_AVX2)
+		kernels->sum3 = sum3_avx2;
+	if (features & DSP_CPU_AVX512F)
+		kernels->sum3 = sum3_avx512;
+#endif
+}
+
+/* Runs all the stages on one tile of at most DRC_TILE_FRAMES frames. */
+static void drc_process_tile(struct drc *drc, float **data, int frames)
+{
+	const struct dsp_kernels *k = dsp_get_kernels();
 	int i;
-	float **data1 = drc->data1;
-	float **data2 = drc->data2;
+	float *data1[DRC_NUM_CHANNELS] = { drc->data1[0], drc->data1[1] };
+	float *data2[DRC_NUM_CHANNELS] = { drc->data2[0], drc->data2[1] };
 
 	/* Apply pre-emphasis filter if it is not disabled. */
 	if (!drc->emphasis_disabled)
@@ -373,9 +453,33 @@ void drc_process(struct drc *drc, float **data, int frames)
 
 	/* Sum the three bands of signal */
 	for (i = 0; i < DRC_NUM_CHANNELS; i++)
-		sum3(data[i], data1[i], data2[i], frames);
+		k->sum3(data[i], data1[i], data2[i], frames);
 
 	/* Apply de-emphasis filter if emphasis is not disabled. */
 	if (!drc->emphasis_disabled)
 		eq2_process(drc->deemphasis_eq, data[0], data[1], frames);
 }
+
+void drc_process(struct drc *drc, float **data, int frames)
+{
+	float *tile[DRC_NUM_CHANNELS];
+	int start, chunk, i;
+
+	for (start = 0; start < frames; start += chunk) {
+		chunk = min(DRC_TILE_FRAMES, frames - start);
+		for (i = 0; i < DRC_NUM_CHANNELS; i++)
+			tile[i] = data[i] + start;
+		drc_process_tile(drc, tile, chunk);
+	}
+}
+
+int drc_get_delay_frames(const struct drc *drc)
+{
+	unsigned delay = 0;
+	int i;
+
+	/* The bands are summed, so the output is as late as the latest. */
+	for (i = 0; i < DRC_NUM_KERNELS; i++)
+		delay = max(delay, drc->kernel[i].last_pre_delay_frames);
+	return delay;
+}
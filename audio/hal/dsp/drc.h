@@ -76,6 +76,10 @@ extern "C" {
  * PARAM_CROSSOVER_LOWER_FREQ - The lower frequency of the band, in normalized
  *     frequency (in [0, 1], relative to half of the sample rate).
  * PARAM_ENABLED - 1 to enable the compressor, 0 to disable it.
+ * PARAM_DETECTOR - How the compressor measures the level, one of enum
+ *     dk_detector.
+ * PARAM_RMS_WINDOW - The time the DK_DETECTOR_RMS detector averages over, in
+ *     seconds.
  */
 enum {
 	PARAM_THRESHOLD,
@@ -94,6 +98,8 @@ enum {
 	PARAM_FILTER_ANCHOR,
 	PARAM_CROSSOVER_LOWER_FREQ,
 	PARAM_ENABLED,
+	PARAM_DETECTOR,
+	PARAM_RMS_WINDOW,
 	PARAM_LAST
 };
 
@@ -103,6 +109,14 @@ enum {
 /* The maximum number of frames can be passed to drc_process() call. */
 #define DRC_PROCESS_MAX_FRAMES 2048
 
+/* drc_process() runs all the stages (emphasis, crossover, compression, band
+ * sum and deemphasis) on one tile of this many frames before moving to the
+ * next tile, so the signal of all three bands stays in L1 cache between the
+ * stages. It is the same as the division size of the compressor kernels, so
+ * each full tile completes exactly one kernel division. The output is
+ * bit-exact with running each stage over the whole block. */
+#define DRC_TILE_FRAMES 32
+
 /* The default value of PARAM_PRE_DELAY in seconds. */
 #define DRC_DEFAULT_PRE_DELAY 0.006f
 
@@ -110,6 +124,9 @@ struct drc {
 	/* sample rate in Hz */
 	float sample_rate;
 
+	/* The arena the DRC and its filters come from, or NULL for the heap. */
+	struct dsp_arena *arena;
+
 	/* 1 to disable the emphasis and deemphasis, 0 to enable it. */
 	int emphasis_disabled;
 
@@ -127,10 +144,12 @@ struct drc {
 	struct drc_kernel kernel[DRC_NUM_KERNELS];
 
 	/* Temporary buffer used during drc_process(). The mid and high band
-	 * signal is stored in these buffers (the low band is stored in the
-	 * original input buffer). */
-	float *data1[DRC_NUM_CHANNELS];
-	float *data2[DRC_NUM_CHANNELS];
+	 * signal of the current tile is stored in these buffers (the low band
+	 * is stored in the original input buffer). */
+	float data1[DRC_NUM_CHANNELS][DRC_TILE_FRAMES]
+		__attribute__ ((aligned (16)));
+	float data2[DRC_NUM_CHANNELS][DRC_TILE_FRAMES]
+		__attribute__ ((aligned (16)));
 };
 
 /* DRC needs the parameters to be set before initialization. So drc_new() should
@@ -153,9 +172,32 @@ struct drc {
 /* Allocates a DRC. */
 struct drc *drc_new(float sample_rate);
 
+/* Allocates a DRC in memory from an arena. drc_init() then also takes the
+ * memory of the emphasis filters and the kernels from the arena. */
+struct drc *drc_new_in_arena(struct dsp_arena *arena, float sample_rate);
+
+/* Returns the arena space a DRC from drc_new_in_arena() takes after
+ * drc_init(). */
+size_t drc_arena_size();
+
 /* Initializes a DRC. */
 void drc_init(struct drc *drc);
 
+/* Applies the parameters set with drc_set_param() to a DRC which is running,
+ * without resetting it. The compressors keep their envelopes and lookahead,
+ * and their output gain moves to the new value over fade_frames frames. The
+ * crossover keeps its state and its coefficients move to the new frequencies
+ * over the same frames. A compressor which is enabled or disabled changes at
+ * once. A new PARAM_PRE_DELAY clears the lookahead
+ * and changes the delay of the DRC, so it should be left as it is.
+ * The emphasis parameters are only read by drc_init().
+ * Args:
+ *    drc - The DRC we want to use.
+ *    fade_frames - The number of frames the gain and crossover changes
+ *        take.
+ */
+void drc_update_params(struct drc *drc, int fade_frames);
+
 /* Frees a DRC.*/
 void drc_free(struct drc *drc);
 
@@ -169,6 +211,17 @@ void drc_free(struct drc *drc);
  */
 void drc_process(struct drc *drc, float **data, int frames);
 
+/* Returns the delay drc_process() adds to the signal, which is the
+ * lookahead of the kernels. The kernels round PARAM_PRE_DELAY down to
+ * whole divisions, so this can be less than the parameter asks for. It is
+ * only valid after drc_init().
+ * Args:
+ *    drc - The DRC we want to use.
+ * Returns:
+ *    The delay in frames.
+ */
+int drc_get_delay_frames(const struct drc *drc);
+
 /* Sets a parameter for the DRC.
  * Args:
  *    drc - The DRC we want to use.
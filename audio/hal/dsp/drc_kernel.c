@@ -14,6 +14,8 @@
 
 #include "drc_math.h"
 #include "drc_kernel.h"
+#include "dsp_cpu.h"
+#include "dsp_kernels.h"
 
 #define MAX_PRE_DELAY_FRAMES 1024U
 #define MAX_PRE_DELAY_FRAMES_MASK (MAX_PRE_DELAY_FRAMES - 1)
@@ -28,7 +30,20 @@
 const float uninitialized_value = -1;
 static int drc_math_initialized;
 
+/* Whether the detector of a kernel gives each signal its own gain. */
+static inline int dk_has_two_gains(const struct drc_kernel *dk)
+{
+	return dk->detector == DK_DETECTOR_UNLINKED ||
+		dk->detector == DK_DETECTOR_MID_SIDE;
+}
+
 void dk_init(struct drc_kernel *dk, float sample_rate)
+{
+	dk_init_in_arena(dk, NULL, sample_rate);
+}
+
+void dk_init_in_arena(struct drc_kernel *dk, struct dsp_arena *arena,
+		      float sample_rate)
 {
 	unsigned int i;
 
@@ -38,14 +53,22 @@ void dk_init(struct drc_kernel *dk, float sample_rate)
 	}
 
 	dk->sample_rate = sample_rate;
-	dk->detector_average = 0;
-	dk->compressor_gain = 1;
+	dk->arena = arena;
+	dk->detector = DK_DETECTOR_LINKED;
+	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
+		dk->gain[i].detector_average = 0;
+		dk->gain[i].compressor_gain = 1;
+		dk->gain[i].max_attack_compression_diff_db = -INFINITY;
+	}
+	dk->rms_divisions = 1;
+	dk->rms_index = 0;
+	memset(dk->rms_squares, 0, sizeof(dk->rms_squares));
 	dk->enabled = 0;
 	dk->processed = 0;
+	dk->interleaved = 0;
 	dk->last_pre_delay_frames = DEFAULT_PRE_DELAY_FRAMES;
 	dk->pre_delay_read_index = 0;
 	dk->pre_delay_write_index = DEFAULT_PRE_DELAY_FRAMES;
-	dk->max_attack_compression_diff_db = -INFINITY;
 	dk->ratio = uninitialized_value;
 	dk->slope = uninitialized_value;
 	dk->linear_threshold = uninitialized_value;
@@ -57,25 +80,37 @@ void dk_init(struct drc_kernel *dk, float sample_rate)
 
 	assert_on_compile_is_power_of_2(DIVISION_FRAMES);
 	assert_on_compile(DIVISION_FRAMES % 4 == 0);
-	/* Allocate predelay buffers */
+	/* Allocate predelay buffers. The buffers of all channels are carved
+	 * from one block, so the same memory can also be used as a single
+	 * interleaved buffer (see dk_set_interleaved). */
 	assert_on_compile_is_power_of_2(MAX_PRE_DELAY_FRAMES);
-	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
-		size_t size = sizeof(float) * MAX_PRE_DELAY_FRAMES;
-		dk->pre_delay_buffers[i] = (float *)calloc(1, size);
-	}
+	size_t size = sizeof(float) * MAX_PRE_DELAY_FRAMES * DRC_NUM_CHANNELS;
+	float *buf = (float *)dsp_arena_calloc(arena, size);
+	for (i = 0; i < DRC_NUM_CHANNELS; i++)
+		dk->pre_delay_buffers[i] = buf + i * MAX_PRE_DELAY_FRAMES;
+}
+
+size_t dk_arena_size()
+{
+	return dsp_arena_size(sizeof(float) * MAX_PRE_DELAY_FRAMES *
+			      DRC_NUM_CHANNELS);
 }
 
 void dk_free(struct drc_kernel *dk)
 {
-	unsigned int i;
-	for (i = 0; i < DRC_NUM_CHANNELS; ++i)
-		free(dk->pre_delay_buffers[i]);
+	dsp_arena_release(dk->arena, dk->pre_delay_buffers[0]);
+}
+
+/* Clears the samples in the pre-delay buffers of all channels. */
+static void clear_pre_delay_buffers(struct drc_kernel *dk)
+{
+	size_t size = sizeof(float) * MAX_PRE_DELAY_FRAMES * DRC_NUM_CHANNELS;
+	memset(dk->pre_delay_buffers[0], 0, size);
 }
 
 /* Sets the pre-delay (lookahead) buffer size */
 static void set_pre_delay_time(struct drc_kernel *dk, float pre_delay_time)
 {
-	unsigned int i;
 	/* Re-configure look-ahead section pre-delay if delay time has
 	 * changed. */
 	unsigned pre_delay_frames = pre_delay_time * dk->sample_rate;
@@ -93,10 +128,7 @@ static void set_pre_delay_time(struct drc_kernel *dk, float pre_delay_time)
 
 	if (dk->last_pre_delay_frames != pre_delay_frames) {
 		dk->last_pre_delay_frames = pre_delay_frames;
-		for (i = 0; i < DRC_NUM_CHANNELS; ++i) {
-			size_t size = sizeof(float) * MAX_PRE_DELAY_FRAMES;
-			memset(dk->pre_delay_buffers[i], 0, size);
-		}
+		clear_pre_delay_buffers(dk);
 
 		dk->pre_delay_read_index = 0;
 		dk->pre_delay_write_index = pre_delay_frames;
@@ -266,6 +298,8 @@ void dk_set_parameters(struct drc_kernel *dk,
 
 	dk->master_linear_gain = decibels_to_linear(db_post_gain) *
 		full_range_makeup_gain;
+	dk->master_linear_gain_target = dk->master_linear_gain;
+	dk->master_gain_steps = 0;
 
 	/* Attack parameters. */
 	attack_time = max(0.001f, attack_time);
@@ -313,13 +347,58 @@ void dk_set_parameters(struct drc_kernel *dk,
 	set_pre_delay_time(dk, pre_delay_time);
 }
 
+void dk_ramp_master_gain(struct drc_kernel *dk, float from_gain,
+			 unsigned frames)
+{
+	dk->master_linear_gain_target = dk->master_linear_gain;
+	dk->master_gain_steps = (frames + DIVISION_FRAMES - 1) /
+		DIVISION_FRAMES;
+	if (dk->master_gain_steps)
+		dk->master_linear_gain = from_gain;
+}
+
 void dk_set_enabled(struct drc_kernel *dk, int enabled)
 {
 	dk->enabled = enabled;
 }
 
-/* Updates the envelope_rate used for the next division */
-static void dk_update_envelope(struct drc_kernel *dk)
+void dk_set_detector(struct drc_kernel *dk, int detector, float rms_window)
+{
+	int divisions = (int)(rms_window * dk->sample_rate / DIVISION_FRAMES +
+			      0.5f);
+
+	if (detector < 0 || detector >= DK_DETECTOR_LAST)
+		detector = DK_DETECTOR_LINKED;
+	divisions = max(1, min(DK_MAX_RMS_DIVISIONS, divisions));
+
+	/* The second gain continues from the linked one, so the switch does
+	 * not jump. */
+	if (detector != dk->detector && !dk_has_two_gains(dk))
+		dk->gain[1] = dk->gain[0];
+	if (detector == DK_DETECTOR_RMS &&
+	    (dk->detector != DK_DETECTOR_RMS ||
+	     divisions != dk->rms_divisions)) {
+		memset(dk->rms_squares, 0, sizeof(dk->rms_squares));
+		dk->rms_index = 0;
+	}
+	dk->detector = detector;
+	dk->rms_divisions = divisions;
+}
+
+void dk_set_interleaved(struct drc_kernel *dk, int interleaved)
+{
+	interleaved = !!interleaved;
+	if (dk->interleaved == interleaved)
+		return;
+
+	/* The samples already in the buffer are in the wrong layout now, so
+	 * drop them. The read/write indices (and so the delay) are kept. */
+	dk->interleaved = interleaved;
+	clear_pre_delay_buffers(dk);
+}
+
+/* Updates the envelope_rate of a gain used for the next division */
+static void dk_update_envelope(struct drc_kernel *dk, struct dk_gain *g)
 {
 	const float kA = dk->kA;
 	const float kB = dk->kB;
@@ -329,7 +408,7 @@ static void dk_update_envelope(struct drc_kernel *dk)
 	const float attack_frames = dk->attack_frames;
 
 	/* Calculate desired gain */
-	float desired_gain = dk->detector_average;
+	float desired_gain = g->detector_average;
 
 	/* Pre-warp so we get desired_gain after sin() warp below. */
 	float scaled_desired_gain = warp_asinf(desired_gain);
@@ -342,16 +421,16 @@ static void dk_update_envelope(struct drc_kernel *dk)
 	 */
 	float envelope_rate;
 
-	int is_releasing = scaled_desired_gain > dk->compressor_gain;
+	int is_releasing = scaled_desired_gain > g->compressor_gain;
 
 	/* compression_diff_db is the difference between current compression
 	 * level and the desired level. */
 	float compression_diff_db = linear_to_decibels(
-		dk->compressor_gain / scaled_desired_gain);
+		g->compressor_gain / scaled_desired_gain);
 
 	if (is_releasing) {
 		/* Release mode - compression_diff_db should be negative dB */
-		dk->max_attack_compression_diff_db = -INFINITY;
+		g->max_attack_compression_diff_db = -INFINITY;
 
 		/* Fix gremlins. */
 		if (isbadf(compression_diff_db))
@@ -389,25 +468,49 @@ static void dk_update_envelope(struct drc_kernel *dk)
 		/* As long as we're still in attack mode, use a rate based off
 		 * the largest compression_diff_db we've encountered so far.
 		 */
-		dk->max_attack_compression_diff_db = max(
-			dk->max_attack_compression_diff_db,
+		g->max_attack_compression_diff_db = max(
+			g->max_attack_compression_diff_db,
 			compression_diff_db);
 
 		float eff_atten_diff_db =
-			max(0.5f, dk->max_attack_compression_diff_db);
+			max(0.5f, g->max_attack_compression_diff_db);
 
 		float x = 0.25f / eff_atten_diff_db;
 		envelope_rate = 1 - powf(x, 1 / attack_frames);
 	}
 
-	dk->envelope_rate = envelope_rate;
-	dk->scaled_desired_gain = scaled_desired_gain;
+	g->envelope_rate = envelope_rate;
+	g->scaled_desired_gain = scaled_desired_gain;
 }
 
 /* For a division of frames, take the absolute values of left channel and right
  * channel, store the maximum of them in output. */
-#ifdef __ARM_NEON__
+#if defined(__ARM_NEON__) || defined(__aarch64__)
 #include <arm_neon.h>
+#if defined(__aarch64__)
+static inline void max_abs_division(float *output, float *data0, float *data1)
+{
+	unsigned int i;
+
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
+		float32x4_t x = vabsq_f32(vld1q_f32(data0 + i));
+		float32x4_t y = vabsq_f32(vld1q_f32(data1 + i));
+		vst1q_f32(output + i, vmaxq_f32(x, y));
+	}
+}
+
+/* Same as max_abs_division, but the two channels are interleaved in data. */
+static inline void max_abs_division_interleaved(float *output, float *data)
+{
+	unsigned int i;
+
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
+		float32x4x2_t v = vld2q_f32(data + 2 * i);
+		vst1q_f32(output + i, vmaxq_f32(vabsq_f32(v.val[0]),
+						vabsq_f32(v.val[1])));
+	}
+}
+#else
 static inline void max_abs_division(float *output, float *data0, float *data1)
 {
 	float32x4_t x, y;
@@ -439,6 +542,118 @@ static inline void max_abs_division(float *output, float *data0, float *data1)
 		  "memory", "cc"
 		);
 }
+
+/* Same as max_abs_division, but the two channels are interleaved in data. */
+static inline void max_abs_division_interleaved(float *output, float *data)
+{
+	float32x4_t x, y;
+	int count = DIVISION_FRAMES / 4;
+
+	__asm__ __volatile__(
+		"1:                                     \n"
+		"vld1.32 {%e[x],%f[x]}, [%[data]]!      \n"
+		"vld1.32 {%e[y],%f[y]}, [%[data]]!      \n"
+		"vuzp.32 %q[x], %q[y]                   \n"
+		"vabs.f32 %q[x], %q[x]                  \n"
+		"vabs.f32 %q[y], %q[y]                  \n"
+		"vmax.f32 %q[x], %q[y]                  \n"
+		"vst1.32 {%e[x],%f[x]}, [%[output]]!    \n"
+		"subs %[count], #1                      \n"
+		"bne 1b                                 \n"
+		: /* output */
+		  "=r"(data),
+		  "=r"(output),
+		  "=r"(count),
+		  [x]"=&w"(x),
+		  [y]"=&w"(y)
+		: /* input */
+		  [data]"0"(data),
+		  [output]"1"(output),
+		  [count]"2"(count)
+		: /* clobber */
+		  "memory", "cc"
+		);
+}
+#endif
+
+/* Loads four frames of the two channels from frame i of a division. If
+ * interleaved, data0 holds L/R pairs and data1 is not used. */
+static inline void load_frames4(const float *data0, const float *data1,
+				int interleaved, unsigned int i,
+				float32x4_t *x, float32x4_t *y)
+{
+	if (interleaved) {
+		float32x4x2_t v = vld2q_f32(data0 + 2 * i);
+		*x = v.val[0];
+		*y = v.val[1];
+	} else {
+		*x = vld1q_f32(data0 + i);
+		*y = vld1q_f32(data1 + i);
+	}
+}
+
+/* For a division of frames, store the absolute values of the left channel
+ * in output0 and of the right channel in output1. */
+static inline void abs_division(float *output0, float *output1,
+				const float *data0, const float *data1,
+				int interleaved)
+{
+	float32x4_t x, y;
+	unsigned int i;
+
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
+		load_frames4(data0, data1, interleaved, i, &x, &y);
+		vst1q_f32(output0 + i, vabsq_f32(x));
+		vst1q_f32(output1 + i, vabsq_f32(y));
+	}
+}
+
+/* For a division of frames, store the absolute values of the mid signal
+ * (L+R)/2 in output0 and of the side signal (L-R)/2 in output1. */
+static inline void mid_side_division(float *output0, float *output1,
+				     const float *data0, const float *data1,
+				     int interleaved)
+{
+	float32x4_t x, y;
+	unsigned int i;
+
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
+		load_frames4(data0, data1, interleaved, i, &x, &y);
+		vst1q_f32(output0 + i,
+			  vabsq_f32(vmulq_n_f32(vaddq_f32(x, y), 0.5f)));
+		vst1q_f32(output1 + i,
+			  vabsq_f32(vmulq_n_f32(vsubq_f32(x, y), 0.5f)));
+	}
+}
+
+/* Returns the sum of the squares of both channels over a division. */
+static inline float square_sum_division(const float *data0,
+					const float *data1, int interleaved)
+{
+	float32x4_t x, y;
+	float32x4_t sum = vdupq_n_f32(0);
+	unsigned int i;
+
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
+		load_frames4(data0, data1, interleaved, i, &x, &y);
+#if defined(__aarch64__)
+		sum = vfmaq_f32(sum, x, x);
+		sum = vfmaq_f32(sum, y, y);
+#else
+		sum = vmlaq_f32(sum, x, x);
+		sum = vmlaq_f32(sum, y, y);
+#endif
+	}
+#if defined(__aarch64__)
+	return vaddvq_f32(sum);
+#else
+	{
+		float32x2_t half = vadd_f32(vget_low_f32(sum),
+					    vget_high_f32(sum));
+		return vget_lane_f32(vpadd_f32(half, half), 0);
+	}
+#endif
+}
 #elif defined(__SSE3__)
 #include <emmintrin.h>
 static inline void max_abs_division(float *output, float *data0, float *data1)
@@ -472,6 +687,113 @@ static inline void max_abs_division(float *output, float *data0, float *data1)
 		  "memory", "cc"
 		);
 }
+
+/* Same as max_abs_division, but the two channels are interleaved in data. */
+static inline void max_abs_division_interleaved(float *output, float *data)
+{
+	__m128 x, y, z;
+	int count = DIVISION_FRAMES / 4;
+
+	__asm__ __volatile__(
+		"1:                                     \n"
+		"lddqu (%[data]), %[x]                  \n"
+		"lddqu 16(%[data]), %[y]                \n"
+		"andps %[mask], %[x]                    \n"
+		"andps %[mask], %[y]                    \n"
+		"movaps %[x], %[z]                      \n"
+		"shufps $0x88, %[y], %[z]               \n"
+		"shufps $0xdd, %[y], %[x]               \n"
+		"maxps %[z], %[x]                       \n"
+		"movdqu %[x], (%[output])               \n"
+		"add $32, %[data]                       \n"
+		"add $16, %[output]                     \n"
+		"sub $1, %[count]                       \n"
+		"jnz 1b                                 \n"
+		: /* output */
+		  [data]"+r"(data),
+		  [output]"+r"(output),
+		  [count]"+r"(count),
+		  [x]"=&x"(x),
+		  [y]"=&x"(y),
+		  [z]"=&x"(z)
+		: /* input */
+		  [mask]"x"(_mm_set1_epi32(0x7fffffff))
+		: /* clobber */
+		  "memory", "cc"
+		);
+}
+
+/* Loads four frames of the two channels from frame i of a division. If
+ * interleaved, data0 holds L/R pairs and data1 is not used. */
+static inline void load_frames4(const float *data0, const float *data1,
+				int interleaved, unsigned int i,
+				__m128 *x, __m128 *y)
+{
+	if (interleaved) {
+		__m128 a = _mm_loadu_ps(data0 + 2 * i);
+		__m128 b = _mm_loadu_ps(data0 + 2 * i + 4);
+		*x = _mm_shuffle_ps(a, b, 0x88);
+		*y = _mm_shuffle_ps(a, b, 0xdd);
+	} else {
+		*x = _mm_loadu_ps(data0 + i);
+		*y = _mm_loadu_ps(data1 + i);
+	}
+}
+
+/* For a division of frames, store the absolute values of the left channel
+ * in output0 and of the right channel in output1. */
+static inline void abs_division(float *output0, float *output1,
+				const float *data0, const float *data1,
+				int interleaved)
+{
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 x, y;
+	unsigned int i;
+
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
+		load_frames4(data0, data1, interleaved, i, &x, &y);
+		_mm_storeu_ps(output0 + i, _mm_and_ps(x, mask));
+		_mm_storeu_ps(output1 + i, _mm_and_ps(y, mask));
+	}
+}
+
+/* For a division of frames, store the absolute values of the mid signal
+ * (L+R)/2 in output0 and of the side signal (L-R)/2 in output1. */
+static inline void mid_side_division(float *output0, float *output1,
+				     const float *data0, const float *data1,
+				     int interleaved)
+{
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 half = _mm_set1_ps(0.5f);
+	__m128 x, y;
+	unsigned int i;
+
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
+		load_frames4(data0, data1, interleaved, i, &x, &y);
+		_mm_storeu_ps(output0 + i, _mm_and_ps(
+			_mm_mul_ps(_mm_add_ps(x, y), half), mask));
+		_mm_storeu_ps(output1 + i, _mm_and_ps(
+			_mm_mul_ps(_mm_sub_ps(x, y), half), mask));
+	}
+}
+
+/* Returns the sum of the squares of both channels over a division. */
+static inline float square_sum_division(const float *data0,
+					const float *data1, int interleaved)
+{
+	__m128 x, y;
+	__m128 sum = _mm_setzero_ps();
+	unsigned int i;
+
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
+		load_frames4(data0, data1, interleaved, i, &x, &y);
+		sum = _mm_add_ps(sum, _mm_mul_ps(x, x));
+		sum = _mm_add_ps(sum, _mm_mul_ps(y, y));
+	}
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
 #else
 static inline void max_abs_division(float *output, float *data0, float *data1)
 {
@@ -479,33 +801,104 @@ static inline void max_abs_division(float *output, float *data0, float *data1)
 	for (i = 0; i < DIVISION_FRAMES; i++)
 		output[i] = fmaxf(fabsf(data0[i]), fabsf(data1[i]));
 }
-#endif
 
-/* Update detector_average from the last input division. */
-static void dk_update_detector_average(struct drc_kernel *dk)
+static inline void max_abs_division_interleaved(float *output, float *data)
 {
-	float abs_input_array[DIVISION_FRAMES];
-	const float sat_release_frames_inv_neg = dk->sat_release_frames_inv_neg;
-	const float sat_release_rate_at_neg_two_db =
-		dk->sat_release_rate_at_neg_two_db;
-	float detector_average = dk->detector_average;
-	unsigned int div_start, i;
+	unsigned int i;
+	for (i = 0; i < DIVISION_FRAMES; i++)
+		output[i] = fmaxf(fabsf(data[2 * i]), fabsf(data[2 * i + 1]));
+}
+/* Returns the sample of a channel at frame i of a division. If interleaved,
+ * data0 holds L/R pairs and data1 is not used. */
+static inline float sample_at(const float *data0, const float *data1,
+			      int interleaved, int channel, unsigned int i)
+{
+	if (interleaved)
+		return data0[2 * i + channel];
+	return channel ? data1[i] : data0[i];
+}
 
-	/* Calculate the start index of the last input division */
-	if (dk->pre_delay_write_index == 0) {
-		div_start = MAX_PRE_DELAY_FRAMES - DIVISION_FRAMES;
-	} else {
-		div_start = dk->pre_delay_write_index - DIVISION_FRAMES;
+static inline void abs_division(float *output0, float *output1,
+				const float *data0, const float *data1,
+				int interleaved)
+{
+	unsigned int i;
+	for (i = 0; i < DIVISION_FRAMES; i++) {
+		output0[i] = fabsf(sample_at(data0, data1, interleaved, 0, i));
+		output1[i] = fabsf(sample_at(data0, data1, interleaved, 1, i));
 	}
+}
 
-	/* The max abs value across all channels for this frame */
-	max_abs_division(abs_input_array,
-			 &dk->pre_delay_buffers[0][div_start],
-			 &dk->pre_delay_buffers[1][div_start]);
+static inline void mid_side_division(float *output0, float *output1,
+				     const float *data0, const float *data1,
+				     int interleaved)
+{
+	unsigned int i;
+	for (i = 0; i < DIVISION_FRAMES; i++) {
+		float l = sample_at(data0, data1, interleaved, 0, i);
+		float r = sample_at(data0, data1, interleaved, 1, i);
+		output0[i] = fabsf((l + r) * 0.5f);
+		output1[i] = fabsf((l - r) * 0.5f);
+	}
+}
 
+static inline float square_sum_division(const float *data0,
+					const float *data1, int interleaved)
+{
+	unsigned int i;
+	float sum = 0;
 	for (i = 0; i < DIVISION_FRAMES; i++) {
+		float l = sample_at(data0, data1, interleaved, 0, i);
+		float r = sample_at(data0, data1, interleaved, 1, i);
+		sum += l * l + r * r;
+	}
+	return sum;
+}
+#endif
+
+/* volume_gain() of four levels. Only the parts of the curve which a lane is
+ * on are computed. */
+static inline drc_f32x4 volume_gain_x4(struct drc_kernel *dk, drc_f32x4 x,
+				       float ratio_base_db)
+{
+	const drc_i32x4 linear = x < dk->linear_threshold;
+	const drc_i32x4 knee = ~linear & (x < dk->knee_threshold);
+	const drc_i32x4 ratio = ~linear & ~knee;
+	drc_f32x4 gain = drc_splat_x4(1);
+	drc_f32x4 y;
+
+	if (drc_any_x4(knee)) {
+		/* See knee_curveK(). */
+		y = dk->knee_alpha + dk->knee_beta * knee_expf_x4(-dk->K * x);
+		gain = drc_select_x4(knee, y / x, gain);
+	}
+	if (drc_any_x4(ratio)) {
+		/* See volume_gain(). y/x = dk->ratio_base * x^(s - 1) is a sum
+		 * in dB. */
+		y = ratio_base_db + linear_to_decibels_x4(x) * (dk->slope - 1);
+		gain = drc_select_x4(ratio, decibels_to_linear_x4(y), gain);
+	}
+	return gain;
+}
+
+/* Moves the detector_average of a gain through the levels of the frames of
+ * the last input division. */
+static void dk_update_gain_detector(struct drc_kernel *dk, struct dk_gain *g,
+				    const float *abs_input_array)
+{
+	const float sat_release_frames_inv_neg = dk->sat_release_frames_inv_neg;
+	const float sat_release_rate_at_neg_two_db =
+		dk->sat_release_rate_at_neg_two_db;
+	const float ratio_base_db = linear_to_decibels(dk->ratio_base);
+	float gains[DIVISION_FRAMES];
+	float detector_average = g->detector_average;
+	unsigned int i;
+
+	/* The gain of a frame only depends on its level, so the gains are
+	 * computed four frames at a time before the loop. */
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
 		/* Compute compression amount from un-delayed signal */
-		float abs_input = abs_input_array[i];
+		drc_f32x4 abs_input = drc_load_x4(abs_input_array + i);
 
 		/* Calculate shaped power on undelayed input.  Put through
 		 * shaping curve. This is linear up to the threshold, then
@@ -514,7 +907,12 @@ static void dk_update_detector_average(struct drc_kernel *dk)
 		 * derivative matched). The transition from the knee to the
 		 * ratio portion is smooth (1st derivative matched).
 		 */
-		float gain = volume_gain(dk, abs_input);
+		drc_store_x4(gains + i,
+			     volume_gain_x4(dk, abs_input, ratio_base_db));
+	}
+
+	for (i = 0; i < DIVISION_FRAMES; i++) {
+		float gain = gains[i];
 		int is_release = (gain > detector_average);
 		if (is_release) {
 			if (gain > NEG_TWO_DB) {
@@ -540,19 +938,97 @@ static void dk_update_detector_average(struct drc_kernel *dk)
 			detector_average = min(detector_average, 1.0f);
 	}
 
-	dk->detector_average = detector_average;
+	g->detector_average = detector_average;
+}
+
+/* Adds the sum of squares of the last input division to the RMS window, and
+ * returns the RMS level of both channels over the window. */
+static float dk_rms_level(struct drc_kernel *dk, float square_sum)
+{
+	float sum = 0;
+	int i;
+
+	dk->rms_squares[dk->rms_index] =
+		square_sum / (DIVISION_FRAMES * DRC_NUM_CHANNELS);
+	dk->rms_index = (dk->rms_index + 1) % dk->rms_divisions;
+	/* Sum the window again each time, so rounding errors do not pile
+	 * up as they would in a running sum. */
+	for (i = 0; i < dk->rms_divisions; i++)
+		sum += dk->rms_squares[i];
+	return sqrtf(sum / dk->rms_divisions);
+}
+
+/* Update detector_average from the last input division. */
+static void dk_update_detector_average(struct drc_kernel *dk)
+{
+	float abs_input_array[DRC_NUM_CHANNELS][DIVISION_FRAMES];
+	float *data0, *data1;
+	unsigned int div_start, i;
+	float level;
+
+	/* Calculate the start index of the last input division */
+	if (dk->pre_delay_write_index == 0) {
+		div_start = MAX_PRE_DELAY_FRAMES - DIVISION_FRAMES;
+	} else {
+		div_start = dk->pre_delay_write_index - DIVISION_FRAMES;
+	}
+
+	if (dk->interleaved) {
+		data0 = &dk->pre_delay_buffers[0][2 * div_start];
+		data1 = NULL;
+	} else {
+		data0 = &dk->pre_delay_buffers[0][div_start];
+		data1 = &dk->pre_delay_buffers[1][div_start];
+	}
+
+	switch (dk->detector) {
+	case DK_DETECTOR_UNLINKED:
+		abs_division(abs_input_array[0], abs_input_array[1], data0,
+			     data1, dk->interleaved);
+		break;
+	case DK_DETECTOR_MID_SIDE:
+		mid_side_division(abs_input_array[0], abs_input_array[1],
+				  data0, data1, dk->interleaved);
+		break;
+	case DK_DETECTOR_RMS:
+		level = dk_rms_level(dk, square_sum_division(data0, data1,
+							     dk->interleaved));
+		for (i = 0; i < DIVISION_FRAMES; i++)
+			abs_input_array[0][i] = level;
+		break;
+	default:
+		/* The max abs value across all channels for this frame */
+		if (dk->interleaved)
+			max_abs_division_interleaved(abs_input_array[0],
+						     data0);
+		else
+			max_abs_division(abs_input_array[0], data0, data1);
+		break;
+	}
+
+	dk_update_gain_detector(dk, &dk->gain[0], abs_input_array[0]);
+	if (dk_has_two_gains(dk))
+		dk_update_gain_detector(dk, &dk->gain[1], abs_input_array[1]);
+}
+
+/* Updates the envelopes of the gains the detector uses. */
+static void dk_update_envelopes(struct drc_kernel *dk)
+{
+	dk_update_envelope(dk, &dk->gain[0]);
+	if (dk_has_two_gains(dk))
+		dk_update_envelope(dk, &dk->gain[1]);
 }
 
 /* Calculate compress_gain from the envelope and apply total_gain to compress
  * the next output division. */
 #if defined(__ARM_NEON__)
 #include <arm_neon.h>
-static void dk_compress_output(struct drc_kernel *dk)
+static void dk_compress_output_planar_neon(struct drc_kernel *dk)
 {
 	const float master_linear_gain = dk->master_linear_gain;
-	const float envelope_rate = dk->envelope_rate;
-	const float scaled_desired_gain = dk->scaled_desired_gain;
-	const float compressor_gain = dk->compressor_gain;
+	const float envelope_rate = dk->gain[0].envelope_rate;
+	const float scaled_desired_gain = dk->gain[0].scaled_desired_gain;
+	const float compressor_gain = dk->gain[0].compressor_gain;
 	unsigned const int div_start = dk->pre_delay_read_index;
 	float *ptr_left = &dk->pre_delay_buffers[0][div_start];
 	float *ptr_right = &dk->pre_delay_buffers[1][div_start];
@@ -623,7 +1099,7 @@ static void dk_compress_output(struct drc_kernel *dk)
 			: /* clobber */
 			  "memory", "cc"
 			);
-		dk->compressor_gain = x[3];
+		dk->gain[0].compressor_gain = x[3];
 	} else {
 		float c = compressor_gain;
 		float r = envelope_rate;
@@ -681,49 +1157,200 @@ static void dk_compress_output(struct drc_kernel *dk)
 			: /* clobber */
 			  "memory", "cc"
 			);
-		dk->compressor_gain = x[3];
+		dk->gain[0].compressor_gain = x[3];
 	}
 }
-#elif defined(__SSE3__) && defined(__x86_64__)
-#include <emmintrin.h>
-static void dk_compress_output(struct drc_kernel *dk)
+
+/* Same as dk_compress_output_planar_neon, but for the interleaved pre-delay
+ * buffer. The gain of four frames is computed once, and applied to both
+ * channels after de-interleaving them with vuzp. */
+static void dk_compress_output_interleaved_neon(struct drc_kernel *dk)
 {
 	const float master_linear_gain = dk->master_linear_gain;
-	const float envelope_rate = dk->envelope_rate;
-	const float scaled_desired_gain = dk->scaled_desired_gain;
-	const float compressor_gain = dk->compressor_gain;
-	const int div_start = dk->pre_delay_read_index;
-	float *ptr_left = &dk->pre_delay_buffers[0][div_start];
-	float *ptr_right = &dk->pre_delay_buffers[1][div_start];
+	const float envelope_rate = dk->gain[0].envelope_rate;
+	const float scaled_desired_gain = dk->gain[0].scaled_desired_gain;
+	const float compressor_gain = dk->gain[0].compressor_gain;
+	unsigned const int div_start = dk->pre_delay_read_index;
+	float *ptr_lo = &dk->pre_delay_buffers[0][2 * div_start];
+	float *ptr_hi = ptr_lo + 4;
+	const int step = 8 * sizeof(float);
 	int count = DIVISION_FRAMES / 4;
 
 	/* See warp_sinf() for the details for the constants. */
-	const __m128 A7 = _mm_set1_ps(-4.3330336920917034149169921875e-3f);
-	const __m128 A5 = _mm_set1_ps(7.9434238374233245849609375e-2f);
-	const __m128 A3 = _mm_set1_ps(-0.645892798900604248046875f);
-	const __m128 A1 = _mm_set1_ps(1.5707910060882568359375f);
+	const float32x4_t A7 = vdupq_n_f32(-4.3330336920917034149169921875e-3f);
+	const float32x4_t A5 = vdupq_n_f32(7.9434238374233245849609375e-2f);
+	const float32x4_t A3 = vdupq_n_f32(-0.645892798900604248046875f);
+	const float32x4_t A1 = vdupq_n_f32(1.5707910060882568359375f);
 
 	/* Exponential approach to desired gain. */
 	if (envelope_rate < 1) {
 		float c = compressor_gain - scaled_desired_gain;
 		float r = 1 - envelope_rate;
-		__m128 x0 = {c*r, c*r*r, c*r*r*r, c*r*r*r*r};
-		__m128 x, x2, x4, left, right, tmp1, tmp2;
+		float32x4_t x0 = {c*r, c*r*r, c*r*r*r, c*r*r*r*r};
+		float32x4_t x, x2, x4, left, right, tmp1, tmp2;
 
 		__asm__ __volatile(
-			"jmp 2f                                     \n"
-			"1:                                         \n"
-			"mulps %[r4], %[x0]                         \n"
-			"2:                                         \n"
-			"lddqu (%[ptr_left]), %[left]               \n"
-			"lddqu (%[ptr_right]), %[right]             \n"
-			"movaps %[x0], %[x]                         \n"
-			"addps %[base], %[x]                        \n"
+			"b 2f                                               \n"
+			"1:                                                 \n"
+			"vmul.f32 %q[x0], %q[r4]                            \n"
+			"2:                                                 \n"
+			"vld1.32 {%e[left],%f[left]}, [%[ptr_lo]]           \n"
+			"vld1.32 {%e[right],%f[right]}, [%[ptr_hi]]         \n"
+			"vadd.f32 %q[x], %q[x0], %q[base]                   \n"
+			"vuzp.32 %q[left], %q[right]                        \n"
 			/* Calculate warp_sin() for four values in x. */
-			"movaps %[x], %[x2]                         \n"
-			"mulps %[x], %[x2]                          \n"
-			"movaps %[x2], %[x4]                        \n"
-			"movaps %[x2], %[tmp1]                      \n"
+			"vmul.f32 %q[x2], %q[x], %q[x]                      \n"
+			"vmov.f32 %q[tmp1], %q[A5]                          \n"
+			"vmov.f32 %q[tmp2], %q[A1]                          \n"
+			"vmul.f32 %q[x4], %q[x2], %q[x2]                    \n"
+			"vmla.f32 %q[tmp1], %q[A7], %q[x2]                  \n"
+			"vmla.f32 %q[tmp2], %q[A3], %q[x2]                  \n"
+			"vmla.f32 %q[tmp2], %q[tmp1], %q[x4]                \n"
+			"vmul.f32 %q[tmp2], %q[tmp2], %q[x]                 \n"
+			/* Now tmp2 contains the result of warp_sin(). */
+			"vmul.f32 %q[tmp2], %q[tmp2], %q[g]                 \n"
+			"vmul.f32 %q[left], %q[tmp2]                        \n"
+			"vmul.f32 %q[right], %q[tmp2]                       \n"
+			"vzip.32 %q[left], %q[right]                        \n"
+			"vst1.32 {%e[left],%f[left]}, [%[ptr_lo]], %[step]  \n"
+			"vst1.32 {%e[right],%f[right]}, [%[ptr_hi]], %[step]\n"
+			"subs %[count], #1                                  \n"
+			"bne 1b                                             \n"
+			: /* output */
+			  "=r"(count),
+			  "=r"(ptr_lo),
+			  "=r"(ptr_hi),
+			  "=w"(x0),
+			  [x]"=&w"(x),
+			  [x2]"=&w"(x2),
+			  [x4]"=&w"(x4),
+			  [left]"=&w"(left),
+			  [right]"=&w"(right),
+			  [tmp1]"=&w"(tmp1),
+			  [tmp2]"=&w"(tmp2)
+			: /* input */
+			  [count]"0"(count),
+			  [ptr_lo]"1"(ptr_lo),
+			  [ptr_hi]"2"(ptr_hi),
+			  [x0]"3"(x0),
+			  [step]"r"(step),
+			  [A1]"w"(A1),
+			  [A3]"w"(A3),
+			  [A5]"w"(A5),
+			  [A7]"w"(A7),
+			  [base]"w"(vdupq_n_f32(scaled_desired_gain)),
+			  [r4]"w"(vdupq_n_f32(r*r*r*r)),
+			  [g]"w"(vdupq_n_f32(master_linear_gain))
+			: /* clobber */
+			  "memory", "cc"
+			);
+		dk->gain[0].compressor_gain = x[3];
+	} else {
+		float c = compressor_gain;
+		float r = envelope_rate;
+		float32x4_t x = {c*r, c*r*r, c*r*r*r, c*r*r*r*r};
+		float32x4_t x2, x4, left, right, tmp1, tmp2;
+
+		__asm__ __volatile(
+			"b 2f                                               \n"
+			"1:                                                 \n"
+			"vmul.f32 %q[x], %q[r4]                             \n"
+			"2:                                                 \n"
+			"vld1.32 {%e[left],%f[left]}, [%[ptr_lo]]           \n"
+			"vld1.32 {%e[right],%f[right]}, [%[ptr_hi]]         \n"
+			"vmin.f32 %q[x], %q[one]                            \n"
+			"vuzp.32 %q[left], %q[right]                        \n"
+			/* Calculate warp_sin() for four values in x. */
+			"vmul.f32 %q[x2], %q[x], %q[x]                      \n"
+			"vmov.f32 %q[tmp1], %q[A5]                          \n"
+			"vmov.f32 %q[tmp2], %q[A1]                          \n"
+			"vmul.f32 %q[x4], %q[x2], %q[x2]                    \n"
+			"vmla.f32 %q[tmp1], %q[A7], %q[x2]                  \n"
+			"vmla.f32 %q[tmp2], %q[A3], %q[x2]                  \n"
+			"vmla.f32 %q[tmp2], %q[tmp1], %q[x4]                \n"
+			"vmul.f32 %q[tmp2], %q[tmp2], %q[x]                 \n"
+			/* Now tmp2 contains the result of warp_sin(). */
+			"vmul.f32 %q[tmp2], %q[tmp2], %q[g]                 \n"
+			"vmul.f32 %q[left], %q[tmp2]                        \n"
+			"vmul.f32 %q[right], %q[tmp2]                       \n"
+			"vzip.32 %q[left], %q[right]                        \n"
+			"vst1.32 {%e[left],%f[left]}, [%[ptr_lo]], %[step]  \n"
+			"vst1.32 {%e[right],%f[right]}, [%[ptr_hi]], %[step]\n"
+			"subs %[count], #1                                  \n"
+			"bne 1b                                             \n"
+			: /* output */
+			  "=r"(count),
+			  "=r"(ptr_lo),
+			  "=r"(ptr_hi),
+			  "=w"(x),
+			  [x2]"=&w"(x2),
+			  [x4]"=&w"(x4),
+			  [left]"=&w"(left),
+			  [right]"=&w"(right),
+			  [tmp1]"=&w"(tmp1),
+			  [tmp2]"=&w"(tmp2)
+			: /* input */
+			  [count]"0"(count),
+			  [ptr_lo]"1"(ptr_lo),
+			  [ptr_hi]"2"(ptr_hi),
+			  [x]"3"(x),
+			  [step]"r"(step),
+			  [A1]"w"(A1),
+			  [A3]"w"(A3),
+			  [A5]"w"(A5),
+			  [A7]"w"(A7),
+			  [one]"w"(vdupq_n_f32(1)),
+			  [r4]"w"(vdupq_n_f32(r*r*r*r)),
+			  [g]"w"(vdupq_n_f32(master_linear_gain))
+			: /* clobber */
+			  "memory", "cc"
+			);
+		dk->gain[0].compressor_gain = x[3];
+	}
+}
+#endif
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+__attribute__((target("sse3")))
+static void dk_compress_output_planar_sse3(struct drc_kernel *dk)
+{
+	const float master_linear_gain = dk->master_linear_gain;
+	const float envelope_rate = dk->gain[0].envelope_rate;
+	const float scaled_desired_gain = dk->gain[0].scaled_desired_gain;
+	const float compressor_gain = dk->gain[0].compressor_gain;
+	const int div_start = dk->pre_delay_read_index;
+	float *ptr_left = &dk->pre_delay_buffers[0][div_start];
+	float *ptr_right = &dk->pre_delay_buffers[1][div_start];
+	int count = DIVISION_FRAMES / 4;
+
+	/* See warp_sinf() for the details for the constants. */
+	const __m128 A7 = _mm_set1_ps(-4.3330336920917034149169921875e-3f);
+	const __m128 A5 = _mm_set1_ps(7.9434238374233245849609375e-2f);
+	const __m128 A3 = _mm_set1_ps(-0.645892798900604248046875f);
+	const __m128 A1 = _mm_set1_ps(1.5707910060882568359375f);
+
+	/* Exponential approach to desired gain. */
+	if (envelope_rate < 1) {
+		float c = compressor_gain - scaled_desired_gain;
+		float r = 1 - envelope_rate;
+		__m128 x0 = {c*r, c*r*r, c*r*r*r, c*r*r*r*r};
+		__m128 x, x2, x4, left, right, tmp1, tmp2;
+
+		__asm__ __volatile(
+			"jmp 2f                                     \n"
+			"1:                                         \n"
+			"mulps %[r4], %[x0]                         \n"
+			"2:                                         \n"
+			"lddqu (%[ptr_left]), %[left]               \n"
+			"lddqu (%[ptr_right]), %[right]             \n"
+			"movaps %[x0], %[x]                         \n"
+			"addps %[base], %[x]                        \n"
+			/* Calculate warp_sin() for four values in x. */
+			"movaps %[x], %[x2]                         \n"
+			"mulps %[x], %[x2]                          \n"
+			"movaps %[x2], %[x4]                        \n"
+			"movaps %[x2], %[tmp1]                      \n"
 			"movaps %[x2], %[tmp2]                      \n"
 			"mulps %[x2], %[x4]                         \n"
 			"mulps %[A7], %[tmp1]                       \n"
@@ -770,7 +1397,7 @@ static void dk_compress_output(struct drc_kernel *dk)
 			: /* clobber */
 			  "memory", "cc"
 			);
-		dk->compressor_gain = x[3];
+		dk->gain[0].compressor_gain = x[3];
 	} else {
 		/* See warp_sinf() for the details for the constants. */
 		__m128 A7 = _mm_set1_ps(-4.3330336920917034149169921875e-3f);
@@ -841,19 +1468,177 @@ static void dk_compress_output(struct drc_kernel *dk)
 			: /* clobber */
 			  "memory", "cc"
 			);
-		dk->compressor_gain = x[3];
+		dk->gain[0].compressor_gain = x[3];
 	}
 }
-#else
-static void dk_compress_output(struct drc_kernel *dk)
+
+/* Same as dk_compress_output_planar_sse3, but for the interleaved pre-delay
+ * buffer. The gain of four frames is computed once, then duplicated with
+ * unpcklps and unpckhps to match the L/R pairs. */
+__attribute__((target("sse3")))
+static void dk_compress_output_interleaved_sse3(struct drc_kernel *dk)
 {
 	const float master_linear_gain = dk->master_linear_gain;
-	const float envelope_rate = dk->envelope_rate;
-	const float scaled_desired_gain = dk->scaled_desired_gain;
-	const float compressor_gain = dk->compressor_gain;
+	const float envelope_rate = dk->gain[0].envelope_rate;
+	const float scaled_desired_gain = dk->gain[0].scaled_desired_gain;
+	const float compressor_gain = dk->gain[0].compressor_gain;
 	const int div_start = dk->pre_delay_read_index;
-	float *ptr_left = &dk->pre_delay_buffers[0][div_start];
-	float *ptr_right = &dk->pre_delay_buffers[1][div_start];
+	float *ptr = &dk->pre_delay_buffers[0][2 * div_start];
+	int count = DIVISION_FRAMES / 4;
+
+	/* See warp_sinf() for the details for the constants. */
+	const __m128 A7 = _mm_set1_ps(-4.3330336920917034149169921875e-3f);
+	const __m128 A5 = _mm_set1_ps(7.9434238374233245849609375e-2f);
+	const __m128 A3 = _mm_set1_ps(-0.645892798900604248046875f);
+	const __m128 A1 = _mm_set1_ps(1.5707910060882568359375f);
+
+	/* Exponential approach to desired gain. */
+	if (envelope_rate < 1) {
+		float c = compressor_gain - scaled_desired_gain;
+		float r = 1 - envelope_rate;
+		__m128 x0 = {c*r, c*r*r, c*r*r*r, c*r*r*r*r};
+		__m128 x, x2, x4, lo, hi, tmp1, tmp2;
+
+		__asm__ __volatile(
+			"jmp 2f                                     \n"
+			"1:                                         \n"
+			"mulps %[r4], %[x0]                         \n"
+			"2:                                         \n"
+			"lddqu (%[ptr]), %[lo]                      \n"
+			"lddqu 16(%[ptr]), %[hi]                    \n"
+			"movaps %[x0], %[x]                         \n"
+			"addps %[base], %[x]                        \n"
+			/* Calculate warp_sin() for four values in x. */
+			"movaps %[x], %[x2]                         \n"
+			"mulps %[x], %[x2]                          \n"
+			"movaps %[x2], %[x4]                        \n"
+			"movaps %[x2], %[tmp1]                      \n"
+			"movaps %[x2], %[tmp2]                      \n"
+			"mulps %[x2], %[x4]                         \n"
+			"mulps %[A7], %[tmp1]                       \n"
+			"mulps %[A3], %[tmp2]                       \n"
+			"addps %[A5], %[tmp1]                       \n"
+			"addps %[A1], %[tmp2]                       \n"
+			"mulps %[x4], %[tmp1]                       \n"
+			"addps %[tmp1], %[tmp2]                     \n"
+			"mulps %[x], %[tmp2]                        \n"
+			/* Now tmp2 contains the result of warp_sin(). */
+			"mulps %[g], %[tmp2]                        \n"
+			"movaps %[tmp2], %[tmp1]                    \n"
+			"unpcklps %[tmp2], %[tmp1]                  \n"
+			"unpckhps %[tmp2], %[tmp2]                  \n"
+			"mulps %[tmp1], %[lo]                       \n"
+			"mulps %[tmp2], %[hi]                       \n"
+			"movdqu %[lo], (%[ptr])                     \n"
+			"movdqu %[hi], 16(%[ptr])                   \n"
+			"add $32, %[ptr]                            \n"
+			"sub $1, %[count]                           \n"
+			"jne 1b                                     \n"
+			: /* output */
+			  "=r"(count),
+			  "=r"(ptr),
+			  "=x"(x0),
+			  [x]"=&x"(x),
+			  [x2]"=&x"(x2),
+			  [x4]"=&x"(x4),
+			  [lo]"=&x"(lo),
+			  [hi]"=&x"(hi),
+			  [tmp1]"=&x"(tmp1),
+			  [tmp2]"=&x"(tmp2)
+			: /* input */
+			  [count]"0"(count),
+			  [ptr]"1"(ptr),
+			  [x0]"2"(x0),
+			  [A1]"x"(A1),
+			  [A3]"x"(A3),
+			  [A5]"x"(A5),
+			  [A7]"x"(A7),
+			  [base]"x"(_mm_set1_ps(scaled_desired_gain)),
+			  [r4]"x"(_mm_set1_ps(r*r*r*r)),
+			  [g]"x"(_mm_set1_ps(master_linear_gain))
+			: /* clobber */
+			  "memory", "cc"
+			);
+		dk->gain[0].compressor_gain = x[3];
+	} else {
+		float c = compressor_gain;
+		float r = envelope_rate;
+		__m128 x = {c*r, c*r*r, c*r*r*r, c*r*r*r*r};
+		__m128 x2, x4, lo, hi, tmp1, tmp2;
+
+		__asm__ __volatile(
+			"jmp 2f                                     \n"
+			"1:                                         \n"
+			"mulps %[r4], %[x]                          \n"
+			"2:                                         \n"
+			"lddqu (%[ptr]), %[lo]                      \n"
+			"lddqu 16(%[ptr]), %[hi]                    \n"
+			"minps %[one], %[x]                         \n"
+			/* Calculate warp_sin() for four values in x. */
+			"movaps %[x], %[x2]                         \n"
+			"mulps %[x], %[x2]                          \n"
+			"movaps %[x2], %[x4]                        \n"
+			"movaps %[x2], %[tmp1]                      \n"
+			"movaps %[x2], %[tmp2]                      \n"
+			"mulps %[x2], %[x4]                         \n"
+			"mulps %[A7], %[tmp1]                       \n"
+			"mulps %[A3], %[tmp2]                       \n"
+			"addps %[A5], %[tmp1]                       \n"
+			"addps %[A1], %[tmp2]                       \n"
+			"mulps %[x4], %[tmp1]                       \n"
+			"addps %[tmp1], %[tmp2]                     \n"
+			"mulps %[x], %[tmp2]                        \n"
+			/* Now tmp2 contains the result of warp_sin(). */
+			"mulps %[g], %[tmp2]                        \n"
+			"movaps %[tmp2], %[tmp1]                    \n"
+			"unpcklps %[tmp2], %[tmp1]                  \n"
+			"unpckhps %[tmp2], %[tmp2]                  \n"
+			"mulps %[tmp1], %[lo]                       \n"
+			"mulps %[tmp2], %[hi]                       \n"
+			"movdqu %[lo], (%[ptr])                     \n"
+			"movdqu %[hi], 16(%[ptr])                   \n"
+			"add $32, %[ptr]                            \n"
+			"sub $1, %[count]                           \n"
+			"jne 1b                                     \n"
+			: /* output */
+			  "=r"(count),
+			  "=r"(ptr),
+			  "=x"(x),
+			  [x2]"=&x"(x2),
+			  [x4]"=&x"(x4),
+			  [lo]"=&x"(lo),
+			  [hi]"=&x"(hi),
+			  [tmp1]"=&x"(tmp1),
+			  [tmp2]"=&x"(tmp2)
+			: /* input */
+			  [count]"0"(count),
+			  [ptr]"1"(ptr),
+			  [x]"2"(x),
+			  [A1]"x"(A1),
+			  [A3]"x"(A3),
+			  [A5]"x"(A5),
+			  [A7]"x"(A7),
+			  [one]"x"(_mm_set1_ps(1)),
+			  [r4]"x"(_mm_set1_ps(r*r*r*r)),
+			  [g]"x"(_mm_set1_ps(master_linear_gain))
+			: /* clobber */
+			  "memory", "cc"
+			);
+		dk->gain[0].compressor_gain = x[3];
+	}
+}
+#endif
+
+/* Compresses one division of samples. The samples of the two channels are
+ * accessed through ptr_left and ptr_right, which advance by stride floats per
+ * frame. */
+static void dk_compress_output_stride(struct drc_kernel *dk, float *ptr_left,
+				      float *ptr_right, unsigned int stride)
+{
+	const float master_linear_gain = dk->master_linear_gain;
+	const float envelope_rate = dk->gain[0].envelope_rate;
+	const float scaled_desired_gain = dk->gain[0].scaled_desired_gain;
+	const float compressor_gain = dk->gain[0].compressor_gain;
 	unsigned int count = DIVISION_FRAMES / 4;
 
 	unsigned int i, j;
@@ -881,8 +1666,10 @@ static void dk_compress_output(struct drc_kernel *dk)
 					post_warp_compressor_gain;
 
 				/* Apply final gain. */
-				*ptr_left++ *= total_gain;
-				*ptr_right++ *= total_gain;
+				*ptr_left *= total_gain;
+				*ptr_right *= total_gain;
+				ptr_left += stride;
+				ptr_right += stride;
 			}
 
 			if (++i == count)
@@ -892,7 +1679,7 @@ static void dk_compress_output(struct drc_kernel *dk)
 				x[j] = x[j] * r4;
 		}
 
-		dk->compressor_gain = x[3] + base;
+		dk->gain[0].compressor_gain = x[3] + base;
 	} else {
 		/* Release - exponentially increase gain to 1.0 */
 		float c = compressor_gain;
@@ -914,8 +1701,10 @@ static void dk_compress_output(struct drc_kernel *dk)
 					post_warp_compressor_gain;
 
 				/* Apply final gain. */
-				*ptr_left++ *= total_gain;
-				*ptr_right++ *= total_gain;
+				*ptr_left *= total_gain;
+				*ptr_right *= total_gain;
+				ptr_left += stride;
+				ptr_right += stride;
 			}
 
 			if (++i == count)
@@ -925,11 +1714,355 @@ static void dk_compress_output(struct drc_kernel *dk)
 				x[j] = min(1.0f, x[j] * r4);
 		}
 
-		dk->compressor_gain = x[3];
+		dk->gain[0].compressor_gain = x[3];
+	}
+}
+
+static void dk_compress_output_planar(struct drc_kernel *dk)
+{
+	const int div_start = dk->pre_delay_read_index;
+
+	dk_compress_output_stride(dk, &dk->pre_delay_buffers[0][div_start],
+				  &dk->pre_delay_buffers[1][div_start], 1);
+}
+
+static void dk_compress_output_interleaved(struct drc_kernel *dk)
+{
+	float *ptr = &dk->pre_delay_buffers[0][2 * dk->pre_delay_read_index];
+
+	dk_compress_output_stride(dk, ptr, ptr + 1, 2);
+}
+
+#if defined(__x86_64__) || defined(__aarch64__)
+/* Fills x with the compressor gains of the frames of the next division, less
+ * the base gain of an attack, and moves compressor_gain to the end of the
+ * division. The ramp is the same as in dk_compress_output_stride().
+ * Returns:
+ *    The base gain to add to each value of x.
+ */
+static float dk_division_ramp(struct drc_kernel *dk, float *x)
+{
+	const float envelope_rate = dk->gain[0].envelope_rate;
+	const float compressor_gain = dk->gain[0].compressor_gain;
+	float base, c, r, r4;
+	unsigned int i;
+
+	if (envelope_rate < 1) {
+		/* Attack - reduce gain to desired. */
+		base = dk->gain[0].scaled_desired_gain;
+		c = compressor_gain - base;
+		r = 1 - envelope_rate;
+	} else {
+		/* Release - exponentially increase gain to 1.0 */
+		base = 0;
+		c = compressor_gain;
+		r = envelope_rate;
+	}
+	x[0] = c*r;
+	x[1] = c*r*r;
+	x[2] = c*r*r*r;
+	x[3] = c*r*r*r*r;
+	r4 = r*r*r*r;
+
+	for (i = 4; i < DIVISION_FRAMES; i++) {
+		x[i] = x[i - 4] * r4;
+		if (envelope_rate >= 1)
+			x[i] = min(1.0f, x[i]);
 	}
+
+	dk->gain[0].compressor_gain = x[DIVISION_FRAMES - 1] + base;
+	return base;
 }
 #endif
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+/* The AVX kernels apply the gains of a whole division eight or sixteen frames
+ * at a time, from the ramp of dk_division_ramp(). */
+__attribute__((target("avx2")))
+static void dk_compress_output_avx2(struct drc_kernel *dk)
+{
+	const int div_start = dk->pre_delay_read_index;
+	float x[DIVISION_FRAMES] __attribute__ ((aligned (32)));
+	float *ptr;
+	unsigned int i;
+
+	/* See warp_sinf() for the details for the constants. */
+	const __m256 A7 = _mm256_set1_ps(-4.3330336920917034149169921875e-3f);
+	const __m256 A5 = _mm256_set1_ps(7.9434238374233245849609375e-2f);
+	const __m256 A3 = _mm256_set1_ps(-0.645892798900604248046875f);
+	const __m256 A1 = _mm256_set1_ps(1.5707910060882568359375f);
+	const __m256 g = _mm256_set1_ps(dk->master_linear_gain);
+	const __m256 base = _mm256_set1_ps(dk_division_ramp(dk, x));
+
+	/* Turn x into the total gains: warp_sinf() of eight values at a
+	 * time, by the master gain. */
+	for (i = 0; i < DIVISION_FRAMES; i += 8) {
+		__m256 v = _mm256_add_ps(_mm256_load_ps(x + i), base);
+		__m256 v2 = _mm256_mul_ps(v, v);
+		__m256 v4 = _mm256_mul_ps(v2, v2);
+		__m256 t1 = _mm256_add_ps(_mm256_mul_ps(v2, A7), A5);
+		__m256 t2 = _mm256_add_ps(_mm256_mul_ps(v2, A3), A1);
+		t1 = _mm256_mul_ps(t1, v4);
+		t2 = _mm256_mul_ps(_mm256_add_ps(t2, t1), v);
+		_mm256_store_ps(x + i, _mm256_mul_ps(g, t2));
+	}
+
+	if (dk->interleaved) {
+		ptr = &dk->pre_delay_buffers[0][2 * div_start];
+		for (i = 0; i < DIVISION_FRAMES; i += 8, ptr += 16) {
+			__m256 gv = _mm256_load_ps(x + i);
+			__m256 lo = _mm256_unpacklo_ps(gv, gv);
+			__m256 hi = _mm256_unpackhi_ps(gv, gv);
+			_mm256_storeu_ps(ptr, _mm256_mul_ps(
+				_mm256_loadu_ps(ptr),
+				_mm256_permute2f128_ps(lo, hi, 0x20)));
+			_mm256_storeu_ps(ptr + 8, _mm256_mul_ps(
+				_mm256_loadu_ps(ptr + 8),
+				_mm256_permute2f128_ps(lo, hi, 0x31)));
+		}
+	} else {
+		float *left = &dk->pre_delay_buffers[0][div_start];
+		float *right = &dk->pre_delay_buffers[1][div_start];
+		for (i = 0; i < DIVISION_FRAMES; i += 8) {
+			__m256 gv = _mm256_load_ps(x + i);
+			_mm256_storeu_ps(left + i, _mm256_mul_ps(
+				_mm256_loadu_ps(left + i), gv));
+			_mm256_storeu_ps(right + i, _mm256_mul_ps(
+				_mm256_loadu_ps(right + i), gv));
+		}
+	}
+}
+
+/* As dk_compress_output_avx2(), but the polynomial of warp_sinf() uses fused
+ * multiply-adds, so the gains may differ in the last bit. */
+__attribute__((target("avx512f")))
+static void dk_compress_output_avx512(struct drc_kernel *dk)
+{
+	const int div_start = dk->pre_delay_read_index;
+	float x[DIVISION_FRAMES] __attribute__ ((aligned (64)));
+	float *ptr;
+	unsigned int i;
+
+	/* See warp_sinf() for the details for the constants. */
+	const __m512 A7 = _mm512_set1_ps(-4.3330336920917034149169921875e-3f);
+	const __m512 A5 = _mm512_set1_ps(7.9434238374233245849609375e-2f);
+	const __m512 A3 = _mm512_set1_ps(-0.645892798900604248046875f);
+	const __m512 A1 = _mm512_set1_ps(1.5707910060882568359375f);
+	const __m512 g = _mm512_set1_ps(dk->master_linear_gain);
+	const __m512 base = _mm512_set1_ps(dk_division_ramp(dk, x));
+	const __m512i dup_lo = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3,
+						 4, 4, 5, 5, 6, 6, 7, 7);
+	const __m512i dup_hi = _mm512_add_epi32(dup_lo, _mm512_set1_epi32(8));
+
+	for (i = 0; i < DIVISION_FRAMES; i += 16) {
+		__m512 v = _mm512_add_ps(_mm512_load_ps(x + i), base);
+		__m512 v2 = _mm512_mul_ps(v, v);
+		__m512 v4 = _mm512_mul_ps(v2, v2);
+		__m512 t1 = _mm512_fmadd_ps(v2, A7, A5);
+		__m512 t2 = _mm512_fmadd_ps(v2, A3, A1);
+		t2 = _mm512_mul_ps(_mm512_fmadd_ps(t1, v4, t2), v);
+		_mm512_store_ps(x + i, _mm512_mul_ps(g, t2));
+	}
+
+	if (dk->interleaved) {
+		ptr = &dk->pre_delay_buffers[0][2 * div_start];
+		for (i = 0; i < DIVISION_FRAMES; i += 16, ptr += 32) {
+			__m512 gv = _mm512_load_ps(x + i);
+			_mm512_storeu_ps(ptr, _mm512_mul_ps(
+				_mm512_loadu_ps(ptr),
+				_mm512_permutexvar_ps(dup_lo, gv)));
+			_mm512_storeu_ps(ptr + 16, _mm512_mul_ps(
+				_mm512_loadu_ps(ptr + 16),
+				_mm512_permutexvar_ps(dup_hi, gv)));
+		}
+	} else {
+		float *left = &dk->pre_delay_buffers[0][div_start];
+		float *right = &dk->pre_delay_buffers[1][div_start];
+		for (i = 0; i < DIVISION_FRAMES; i += 16) {
+			__m512 gv = _mm512_load_ps(x + i);
+			_mm512_storeu_ps(left + i, _mm512_mul_ps(
+				_mm512_loadu_ps(left + i), gv));
+			_mm512_storeu_ps(right + i, _mm512_mul_ps(
+				_mm512_loadu_ps(right + i), gv));
+		}
+	}
+}
+#endif
+
+#if defined(__aarch64__)
+/* As dk_compress_output_avx512(), four frames at a time with ASIMD. */
+static void dk_compress_output_asimd(struct drc_kernel *dk)
+{
+	const int div_start = dk->pre_delay_read_index;
+	float x[DIVISION_FRAMES] __attribute__ ((aligned (16)));
+	float *left, *right;
+	unsigned int i;
+
+	/* See warp_sinf() for the details for the constants. */
+	const float32x4_t A7 = vdupq_n_f32(-4.3330336920917034149169921875e-3f);
+	const float32x4_t A5 = vdupq_n_f32(7.9434238374233245849609375e-2f);
+	const float32x4_t A3 = vdupq_n_f32(-0.645892798900604248046875f);
+	const float32x4_t A1 = vdupq_n_f32(1.5707910060882568359375f);
+	const float32x4_t g = vdupq_n_f32(dk->master_linear_gain);
+	const float32x4_t base = vdupq_n_f32(dk_division_ramp(dk, x));
+
+	left = &dk->pre_delay_buffers[0][div_start];
+	right = &dk->pre_delay_buffers[1][div_start];
+	if (dk->interleaved)
+		left = &dk->pre_delay_buffers[0][2 * div_start];
+
+	for (i = 0; i < DIVISION_FRAMES; i += 4) {
+		float32x4_t v = vaddq_f32(vld1q_f32(x + i), base);
+		float32x4_t v2 = vmulq_f32(v, v);
+		float32x4_t v4 = vmulq_f32(v2, v2);
+		float32x4_t t1 = vfmaq_f32(A5, v2, A7);
+		float32x4_t t2 = vfmaq_f32(A1, v2, A3);
+		float32x4_t gv;
+
+		t2 = vmulq_f32(vfmaq_f32(t2, t1, v4), v);
+		gv = vmulq_f32(g, t2);
+
+		if (dk->interleaved) {
+			float32x4x2_t s = vld2q_f32(left + 2 * i);
+			s.val[0] = vmulq_f32(s.val[0], gv);
+			s.val[1] = vmulq_f32(s.val[1], gv);
+			vst2q_f32(left + 2 * i, s);
+		} else {
+			vst1q_f32(left + i, vmulq_f32(vld1q_f32(left + i), gv));
+			vst1q_f32(right + i,
+				  vmulq_f32(vld1q_f32(right + i), gv));
+		}
+	}
+}
+#endif
+
+/* Calculates the total gain of each frame of the next output division from a
+ * gain, as dk_compress_output_stride() does, and moves its compressor_gain
+ * to the end of the division. */
+static void dk_division_gains(struct drc_kernel *dk, struct dk_gain *g,
+			      float *gains)
+{
+	const float master_linear_gain = dk->master_linear_gain;
+	unsigned int i;
+	float x;
+
+	if (g->envelope_rate < 1) {
+		/* Attack - reduce gain to desired. */
+		const float base = g->scaled_desired_gain;
+		const float r = 1 - g->envelope_rate;
+
+		x = g->compressor_gain - base;
+		for (i = 0; i < DIVISION_FRAMES; i++) {
+			x *= r;
+			gains[i] = master_linear_gain * warp_sinf(x + base);
+		}
+		g->compressor_gain = x + base;
+	} else {
+		/* Release - exponentially increase gain to 1.0 */
+		const float r = g->envelope_rate;
+
+		x = g->compressor_gain;
+		for (i = 0; i < DIVISION_FRAMES; i++) {
+			x = min(1.0f, x * r);
+			gains[i] = master_linear_gain * warp_sinf(x);
+		}
+		g->compressor_gain = x;
+	}
+}
+
+/* Compresses the next output division with the two gains of the unlinked
+ * and mid/side detectors. */
+static void dk_compress_output_two_gains(struct drc_kernel *dk)
+{
+	float gains[DRC_NUM_CHANNELS][DIVISION_FRAMES];
+	const int div_start = dk->pre_delay_read_index;
+	unsigned int stride = dk->interleaved ? 2 : 1;
+	float *left, *right;
+	unsigned int i;
+
+	if (dk->interleaved) {
+		left = &dk->pre_delay_buffers[0][2 * div_start];
+		right = left + 1;
+	} else {
+		left = &dk->pre_delay_buffers[0][div_start];
+		right = &dk->pre_delay_buffers[1][div_start];
+	}
+
+	dk_division_gains(dk, &dk->gain[0], gains[0]);
+	dk_division_gains(dk, &dk->gain[1], gains[1]);
+
+	if (dk->detector == DK_DETECTOR_MID_SIDE) {
+		for (i = 0; i < DIVISION_FRAMES; i++) {
+			float l = left[i * stride];
+			float r = right[i * stride];
+			float mid = gains[0][i] * (l + r) * 0.5f;
+			float side = gains[1][i] * (l - r) * 0.5f;
+			left[i * stride] = mid + side;
+			right[i * stride] = mid - side;
+		}
+	} else {
+		for (i = 0; i < DIVISION_FRAMES; i++) {
+			left[i * stride] *= gains[0][i];
+			right[i * stride] *= gains[1][i];
+		}
+	}
+}
+
+static void dk_compress_output(struct drc_kernel *dk)
+{
+	const struct dsp_kernels *k = dsp_get_kernels();
+
+	if (dk_has_two_gains(dk))
+		dk_compress_output_two_gains(dk);
+	else if (dk->interleaved)
+		k->dk_compress_output_interleaved(dk);
+	else
+		k->dk_compress_output_planar(dk);
+}
+
+void dk_select_kernels(struct dsp_kernels *kernels, unsigned int features)
+{
+	kernels->dk_compress_output_planar = dk_compress_output_planar;
+	kernels->dk_compress_output_interleaved =
+		dk_compress_output_interleaved;
+#if defined(__ARM_NEON__)
+	if (features & DSP_CPU_NEON) {
+		kernels->dk_compress_output_planar =
+			dk_compress_output_planar_neon;
+		kernels->dk_compress_output_interleaved =
+			dk_compress_output_interleaved_neon;
+	}
+#endif
+#if defined(__aarch64__)
+	/* The ASIMD kernel handles both layouts. */
+	if (features & DSP_CPU_ASIMD) {
+		kernels->dk_compress_output_planar = dk_compress_output_asimd;
+		kernels->dk_compress_output_interleaved =
+			dk_compress_output_asimd;
+	}
+#endif
+#if defined(__x86_64__)
+	if (features & DSP_CPU_SSE3) {
+		kernels->dk_compress_output_planar =
+			dk_compress_output_planar_sse3;
+		kernels->dk_compress_output_interleaved =
+			dk_compress_output_interleaved_sse3;
+	}
+	/* The AVX kernels handle both layouts. */
+	if (features & DSP_CPU_AVX2) {
+		kernels->dk_compress_output_planar = dk_compress_output_avx2;
+		kernels->dk_compress_output_interleaved =
+			dk_compress_output_avx2;
+	}
+	if (features & DSP_CPU_AVX512F) {
+		kernels->dk_compress_output_planar = dk_compress_output_avx512;
+		kernels->dk_compress_output_interleaved =
+			dk_compress_output_avx512;
+	}
+#endif
+}
+
 /* After one complete divison of samples have been received (and one divison of
  * samples have been output), we calculate shaped power average
  * (detector_average) from the input division, update envelope parameters from
@@ -939,10 +2072,37 @@ static void dk_compress_output(struct drc_kernel *dk)
 static void dk_process_one_division(struct drc_kernel *dk)
 {
 	dk_update_detector_average(dk);
-	dk_update_envelope(dk);
+	dk_update_envelopes(dk);
+	if (dk->master_gain_steps > 0) {
+		float target = dk->master_linear_gain_target;
+		if (--dk->master_gain_steps == 0)
+			dk->master_linear_gain = target;
+		else
+			dk->master_linear_gain += (target -
+				dk->master_linear_gain) /
+				(dk->master_gain_steps + 1);
+	}
 	dk_compress_output(dk);
 }
 
+/* Writes frames of the two channels in left and right to the interleaved
+ * pre-delay buffer at write_index, and replaces them with the frames read from
+ * read_index. The two ranges in the pre-delay buffer must not overlap. */
+static void exchange_interleaved(float *buf, int write_index, int read_index,
+				 float *left, float *right, int frames)
+{
+	float *w = &buf[2 * write_index];
+	const float *r = &buf[2 * read_index];
+	int i;
+
+	for (i = 0; i < frames; i++) {
+		w[2 * i] = left[i];
+		w[2 * i + 1] = right[i];
+		left[i] = r[2 * i];
+		right[i] = r[2 * i + 1];
+	}
+}
+
 /* Copy the input data to the pre-delay buffer, and copy the output data back to
  * the input buffer */
 static void dk_copy_fragment(struct drc_kernel *dk, float *data_channels[],
@@ -952,13 +2112,20 @@ static void dk_copy_fragment(struct drc_kernel *dk, float *data_channels[],
 	int read_index = dk->pre_delay_read_index;
 	int j;
 
-	for (j = 0; j < DRC_NUM_CHANNELS; ++j) {
-		memcpy(&dk->pre_delay_buffers[j][write_index],
-		       &data_channels[j][frame_index],
-		       frames_to_process * sizeof(float));
-		memcpy(&data_channels[j][frame_index],
-		       &dk->pre_delay_buffers[j][read_index],
-		       frames_to_process * sizeof(float));
+	if (dk->interleaved) {
+		exchange_interleaved(dk->pre_delay_buffers[0], write_index,
+				     read_index, &data_channels[0][frame_index],
+				     &data_channels[1][frame_index],
+				     frames_to_process);
+	} else {
+		for (j = 0; j < DRC_NUM_CHANNELS; ++j) {
+			memcpy(&dk->pre_delay_buffers[j][write_index],
+			       &data_channels[j][frame_index],
+			       frames_to_process * sizeof(float));
+			memcpy(&data_channels[j][frame_index],
+			       &dk->pre_delay_buffers[j][read_index],
+			       frames_to_process * sizeof(float));
+		}
 	}
 
 	dk->pre_delay_write_index = (write_index + frames_to_process) &
@@ -988,13 +2155,20 @@ static void dk_process_delay_only(struct drc_kernel *dk, float *data_channels[],
 		unsigned int chunk = min(large - small,
 					 MAX_PRE_DELAY_FRAMES - large);
 		chunk = min(chunk, count - i);
-		for (j = 0; j < DRC_NUM_CHANNELS; ++j) {
-			memcpy(&dk->pre_delay_buffers[j][write_index],
-			       &data_channels[j][i],
-			       chunk * sizeof(float));
-			memcpy(&data_channels[j][i],
-			       &dk->pre_delay_buffers[j][read_index],
-			       chunk * sizeof(float));
+		if (dk->interleaved) {
+			exchange_interleaved(dk->pre_delay_buffers[0],
+					     write_index, read_index,
+					     &data_channels[0][i],
+					     &data_channels[1][i], chunk);
+		} else {
+			for (j = 0; j < DRC_NUM_CHANNELS; ++j) {
+				memcpy(&dk->pre_delay_buffers[j][write_index],
+				       &data_channels[j][i],
+				       chunk * sizeof(float));
+				memcpy(&data_channels[j][i],
+				       &dk->pre_delay_buffers[j][read_index],
+				       chunk * sizeof(float));
+			}
 		}
 		read_index = (read_index + chunk) & MAX_PRE_DELAY_FRAMES_MASK;
 		write_index = (write_index + chunk) & MAX_PRE_DELAY_FRAMES_MASK;
@@ -1016,7 +2190,7 @@ void dk_process(struct drc_kernel *dk, float *data_channels[], unsigned count)
 	}
 
 	if (!dk->processed) {
-		dk_update_envelope(dk);
+		dk_update_envelopes(dk);
 		dk_compress_output(dk);
 		dk->processed = 1;
 	}
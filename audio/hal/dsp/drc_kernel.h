@@ -15,29 +15,76 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+#include "dsp_arena.h"
+
 #define DRC_NUM_CHANNELS 2
 
-struct drc_kernel {
-	float sample_rate;
+/* The most divisions the RMS detector averages over. */
+#define DK_MAX_RMS_DIVISIONS 64
+
+/* How the kernel measures the level of its input.
+ * DK_DETECTOR_LINKED - The peak of the louder channel sets one gain for both
+ *     channels. This is the default.
+ * DK_DETECTOR_UNLINKED - Each channel has its own peak detector and gain.
+ * DK_DETECTOR_RMS - The RMS level of both channels over a window sets one
+ *     gain for both channels.
+ * DK_DETECTOR_MID_SIDE - The mid (L+R)/2 and side (L-R)/2 signals each
+ *     have their own peak detector and gain.
+ */
+enum dk_detector {
+	DK_DETECTOR_LINKED,
+	DK_DETECTOR_UNLINKED,
+	DK_DETECTOR_RMS,
+	DK_DETECTOR_MID_SIDE,
+	DK_DETECTOR_LAST
+};
 
-	/* The detector_average is the target gain obtained by looking at the
-	 * future samples in the lookahead buffer and applying the compression
-	 * curve on them. compressor_gain is the gain applied to the current
-	 * samples. compressor_gain moves towards detector_average with the
-	 * speed envelope_rate which is calculated once for each division (32
-	 * frames). */
+/* The gain of one signal the kernel compresses. The detector_average is the
+ * target gain obtained by looking at the future samples in the lookahead
+ * buffer and applying the compression curve on them. compressor_gain is the
+ * gain applied to the current samples. compressor_gain moves towards
+ * detector_average with the speed envelope_rate which is calculated once
+ * for each division (32 frames). */
+struct dk_gain {
 	float detector_average;
 	float compressor_gain;
+	float max_attack_compression_diff_db;
+
+	/* envelope for the current division */
+	float envelope_rate;
+	float scaled_desired_gain;
+};
+
+struct drc_kernel {
+	float sample_rate;
+
+	/* The arena the pre-delay buffers come from, or NULL for the heap. */
+	struct dsp_arena *arena;
+
+	/* The gains of the signals, see enum dk_detector. The linked and RMS
+	 * detectors only use gain[0]. */
+	int detector;
+	struct dk_gain gain[DRC_NUM_CHANNELS];
 	int enabled;
 	int processed;
 
-	/* Lookahead section. */
+	/* Lookahead section. In the default (planar) layout each channel has
+	 * its own pre-delay buffer. If interleaved is set, both channels are
+	 * stored as L/R pairs in pre_delay_buffers[0] (which is then
+	 * 2 * MAX_PRE_DELAY_FRAMES floats long), so the gain of a frame can be
+	 * applied to both channels with one vector multiply. */
+	int interleaved;
 	unsigned last_pre_delay_frames;
 	float *pre_delay_buffers[DRC_NUM_CHANNELS];
 	int pre_delay_read_index;
 	int pre_delay_write_index;
 
-	float max_attack_compression_diff_db;
+	/* The RMS detector keeps the mean square of each of the last
+	 * rms_divisions divisions, and writes the next one at rms_index. */
+	int rms_divisions;
+	int rms_index;
+	float rms_squares[DK_MAX_RMS_DIVISIONS];
 
 	/* Amount of input change in dB required for 1 dB of output change.
 	 * This applies to the portion of the curve above knee_threshold
@@ -68,19 +115,26 @@ struct drc_kernel {
 
 	/* Calculated parameters */
 	float master_linear_gain;
+	/* The master_linear_gain dk_ramp_master_gain() moves to, and the
+	 * number of divisions left to get there. */
+	float master_linear_gain_target;
+	int master_gain_steps;
 	float attack_frames;
 	float sat_release_frames_inv_neg;
 	float sat_release_rate_at_neg_two_db;
 	float knee_alpha, knee_beta;
-
-	/* envelope for the current division */
-	float envelope_rate;
-	float scaled_desired_gain;
 };
 
 /* Initializes a drc kernel */
 void dk_init(struct drc_kernel *dk, float sample_rate);
 
+/* Initializes a drc kernel with its pre-delay buffers from an arena. */
+void dk_init_in_arena(struct drc_kernel *dk, struct dsp_arena *arena,
+		      float sample_rate);
+
+/* Returns the arena space dk_init_in_arena() takes. */
+size_t dk_arena_size();
+
 /* Frees a drc kernel */
 void dk_free(struct drc_kernel *dk);
 
@@ -99,10 +153,43 @@ void dk_set_parameters(struct drc_kernel *dk,
 		       float releaseZone4
 		       );
 
+/* Moves the output gain of a kernel from a previous value to the one
+ * dk_set_parameters() has set, over some frames instead of at once, so a
+ * change of the post gain or of the compression curve does not click. The
+ * gain changes once per division.
+ * Args:
+ *    dk - The DRC kernel.
+ *    from_gain - The master_linear_gain before dk_set_parameters().
+ *    frames - The length of the ramp, 0 to change at once.
+ */
+void dk_ramp_master_gain(struct drc_kernel *dk, float from_gain,
+			 unsigned frames);
+
 /* Enables or disables a drc kernel */
 void dk_set_enabled(struct drc_kernel *dk, int enabled);
 
-/* Performs stereo-linked compression.
+/* Selects how the kernel measures the level of its input. It can be
+ * changed while the kernel runs: a signal which gets its own gain starts
+ * from the gain of the linked signal.
+ * Args:
+ *    dk - The DRC kernel.
+ *    detector - One of enum dk_detector.
+ *    rms_window - The time the RMS detector averages over, in seconds. It
+ *        is rounded to whole divisions, from one to DK_MAX_RMS_DIVISIONS.
+ */
+void dk_set_detector(struct drc_kernel *dk, int detector, float rms_window);
+
+/* Selects the layout of the pre-delay buffer. Switching the layout clears the
+ * samples currently in the lookahead buffer, so this should be called before
+ * the first dk_process().
+ * Args:
+ *    dk - The DRC kernel.
+ *    interleaved - 1 to store the two channels as L/R pairs, 0 to store them
+ *        in separate buffers.
+ */
+void dk_set_interleaved(struct drc_kernel *dk, int interleaved);
+
+/* Performs stereo compression with the detector of the kernel.
  * Args:
  *    dk - The DRC kernel.
  *    data - The pointers to the audio sample buffer. One pointer per channel.
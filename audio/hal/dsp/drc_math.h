@@ -11,6 +11,8 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
 
 /* Uncomment to use the slow but accurate functions. */
@@ -193,6 +195,24 @@ static inline float knee_expf(float input)
 #endif
 }
 
+/* The same approximations on vectors of four or eight floats, which need no
+ * table. See drc_math_vec.h. */
+#define DRC_VEC_LANES 4
+#include "drc_math_vec.h"
+#undef DRC_VEC_LANES
+/* They are static inline, so passing eight lanes without AVX changes no ABI,
+ * which GCC warns about. */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+#define DRC_VEC_LANES 8
+#include "drc_math_vec.h"
+#undef DRC_VEC_LANES
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
 /* Returns 1 for nan or inf, 0 otherwise. This is faster than the alternative
  * return x != 0 && !isnormal(x);
  */
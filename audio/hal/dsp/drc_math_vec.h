@@ -0,0 +1,208 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* The vector versions of the approximations in drc_math.h, for vectors of
+ * DRC_VEC_LANES floats. drc_math.h includes this file once for each width,
+ * which defines the types drc_f32x<N> and drc_i32x<N>, and functions named
+ * like their scalar version with an _x<N> suffix, such as warp_sinf_x4().
+ *
+ * The lanes are computed independently with the GCC vector extensions, so
+ * the compiler uses whichever SIMD instructions the target has. They use
+ * polynomials and the bits of the floats only, never db_to_linear[], and
+ * ignore the SLOW_* options. tests/drc_math_test.c reports their accuracy
+ * against the slow versions.
+ */
+
+#define DRC_VEC_PASTE(a, b) a ## b
+#define DRC_VEC_NAME(a, b) DRC_VEC_PASTE(a, b)
+#define VF DRC_VEC_NAME(drc_f32x, DRC_VEC_LANES)
+#define VI DRC_VEC_NAME(drc_i32x, DRC_VEC_LANES)
+#define FN(name) DRC_VEC_NAME(name ## _x, DRC_VEC_LANES)
+
+typedef float VF __attribute__ ((vector_size (4 * DRC_VEC_LANES)));
+typedef int32_t VI __attribute__ ((vector_size (4 * DRC_VEC_LANES)));
+
+/* Loads a vector from floats at any alignment. */
+static inline VF FN(drc_load)(const float *p)
+{
+	VF v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/* Stores a vector to floats at any alignment. */
+static inline void FN(drc_store)(float *p, VF v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+/* Returns a vector with f in every lane. */
+static inline VF FN(drc_splat)(float f)
+{
+	return (VF){} + f;
+}
+
+/* Returns the lanes of a where the mask from a comparison is set, and those
+ * of b elsewhere. */
+static inline VF FN(drc_select)(VI mask, VF a, VF b)
+{
+	return (VF)((mask & (VI)a) | (~mask & (VI)b));
+}
+
+/* Returns nonzero if any lane of the mask from a comparison is set. */
+static inline int FN(drc_any)(VI mask)
+{
+	int32_t any = 0;
+	int i;
+
+	for (i = 0; i < DRC_VEC_LANES; i++)
+		any |= mask[i];
+	return any;
+}
+
+/* Converts ints in [-2^22, 2^22] to float by adding them to the bits of
+ * 1.5 * 2^23, whose last bit is worth 1. */
+static inline VF FN(drc_to_float)(VI i)
+{
+	return (VF)(i + 0x4b400000) - 12582912.0f;
+}
+
+/* Returns the square root of x >= 0, from the usual guess of its inverse
+ * from the bits of x, and three Newton steps. A zero x gives zero. */
+static inline VF FN(drc_sqrtf)(VF x)
+{
+	VF y = (VF)(0x5f3759df - ((VI)x >> 1));
+
+	y = y * (1.5f - 0.5f * x * y * y);
+	y = y * (1.5f - 0.5f * x * y * y);
+	y = y * (1.5f - 0.5f * x * y * y);
+	return x * y;
+}
+
+/* Returns e^x for x in [-87, 87]. x is split into n * log(2) + r with r in
+ * [-log(2)/2, log(2)/2], and e^r comes from the polynomial of the expf() of
+ * Cephes, with a relative error below 1.2e-7. 2^n is built in the exponent
+ * bits.
+ */
+static inline VF FN(drc_expf)(VF x)
+{
+	const float LOG2E = 1.44269504088896341f;
+	const float C1 = 0.693359375f;   /* log(2) = C1 + C2 */
+	const float C2 = -2.12194440e-4f;
+	VF n, r, p;
+	VI e;
+
+	/* Rounds x / log(2) to an integer, by adding 1.5 * 2^23. */
+	n = x * LOG2E + 12582912.0f;
+	e = (VI)n - 0x4b400000;
+	n = n - 12582912.0f;
+	r = x - n * C1 - n * C2;
+
+	p = 1.9875691500e-4f * r + 1.3981999507e-3f;
+	p = p * r + 8.3334519073e-3f;
+	p = p * r + 4.1665795894e-2f;
+	p = p * r + 1.6666665459e-1f;
+	p = p * r + 5.0000001201e-1f;
+	p = p * r * r + r + 1;
+	return p * (VF)((e + 127) << 23);
+}
+
+/* As decibels_to_linear(), which saturates at +/-100 dB. */
+static inline VF FN(decibels_to_linear)(VF decibels)
+{
+	VF x = FN(drc_select)(decibels < -100.0f, FN(drc_splat)(-100),
+			      decibels);
+
+	x = FN(drc_select)(x > 100.0f, FN(drc_splat)(100), x);
+	/* 10^(x/20) = e^(x * log(10^(1/20))) */
+	return FN(drc_expf)(0.1151292546497022f * x);
+}
+
+/* As linear_to_decibels(), with the same polynomial. The exponent and
+ * mantissa of frexpf() are taken from the bits of each lane. */
+static inline VF FN(linear_to_decibels)(VF linear)
+{
+	const VI bits = (VI)linear;
+	const VI biased = (bits >> 23) & 0xff;
+	VF x = (VF)((bits & 0x007fffff) | 0x3f000000);
+	VF exp = FN(drc_to_float)(biased - 126);
+	VI big = x > 0.707106781186548f;
+	VF x2, x4, y;
+
+	x = FN(drc_select)(big, x * 0.707106781186548f, x);
+	exp = FN(drc_select)(big, exp + 0.5f, exp);
+
+	/* See linear_to_decibels() for the details of the constants. */
+	const float A5 = 1.131880283355712890625f;
+	const float A4 = -4.258677959442138671875f;
+	const float A3 = 6.81631565093994140625f;
+	const float A2 = -6.1185703277587890625f;
+	const float A1 = 3.6505267620086669921875f;
+	const float A0 = -1.217894077301025390625f;
+
+	x2 = x * x;
+	x4 = x2 * x2;
+	y = ((A5 * x + A4)*x4 + (A3 * x + A2)*x2 + (A1 * x + A0)) * 20.0f
+		+ exp * 6.0205999132796239f;
+
+	/* NaN for nan and inf as frexpf_fast(), then a very small dB value
+	 * for negative or zero. */
+	y = FN(drc_select)(biased == 0xff, FN(drc_splat)(NAN), y);
+	return FN(drc_select)(linear <= 0, FN(drc_splat)(-1000), y);
+}
+
+/* As warp_sinf(), with the same polynomial. */
+static inline VF FN(warp_sinf)(VF x)
+{
+	/* See warp_sinf() for the details of the constants. */
+	const float A7 = -4.3330336920917034149169921875e-3f;
+	const float A5 = 7.9434238374233245849609375e-2f;
+	const float A3 = -0.645892798900604248046875f;
+	const float A1 = 1.5707910060882568359375f;
+
+	VF x2 = x * x;
+	VF x4 = x2 * x2;
+	return x * ((A7 * x2 + A5) * x4 + (A3 * x2 + A1));
+}
+
+/* As warp_asinf(), for x in [-1, 1]; larger values count as +/-1. asin() of
+ * |x| comes from the polynomial of the asinf() of Cephes, on x^2 up to 0.5
+ * and on (1 - |x|) / 2 above, with a relative error below 2.5e-7.
+ */
+static inline VF FN(warp_asinf)(VF x)
+{
+	const VI sign = (VI)x & ~0x7fffffff;
+	VF a = (VF)((VI)x & 0x7fffffff);
+	VI big;
+	VF z, s, p;
+
+	a = FN(drc_select)(a > 1.0f, FN(drc_splat)(1), a);
+	big = a > 0.5f;
+	/* asin(a) = pi/2 - 2 * asin(sqrt((1 - a) / 2)) */
+	z = FN(drc_select)(big, 0.5f * (1 - a), a * a);
+	s = FN(drc_select)(big, FN(drc_sqrtf)(z), a);
+
+	p = 4.2163199048e-2f * z + 2.4181311049e-2f;
+	p = p * z + 4.5470025998e-2f;
+	p = p * z + 7.4953002686e-2f;
+	p = p * z + 1.6666752422e-1f;
+	p = p * z * s + s;
+	p = FN(drc_select)(big, PI_OVER_TWO_FLOAT - 2 * p, p);
+
+	return (VF)((VI)(p * TWO_OVER_PI_FLOAT) | sign);
+}
+
+/* As knee_expf(). */
+static inline VF FN(knee_expf)(VF input)
+{
+	/* exp(x) = decibels_to_linear(20*log10(e)*x) */
+	return FN(decibels_to_linear)(8.685889638065044f * input);
+}
+
+#undef FN
+#undef VI
+#undef VF
+#undef DRC_VEC_NAME
+#undef DRC_VEC_PASTE
@@ -0,0 +1,79 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dsp_arena.h"
+
+/* Allocates zero filled, aligned memory from the heap. */
+static void *heap_calloc(size_t size)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, DSP_ARENA_ALIGN, size ? size : 1) != 0)
+		return NULL;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+struct dsp_arena *dsp_arena_new(size_t size)
+{
+	struct dsp_arena *arena;
+
+	arena = (struct dsp_arena *)calloc(1, sizeof(*arena));
+	if (!arena)
+		return NULL;
+
+	arena->size = dsp_arena_size(size);
+	arena->base = (char *)heap_calloc(arena->size);
+	if (!arena->base) {
+		free(arena);
+		return NULL;
+	}
+	return arena;
+}
+
+void dsp_arena_free(struct dsp_arena *arena)
+{
+	if (!arena)
+		return;
+	free(arena->base);
+	free(arena);
+}
+
+void *dsp_arena_calloc(struct dsp_arena *arena, size_t size)
+{
+	size_t n = dsp_arena_size(size);
+	char *ptr;
+
+	if (!arena || n > arena->size - arena->used)
+		return heap_calloc(size);
+
+	ptr = arena->base + arena->used;
+	arena->used += n;
+	/* The memory may have been used before dsp_arena_reset(). */
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+void dsp_arena_release(struct dsp_arena *arena, void *ptr)
+{
+	char *p = (char *)ptr;
+
+	if (arena && p >= arena->base && p < arena->base + arena->size)
+		return;
+	free(ptr);
+}
+
+size_t dsp_arena_mark(struct dsp_arena *arena)
+{
+	return arena ? arena->used : 0;
+}
+
+void dsp_arena_reset(struct dsp_arena *arena, size_t mark)
+{
+	if (arena && mark <= arena->used)
+		arena->used = mark;
+}
@@ -0,0 +1,74 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef DSP_ARENA_H_
+#define DSP_ARENA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/* An arena is one block of memory which the audio buffers and the state of
+ * the modules of a pipeline are carved from. Allocations are never freed
+ * one by one; the whole arena is freed at once. When an arena is full (or
+ * NULL is passed as the arena), the allocation functions fall back to the
+ * heap, so callers do not have to handle that case. */
+
+/* The alignment of every allocation, a cache line. */
+#define DSP_ARENA_ALIGN 64
+
+struct dsp_arena {
+	char *base;
+	size_t size;
+	size_t used;
+};
+
+/* Returns the arena space taken by an allocation of the given size. This
+ * is used to calculate the size hints of the modules. */
+static inline size_t dsp_arena_size(size_t size)
+{
+	return (size + DSP_ARENA_ALIGN - 1) & ~(size_t)(DSP_ARENA_ALIGN - 1);
+}
+
+/* Creates an arena. The memory is zero filled now, so the pages are mapped
+ * when the pipeline is loaded rather than when it first runs.
+ * Args:
+ *    size - The number of bytes in the arena.
+ * Returns:
+ *    The arena, or NULL if there is not enough memory.
+ */
+struct dsp_arena *dsp_arena_new(size_t size);
+
+/* Frees an arena and all the memory allocated from it. */
+void dsp_arena_free(struct dsp_arena *arena);
+
+/* Allocates zero filled memory aligned to DSP_ARENA_ALIGN.
+ * Args:
+ *    arena - The arena to allocate from. If it is NULL or full, the memory
+ *        comes from the heap.
+ *    size - The number of bytes to allocate.
+ * Returns:
+ *    The memory, or NULL if there is not enough memory.
+ */
+void *dsp_arena_calloc(struct dsp_arena *arena, size_t size);
+
+/* Releases memory from dsp_arena_calloc(). It is freed if it came from the
+ * heap, and left alone if it came from the arena. */
+void dsp_arena_release(struct dsp_arena *arena, void *ptr);
+
+/* Returns the current allocation position, to pass to dsp_arena_reset(). */
+size_t dsp_arena_mark(struct dsp_arena *arena);
+
+/* Makes the memory allocated after the given mark available again. The
+ * allocations made after the mark must not be used anymore. */
+void dsp_arena_reset(struct dsp_arena *arena, size_t mark);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* DSP_ARENA_H_ */
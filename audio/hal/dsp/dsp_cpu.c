@@ -0,0 +1,55 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#if defined(__arm__) || defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
+#include "dsp_cpu.h"
+
+#ifndef HWCAP_NEON
+#define HWCAP_NEON (1 << 12)	/* 32 bit ARM */
+#endif
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD (1 << 1)	/* AArch64 */
+#endif
+
+/* The detected features, or -1 before the first call. Detecting twice gives
+ * the same value, so racing callers are harmless. */
+static int detected = -1;
+
+static unsigned int detect_features()
+{
+	unsigned int features = 0;
+
+#if defined(DSP_ASIMD_EMUL)
+	/* A host build of the AArch64 kernels on the emulated intrinsics of
+	 * tests/neon_emul, see golden_test_asimd_emul in Android.mk. */
+	features |= DSP_CPU_ASIMD;
+#elif defined(__i386__) || defined(__x86_64__)
+	/* This also checks that the OS saves the AVX registers. */
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse3"))
+		features |= DSP_CPU_SSE3;
+	if (__builtin_cpu_supports("avx2"))
+		features |= DSP_CPU_AVX2;
+	if (__builtin_cpu_supports("avx512f"))
+		features |= DSP_CPU_AVX512F;
+#elif defined(__aarch64__)
+	if (getauxval(AT_HWCAP) & HWCAP_ASIMD)
+		features |= DSP_CPU_ASIMD;
+#elif defined(__arm__)
+	if (getauxval(AT_HWCAP) & HWCAP_NEON)
+		features |= DSP_CPU_NEON;
+#endif
+	return features;
+}
+
+unsigned int dsp_cpu_features()
+{
+	if (detected < 0)
+		detected = detect_features();
+	return detected;
+}
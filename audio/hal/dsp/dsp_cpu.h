@@ -0,0 +1,30 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef DSP_CPU_H_
+#define DSP_CPU_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The CPU features the kernels can use. A build for one architecture only
+ * reports the features of that architecture. */
+enum {
+	DSP_CPU_SSE3 = 1 << 0,
+	DSP_CPU_AVX2 = 1 << 1,
+	DSP_CPU_AVX512F = 1 << 2,
+	DSP_CPU_NEON = 1 << 3,	/* NEON on 32 bit ARM */
+	DSP_CPU_ASIMD = 1 << 4,	/* Advanced SIMD on AArch64 */
+};
+
+/* Returns the DSP_CPU_* flags of the features this CPU and the OS support. */
+unsigned int dsp_cpu_features();
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* DSP_CPU_H_ */
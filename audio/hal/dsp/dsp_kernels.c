@@ -0,0 +1,54 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <string.h>
+
+#include "dsp_cpu.h"
+#include "dsp_kernels.h"
+
+const struct dsp_backend dsp_backends[] = {
+	{ "c", 0 },
+	{ "sse3", DSP_CPU_SSE3 },
+	{ "avx2", DSP_CPU_SSE3 | DSP_CPU_AVX2 },
+	{ "avx512f", DSP_CPU_SSE3 | DSP_CPU_AVX2 | DSP_CPU_AVX512F },
+	{ "neon", DSP_CPU_NEON },
+	{ "asimd", DSP_CPU_ASIMD },
+	{ NULL, 0 },
+};
+
+static struct dsp_kernels kernels;
+static int selected;
+
+void dsp_kernels_select(unsigned int mask)
+{
+	unsigned int features = dsp_cpu_features() & mask;
+	struct dsp_kernels k;
+
+	/* Fill in a copy, so the table never holds a NULL kernel which is
+	 * about to be set. */
+	memset(&k, 0, sizeof(k));
+	k.features = features;
+	eq2_select_kernels(&k, features);
+	crossover2_select_kernels(&k, features);
+	dk_select_kernels(&k, features);
+	drc_select_kernels(&k, features);
+	dsp_util_select_kernels(&k, features);
+	kernels = k;
+	selected = 1;
+}
+
+const struct dsp_kernels *dsp_get_kernels()
+{
+	/* Selecting twice fills in the same kernels, so racing callers are
+	 * harmless. */
+	if (!selected)
+		dsp_kernels_select(~0U);
+	return &kernels;
+}
+
+int dsp_backend_supported(const struct dsp_backend *backend)
+{
+	return (dsp_cpu_features() & backend->features) == backend->features;
+}
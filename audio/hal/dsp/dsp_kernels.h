@@ -0,0 +1,99 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef DSP_KERNELS_H_
+#define DSP_KERNELS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "biquad.h"
+#include "crossover2.h"
+#include "drc_kernel.h"
+
+/* The kernels the modules run, picked for the features of the CPU. Each
+ * module fills in its own kernels with its *_select_kernels() function, so
+ * the kernels of all the backends the library is built with are in one
+ * binary. A NULL kernel means the module uses its C code. */
+struct dsp_kernels {
+	/* The DSP_CPU_* features the kernels were picked for. */
+	unsigned int features;
+
+	/* Runs two, four or eight biquads of both channels of an eq2. */
+	void (*eq2_process_two)(struct biquad (*bq)[2], float *data0,
+				float *data1, int count);
+	void (*eq2_process_four)(struct biquad (*bq)[2], float *data0,
+				 float *data1, int count);
+	void (*eq2_process_eight)(struct biquad (*bq)[2], float *data0,
+				  float *data1, int count);
+
+	/* Splits with, or runs through, a pair of crossover2 filters. */
+	void (*lr42_split)(struct lr42 *lp, struct lr42 *hp, int count,
+			   float *data0L, float *data0R,
+			   float *data1L, float *data1R);
+	void (*lr42_merge)(struct lr42 *lp, struct lr42 *hp, int count,
+			   float *dataL, float *dataR);
+
+	/* Applies the gain of a compressor to one division of samples. */
+	void (*dk_compress_output_planar)(struct drc_kernel *dk);
+	void (*dk_compress_output_interleaved)(struct drc_kernel *dk);
+
+	/* Adds the two upper bands of the drc to the lowest one. */
+	void (*sum3)(float *data, float *data1, float *data2, int n);
+
+	/* Convert between interleaved int16_t and planar float samples. The
+	 * multi channel kernels return the number of frames they converted,
+	 * and leave the rest to the C code. */
+	void (*deinterleave_stereo)(int16_t *input, float *output1,
+				    float *output2, int frames);
+	void (*interleave_stereo)(float *input1, float *input2,
+				  int16_t *output, int frames);
+	int (*deinterleave_multi)(int16_t *input, float *const *output,
+				  int channels, int frames);
+	int (*interleave_multi)(float *const *input, int16_t *output,
+				int channels, int frames);
+};
+
+/* A set of kernels which can be forced with dsp_kernels_select(). */
+struct dsp_backend {
+	const char *name;
+	unsigned int features;
+};
+
+/* The backends, from the slowest to the fastest of each architecture, and
+ * then { NULL, 0 }. The "c" backend uses no feature. */
+extern const struct dsp_backend dsp_backends[];
+
+/* Picks the fastest kernels which only use the features of the CPU which
+ * are in mask. cras_dsp_init() calls it with ~0U. Tests and benchmarks pass
+ * the features of a backend to run its kernels. It must not be called while
+ * a module is processing samples.
+ */
+void dsp_kernels_select(unsigned int mask);
+
+/* Returns the kernels picked by the last dsp_kernels_select(), which is
+ * called with ~0U if it has not been yet. */
+const struct dsp_kernels *dsp_get_kernels();
+
+/* Returns 1 if the CPU has all the features of the backend, 0 otherwise. */
+int dsp_backend_supported(const struct dsp_backend *backend);
+
+/* Fill in the kernels of each module for the given features. */
+void eq2_select_kernels(struct dsp_kernels *kernels, unsigned int features);
+void crossover2_select_kernels(struct dsp_kernels *kernels,
+			       unsigned int features);
+void dk_select_kernels(struct dsp_kernels *kernels, unsigned int features);
+void drc_select_kernels(struct dsp_kernels *kernels, unsigned int features);
+void dsp_util_select_kernels(struct dsp_kernels *kernels,
+			     unsigned int features);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* DSP_KERNELS_H_ */
@@ -3,6 +3,10 @@
  * found in the LICENSE file.
  */
 
+#include <string.h>
+
+#include "dsp_cpu.h"
+#include "dsp_kernels.h"
 #include "dsp_util.h"
 
 #ifndef max
@@ -17,14 +21,13 @@
 			_a < _b ? _a : _b; })
 #endif
 
-#undef deinterleave_stereo
-#undef interleave_stereo
-
-#ifdef __ARM_NEON__
+#if defined(__ARM_NEON__) || defined(__aarch64__)
 #include <arm_neon.h>
+#endif
 
-static void deinterleave_stereo(int16_t *input, float *output1,
-				float *output2, int frames)
+#ifdef __ARM_NEON__
+static void deinterleave_stereo_neon(int16_t *input, float *output1,
+				     float *output2, int frames)
 {
 	/* Process 8 frames (16 samples) each loop. */
 	/* L0 R0 L1 R1 L2 R2 L3 R3... -> L0 L1 L2 L3... R0 R1 R2 R3... */
@@ -63,10 +66,9 @@ static void deinterleave_stereo(int16_t *input, float *output1,
 		*output2++ = *input++ / 32768.0f;
 	}
 }
-#define deinterleave_stereo deinterleave_stereo
 
-static void interleave_stereo(float *input1, float *input2,
-			      int16_t *output, int frames)
+static void interleave_stereo_neon(float *input1, float *input2,
+				   int16_t *output, int frames)
 {
 	/* Process 4 frames (8 samples) each loop. */
 	/* L0 L1 L2 L3, R0 R1 R2 R3 -> L0 R0 L1 R1, L2 R2 L3 R3 */
@@ -126,15 +128,192 @@ static void interleave_stereo(float *input1, float *input2,
 		*output++ = max(-32768, min(32767, (int)(f * 32768.0f)));
 	}
 }
-#define interleave_stereo interleave_stereo
 
 #endif
 
-#ifdef __SSE3__
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+/* Converts 8 int16_t samples to float and stores them to output. */
+static inline void store_s16x8(float *output, int16x8_t x)
+{
+	int32x4_t lo = vmovl_s16(vget_low_s16(x));
+	int32x4_t hi = vmovl_s16(vget_high_s16(x));
+	vst1q_f32(output, vcvtq_n_f32_s32(lo, 15));
+	vst1q_f32(output + 4, vcvtq_n_f32_s32(hi, 15));
+}
+
+/* Converts 4 float samples to int32_t the same way as the scalar code in
+ * dsp_util_interleave() does: scale, saturate, then round half away from
+ * zero. */
+static inline int32x4_t f32_to_s32(float32x4_t f)
+{
+	float32x4_t half;
+
+	f = vmulq_n_f32(f, 32768.0f);
+	f = vminq_f32(vmaxq_f32(f, vdupq_n_f32(-32768.0f)),
+		      vdupq_n_f32(32767.0f));
+	half = vbslq_f32(vcgtq_f32(f, vdupq_n_f32(0)), vdupq_n_f32(0.5f),
+			 vdupq_n_f32(-0.5f));
+	return vcvtq_s32_f32(vaddq_f32(f, half));
+}
+
+/* Loads 8 float samples from input and converts them to int16_t. */
+static inline int16x8_t load_s16x8(const float *input)
+{
+	return vcombine_s16(vmovn_s32(f32_to_s32(vld1q_f32(input))),
+			    vmovn_s32(f32_to_s32(vld1q_f32(input + 4))));
+}
+
+/* Deinterleaves 4, 6 or 8 channels, 8 frames each loop. vld3/vld4 leave two
+ * channels in each register for 6 and 8 channels, which vuzp separates.
+ * Returns the number of frames processed. */
+static int deinterleave_multi_neon(int16_t *input, float *const *output,
+				   int channels, int frames)
+{
+	int i, k, chunk = frames >> 3;
+
+	switch (channels) {
+	case 4:
+		for (i = 0; i < chunk; i++) {
+			int16x8x4_t v = vld4q_s16(input);
+			input += 32;
+			for (k = 0; k < 4; k++)
+				store_s16x8(output[k] + i * 8, v.val[k]);
+		}
+		break;
+	case 6:
+		for (i = 0; i < chunk; i++) {
+			int16x8x3_t a = vld3q_s16(input);
+			int16x8x3_t b = vld3q_s16(input + 24);
+			input += 48;
+			for (k = 0; k < 3; k++) {
+				int16x8x2_t u = vuzpq_s16(a.val[k], b.val[k]);
+				store_s16x8(output[k] + i * 8, u.val[0]);
+				store_s16x8(output[k + 3] + i * 8,
+					    u.val[1]);
+			}
+		}
+		break;
+	case 8:
+		for (i = 0; i < chunk; i++) {
+			int16x8x4_t a = vld4q_s16(input);
+			int16x8x4_t b = vld4q_s16(input + 32);
+			input += 64;
+			for (k = 0; k < 4; k++) {
+				int16x8x2_t u = vuzpq_s16(a.val[k], b.val[k]);
+				store_s16x8(output[k] + i * 8, u.val[0]);
+				store_s16x8(output[k + 4] + i * 8,
+					    u.val[1]);
+			}
+		}
+		break;
+	default:
+		return 0;
+	}
+	return chunk << 3;
+}
+
+/* Interleaves 4, 6 or 8 channels, 8 frames each loop. The inverse of
+ * deinterleave_multi_neon(). Returns the number of frames processed. */
+static int interleave_multi_neon(float *const *input, int16_t *output,
+				 int channels, int frames)
+{
+	int i, k, chunk = frames >> 3;
+
+	switch (channels) {
+	case 4:
+		for (i = 0; i < chunk; i++) {
+			int16x8x4_t v;
+			for (k = 0; k < 4; k++)
+				v.val[k] = load_s16x8(input[k] + i * 8);
+			vst4q_s16(output, v);
+			output += 32;
+		}
+		break;
+	case 6:
+		for (i = 0; i < chunk; i++) {
+			int16x8x3_t a, b;
+			for (k = 0; k < 3; k++) {
+				int16x8x2_t z = vzipq_s16(
+					load_s16x8(input[k] + i * 8),
+					load_s16x8(input[k + 3] + i * 8));
+				a.val[k] = z.val[0];
+				b.val[k] = z.val[1];
+			}
+			vst3q_s16(output, a);
+			vst3q_s16(output + 24, b);
+			output += 48;
+		}
+		break;
+	case 8:
+		for (i = 0; i < chunk; i++) {
+			int16x8x4_t a, b;
+			for (k = 0; k < 4; k++) {
+				int16x8x2_t z = vzipq_s16(
+					load_s16x8(input[k] + i * 8),
+					load_s16x8(input[k + 4] + i * 8));
+				a.val[k] = z.val[0];
+				b.val[k] = z.val[1];
+			}
+			vst4q_s16(output, a);
+			vst4q_s16(output + 32, b);
+			output += 64;
+		}
+		break;
+	default:
+		return 0;
+	}
+	return chunk << 3;
+}
+#endif
+
+#if defined(__aarch64__)
+/* Deinterleaves two channels with ASIMD, 8 frames each loop. */
+static void deinterleave_stereo_asimd(int16_t *input, float *output1,
+				      float *output2, int frames)
+{
+	int i;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		int16x8x2_t x = vld2q_s16(input + 2 * i);
+		store_s16x8(output1 + i, x.val[0]);
+		store_s16x8(output2 + i, x.val[1]);
+	}
+	for (; i < frames; i++) {
+		output1[i] = input[2 * i] / 32768.0f;
+		output2[i] = input[2 * i + 1] / 32768.0f;
+	}
+}
+
+/* Interleaves two channels with ASIMD, 8 frames each loop. Rounds like
+ * dsp_util_interleave(). */
+static void interleave_stereo_asimd(float *input1, float *input2,
+				    int16_t *output, int frames)
+{
+	int i;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		int16x8x2_t y;
+		y.val[0] = load_s16x8(input1 + i);
+		y.val[1] = load_s16x8(input2 + i);
+		vst2q_s16(output + 2 * i, y);
+	}
+	for (; i < frames; i++) {
+		float f = input1[i] * 32768.0f;
+		float g = input2[i] * 32768.0f;
+		f = max(-32768.0f, min(32767.0f, f));
+		g = max(-32768.0f, min(32767.0f, g));
+		output[2 * i] = (int16_t)(f > 0 ? f + 0.5f : f - 0.5f);
+		output[2 * i + 1] = (int16_t)(g > 0 ? g + 0.5f : g - 0.5f);
+	}
+}
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
 #include <emmintrin.h>
 
-static void deinterleave_stereo(int16_t *input, float *output1,
-				float *output2, int frames)
+__attribute__((target("sse3")))
+static void deinterleave_stereo_sse3(int16_t *input, float *output1,
+				     float *output2, int frames)
 {
 	/* Process 8 frames (16 samples) each loop. */
 	/* L0 R0 L1 R1 L2 R2 L3 R3... -> L0 L1 L2 L3... R0 R1 R2 R3... */
@@ -187,10 +366,10 @@ static void deinterleave_stereo(int16_t *input, float *output1,
 		*output2++ = *input++ / 32768.0f;
 	}
 }
-#define deinterleave_stereo deinterleave_stereo
 
-static void interleave_stereo(float *input1, float *input2,
-			      int16_t *output, int frames)
+__attribute__((target("sse3")))
+static void interleave_stereo_sse3(float *input1, float *input2,
+				   int16_t *output, int frames)
 {
 	/* Process 4 frames (8 samples) each loop. */
 	/* L0 L1 L2 L3, R0 R1 R2 R3 -> L0 R0 L1 R1, L2 R2 L3 R3 */
@@ -243,25 +422,169 @@ static void interleave_stereo(float *input1, float *input2,
 		*output++ = max(-32768, min(32767, (int)(f * 32768.0f)));
 	}
 }
-#define interleave_stereo interleave_stereo
+
+/* Converts the 4 int16_t samples in the low half of x to float. */
+static inline __m128 s16_lo_to_f32(__m128i x)
+{
+	return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(
+				_mm_unpacklo_epi16(x, x), 16)),
+			  _mm_set1_ps(1.0f / 32768.0f));
+}
+
+/* Converts the 4 int16_t samples in the high half of x to float. */
+static inline __m128 s16_hi_to_f32(__m128i x)
+{
+	return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(
+				_mm_unpackhi_epi16(x, x), 16)),
+			  _mm_set1_ps(1.0f / 32768.0f));
+}
+
+/* Converts 4 float samples to int32_t the same way as the scalar code in
+ * dsp_util_interleave() does: scale, saturate, then round half away from
+ * zero. */
+static inline __m128i f32_to_s32_sse3(__m128 f)
+{
+	__m128 half;
+
+	f = _mm_mul_ps(f, _mm_set1_ps(32768.0f));
+	f = _mm_min_ps(_mm_max_ps(f, _mm_set1_ps(-32768.0f)),
+		       _mm_set1_ps(32767.0f));
+	half = _mm_cmpgt_ps(f, _mm_setzero_ps());
+	half = _mm_or_ps(_mm_and_ps(half, _mm_set1_ps(0.5f)),
+			 _mm_andnot_ps(half, _mm_set1_ps(-0.5f)));
+	return _mm_cvttps_epi32(_mm_add_ps(f, half));
+}
+
+/* Loads two int16_t samples, e.g. the last two channels of a 6 channel
+ * frame, without reading past them. */
+static inline __m128i load_s16x2(const int16_t *input)
+{
+	int32_t v;
+	memcpy(&v, input, sizeof(v));
+	return _mm_cvtsi32_si128(v);
+}
+
+static inline void store_s16x2(int16_t *output, __m128i x)
+{
+	int32_t v = _mm_cvtsi128_si32(x);
+	memcpy(output, &v, sizeof(v));
+}
+
+/* Deinterleaves 4, 6 or 8 channels, 4 frames each loop. Each frame is
+ * converted to one (4 channels) or two (6 and 8 channels) vectors, which are
+ * then transposed. Returns the number of frames processed. */
+__attribute__((target("sse3")))
+static int deinterleave_multi_sse3(int16_t *input, float *const *output,
+				   int channels, int frames)
+{
+	int i, k, chunk = frames >> 2;
+	__m128 lo[4], hi[4];
+
+	if (channels != 4 && channels != 6 && channels != 8)
+		return 0;
+
+	for (i = 0; i < chunk; i++) {
+		for (k = 0; k < 4; k++) {
+			const int16_t *frame = input + k * channels;
+			if (channels == 4) {
+				lo[k] = s16_lo_to_f32(
+					_mm_loadl_epi64((__m128i *)frame));
+			} else if (channels == 6) {
+				lo[k] = s16_lo_to_f32(
+					_mm_loadl_epi64((__m128i *)frame));
+				hi[k] = s16_lo_to_f32(load_s16x2(frame + 4));
+			} else {
+				__m128i x = _mm_loadu_si128((__m128i *)frame);
+				lo[k] = s16_lo_to_f32(x);
+				hi[k] = s16_hi_to_f32(x);
+			}
+		}
+		input += 4 * channels;
+
+		_MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+		for (k = 0; k < 4; k++)
+			_mm_storeu_ps(output[k] + i * 4, lo[k]);
+		if (channels == 4)
+			continue;
+		_MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+		for (k = 0; k < channels - 4; k++)
+			_mm_storeu_ps(output[k + 4] + i * 4, hi[k]);
+	}
+	return chunk << 2;
+}
+
+/* Interleaves 4, 6 or 8 channels, 4 frames each loop. The inverse of
+ * deinterleave_multi_sse3(). Returns the number of frames processed. */
+__attribute__((target("sse3")))
+static int interleave_multi_sse3(float *const *input, int16_t *output,
+				 int channels, int frames)
+{
+	int i, k, chunk = frames >> 2;
+	__m128 lo[4], hi[4];
+
+	if (channels != 4 && channels != 6 && channels != 8)
+		return 0;
+
+	for (i = 0; i < chunk; i++) {
+		for (k = 0; k < 4; k++)
+			lo[k] = _mm_loadu_ps(input[k] + i * 4);
+		_MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+
+		if (channels == 4) {
+			_mm_storeu_si128((__m128i *)output,
+				_mm_packs_epi32(f32_to_s32_sse3(lo[0]),
+						f32_to_s32_sse3(lo[1])));
+			_mm_storeu_si128((__m128i *)(output + 8),
+				_mm_packs_epi32(f32_to_s32_sse3(lo[2]),
+						f32_to_s32_sse3(lo[3])));
+			output += 16;
+			continue;
+		}
+
+		for (k = 0; k < 4; k++)
+			hi[k] = k < channels - 4 ?
+				_mm_loadu_ps(input[k + 4] + i * 4) :
+				_mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+
+		for (k = 0; k < 4; k++) {
+			__m128i x = _mm_packs_epi32(f32_to_s32_sse3(lo[k]),
+						    f32_to_s32_sse3(hi[k]));
+			if (channels == 8) {
+				_mm_storeu_si128((__m128i *)output, x);
+			} else {
+				_mm_storel_epi64((__m128i *)output, x);
+				store_s16x2(output + 4,
+					    _mm_srli_si128(x, 8));
+			}
+			output += channels;
+		}
+	}
+	return chunk << 2;
+}
 
 #endif
 
 void dsp_util_deinterleave(int16_t *input, float *const *output, int channels,
 			   int frames)
 {
+	const struct dsp_kernels *k = dsp_get_kernels();
 	float *output_ptr[channels];
-	int i, j;
+	int i, j, done = 0;
 
-#ifdef deinterleave_stereo
-	if (channels == 2) {
-		deinterleave_stereo(input, output[0], output[1], frames);
+	if (channels == 2 && k->deinterleave_stereo) {
+		k->deinterleave_stereo(input, output[0], output[1], frames);
 		return;
 	}
-#endif
+
+	if (k->deinterleave_multi) {
+		done = k->deinterleave_multi(input, output, channels, frames);
+		input += done * channels;
+		frames -= done;
+	}
 
 	for (i = 0; i < channels; i++)
-		output_ptr[i] = output[i];
+		output_ptr[i] = output[i] + done;
 
 	for (i = 0; i < frames; i++)
 		for (j = 0; j < channels; j++)
@@ -271,18 +594,23 @@ void dsp_util_deinterleave(int16_t *input, float *const *output, int channels,
 void dsp_util_interleave(float *const *input, int16_t *output, int channels,
 			 int frames)
 {
+	const struct dsp_kernels *k = dsp_get_kernels();
 	float *input_ptr[channels];
-	int i, j;
+	int i, j, done = 0;
 
-#ifdef interleave_stereo
-	if (channels == 2) {
-		interleave_stereo(input[0], input[1], output, frames);
+	if (channels == 2 && k->interleave_stereo) {
+		k->interleave_stereo(input[0], input[1], output, frames);
 		return;
 	}
-#endif
+
+	if (k->interleave_multi) {
+		done = k->interleave_multi(input, output, channels, frames);
+		output += done * channels;
+		frames -= done;
+	}
 
 	for (i = 0; i < channels; i++)
-		input_ptr[i] = input[i];
+		input_ptr[i] = input[i] + done;
 
 	for (i = 0; i < frames; i++)
 		for (j = 0; j < channels; j++) {
@@ -298,6 +626,436 @@ void dsp_util_interleave(float *const *input, int16_t *output, int channels,
 		}
 }
 
+void dsp_util_select_kernels(struct dsp_kernels *kernels,
+			     unsigned int features)
+{
+#if defined(__ARM_NEON__)
+	if (features & DSP_CPU_NEON) {
+		kernels->deinterleave_stereo = deinterleave_stereo_neon;
+		kernels->interleave_stereo = interleave_stereo_neon;
+		kernels->deinterleave_multi = deinterleave_multi_neon;
+		kernels->interleave_multi = interleave_multi_neon;
+	}
+#endif
+#if defined(__aarch64__)
+	if (features & DSP_CPU_ASIMD) {
+		kernels->deinterleave_stereo = deinterleave_stereo_asimd;
+		kernels->interleave_stereo = interleave_stereo_asimd;
+		kernels->deinterleave_multi = deinterleave_multi_neon;
+		kernels->interleave_multi = interleave_multi_neon;
+	}
+#endif
+#if defined(__i386__) || defined(__x86_64__)
+	if (features & DSP_CPU_SSE3) {
+		kernels->deinterleave_stereo = deinterleave_stereo_sse3;
+		kernels->interleave_stereo = interleave_stereo_sse3;
+		kernels->deinterleave_multi = deinterleave_multi_sse3;
+		kernels->interleave_multi = interleave_multi_sse3;
+	}
+#endif
+}
+
+int dsp_util_sample_bytes(enum dsp_sample_format format)
+{
+	switch (format) {
+	case DSP_SAMPLE_FORMAT_S16_LE:
+		return 2;
+	case DSP_SAMPLE_FORMAT_S24_3LE:
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+/* Reads one sample of a 32-bit format. The buffers of the integer formats are
+ * not always aligned, so go through memcpy. */
+static inline int32_t read_s32(const uint8_t *p)
+{
+	int32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void write_s32(uint8_t *p, int32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+/* Scales a float sample by "scale", saturates it to [-scale, scale - 1] and
+ * rounds half away from zero, like dsp_util_interleave() does for int16_t. */
+static inline int32_t float_to_int(float f, double scale)
+{
+	double d = f * scale;
+	if (d > scale - 1)
+		return (int32_t)(scale - 1);
+	if (d < -scale)
+		return (int32_t)-scale;
+	return (int32_t)(d > 0 ? d + 0.5 : d - 0.5);
+}
+
+void dsp_util_deinterleave_format(const uint8_t *input, float *const *output,
+				  int channels, enum dsp_sample_format format,
+				  int frames)
+{
+	int i, j;
+
+	switch (format) {
+	case DSP_SAMPLE_FORMAT_S16_LE:
+		dsp_util_deinterleave((int16_t *)input, output, channels,
+				      frames);
+		break;
+	case DSP_SAMPLE_FORMAT_S24_3LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				/* Put the 24 bits at the top of an int32_t and
+				 * shift back to sign extend. */
+				uint32_t u = (input[0] << 8) |
+					     (input[1] << 16) |
+					     ((uint32_t)input[2] << 24);
+				output[j][i] = ((int32_t)u >> 8) / 8388608.0f;
+				input += 3;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S24_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				/* Ignore the top byte, sign extend bit 23. */
+				uint32_t u = (uint32_t)read_s32(input) << 8;
+				output[j][i] = ((int32_t)u >> 8) / 8388608.0f;
+				input += 4;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S32_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				output[j][i] = read_s32(input) / 2147483648.0f;
+				input += 4;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_FLOAT_LE:
+		/* Already float, only deinterleave. */
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				memcpy(&output[j][i], input, sizeof(float));
+				input += 4;
+			}
+		break;
+	}
+}
+
+void dsp_util_interleave_format(float *const *input, uint8_t *output,
+				int channels, enum dsp_sample_format format,
+				int frames)
+{
+	int i, j;
+
+	switch (format) {
+	case DSP_SAMPLE_FORMAT_S16_LE:
+		dsp_util_interleave(input, (int16_t *)output, channels,
+				    frames);
+		break;
+	case DSP_SAMPLE_FORMAT_S24_3LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				int32_t v = float_to_int(input[j][i],
+							 8388608.0);
+				output[0] = v;
+				output[1] = v >> 8;
+				output[2] = v >> 16;
+				output += 3;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S24_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				write_s32(output, float_to_int(input[j][i],
+							       8388608.0));
+				output += 4;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S32_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				write_s32(output, float_to_int(input[j][i],
+							       2147483648.0));
+				output += 4;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_FLOAT_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				memcpy(output, &input[j][i], sizeof(float));
+				output += 4;
+			}
+		break;
+	}
+}
+
+void dsp_util_copy_channels(const uint8_t *input, int in_channels,
+			    uint8_t *output, int out_channels, int channels,
+			    enum dsp_sample_format format, int frames)
+{
+	size_t sample_bytes = dsp_util_sample_bytes(format);
+	size_t in_stride = in_channels * sample_bytes;
+	size_t out_stride = out_channels * sample_bytes;
+	size_t copy_bytes = channels * sample_bytes;
+	int i;
+
+	/* Same layout: one block copy, or nothing at all in place. */
+	if (in_channels == out_channels && channels == out_channels) {
+		if (input != output)
+			memcpy(output, input, frames * out_stride);
+		return;
+	}
+
+	for (i = 0; i < frames; i++) {
+		memmove(output, input, copy_bytes);
+		memset(output + copy_bytes, 0, out_stride - copy_bytes);
+		input += in_stride;
+		output += out_stride;
+	}
+}
+
+/* Q31 samples are int32_t where INT32_MIN is -1.0. The integer formats are
+ * shifted to the top of the int32_t and back, so they are converted without
+ * any loss. */
+
+/* Rounds a Q31 sample to the top "bits" bits, and saturates it. */
+static inline int32_t q31_to_int(int32_t v, int bits)
+{
+	int shift = 32 - bits;
+	int64_t r = ((int64_t)v + (1 << (shift - 1))) >> shift;
+	int32_t limit = 1 << (bits - 1);
+
+	if (r > limit - 1)
+		return limit - 1;
+	return (int32_t)r;
+}
+
+static inline int32_t float_to_q31(float f)
+{
+	return float_to_int(f, 2147483648.0);
+}
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+/* Converts two channels of int16_t to Q31, 8 frames each loop. Returns the
+ * number of frames processed. */
+static int deinterleave_stereo_q31(const int16_t *input, int32_t *output1,
+				   int32_t *output2, int frames)
+{
+	int i;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		int16x8x2_t x = vld2q_s16(input + 2 * i);
+		vst1q_s32(output1 + i, vshll_n_s16(vget_low_s16(x.val[0]), 16));
+		vst1q_s32(output1 + i + 4,
+			  vshll_n_s16(vget_high_s16(x.val[0]), 16));
+		vst1q_s32(output2 + i, vshll_n_s16(vget_low_s16(x.val[1]), 16));
+		vst1q_s32(output2 + i + 4,
+			  vshll_n_s16(vget_high_s16(x.val[1]), 16));
+	}
+	return i;
+}
+
+/* Rounds two channels of Q31 to int16_t with a saturating narrow, 8 frames
+ * each loop. Returns the number of frames processed. */
+static int interleave_stereo_q31(const int32_t *input1, const int32_t *input2,
+				 int16_t *output, int frames)
+{
+	int i;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		int16x8x2_t y;
+		y.val[0] = vcombine_s16(vqrshrn_n_s32(vld1q_s32(input1 + i), 16),
+					vqrshrn_n_s32(vld1q_s32(input1 + i + 4),
+						      16));
+		y.val[1] = vcombine_s16(vqrshrn_n_s32(vld1q_s32(input2 + i), 16),
+					vqrshrn_n_s32(vld1q_s32(input2 + i + 4),
+						      16));
+		vst2q_s16(output + 2 * i, y);
+	}
+	return i;
+}
+#else
+static int deinterleave_stereo_q31(const int16_t *input, int32_t *output1,
+				   int32_t *output2, int frames)
+{
+	return 0;
+}
+
+static int interleave_stereo_q31(const int32_t *input1, const int32_t *input2,
+				 int16_t *output, int frames)
+{
+	return 0;
+}
+#endif
+
+void dsp_util_deinterleave_q31(const uint8_t *input, int32_t *const *output,
+			       int channels, enum dsp_sample_format format,
+			       int frames)
+{
+	int i = 0, j;
+
+	switch (format) {
+	case DSP_SAMPLE_FORMAT_S16_LE:
+		if (channels == 2)
+			i = deinterleave_stereo_q31((const int16_t *)input,
+						    output[0], output[1],
+						    frames);
+		input += i * channels * 2;
+		for (; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				int16_t v;
+				memcpy(&v, input, sizeof(v));
+				output[j][i] = (int32_t)((uint32_t)v << 16);
+				input += 2;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S24_3LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				output[j][i] = (int32_t)((input[0] << 8) |
+							 (input[1] << 16) |
+							 ((uint32_t)input[2]
+							  << 24));
+				input += 3;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S24_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				output[j][i] = (int32_t)((uint32_t)read_s32(
+							 input) << 8);
+				input += 4;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S32_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				output[j][i] = read_s32(input);
+				input += 4;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_FLOAT_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				float f;
+				memcpy(&f, input, sizeof(f));
+				output[j][i] = float_to_q31(f);
+				input += 4;
+			}
+		break;
+	}
+}
+
+void dsp_util_interleave_q31(int32_t *const *input, uint8_t *output,
+			     int channels, enum dsp_sample_format format,
+			     int frames)
+{
+	int i = 0, j;
+
+	switch (format) {
+	case DSP_SAMPLE_FORMAT_S16_LE:
+		if (channels == 2)
+			i = interleave_stereo_q31(input[0], input[1],
+						  (int16_t *)output, frames);
+		output += i * channels * 2;
+		for (; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				int16_t v = q31_to_int(input[j][i], 16);
+				memcpy(output, &v, sizeof(v));
+				output += 2;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S24_3LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				int32_t v = q31_to_int(input[j][i], 24);
+				output[0] = v;
+				output[1] = v >> 8;
+				output[2] = v >> 16;
+				output += 3;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S24_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				write_s32(output, q31_to_int(input[j][i], 24));
+				output += 4;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_S32_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				write_s32(output, input[j][i]);
+				output += 4;
+			}
+		break;
+	case DSP_SAMPLE_FORMAT_FLOAT_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++) {
+				float f = input[j][i] / 2147483648.0f;
+				memcpy(output, &f, sizeof(f));
+				output += 4;
+			}
+		break;
+	}
+}
+
+static inline int32_t sat_add_q31(int32_t a, int32_t b)
+{
+	int64_t sum = (int64_t)a + b;
+
+	if (sum > INT32_MAX)
+		return INT32_MAX;
+	if (sum < INT32_MIN)
+		return INT32_MIN;
+	return (int32_t)sum;
+}
+
+/* Both inputs of a frame are loaded before its outputs are stored, so the
+ * outputs can be the inputs in any order. */
+void dsp_util_mix_stereo_q31(const int32_t *input1, const int32_t *input2,
+			     int32_t *output1, int32_t *output2, int count)
+{
+	int i = 0;
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+	for (; i + 4 <= count; i += 4) {
+		int32x4_t sum = vqaddq_s32(vld1q_s32(input1 + i),
+					   vld1q_s32(input2 + i));
+		vst1q_s32(output1 + i, sum);
+		vst1q_s32(output2 + i, sum);
+	}
+#endif
+	for (; i < count; i++) {
+		int32_t sum = sat_add_q31(input1[i], input2[i]);
+		output1[i] = sum;
+		output2[i] = sum;
+	}
+}
+
+void dsp_util_invert_lr_q31(const int32_t *input1, const int32_t *input2,
+			    int32_t *output1, int32_t *output2, int count)
+{
+	int i = 0;
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+	for (; i + 4 <= count; i += 4) {
+		int32x4_t left = vqnegq_s32(vld1q_s32(input1 + i));
+		int32x4_t right = vld1q_s32(input2 + i);
+		vst1q_s32(output1 + i, left);
+		vst1q_s32(output2 + i, right);
+	}
+#endif
+	for (; i < count; i++) {
+		int32_t left = input1[i] == INT32_MIN ? INT32_MAX : -input1[i];
+		int32_t right = input2[i];
+		output1[i] = left;
+		output2[i] = right;
+	}
+}
+
 void dsp_enable_flush_denormal_to_zero()
 {
 #if defined(__i386__) || defined(__x86_64__)
@@ -308,6 +1066,10 @@ void dsp_enable_flush_denormal_to_zero()
 	int cw;
 	__asm__ __volatile__ ("mrc p10, 7, %0, cr1, cr0, 0" : "=r" (cw));
 	__asm__ __volatile__ ("mcr p10, 7, %0, cr1, cr0, 0" : : "r" (cw | (1 << 24)));
+#elif defined(__aarch64__)
+	uint64_t fpcr;
+	__asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+	__asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr | (1 << 24)));
 #else
 #warning "Don't know how to disable denorms. Performace may suffer."
 #endif
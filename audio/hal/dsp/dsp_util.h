@@ -37,6 +37,120 @@ void dsp_util_deinterleave(int16_t *input, float *const *output, int channels,
 void dsp_util_interleave(float *const *input, int16_t *output, int channels,
 			 int frames);
 
+/* The sample formats the interleaved buffers can have.
+ * S16_LE - 16-bit signed integer.
+ * S24_3LE - 24-bit signed integer packed in 3 bytes.
+ * S24_LE - 24-bit signed integer in the low 3 bytes of a 32-bit word.
+ * S32_LE - 32-bit signed integer.
+ * FLOAT_LE - 32-bit float with range [-1.0, 1.0].
+ */
+enum dsp_sample_format {
+	DSP_SAMPLE_FORMAT_S16_LE,
+	DSP_SAMPLE_FORMAT_S24_3LE,
+	DSP_SAMPLE_FORMAT_S24_LE,
+	DSP_SAMPLE_FORMAT_S32_LE,
+	DSP_SAMPLE_FORMAT_FLOAT_LE,
+};
+
+/* Returns the number of bytes of one sample in the given format. */
+int dsp_util_sample_bytes(enum dsp_sample_format format);
+
+/* Converts from interleaved samples of the given format to non-interleaved
+ * float samples. Integer samples are scaled to range [-1.0, 1.0], float
+ * samples are copied as they are.
+ * Args:
+ *    input - The interleaved input buffer. Every "channels" samples is a frame.
+ *    output - Pointers to output buffers. There are "channels" output buffers.
+ *    channels - The number of samples per frame.
+ *    format - The format of the samples in input.
+ *    frames - The number of frames to convert.
+ */
+void dsp_util_deinterleave_format(const uint8_t *input, float *const *output,
+				  int channels, enum dsp_sample_format format,
+				  int frames);
+
+/* Converts from non-interleaved float samples to interleaved samples of the
+ * given format. This is the inverse of dsp_util_deinterleave_format(). Integer
+ * samples are saturated to their range, float samples are copied as they are.
+ * Args:
+ *    input - Pointers to input buffers. There are "channels" input buffers.
+ *    output - The interleaved output buffer. Every "channels" samples is a
+ *        frame.
+ *    channels - The number of samples per frame.
+ *    format - The format of the samples in output.
+ *    frames - The number of frames to convert.
+ */
+void dsp_util_interleave_format(float *const *input, uint8_t *output,
+				int channels, enum dsp_sample_format format,
+				int frames);
+
+/* Converts from interleaved samples of the given format to non-interleaved
+ * Q31 fixed point samples, which are int32_t where INT32_MIN is -1.0. The
+ * integer samples are moved to the top bits, so they keep all their bits.
+ * Float samples are scaled and saturated.
+ * Args:
+ *    input - The interleaved input buffer. Every "channels" samples is a frame.
+ *    output - Pointers to output buffers. There are "channels" output buffers.
+ *    channels - The number of samples per frame.
+ *    format - The format of the samples in input.
+ *    frames - The number of frames to convert.
+ */
+void dsp_util_deinterleave_q31(const uint8_t *input, int32_t *const *output,
+			       int channels, enum dsp_sample_format format,
+			       int frames);
+
+/* Converts from non-interleaved Q31 samples to interleaved samples of the
+ * given format. This is the inverse of dsp_util_deinterleave_q31(). The
+ * samples are rounded to the bits of the format and saturated.
+ * Args:
+ *    input - Pointers to input buffers. There are "channels" input buffers.
+ *    output - The interleaved output buffer. Every "channels" samples is a
+ *        frame.
+ *    channels - The number of samples per frame.
+ *    format - The format of the samples in output.
+ *    frames - The number of frames to convert.
+ */
+void dsp_util_interleave_q31(int32_t *const *input, uint8_t *output,
+			     int channels, enum dsp_sample_format format,
+			     int frames);
+
+/* Runs the mix_stereo module on Q31 samples: both outputs are the sum of the
+ * inputs, saturated. The outputs can be the inputs, in either order.
+ * Args:
+ *    input1, input2 - The samples of the two input channels.
+ *    output1, output2 - The samples of the two output channels.
+ *    count - The number of samples in each channel.
+ */
+void dsp_util_mix_stereo_q31(const int32_t *input1, const int32_t *input2,
+			     int32_t *output1, int32_t *output2, int count);
+
+/* Runs the invert_lr module on Q31 samples: the first channel is negated,
+ * with -1.0 saturated to the largest value, and the second is copied. The
+ * outputs can be the inputs, in either order. The arguments are as for
+ * dsp_util_mix_stereo_q31(). */
+void dsp_util_invert_lr_q31(const int32_t *input1, const int32_t *input2,
+			    int32_t *output1, int32_t *output2, int count);
+
+/* Copies interleaved frames to a buffer with another number of channels,
+ * without converting the samples. The first "channels" channels of each
+ * frame are copied, and the other output channels are set to zero. When
+ * the two buffers have the same layout this is one block copy, and nothing
+ * at all if they are the same buffer. The buffers can be the same if
+ * out_channels is not more than in_channels.
+ * Args:
+ *    input - The interleaved input buffer.
+ *    in_channels - The number of samples per input frame.
+ *    output - The interleaved output buffer.
+ *    out_channels - The number of samples per output frame.
+ *    channels - The number of channels to copy, at most in_channels and
+ *        out_channels.
+ *    format - The format of the samples in both buffers.
+ *    frames - The number of frames to copy.
+ */
+void dsp_util_copy_channels(const uint8_t *input, int in_channels,
+			    uint8_t *output, int out_channels, int channels,
+			    enum dsp_sample_format format, int frames);
+
 /* Disables denormal numbers in floating point calculation. Denormal numbers
  * happens often in IIR filters, and it can be very slow.
  */
@@ -3,23 +3,168 @@
  * found in the LICENSE file.
  */
 
+#include <math.h>
 #include <stdlib.h>
 #include "eq.h"
 
+/* The coefficients of a biquad for EQ_ENGINE_BLOCK4. For a block of four
+ * inputs x[0..3], the four outputs are
+ *
+ *    y = col[0] * x[-2] + col[1] * x[-1] + col[2] * y[-2] + col[3] * y[-1]
+ *      + col[4] * x[0] + col[5] * x[1] + col[6] * x[2] + col[7] * x[3]
+ *
+ * where each col[k] is a 4-vector, and x[-2], x[-1], y[-2], y[-1] are the
+ * state left by the previous block. */
+struct eq_block4 {
+	float col[8][4] __attribute__ ((aligned (16)));
+};
+
+/* A biquad for eq_process_q31(). The coefficients are scaled by 2^shift,
+ * and the state is in Q31. */
+struct biquad_q31 {
+	int32_t b0, b1, b2;
+	int32_t a1, a2;
+	int shift;
+	int32_t x1, x2;
+	int32_t y1, y2;
+};
+
+/* The block coefficients of struct eq_block4 for eq_process_q31(), scaled
+ * by 2^shift. */
+struct eq_block4_q31 {
+	int32_t col[8][4] __attribute__ ((aligned (16)));
+	int shift;
+};
+
 struct eq {
+	struct dsp_arena *arena;
 	int n;
+	enum eq_engine engine;
 	struct biquad biquad[MAX_BIQUADS_PER_EQ];
+	struct eq_block4 block4[MAX_BIQUADS_PER_EQ];
+	struct biquad_q31 biquad_q31[MAX_BIQUADS_PER_EQ];
+	struct eq_block4_q31 block4_q31[MAX_BIQUADS_PER_EQ];
+	/* The coefficients eq_set_biquad() moves the biquads to, and the
+	 * number of steps of BIQUAD_FADE_FRAMES left to get there. */
+	struct biquad target[MAX_BIQUADS_PER_EQ];
+	int fade_steps;
 };
 
 struct eq *eq_new()
 {
-	struct eq *eq = (struct eq *)calloc(1, sizeof(*eq));
+	return eq_new_with_engine(EQ_ENGINE_SERIAL);
+}
+
+struct eq *eq_new_with_engine(enum eq_engine engine)
+{
+	return eq_new_in_arena(NULL, engine);
+}
+
+struct eq *eq_new_in_arena(struct dsp_arena *arena, enum eq_engine engine)
+{
+	struct eq *eq = (struct eq *)dsp_arena_calloc(arena, sizeof(*eq));
+	eq->arena = arena;
+	eq->engine = engine;
 	return eq;
 }
 
+size_t eq_arena_size()
+{
+	return dsp_arena_size(sizeof(struct eq));
+}
+
 void eq_free(struct eq *eq)
 {
-	free(eq);
+	dsp_arena_release(eq->arena, eq);
+}
+
+/* Computes the block coefficients of a biquad by running the recurrence for
+ * four samples with one of the state or input values set to one. This is done
+ * in double for better accuracy. */
+static void block4_response(const struct biquad *q, double col[8][4])
+{
+	int k, n;
+
+	for (k = 0; k < 8; k++) {
+		/* x[-2], x[-1], x[0], ..., x[3], and the same for y */
+		double x[6] = {0};
+		double y[6] = {0};
+
+		if (k < 2)
+			x[k] = 1;
+		else if (k < 4)
+			y[k - 2] = 1;
+		else
+			x[k - 2] = 1;
+
+		for (n = 2; n < 6; n++)
+			y[n] = (double)q->b0 * x[n] + (double)q->b1 * x[n - 1]
+				+ (double)q->b2 * x[n - 2]
+				- (double)q->a1 * y[n - 1]
+				- (double)q->a2 * y[n - 2];
+
+		for (n = 0; n < 4; n++)
+			col[k][n] = y[n + 2];
+	}
+}
+
+/* Returns the power of two to scale coefficients of up to max in magnitude
+ * by, so they stay below 2^28. A sum of eight of their products with Q31
+ * samples then fits in an int64_t. */
+static int q31_shift(double max)
+{
+	int shift = 28;
+
+	while (shift > 1 && ldexp(max, shift) >= 268435456.0)
+		shift--;
+	return shift;
+}
+
+/* Rounds a sum of products with coefficients scaled by 2^shift back to Q31,
+ * and saturates it. */
+static inline int32_t q31_narrow(int64_t acc, int shift)
+{
+	acc = (acc + ((int64_t)1 << (shift - 1))) >> shift;
+	if (acc > INT32_MAX)
+		return INT32_MAX;
+	if (acc < INT32_MIN)
+		return INT32_MIN;
+	return (int32_t)acc;
+}
+
+/* Sets the coefficients of all the engines from biquad i. The Q31 state is
+ * kept. */
+static void eq_set_coefficients(struct eq *eq, int i)
+{
+	const struct biquad *q = &eq->biquad[i];
+	struct biquad_q31 *f = &eq->biquad_q31[i];
+	struct eq_block4_q31 *fblk = &eq->block4_q31[i];
+	double col[8][4];
+	double max;
+	int k, n;
+
+	block4_response(q, col);
+	for (k = 0; k < 8; k++)
+		for (n = 0; n < 4; n++)
+			eq->block4[i].col[k][n] = col[k][n];
+
+	max = fmax(fmax(fabs(q->b0), fabs(q->b1)), fabs(q->b2));
+	max = fmax(max, fmax(fabs(q->a1), fabs(q->a2)));
+	f->shift = q31_shift(max);
+	f->b0 = lrint(ldexp(q->b0, f->shift));
+	f->b1 = lrint(ldexp(q->b1, f->shift));
+	f->b2 = lrint(ldexp(q->b2, f->shift));
+	f->a1 = lrint(ldexp(q->a1, f->shift));
+	f->a2 = lrint(ldexp(q->a2, f->shift));
+
+	max = 0;
+	for (k = 0; k < 8; k++)
+		for (n = 0; n < 4; n++)
+			max = fmax(max, fabs(col[k][n]));
+	fblk->shift = q31_shift(max);
+	for (k = 0; k < 8; k++)
+		for (n = 0; n < 4; n++)
+			fblk->col[k][n] = lrint(ldexp(col[k][n], fblk->shift));
 }
 
 int eq_append_biquad(struct eq *eq, enum biquad_type type, float freq, float Q,
@@ -27,7 +172,10 @@ int eq_append_biquad(struct eq *eq, enum biquad_type type, float freq, float Q,
 {
 	if (eq->n >= MAX_BIQUADS_PER_EQ)
 		return -1;
-	biquad_set(&eq->biquad[eq->n++], type, freq, Q, gain);
+	biquad_set(&eq->biquad[eq->n], type, freq, Q, gain);
+	eq_set_coefficients(eq, eq->n);
+	eq->target[eq->n] = eq->biquad[eq->n];
+	eq->n++;
 	return 0;
 }
 
@@ -35,10 +183,220 @@ int eq_append_biquad_direct(struct eq *eq, const struct biquad *biquad)
 {
 	if (eq->n >= MAX_BIQUADS_PER_EQ)
 		return -1;
-	eq->biquad[eq->n++] = *biquad;
+	eq->biquad[eq->n] = *biquad;
+	eq_set_coefficients(eq, eq->n);
+	eq->target[eq->n] = *biquad;
+	eq->n++;
 	return 0;
 }
 
+/* Runs one biquad over count samples with EQ_ENGINE_BLOCK4. count must be a
+ * multiple of four. The state is kept in a vector as {x[-2], x[-1], y[-2],
+ * y[-1]}, which is the upper half of the last input and output block. */
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+static void block4_process(struct biquad *q, const struct eq_block4 *blk,
+			   float *data, int count)
+{
+	const float32x4_t c0 = vld1q_f32(blk->col[0]);
+	const float32x4_t c1 = vld1q_f32(blk->col[1]);
+	const float32x4_t c2 = vld1q_f32(blk->col[2]);
+	const float32x4_t c3 = vld1q_f32(blk->col[3]);
+	const float32x4_t d0 = vld1q_f32(blk->col[4]);
+	const float32x4_t d1 = vld1q_f32(blk->col[5]);
+	const float32x4_t d2 = vld1q_f32(blk->col[6]);
+	const float32x4_t d3 = vld1q_f32(blk->col[7]);
+	float32x2_t sx = {q->x2, q->x1};
+	float32x2_t sy = {q->y2, q->y1};
+	float32x4_t x, y;
+	float32x2_t xl, xh;
+	int j;
+
+	for (j = 0; j < count; j += 4) {
+		x = vld1q_f32(data + j);
+		xl = vget_low_f32(x);
+		xh = vget_high_f32(x);
+		/* The input part does not depend on the previous block. */
+		y = vmulq_lane_f32(d0, xl, 0);
+		y = vmlaq_lane_f32(y, d1, xl, 1);
+		y = vmlaq_lane_f32(y, d2, xh, 0);
+		y = vmlaq_lane_f32(y, d3, xh, 1);
+		y = vmlaq_lane_f32(y, c0, sx, 0);
+		y = vmlaq_lane_f32(y, c1, sx, 1);
+		y = vmlaq_lane_f32(y, c2, sy, 0);
+		y = vmlaq_lane_f32(y, c3, sy, 1);
+		vst1q_f32(data + j, y);
+		sx = xh;
+		sy = vget_high_f32(y);
+	}
+
+	q->x2 = vget_lane_f32(sx, 0);
+	q->x1 = vget_lane_f32(sx, 1);
+	q->y2 = vget_lane_f32(sy, 0);
+	q->y1 = vget_lane_f32(sy, 1);
+}
+#elif defined(__SSE3__)
+#include <emmintrin.h>
+#define LANE(v, i) _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i))
+static void block4_process(struct biquad *q, const struct eq_block4 *blk,
+			   float *data, int count)
+{
+	const __m128 c0 = _mm_load_ps(blk->col[0]);
+	const __m128 c1 = _mm_load_ps(blk->col[1]);
+	const __m128 c2 = _mm_load_ps(blk->col[2]);
+	const __m128 c3 = _mm_load_ps(blk->col[3]);
+	const __m128 d0 = _mm_load_ps(blk->col[4]);
+	const __m128 d1 = _mm_load_ps(blk->col[5]);
+	const __m128 d2 = _mm_load_ps(blk->col[6]);
+	const __m128 d3 = _mm_load_ps(blk->col[7]);
+	__m128 s = _mm_setr_ps(q->x2, q->x1, q->y2, q->y1);
+	__m128 x, y, t;
+	int j;
+
+	for (j = 0; j < count; j += 4) {
+		x = _mm_loadu_ps(data + j);
+		/* The input part does not depend on the previous block. */
+		y = _mm_mul_ps(d0, LANE(x, 0));
+		t = _mm_mul_ps(d1, LANE(x, 1));
+		y = _mm_add_ps(y, _mm_mul_ps(d2, LANE(x, 2)));
+		t = _mm_add_ps(t, _mm_mul_ps(d3, LANE(x, 3)));
+		y = _mm_add_ps(y, _mm_mul_ps(c0, LANE(s, 0)));
+		t = _mm_add_ps(t, _mm_mul_ps(c1, LANE(s, 1)));
+		y = _mm_add_ps(y, _mm_mul_ps(c2, LANE(s, 2)));
+		t = _mm_add_ps(t, _mm_mul_ps(c3, LANE(s, 3)));
+		y = _mm_add_ps(y, t);
+		_mm_storeu_ps(data + j, y);
+		s = _mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	q->x2 = s[0];
+	q->x1 = s[1];
+	q->y2 = s[2];
+	q->y1 = s[3];
+}
+#undef LANE
+#else
+static void block4_process(struct biquad *q, const struct eq_block4 *blk,
+			   float *data, int count)
+{
+	float s[4] = {q->x2, q->x1, q->y2, q->y1};
+	float y[4];
+	int j, k, n;
+
+	for (j = 0; j < count; j += 4) {
+		for (n = 0; n < 4; n++) {
+			y[n] = 0;
+			for (k = 0; k < 4; k++)
+				y[n] += blk->col[4 + k][n] * data[j + k]
+					+ blk->col[k][n] * s[k];
+		}
+		s[0] = data[j + 2];
+		s[1] = data[j + 3];
+		s[2] = y[2];
+		s[3] = y[3];
+		for (n = 0; n < 4; n++)
+			data[j + n] = y[n];
+	}
+
+	q->x2 = s[0];
+	q->x1 = s[1];
+	q->y2 = s[2];
+	q->y1 = s[3];
+}
+#endif
+
+/* Runs one biquad over count Q31 samples with EQ_ENGINE_BLOCK4. count must
+ * be a multiple of four. This is block4_process() with 64-bit sums of the
+ * products, rounded back to Q31 once per output sample. */
+#if defined(__ARM_NEON__)
+static void block4_q31_process(struct biquad_q31 *q,
+			       const struct eq_block4_q31 *blk,
+			       int32_t *data, int count)
+{
+	const int32x4_t c0 = vld1q_s32(blk->col[0]);
+	const int32x4_t c1 = vld1q_s32(blk->col[1]);
+	const int32x4_t c2 = vld1q_s32(blk->col[2]);
+	const int32x4_t c3 = vld1q_s32(blk->col[3]);
+	const int32x4_t d0 = vld1q_s32(blk->col[4]);
+	const int32x4_t d1 = vld1q_s32(blk->col[5]);
+	const int32x4_t d2 = vld1q_s32(blk->col[6]);
+	const int32x4_t d3 = vld1q_s32(blk->col[7]);
+	/* The multiplies double the products, so shift one more. */
+	const int64x2_t shift = vdupq_n_s64(-(blk->shift + 1));
+	int32x2_t sx = {q->x2, q->x1};
+	int32x2_t sy = {q->y2, q->y1};
+	int64x2_t lo, hi;
+	int32x4_t x, y;
+	int32x2_t xl, xh;
+	int j;
+
+#define MAC(c, v, lane)							\
+	do {								\
+		lo = vqdmlal_lane_s32(lo, vget_low_s32(c), v, lane);	\
+		hi = vqdmlal_lane_s32(hi, vget_high_s32(c), v, lane);	\
+	} while (0)
+
+	for (j = 0; j < count; j += 4) {
+		x = vld1q_s32(data + j);
+		xl = vget_low_s32(x);
+		xh = vget_high_s32(x);
+		lo = vqdmull_lane_s32(vget_low_s32(d0), xl, 0);
+		hi = vqdmull_lane_s32(vget_high_s32(d0), xl, 0);
+		MAC(d1, xl, 1);
+		MAC(d2, xh, 0);
+		MAC(d3, xh, 1);
+		MAC(c0, sx, 0);
+		MAC(c1, sx, 1);
+		MAC(c2, sy, 0);
+		MAC(c3, sy, 1);
+		/* Round, and saturate to 32 bits. */
+		lo = vqrshlq_s64(lo, shift);
+		hi = vqrshlq_s64(hi, shift);
+		y = vcombine_s32(vqmovn_s64(lo), vqmovn_s64(hi));
+		vst1q_s32(data + j, y);
+		sx = xh;
+		sy = vget_high_s32(y);
+	}
+#undef MAC
+
+	q->x2 = vget_lane_s32(sx, 0);
+	q->x1 = vget_lane_s32(sx, 1);
+	q->y2 = vget_lane_s32(sy, 0);
+	q->y1 = vget_lane_s32(sy, 1);
+}
+#else
+static void block4_q31_process(struct biquad_q31 *q,
+			       const struct eq_block4_q31 *blk,
+			       int32_t *data, int count)
+{
+	int32_t s[4] = {q->x2, q->x1, q->y2, q->y1};
+	int32_t y[4];
+	int64_t acc;
+	int j, k, n;
+
+	for (j = 0; j < count; j += 4) {
+		for (n = 0; n < 4; n++) {
+			acc = 0;
+			for (k = 0; k < 4; k++)
+				acc += (int64_t)blk->col[4 + k][n] * data[j + k]
+					+ (int64_t)blk->col[k][n] * s[k];
+			y[n] = q31_narrow(acc, blk->shift);
+		}
+		s[0] = data[j + 2];
+		s[1] = data[j + 3];
+		s[2] = y[2];
+		s[3] = y[3];
+		for (n = 0; n < 4; n++)
+			data[j + n] = y[n];
+	}
+
+	q->x2 = s[0];
+	q->x1 = s[1];
+	q->y2 = s[2];
+	q->y1 = s[3];
+}
+#endif
+
 /* This is the prototype of the processing loop. */
 void eq_process1(struct eq *eq, float *data, int count)
 {
@@ -74,9 +432,27 @@ void eq_process1(struct eq *eq, float *data, int count)
 
 /* This is the actual processing loop used. It is the unrolled version of the
  * above prototype. */
-void eq_process(struct eq *eq, float *data, int count)
+static void eq_process_chunk(struct eq *eq, float *data, int count)
 {
 	int i, j;
+
+	/* Run the block engine on whole blocks, and leave the remaining samples
+	 * to the serial loop below. Both engines keep the state in the same
+	 * biquad fields, except that the serial loop does not update x1 and x2
+	 * of the second biquad in a pair: they are the same as y1 and y2 of the
+	 * biquad before it, so copy them from there. */
+	if (eq->engine == EQ_ENGINE_BLOCK4) {
+		int blocks = count & ~3;
+		for (i = 1; i < eq->n; i++) {
+			eq->biquad[i].x1 = eq->biquad[i - 1].y1;
+			eq->biquad[i].x2 = eq->biquad[i - 1].y2;
+		}
+		for (i = 0; i < eq->n; i++)
+			block4_process(&eq->biquad[i], &eq->block4[i], data,
+				       blocks);
+		data += blocks;
+		count -= blocks;
+	}
 	for (i = 0; i < eq->n; i += 2) {
 		if (i + 1 == eq->n) {
 			struct biquad *q = &eq->biquad[i];
@@ -150,3 +526,115 @@ void eq_process(struct eq *eq, float *data, int count)
 		}
 	}
 }
+
+/* Moves all biquads one step to their targets. */
+static void eq_step_fade(struct eq *eq)
+{
+	int i;
+
+	for (i = 0; i < eq->n; i++) {
+		biquad_step_to(&eq->biquad[i], &eq->target[i], eq->fade_steps);
+		eq_set_coefficients(eq, i);
+	}
+	eq->fade_steps--;
+}
+
+int eq_set_biquad(struct eq *eq, int index, enum biquad_type type, float freq,
+		  float Q, float gain, int fade_frames)
+{
+	if (index < 0 || index >= eq->n)
+		return -1;
+	biquad_set(&eq->target[index], type, freq, Q, gain);
+	eq->fade_steps = biquad_fade_steps(fade_frames);
+	if (!eq->fade_steps) {
+		eq->fade_steps = 1;
+		eq_step_fade(eq);
+	}
+	return 0;
+}
+
+void eq_process(struct eq *eq, float *data, int count)
+{
+	/* While fading, change the coefficients every BIQUAD_FADE_FRAMES
+	 * frames, so the speed of the fade does not depend on the block
+	 * size. */
+	while (eq->fade_steps > 0 && count > 0) {
+		int chunk = count < BIQUAD_FADE_FRAMES ?
+			count : BIQUAD_FADE_FRAMES;
+		eq_step_fade(eq);
+		eq_process_chunk(eq, data, chunk);
+		data += chunk;
+		count -= chunk;
+	}
+	eq_process_chunk(eq, data, count);
+}
+
+/* Runs one biquad over count Q31 samples, sample by sample. */
+static void biquad_q31_process(struct biquad_q31 *q, int32_t *data, int count)
+{
+	int32_t x1 = q->x1;
+	int32_t x2 = q->x2;
+	int32_t y1 = q->y1;
+	int32_t y2 = q->y2;
+	int j;
+
+	for (j = 0; j < count; j++) {
+		int32_t x = data[j];
+		int64_t acc = (int64_t)q->b0 * x
+			+ (int64_t)q->b1 * x1 + (int64_t)q->b2 * x2
+			- (int64_t)q->a1 * y1 - (int64_t)q->a2 * y2;
+		int32_t y = q31_narrow(acc, q->shift);
+		data[j] = y;
+		x2 = x1;
+		x1 = x;
+		y2 = y1;
+		y1 = y;
+	}
+	q->x1 = x1;
+	q->x2 = x2;
+	q->y1 = y1;
+	q->y2 = y2;
+}
+
+static void eq_process_q31_chunk(struct eq *eq, int32_t *data, int count)
+{
+	int i;
+
+	/* Each fixed point biquad keeps its own input state, so the two
+	 * engines can take turns without copying it. */
+	if (eq->engine == EQ_ENGINE_BLOCK4) {
+		int blocks = count & ~3;
+		for (i = 0; i < eq->n; i++)
+			block4_q31_process(&eq->biquad_q31[i],
+					   &eq->block4_q31[i], data, blocks);
+		data += blocks;
+		count -= blocks;
+	}
+	for (i = 0; i < eq->n; i++)
+		biquad_q31_process(&eq->biquad_q31[i], data, count);
+}
+
+void eq_process_q31(struct eq *eq, int32_t *data, int count)
+{
+	while (eq->fade_steps > 0 && count > 0) {
+		int chunk = count < BIQUAD_FADE_FRAMES ?
+			count : BIQUAD_FADE_FRAMES;
+		eq_step_fade(eq);
+		eq_process_q31_chunk(eq, data, chunk);
+		data += chunk;
+		count -= chunk;
+	}
+	eq_process_q31_chunk(eq, data, count);
+}
+
+int eq_is_identity(const struct eq *eq)
+{
+	int i;
+
+	if (eq->fade_steps)
+		return 0;
+	for (i = 0; i < eq->n; i++)
+		if (!biquad_is_identity(&eq->biquad[i]))
+			return 0;
+	return 1;
+}
@@ -13,16 +13,40 @@ extern "C" {
 /* An EQ is a chain of biquad filters. See Web Audio API spec for details of the
  * biquad filters and their parameters. */
 
+#include <stdint.h>
+
 #include "biquad.h"
+#include "dsp_arena.h"
 
 /* Maximum number of biquad filters an EQ can have */
 #define MAX_BIQUADS_PER_EQ 10
 
 struct eq;
 
-/* Create an EQ. */
+/* The ways to run the biquad cascade of an EQ.
+ *    EQ_ENGINE_SERIAL - Runs the biquad recurrence sample by sample.
+ *    EQ_ENGINE_BLOCK4 - Rewrites each biquad as a state-space update over
+ *        blocks of four samples, so one block is eight vector multiply-adds
+ *        instead of a serial chain of twenty scalar ones. The output differs
+ *        from EQ_ENGINE_SERIAL only by float rounding.
+ */
+enum eq_engine {
+	EQ_ENGINE_SERIAL,
+	EQ_ENGINE_BLOCK4
+};
+
+/* Create an EQ which uses EQ_ENGINE_SERIAL. */
 struct eq *eq_new();
 
+/* Create an EQ which uses the specified engine. */
+struct eq *eq_new_with_engine(enum eq_engine engine);
+
+/* Create an EQ which uses the specified engine, in memory from an arena. */
+struct eq *eq_new_in_arena(struct dsp_arena *arena, enum eq_engine engine);
+
+/* Returns the arena space eq_new_in_arena() takes. */
+size_t eq_arena_size();
+
 /* Free an EQ. */
 void eq_free(struct eq *eq);
 
@@ -52,6 +76,22 @@ int eq_append_biquad(struct eq *eq, enum biquad_type type, float freq, float Q,
  */
 int eq_append_biquad_direct(struct eq *eq, const struct biquad *biquad);
 
+/* Changes the parameters of a biquad filter of an EQ while it runs. The
+ * filter keeps its state and moves to the new coefficients over the next
+ * fade_frames frames of eq_process(), so the change does not click. A
+ * change before the last one has finished continues from where it is.
+ * Args:
+ *    eq - The EQ we want to use.
+ *    index - The index of the biquad, in the order they were appended.
+ *    type, freq, Q, gain - The new parameters, as for eq_append_biquad().
+ *    fade_frames - The number of frames the change takes, 0 to change at
+ *        once.
+ * Returns:
+ *    0 if success. -1 if the EQ has no biquad at index.
+ */
+int eq_set_biquad(struct eq *eq, int index, enum biquad_type type, float freq,
+		  float Q, float gain, int fade_frames);
+
 /* Process a buffer of audio data through the EQ.
  * Args:
  *    eq - The EQ we want to use.
@@ -60,6 +100,22 @@ int eq_append_biquad_direct(struct eq *eq, const struct biquad *biquad);
  */
 void eq_process(struct eq *eq, float *data, int count);
 
+/* Process a buffer of Q31 fixed point samples through the EQ, where
+ * INT32_MIN is -1.0. The coefficients are scaled to 32-bit integers and the
+ * products summed in 64 bits, so the result is close to eq_process() for
+ * signals which do not clip. The fixed point biquads keep their own state,
+ * so an EQ should only be run by one of the two.
+ * Args:
+ *    eq - The EQ we want to use.
+ *    data - The array of audio samples.
+ *    count - The number of elements in the data array to process.
+ */
+void eq_process_q31(struct eq *eq, int32_t *data, int count);
+
+/* Returns 1 if every biquad of the EQ is an identity filter, so
+ * eq_process() leaves the data as it is. Returns 0 otherwise. */
+int eq_is_identity(const struct eq *eq);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -4,48 +4,76 @@
  */
 
 #include <stdlib.h>
+#include "dsp_cpu.h"
+#include "dsp_kernels.h"
 #include "eq2.h"
 
 struct eq2 {
+	struct dsp_arena *arena;
 	int n[2];
 	struct biquad biquad[MAX_BIQUADS_PER_EQ2][2];
+	/* The coefficients eq2_set_biquad() moves the biquads to, and the
+	 * number of steps of BIQUAD_FADE_FRAMES left to get there. */
+	struct biquad target[MAX_BIQUADS_PER_EQ2][2];
+	int fade_steps;
 };
 
 struct eq2 *eq2_new()
 {
-	struct eq2 *eq2 = (struct eq2 *)calloc(1, sizeof(*eq2));
+	return eq2_new_in_arena(NULL);
+}
+
+struct eq2 *eq2_new_in_arena(struct dsp_arena *arena)
+{
+	struct eq2 *eq2 = (struct eq2 *)dsp_arena_calloc(arena, sizeof(*eq2));
 	int i, j;
 
+	eq2->arena = arena;
+
 	/* Initialize all biquads to identity filter, so if two channels have
 	 * different numbers of biquads, it still works. */
 	for (i = 0; i < MAX_BIQUADS_PER_EQ2; i++)
-		for (j = 0; j < 2; j++)
+		for (j = 0; j < 2; j++) {
 			biquad_set(&eq2->biquad[i][j], BQ_NONE, 0, 0, 0);
+			eq2->target[i][j] = eq2->biquad[i][j];
+		}
 
 	return eq2;
 }
 
+size_t eq2_arena_size()
+{
+	return dsp_arena_size(sizeof(struct eq2));
+}
+
 void eq2_free(struct eq2 *eq2)
 {
-	free(eq2);
+	dsp_arena_release(eq2->arena, eq2);
 }
 
 int eq2_append_biquad(struct eq2 *eq2, int channel,
 		      enum biquad_type type, float freq, float Q, float gain)
 {
-	if (eq2->n[channel] >= MAX_BIQUADS_PER_EQ2)
+	int i = eq2->n[channel];
+
+	if (i >= MAX_BIQUADS_PER_EQ2)
 		return -1;
-	biquad_set(&eq2->biquad[eq2->n[channel]++][channel], type, freq, Q,
-		   gain);
+	biquad_set(&eq2->biquad[i][channel], type, freq, Q, gain);
+	eq2->target[i][channel] = eq2->biquad[i][channel];
+	eq2->n[channel]++;
 	return 0;
 }
 
 int eq2_append_biquad_direct(struct eq2 *eq2, int channel,
 			     const struct biquad *biquad)
 {
-	if (eq2->n[channel] >= MAX_BIQUADS_PER_EQ2)
+	int i = eq2->n[channel];
+
+	if (i >= MAX_BIQUADS_PER_EQ2)
 		return -1;
-	eq2->biquad[eq2->n[channel]++][channel] = *biquad;
+	eq2->biquad[i][channel] = *biquad;
+	eq2->target[i][channel] = *biquad;
+	eq2->n[channel]++;
 	return 0;
 }
 
@@ -110,10 +138,18 @@ static inline void eq2_process_one(struct biquad (*bq)[2],
 	qR->y2 = y2R;
 }
 
+/* Runs two biquads of each channel with the C code. */
+static void eq2_process_two(struct biquad (*bq)[2],
+			    float *data0, float *data1, int count)
+{
+	eq2_process_one(&bq[0], data0, data1, count);
+	eq2_process_one(&bq[1], data0, data1, count);
+}
+
 #ifdef __ARM_NEON__
 #include <arm_neon.h>
-static inline void eq2_process_two_neon(struct biquad (*bq)[2],
-					float *data0, float *data1, int count)
+static void eq2_process_two_neon(struct biquad (*bq)[2],
+				 float *data0, float *data1, int count)
 {
 	struct biquad *qL = &bq[0][0];
 	struct biquad *rL = &bq[1][0];
@@ -203,10 +239,92 @@ static inline void eq2_process_two_neon(struct biquad (*bq)[2],
 }
 #endif
 
-#if defined(__SSE3__) && defined(__x86_64__)
+#if defined(__aarch64__)
+#include <arm_neon.h>
+/* Runs two biquads of each channel with ASIMD, as a pipeline: lanes 0 and 1
+ * hold the first biquad of the left and right channels, and lanes 2 and 3
+ * the second one, which is fed the output of the first one for the previous
+ * sample. The products are summed with fused multiply-adds. */
+static void eq2_process_two_asimd(struct biquad (*bq)[2],
+				  float *data0, float *data1, int count)
+{
+	struct biquad *qL = &bq[0][0];
+	struct biquad *rL = &bq[1][0];
+	struct biquad *qR = &bq[0][1];
+	struct biquad *rR = &bq[1][1];
+
+	const uint32x4_t first = {~0U, ~0U, 0, 0};
+	float32x4_t b0 = {qL->b0, qR->b0, rL->b0, rR->b0};
+	float32x4_t b1 = {qL->b1, qR->b1, rL->b1, rR->b1};
+	float32x4_t b2 = {qL->b2, qR->b2, rL->b2, rR->b2};
+	float32x4_t a1 = {qL->a1, qR->a1, rL->a1, rR->a1};
+	float32x4_t a2 = {qL->a2, qR->a2, rL->a2, rR->a2};
+	float32x4_t x1 = {qL->x1, qR->x1, rL->x1, rR->x1};
+	float32x4_t x2 = {qL->x2, qR->x2, rL->x2, rR->x2};
+	float32x4_t y1 = {qL->y1, qR->y1, rL->y1, rR->y1};
+	float32x4_t y2 = {qL->y2, qR->y2, rL->y2, rR->y2};
+	float32x4_t in, y = vdupq_n_f32(0);
+	int t;
+
+	for (t = 0; t <= count; t++) {
+		float32x2_t x = vdup_n_f32(0);
+
+		if (t < count) {
+			x = vset_lane_f32(data0[t], x, 0);
+			x = vset_lane_f32(data1[t], x, 1);
+		}
+		in = vcombine_f32(x, vget_low_f32(y));
+		y = vmulq_f32(b0, in);
+		y = vfmaq_f32(y, b1, x1);
+		y = vfmaq_f32(y, b2, x2);
+		y = vfmsq_f32(y, a1, y1);
+		y = vfmsq_f32(y, a2, y2);
+
+		if (t > 0 && t < count) {
+			x2 = x1;
+			x1 = in;
+			y2 = y1;
+			y1 = y;
+		} else {
+			/* Only the biquads which have a sample. */
+			uint32x4_t m = t ? vmvnq_u32(first) : first;
+
+			x2 = vbslq_f32(m, x1, x2);
+			x1 = vbslq_f32(m, in, x1);
+			y2 = vbslq_f32(m, y1, y2);
+			y1 = vbslq_f32(m, y, y1);
+		}
+
+		if (t > 0) {
+			data0[t - 1] = vgetq_lane_f32(y, 2);
+			data1[t - 1] = vgetq_lane_f32(y, 3);
+		}
+	}
+
+	qL->x1 = vgetq_lane_f32(x1, 0);
+	qL->x2 = vgetq_lane_f32(x2, 0);
+	qL->y1 = vgetq_lane_f32(y1, 0);
+	qL->y2 = vgetq_lane_f32(y2, 0);
+	qR->x1 = vgetq_lane_f32(x1, 1);
+	qR->x2 = vgetq_lane_f32(x2, 1);
+	qR->y1 = vgetq_lane_f32(y1, 1);
+	qR->y2 = vgetq_lane_f32(y2, 1);
+	rL->x1 = vgetq_lane_f32(x1, 2);
+	rL->x2 = vgetq_lane_f32(x2, 2);
+	rL->y1 = vgetq_lane_f32(y1, 2);
+	rL->y2 = vgetq_lane_f32(y2, 2);
+	rR->x1 = vgetq_lane_f32(x1, 3);
+	rR->x2 = vgetq_lane_f32(x2, 3);
+	rR->y1 = vgetq_lane_f32(y1, 3);
+	rR->y2 = vgetq_lane_f32(y2, 3);
+}
+#endif
+
+#if defined(__x86_64__)
 #include <emmintrin.h>
-static inline void eq2_process_two_sse3(struct biquad (*bq)[2],
-					float *data0, float *data1, int count)
+__attribute__((target("sse3")))
+static void eq2_process_two_sse3(struct biquad (*bq)[2],
+				 float *data0, float *data1, int count)
 {
 	struct biquad *qL = &bq[0][0];
 	struct biquad *rL = &bq[1][0];
@@ -314,8 +432,205 @@ static inline void eq2_process_two_sse3(struct biquad (*bq)[2],
 }
 #endif
 
-void eq2_process(struct eq2 *eq2, float *data0, float *data1, int count)
+#if defined(__x86_64__)
+#include <immintrin.h>
+/* The AVX kernels run a cascade of biquads as a pipeline: lane 2 * k + c
+ * holds biquad k of channel c, which is fed the output of biquad k - 1 for
+ * the previous sample. A sample leaves the last biquad a few steps after it
+ * enters the first one, and a biquad only updates its state for the samples
+ * which have reached it. Each lane sums the same products in the same order
+ * as eq2_process_one(), so the output is the same. */
+
+/* Runs four biquads of each channel with AVX2. */
+__attribute__((target("avx2")))
+static void eq2_process_four_avx2(struct biquad (*bq)[2],
+				  float *data0, float *data1, int count)
+{
+	const __m256i shift = _mm256_setr_epi32(0, 1, 0, 1, 2, 3, 4, 5);
+	const __m256i stage = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	float v[9][8] __attribute__ ((aligned (32)));
+	__m256 b0, b1, b2, a1, a2, x1, x2, y1, y2, in, y;
+	int k, t;
+
+	for (k = 0; k < 8; k++) {
+		struct biquad *q = &bq[k / 2][k % 2];
+		v[0][k] = q->b0;
+		v[1][k] = q->b1;
+		v[2][k] = q->b2;
+		v[3][k] = q->a1;
+		v[4][k] = q->a2;
+		v[5][k] = q->x1;
+		v[6][k] = q->x2;
+		v[7][k] = q->y1;
+		v[8][k] = q->y2;
+	}
+	b0 = _mm256_load_ps(v[0]);
+	b1 = _mm256_load_ps(v[1]);
+	b2 = _mm256_load_ps(v[2]);
+	a1 = _mm256_load_ps(v[3]);
+	a2 = _mm256_load_ps(v[4]);
+	x1 = _mm256_load_ps(v[5]);
+	x2 = _mm256_load_ps(v[6]);
+	y1 = _mm256_load_ps(v[7]);
+	y2 = _mm256_load_ps(v[8]);
+	y = _mm256_setzero_ps();
+
+	for (t = 0; t < count + 3; t++) {
+		__m128 x = _mm_setzero_ps();
+
+		if (t < count)
+			x = _mm_unpacklo_ps(_mm_load_ss(data0 + t),
+					    _mm_load_ss(data1 + t));
+		in = _mm256_blend_ps(_mm256_permutevar8x32_ps(y, shift),
+				     _mm256_castps128_ps256(x), 0x03);
+		y = _mm256_mul_ps(b0, in);
+		y = _mm256_add_ps(y, _mm256_mul_ps(b1, x1));
+		y = _mm256_add_ps(y, _mm256_mul_ps(b2, x2));
+		y = _mm256_sub_ps(y, _mm256_mul_ps(a1, y1));
+		y = _mm256_sub_ps(y, _mm256_mul_ps(a2, y2));
+
+		if (t >= 3 && t < count) {
+			x2 = x1;
+			x1 = in;
+			y2 = y1;
+			y1 = y;
+		} else {
+			/* Only the biquads sample t - k has reached. */
+			__m256i n = _mm256_sub_epi32(_mm256_set1_epi32(t),
+						     stage);
+			__m256 m = _mm256_castsi256_ps(_mm256_andnot_si256(
+				_mm256_cmpgt_epi32(_mm256_setzero_si256(), n),
+				_mm256_cmpgt_epi32(_mm256_set1_epi32(count),
+						   n)));
+			x2 = _mm256_blendv_ps(x2, x1, m);
+			x1 = _mm256_blendv_ps(x1, in, m);
+			y2 = _mm256_blendv_ps(y2, y1, m);
+			y1 = _mm256_blendv_ps(y1, y, m);
+		}
+
+		if (t >= 3) {
+			__m128 out = _mm256_extractf128_ps(y, 1);
+			data0[t - 3] = out[2];
+			data1[t - 3] = out[3];
+		}
+	}
+
+	_mm256_store_ps(v[5], x1);
+	_mm256_store_ps(v[6], x2);
+	_mm256_store_ps(v[7], y1);
+	_mm256_store_ps(v[8], y2);
+	for (k = 0; k < 8; k++) {
+		struct biquad *q = &bq[k / 2][k % 2];
+		q->x1 = v[5][k];
+		q->x2 = v[6][k];
+		q->y1 = v[7][k];
+		q->y2 = v[8][k];
+	}
+}
+
+/* AVX-512 implies FMA, and the compiler may fuse a multiply and an add,
+ * which rounds once instead of twice. These forms with explicit rounding are
+ * never fused. */
+#define ROUND512 (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define MUL512(a, b) _mm512_mul_round_ps(a, b, ROUND512)
+#define ADD512(a, b) _mm512_add_round_ps(a, b, ROUND512)
+#define SUB512(a, b) _mm512_sub_round_ps(a, b, ROUND512)
+
+/* Runs eight biquads of each channel with AVX-512. */
+__attribute__((target("avx512f")))
+static void eq2_process_eight_avx512(struct biquad (*bq)[2],
+				     float *data0, float *data1, int count)
 {
+	const __m512i shift = _mm512_setr_epi32(0, 1, 0, 1, 2, 3, 4, 5,
+						6, 7, 8, 9, 10, 11, 12, 13);
+	const __m512i stage = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3,
+						4, 4, 5, 5, 6, 6, 7, 7);
+	float v[9][16] __attribute__ ((aligned (64)));
+	__m512 b0, b1, b2, a1, a2, x1, x2, y1, y2, in, y;
+	int k, t;
+
+	for (k = 0; k < 16; k++) {
+		struct biquad *q = &bq[k / 2][k % 2];
+		v[0][k] = q->b0;
+		v[1][k] = q->b1;
+		v[2][k] = q->b2;
+		v[3][k] = q->a1;
+		v[4][k] = q->a2;
+		v[5][k] = q->x1;
+		v[6][k] = q->x2;
+		v[7][k] = q->y1;
+		v[8][k] = q->y2;
+	}
+	b0 = _mm512_load_ps(v[0]);
+	b1 = _mm512_load_ps(v[1]);
+	b2 = _mm512_load_ps(v[2]);
+	a1 = _mm512_load_ps(v[3]);
+	a2 = _mm512_load_ps(v[4]);
+	x1 = _mm512_load_ps(v[5]);
+	x2 = _mm512_load_ps(v[6]);
+	y1 = _mm512_load_ps(v[7]);
+	y2 = _mm512_load_ps(v[8]);
+	y = _mm512_setzero_ps();
+
+	for (t = 0; t < count + 7; t++) {
+		__m128 x = _mm_setzero_ps();
+
+		if (t < count)
+			x = _mm_unpacklo_ps(_mm_load_ss(data0 + t),
+					    _mm_load_ss(data1 + t));
+		in = _mm512_mask_blend_ps(0x0003,
+					  _mm512_permutexvar_ps(shift, y),
+					  _mm512_castps128_ps512(x));
+		y = MUL512(b0, in);
+		y = ADD512(y, MUL512(b1, x1));
+		y = ADD512(y, MUL512(b2, x2));
+		y = SUB512(y, MUL512(a1, y1));
+		y = SUB512(y, MUL512(a2, y2));
+
+		if (t >= 7 && t < count) {
+			x2 = x1;
+			x1 = in;
+			y2 = y1;
+			y1 = y;
+		} else {
+			/* Only the biquads sample t - k has reached. */
+			__m512i n = _mm512_sub_epi32(_mm512_set1_epi32(t),
+						     stage);
+			__mmask16 m = _mm512_cmpge_epi32_mask(
+					n, _mm512_setzero_si512()) &
+				      _mm512_cmplt_epi32_mask(
+					n, _mm512_set1_epi32(count));
+			x2 = _mm512_mask_blend_ps(m, x2, x1);
+			x1 = _mm512_mask_blend_ps(m, x1, in);
+			y2 = _mm512_mask_blend_ps(m, y2, y1);
+			y1 = _mm512_mask_blend_ps(m, y1, y);
+		}
+
+		if (t >= 7) {
+			__m128 out = _mm512_extractf32x4_ps(y, 3);
+			data0[t - 7] = out[2];
+			data1[t - 7] = out[3];
+		}
+	}
+
+	_mm512_store_ps(v[5], x1);
+	_mm512_store_ps(v[6], x2);
+	_mm512_store_ps(v[7], y1);
+	_mm512_store_ps(v[8], y2);
+	for (k = 0; k < 16; k++) {
+		struct biquad *q = &bq[k / 2][k % 2];
+		q->x1 = v[5][k];
+		q->x2 = v[6][k];
+		q->y1 = v[7][k];
+		q->y2 = v[8][k];
+	}
+}
+#endif
+
+static void eq2_process_chunk(struct eq2 *eq2, float *data0, float *data1,
+			      int count)
+{
+	const struct dsp_kernels *k = dsp_get_kernels();
 	int i;
 	int n;
 	if (!count)
@@ -324,19 +639,97 @@ void eq2_process(struct eq2 *eq2, float *data0, float *data1, int count)
 	if (eq2->n[1] > n)
 		n = eq2->n[1];
 	for (i = 0; i < n; i += 2) {
-		if (i + 1 == n) {
+		if (n - i >= 8 && k->eq2_process_eight) {
+			k->eq2_process_eight(&eq2->biquad[i], data0, data1,
+					     count);
+			i += 6;
+		} else if (n - i >= 4 && k->eq2_process_four) {
+			k->eq2_process_four(&eq2->biquad[i], data0, data1,
+					    count);
+			i += 2;
+		} else if (i + 1 == n) {
 			eq2_process_one(&eq2->biquad[i], data0, data1, count);
 		} else {
+			k->eq2_process_two(&eq2->biquad[i], data0, data1,
+					   count);
+		}
+	}
+}
+
+void eq2_select_kernels(struct dsp_kernels *kernels, unsigned int features)
+{
+	kernels->eq2_process_two = eq2_process_two;
 #if defined(__ARM_NEON__)
-			eq2_process_two_neon(&eq2->biquad[i], data0, data1,
-					     count);
-#elif defined(__SSE3__) && defined(__x86_64__)
-			eq2_process_two_sse3(&eq2->biquad[i], data0, data1,
-					     count);
-#else
-			eq2_process_one(&eq2->biquad[i], data0, data1, count);
-			eq2_process_one(&eq2->biquad[i+1], data0, data1, count);
+	if (features & DSP_CPU_NEON)
+		kernels->eq2_process_two = eq2_process_two_neon;
 #endif
-		}
+#if defined(__aarch64__)
+	if (features & DSP_CPU_ASIMD)
+		kernels->eq2_process_two = eq2_process_two_asimd;
+#endif
+#if defined(__x86_64__)
+	if (features & DSP_CPU_SSE3)
+		kernels->eq2_process_two = eq2_process_two_sse3;
+	if (features & DSP_CPU_AVX2)
+		kernels->eq2_process_four = eq2_process_four_avx2;
+	if (features & DSP_CPU_AVX512F)
+		kernels->eq2_process_eight = eq2_process_eight_avx512;
+#endif
+}
+
+/* Moves all biquads one step to their targets. */
+static void eq2_step_fade(struct eq2 *eq2)
+{
+	int i, j;
+
+	for (j = 0; j < 2; j++)
+		for (i = 0; i < eq2->n[j]; i++)
+			biquad_step_to(&eq2->biquad[i][j], &eq2->target[i][j],
+				       eq2->fade_steps);
+	eq2->fade_steps--;
+}
+
+int eq2_set_biquad(struct eq2 *eq2, int index, int channel,
+		   enum biquad_type type, float freq, float Q, float gain,
+		   int fade_frames)
+{
+	if (index < 0 || index >= eq2->n[channel])
+		return -1;
+	biquad_set(&eq2->target[index][channel], type, freq, Q, gain);
+	eq2->fade_steps = biquad_fade_steps(fade_frames);
+	if (!eq2->fade_steps) {
+		eq2->fade_steps = 1;
+		eq2_step_fade(eq2);
+	}
+	return 0;
+}
+
+void eq2_process(struct eq2 *eq2, float *data0, float *data1, int count)
+{
+	/* While fading, change the coefficients every BIQUAD_FADE_FRAMES
+	 * frames, so the speed of the fade does not depend on the block
+	 * size. */
+	while (eq2->fade_steps > 0 && count > 0) {
+		int chunk = count < BIQUAD_FADE_FRAMES ?
+			count : BIQUAD_FADE_FRAMES;
+		eq2_step_fade(eq2);
+		eq2_process_chunk(eq2, data0, data1, chunk);
+		data0 += chunk;
+		data1 += chunk;
+		count -= chunk;
 	}
+	eq2_process_chunk(eq2, data0, data1, count);
+}
+
+int eq2_is_identity(const struct eq2 *eq2)
+{
+	int i, j;
+
+	if (eq2->fade_steps)
+		return 0;
+	for (j = 0; j < 2; j++)
+		for (i = 0; i < eq2->n[j]; i++)
+			if (!biquad_is_identity(&eq2->biquad[i][j]))
+				return 0;
+	return 1;
 }
@@ -14,6 +14,7 @@ extern "C" {
  * of data at once to increase performance. */
 
 #include "biquad.h"
+#include "dsp_arena.h"
 
 /* Maximum number of biquad filters an EQ2 can have per channel */
 #define MAX_BIQUADS_PER_EQ2 10
@@ -23,6 +24,12 @@ struct eq2;
 /* Create an EQ2. */
 struct eq2 *eq2_new();
 
+/* Create an EQ2 in memory from an arena. */
+struct eq2 *eq2_new_in_arena(struct dsp_arena *arena);
+
+/* Returns the arena space eq2_new_in_arena() takes. */
+size_t eq2_arena_size();
+
 /* Free an EQ2. */
 void eq2_free(struct eq2 *eq2);
 
@@ -55,6 +62,23 @@ int eq2_append_biquad(struct eq2 *eq2, int channel,
 int eq2_append_biquad_direct(struct eq2 *eq2, int channel,
 			     const struct biquad *biquad);
 
+/* Changes the parameters of a biquad filter of an EQ2 while it runs, see
+ * eq_set_biquad().
+ * Args:
+ *    eq2 - The EQ2 we want to use.
+ *    index - The index of the biquad in the channel, in the order they were
+ *        appended.
+ *    channel - 0 or 1. The channel of the biquad.
+ *    type, freq, Q, gain - The new parameters, as for eq2_append_biquad().
+ *    fade_frames - The number of frames the change takes, 0 to change at
+ *        once.
+ * Returns:
+ *    0 if success. -1 if the channel has no biquad at index.
+ */
+int eq2_set_biquad(struct eq2 *eq2, int index, int channel,
+		   enum biquad_type type, float freq, float Q, float gain,
+		   int fade_frames);
+
 /* Process a buffer of audio data through the EQ2.
  * Args:
  *    eq2 - The EQ2 we want to use.
@@ -64,6 +88,10 @@ int eq2_append_biquad_direct(struct eq2 *eq2, int channel,
  */
 void eq2_process(struct eq2 *eq2, float *data0, float *data1, int count);
 
+/* Returns 1 if every biquad of both channels of the EQ2 is an identity
+ * filter, so eq2_process() leaves the data as it is. Returns 0 otherwise. */
+int eq2_is_identity(const struct eq2 *eq2);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
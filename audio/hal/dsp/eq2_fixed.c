@@ -0,0 +1,26 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <string.h>
+#include "eq2_fixed.h"
+
+const struct eq2_fixed *eq2_fixed_find(int sample_rate, const float *params,
+				       int num_params)
+{
+	const struct eq2_fixed *fixed;
+	uint32_t hash = eq2_fixed_hash(sample_rate, params, num_params);
+
+	for (fixed = eq2_fixed_table; fixed->process; fixed++) {
+		if (fixed->hash != hash ||
+		    fixed->sample_rate != sample_rate ||
+		    fixed->num_params != num_params)
+			continue;
+		/* Rule out a hash collision. */
+		if (memcmp(fixed->params, params,
+			   sizeof(float) * num_params) == 0)
+			return fixed;
+	}
+	return NULL;
+}
@@ -0,0 +1,101 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef EQ2_FIXED_H_
+#define EQ2_FIXED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* "eq2_fixed" is an eq2 filter specialized at build time. The gen_eq2_fixed
+ * host tool reads the eq2 plugins of an ini file and generates, for each of
+ * them and for each sample rate, a process function with a fixed number of
+ * biquads and the coefficients as constants. The eq2 builtin module uses the
+ * generated function when the parameters of the plugin are the same as the
+ * ones it was generated from, and falls back to the generic eq2 otherwise. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "eq2.h"
+
+/* The number of floats in the state of a fixed eq2. For each channel, the
+ * last two samples of the input and of the output of each biquad. */
+#define EQ2_FIXED_STATE_SIZE (2 * 2 * (MAX_BIQUADS_PER_EQ2 + 1))
+
+/* The maximum number of parameters of an eq2 plugin: type, freq, Q and gain
+ * for each channel of each biquad. */
+#define EQ2_FIXED_MAX_PARAMS (MAX_BIQUADS_PER_EQ2 * 8)
+
+struct eq2_fixed {
+	/* eq2_fixed_hash() of sample_rate and params */
+	uint32_t hash;
+	int sample_rate;
+	int num_params;
+	const float *params;
+	/* Processes count samples of the two channels in place. state points
+	 * to EQ2_FIXED_STATE_SIZE floats, which are zero initially. */
+	void (*process)(float *state, float *data0, float *data1, int count);
+};
+
+/* The table generated by gen_eq2_fixed. It is terminated by an entry with
+ * NULL process. */
+extern const struct eq2_fixed eq2_fixed_table[];
+
+/* Adds the four bytes of a 32-bit value to a FNV-1a hash, least significant
+ * byte first, so the result does not depend on the byte order of the host. */
+static inline uint32_t eq2_fixed_fnv1a_u32(uint32_t hash, uint32_t value)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		hash ^= (value >> (8 * i)) & 0xff;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/* Calculates the 32-bit FNV-1a hash of the sample rate and the parameters of
+ * an eq2 plugin. This is shared by gen_eq2_fixed and the runtime lookup.
+ * Args:
+ *    sample_rate - The sample rate the eq2 runs at.
+ *    params - The values of the control ports of the eq2, in port order.
+ *    num_params - The number of values in params.
+ * Returns:
+ *    The hash value.
+ */
+static inline uint32_t eq2_fixed_hash(int sample_rate, const float *params,
+				      int num_params)
+{
+	uint32_t hash = 2166136261U;
+	uint32_t bits;
+	int i;
+
+	hash = eq2_fixed_fnv1a_u32(hash, (uint32_t)sample_rate);
+	hash = eq2_fixed_fnv1a_u32(hash, (uint32_t)num_params);
+	for (i = 0; i < num_params; i++) {
+		memcpy(&bits, &params[i], sizeof(bits));
+		hash = eq2_fixed_fnv1a_u32(hash, bits);
+	}
+	return hash;
+}
+
+/* Finds the generated eq2 for the given sample rate and parameters.
+ * Args:
+ *    sample_rate - The sample rate the eq2 runs at.
+ *    params - The values of the control ports of the eq2, in port order.
+ *    num_params - The number of values in params.
+ * Returns:
+ *    The matching entry of eq2_fixed_table, or NULL if there is none.
+ */
+const struct eq2_fixed *eq2_fixed_find(int sample_rate, const float *params,
+				       int num_params);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* EQ2_FIXED_H_ */
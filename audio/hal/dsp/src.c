@@ -0,0 +1,358 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "src.h"
+
+#ifndef max
+#define max(a, b) ({ __typeof__(a) _a = (a);	\
+			__typeof__(b) _b = (b);	\
+			_a > _b ? _a : _b; })
+#endif
+
+#ifndef min
+#define min(a, b) ({ __typeof__(a) _a = (a);	\
+			__typeof__(b) _b = (b);	\
+			_a < _b ? _a : _b; })
+#endif
+
+/* The most input frames the history takes at a time, after the taps it
+ * keeps from the last call. */
+#define SRC_CHUNK_FRAMES 256
+
+/* The taps per phase at each quality, for a ratio which does not reduce
+ * the rate. Reducing the rate widens the filter by the ratio, so the
+ * cutoff moves down without a wider transition band. */
+static const int quality_taps[SRC_QUALITY_LAST] = { 16, 32, 64 };
+
+/* The stopband attenuation in dB each quality is designed for, which sets
+ * the Kaiser window and the width of the transition band. The gains of the
+ * phases differ a little, so the images of a high quality converter which
+ * raises the rate are only 80 dB down. */
+static const double quality_attenuation[SRC_QUALITY_LAST] = { 50, 70, 90 };
+
+struct src {
+	struct dsp_arena *arena;
+	/* The output rate over the input rate is phases/step. */
+	int phases;
+	int step;
+	/* The taps of each phase, a multiple of four. */
+	int taps;
+	/* phases * taps coefficients. The taps of phase p are at
+	 * coefs[p * taps], in the order of the input samples they meet. */
+	float *coefs;
+	/* The input samples of each channel. The first taps - 1 are kept
+	 * from the last call. */
+	float *hist[2];
+	int filled;
+	/* The position of the next output frame: the index in hist of the
+	 * newest input sample it takes, and its phase. */
+	int pos;
+	int phase;
+};
+
+static int gcd(int a, int b)
+{
+	while (b) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* Finds the ratio and the taps per phase of a converter. Returns -1 if the
+ * rates are not supported. */
+static int src_get_shape(int in_rate, int out_rate, int quality,
+			 int *phases, int *step, int *taps)
+{
+	int g;
+
+	if (in_rate <= 0 || out_rate <= 0 || quality < 0 ||
+	    quality >= SRC_QUALITY_LAST)
+		return -1;
+	g = gcd(in_rate, out_rate);
+	*phases = out_rate / g;
+	*step = in_rate / g;
+	if (*phases > SRC_MAX_PHASES)
+		return -1;
+
+	*taps = quality_taps[quality];
+	if (*step > *phases)
+		*taps = (*taps * *step + *phases - 1) / *phases;
+	*taps = (*taps + 3) & ~3;
+	return 0;
+}
+
+/* The zeroth order modified Bessel function of the first kind, for the
+ * Kaiser window. */
+static double bessel_i0(double x)
+{
+	double sum = 1, term = 1;
+	int k;
+
+	for (k = 1; k < 50; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+/* Designs the low-pass filter for the input upsampled by the number of
+ * phases, and splits it into the phases. */
+static void src_design(struct src *src, int quality)
+{
+	int n = src->phases * src->taps;
+	double attenuation = quality_attenuation[quality];
+	double beta, transition, cutoff, center, sum = 0;
+	int i, p, j;
+
+	/* Kaiser's formulas for the window and the transition width, the
+	 * latter relative to the lower of the two rates. */
+	if (attenuation > 50)
+		beta = 0.1102 * (attenuation - 8.7);
+	else
+		beta = 0.5842 * pow(attenuation - 21, 0.4) +
+			0.07886 * (attenuation - 21);
+	transition = (attenuation - 8) /
+		(2.285 * 2 * M_PI * (n / (double)src->phases));
+	if (src->step > src->phases)
+		transition *= src->step / (double)src->phases;
+
+	/* Center the transition band below half the lower rate, so the
+	 * images and the aliases are attenuated fully. This is in cycles
+	 * per sample of the upsampled input. */
+	cutoff = 0.5 - transition / 2;
+	if (src->step > src->phases)
+		cutoff *= src->phases / (double)src->step;
+	cutoff /= src->phases;
+
+	center = (n - 1) / 2.0;
+	for (i = 0; i < n; i++) {
+		double t = i - center;
+		double r = t / center;
+		double h = 2 * cutoff;
+		double w = bessel_i0(beta * sqrt(max(0.0, 1 - r * r))) /
+			bessel_i0(beta);
+
+		if (t != 0)
+			h = sin(2 * M_PI * cutoff * t) / (M_PI * t);
+		h *= w;
+		sum += h;
+
+		/* Sample i meets the input sample (taps - 1 - j) behind the
+		 * newest one in phase i % phases. */
+		p = i % src->phases;
+		j = src->taps - 1 - i / src->phases;
+		src->coefs[p * src->taps + j] = h;
+	}
+
+	/* Each phase sums to about one, so the gain at DC is one. */
+	for (i = 0; i < n; i++)
+		src->coefs[i] *= src->phases / sum;
+}
+
+struct src *src_new(int in_rate, int out_rate, int quality)
+{
+	return src_new_in_arena(NULL, in_rate, out_rate, quality);
+}
+
+struct src *src_new_in_arena(struct dsp_arena *arena, int in_rate,
+			     int out_rate, int quality)
+{
+	struct src *src;
+	int phases, step, taps, i;
+	size_t hist_size;
+
+	if (src_get_shape(in_rate, out_rate, quality, &phases, &step,
+			  &taps) != 0)
+		return NULL;
+
+	src = (struct src *)dsp_arena_calloc(arena, sizeof(*src));
+	if (!src)
+		return NULL;
+	src->arena = arena;
+	src->phases = phases;
+	src->step = step;
+	src->taps = taps;
+	src->coefs = (float *)dsp_arena_calloc(
+		arena, phases * taps * sizeof(float));
+	hist_size = (taps - 1 + SRC_CHUNK_FRAMES) * sizeof(float);
+	for (i = 0; i < 2; i++)
+		src->hist[i] = (float *)dsp_arena_calloc(arena, hist_size);
+	if (!src->coefs || !src->hist[0] || !src->hist[1]) {
+		src_free(src);
+		return NULL;
+	}
+
+	src_design(src, quality);
+
+	/* Start with silence before the first input sample, which the
+	 * first output frame is centered on. */
+	src->filled = taps - 1;
+	src->pos = taps - 1;
+	return src;
+}
+
+size_t src_arena_size(int in_rate, int out_rate, int quality)
+{
+	int phases, step, taps;
+
+	if (src_get_shape(in_rate, out_rate, quality, &phases, &step,
+			  &taps) != 0)
+		return 0;
+	return dsp_arena_size(sizeof(struct src)) +
+		dsp_arena_size(phases * taps * sizeof(float)) +
+		2 * dsp_arena_size((taps - 1 + SRC_CHUNK_FRAMES) *
+				   sizeof(float));
+}
+
+void src_free(struct src *src)
+{
+	dsp_arena_release(src->arena, src->hist[1]);
+	dsp_arena_release(src->arena, src->hist[0]);
+	dsp_arena_release(src->arena, src->coefs);
+	dsp_arena_release(src->arena, src);
+}
+
+int src_get_output_frames(const struct src *src, int in_frames)
+{
+	/* Output frame k takes the input up to pos + (phase + k * step) /
+	 * phases, so count the k for which that is in the history. */
+	int64_t room = (int64_t)(src->filled + in_frames - src->pos) *
+		src->phases - src->phase;
+
+	if (room <= 0)
+		return 0;
+	return (room + src->step - 1) / src->step;
+}
+
+int src_get_delay(const struct src *src)
+{
+	/* Half the filter, in samples of the upsampled input. */
+	int half = (src->phases * src->taps - 1) / 2;
+
+	return (half + src->step / 2) / src->step;
+}
+
+/* Computes one output frame of both channels from the taps of a phase and
+ * the input samples they meet. */
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+static inline void dot2(const float *coefs, const float *x0, const float *x1,
+			int taps, float *y0, float *y1)
+{
+	float32x4_t acc0 = vdupq_n_f32(0);
+	float32x4_t acc1 = vdupq_n_f32(0);
+	float32x2_t sum0, sum1, sum;
+	int i;
+
+	for (i = 0; i < taps; i += 4) {
+		float32x4_t c = vld1q_f32(coefs + i);
+		acc0 = vmlaq_f32(acc0, c, vld1q_f32(x0 + i));
+		acc1 = vmlaq_f32(acc1, c, vld1q_f32(x1 + i));
+	}
+	sum0 = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+	sum1 = vadd_f32(vget_low_f32(acc1), vget_high_f32(acc1));
+	sum = vpadd_f32(sum0, sum1);
+	*y0 = vget_lane_f32(sum, 0);
+	*y1 = vget_lane_f32(sum, 1);
+}
+#elif defined(__SSE3__)
+#include <pmmintrin.h>
+static inline void dot2(const float *coefs, const float *x0, const float *x1,
+			int taps, float *y0, float *y1)
+{
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	__m128 sum;
+	int i;
+
+	/* The coefficients are aligned, the history moves by one sample. */
+	for (i = 0; i < taps; i += 4) {
+		__m128 c = _mm_load_ps(coefs + i);
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(c, _mm_loadu_ps(x0 + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(c, _mm_loadu_ps(x1 + i)));
+	}
+	sum = _mm_hadd_ps(acc0, acc1);
+	sum = _mm_hadd_ps(sum, sum);
+	_mm_store_ss(y0, sum);
+	_mm_store_ss(y1, _mm_shuffle_ps(sum, sum, 1));
+}
+#else
+static inline void dot2(const float *coefs, const float *x0, const float *x1,
+			int taps, float *y0, float *y1)
+{
+	float a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	float b0 = 0, b1 = 0, b2 = 0, b3 = 0;
+	int i;
+
+	for (i = 0; i < taps; i += 4) {
+		a0 += coefs[i] * x0[i];
+		a1 += coefs[i + 1] * x0[i + 1];
+		a2 += coefs[i + 2] * x0[i + 2];
+		a3 += coefs[i + 3] * x0[i + 3];
+		b0 += coefs[i] * x1[i];
+		b1 += coefs[i + 1] * x1[i + 1];
+		b2 += coefs[i + 2] * x1[i + 2];
+		b3 += coefs[i + 3] * x1[i + 3];
+	}
+	*y0 = (a0 + a1) + (a2 + a3);
+	*y1 = (b0 + b1) + (b2 + b3);
+}
+#endif
+
+int src_process(struct src *src, const float *in0, const float *in1,
+		int in_frames, float *out0, float *out1)
+{
+	const int taps = src->taps;
+	const int phases = src->phases;
+	const int step = src->step;
+	float *hist0 = src->hist[0];
+	float *hist1 = src->hist[1];
+	int pos = src->pos;
+	int phase = src->phase;
+	int out_frames = 0;
+
+	while (in_frames > 0) {
+		int n = min(in_frames, taps - 1 + SRC_CHUNK_FRAMES -
+			    src->filled);
+		int drop;
+
+		memcpy(hist0 + src->filled, in0, n * sizeof(float));
+		memcpy(hist1 + src->filled, in1, n * sizeof(float));
+		src->filled += n;
+		in0 += n;
+		in1 += n;
+		in_frames -= n;
+
+		while (pos < src->filled) {
+			int start = pos - taps + 1;
+			dot2(src->coefs + phase * taps, hist0 + start,
+			     hist1 + start, taps, out0 + out_frames,
+			     out1 + out_frames);
+			out_frames++;
+			phase += step;
+			pos += phase / phases;
+			phase %= phases;
+		}
+
+		/* Keep the taps - 1 samples the next output frame starts
+		 * from at most. */
+		drop = src->filled - (taps - 1);
+		memmove(hist0, hist0 + drop, (taps - 1) * sizeof(float));
+		memmove(hist1, hist1 + drop, (taps - 1) * sizeof(float));
+		src->filled = taps - 1;
+		pos -= drop;
+	}
+
+	src->pos = pos;
+	src->phase = phase;
+	return out_frames;
+}
@@ -0,0 +1,89 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef SRC_H_
+#define SRC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* "src" converts the sampling rate of two channels of float samples with a
+ * polyphase FIR filter. The ratio of the rates is reduced to out/in = L/M,
+ * and a windowed sinc low-pass filter for the input upsampled by L is split
+ * into L phases. Each output frame takes one phase, so only the taps which
+ * meet input samples are computed. The two channels share the coefficient
+ * loads of each phase, which are vectorized where NEON or SSE is
+ * available. */
+
+#include "dsp_arena.h"
+
+/* The most phases a converter can have. It covers 44100 <-> 48000 Hz
+ * (147/160) and the integer ratios between 48000 Hz and 16000 or 8000 Hz. */
+#define SRC_MAX_PHASES 160
+
+/* The quality of a converter. A higher quality has a longer filter, which
+ * costs more time and delay but has a sharper cutoff and a stronger
+ * attenuation of the images and the aliases. */
+enum src_quality {
+	SRC_QUALITY_LOW,  /* 16 taps per phase, 50 dB stopband */
+	SRC_QUALITY_MEDIUM,  /* 32 taps per phase, 70 dB stopband */
+	SRC_QUALITY_HIGH,  /* 64 taps per phase, 80 dB stopband */
+	SRC_QUALITY_LAST
+};
+
+struct src;
+
+/* Creates a converter.
+ * Args:
+ *    in_rate - The sampling rate of the input.
+ *    out_rate - The sampling rate of the output.
+ *    quality - One of enum src_quality.
+ * Returns:
+ *    The converter, or NULL if the ratio of the rates needs more than
+ *    SRC_MAX_PHASES phases.
+ */
+struct src *src_new(int in_rate, int out_rate, int quality);
+
+/* Creates a converter in memory from an arena, see src_new(). */
+struct src *src_new_in_arena(struct dsp_arena *arena, int in_rate,
+			     int out_rate, int quality);
+
+/* Returns the arena space src_new_in_arena() takes, or 0 if the rates are
+ * not supported. */
+size_t src_arena_size(int in_rate, int out_rate, int quality);
+
+/* Frees a converter. */
+void src_free(struct src *src);
+
+/* Returns the number of frames the next src_process() outputs for a number
+ * of input frames. */
+int src_get_output_frames(const struct src *src, int in_frames);
+
+/* Returns the delay of the filter, in output frames. */
+int src_get_delay(const struct src *src);
+
+/* Converts two channels of samples. All the input is taken, and the output
+ * frames are written as soon as the input they need has arrived, so the
+ * output may have one frame more or less than in_frames scaled by the
+ * ratio. The filter keeps the input it still needs for later frames.
+ * Args:
+ *    src - The converter.
+ *    in0, in1 - The input samples of channel 0 and 1.
+ *    in_frames - The number of frames in in0 and in1.
+ *    out0, out1 - The arrays for the output samples of channel 0 and 1,
+ *        with room for src_get_output_frames(src, in_frames) frames. They
+ *        must not overlap the input.
+ * Returns:
+ *    The number of frames written to out0 and out1.
+ */
+int src_process(struct src *src, const float *in0, const float *in1,
+		int in_frames, float *out0, float *out1);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* SRC_H_ */
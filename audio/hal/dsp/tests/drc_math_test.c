@@ -0,0 +1,226 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Reports the accuracy of the approximations in drc_math.h, scalar and on
+ * vectors of four and eight floats, against the formulas of the SLOW_*
+ * options computed in double, and fails when one is worse than its bound.
+ * Then times each version.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+/* The eight lane versions are static inline, so passing them eight lanes
+ * without AVX changes no ABI, which GCC warns about. */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+#include "drc_math.h"
+
+#define TEST_VALUES 40000 /* A multiple of eight. */
+#define BENCH_LOOPS 500
+
+/* Defines the functions applying the scalar, four lane, and eight lane
+ * versions of an approximation to count values, a multiple of eight. */
+#define DEFINE_ARRAY_FUNCTIONS(name)					\
+	static void name##_1(const float *in, float *out, int count)	\
+	{								\
+		int i;							\
+		for (i = 0; i < count; i++)				\
+			out[i] = name(in[i]);				\
+	}								\
+	static void name##_4(const float *in, float *out, int count)	\
+	{								\
+		int i;							\
+		for (i = 0; i < count; i += 4)				\
+			drc_store_x4(out + i,				\
+				     name##_x4(drc_load_x4(in + i)));	\
+	}								\
+	static void name##_8(const float *in, float *out, int count)	\
+	{								\
+		int i;							\
+		for (i = 0; i < count; i += 8)				\
+			drc_store_x8(out + i,				\
+				     name##_x8(drc_load_x8(in + i)));	\
+	}
+
+DEFINE_ARRAY_FUNCTIONS(decibels_to_linear)
+DEFINE_ARRAY_FUNCTIONS(linear_to_decibels)
+DEFINE_ARRAY_FUNCTIONS(warp_sinf)
+DEFINE_ARRAY_FUNCTIONS(warp_asinf)
+DEFINE_ARRAY_FUNCTIONS(knee_expf)
+
+/* The formulas of the SLOW_* options, in double. */
+static double slow_decibels_to_linear(double x)
+{
+	return exp(0.1151292546497022 * x);
+}
+
+static double slow_linear_to_decibels(double x)
+{
+	return 8.6858896380650366 * log(x);
+}
+
+static double slow_warp_sinf(double x)
+{
+	return sin(M_PI / 2 * x);
+}
+
+static double slow_warp_asinf(double x)
+{
+	return asin(x) * 2 / M_PI;
+}
+
+static double slow_knee_expf(double x)
+{
+	return exp(x);
+}
+
+typedef void (*array_function)(const float *in, float *out, int count);
+
+struct approximation {
+	const char *name;
+	array_function versions[3];
+	double (*slow)(double x);
+	/* The values are from lo to hi, evenly spaced, or on a log scale
+	 * if log_scale is set. */
+	float lo, hi;
+	int log_scale;
+	/* The error is relative to the slow value if relative is set, and
+	 * absolute otherwise. */
+	int relative;
+	double max_error;
+};
+
+#define VERSIONS(name) { name##_1, name##_4, name##_8 }
+
+static const char *const version_names[3] = { "scalar", "x4", "x8" };
+
+static const struct approximation approximations[] = {
+	{ "decibels_to_linear", VERSIONS(decibels_to_linear),
+	  slow_decibels_to_linear, -100, 100, 0, 1, 1e-6 },
+	{ "linear_to_decibels", VERSIONS(linear_to_decibels),
+	  slow_linear_to_decibels, 1e-5f, 1e5f, 1, 0, 2e-5 },
+	{ "warp_sinf", VERSIONS(warp_sinf),
+	  slow_warp_sinf, -1, 1, 0, 0, 1e-6 },
+	{ "warp_asinf", VERSIONS(warp_asinf),
+	  slow_warp_asinf, -1, 1, 0, 0, 1e-6 },
+	{ "knee_expf", VERSIONS(knee_expf),
+	  slow_knee_expf, -11.5f, 11.5f, 0, 1, 2e-6 },
+};
+
+static float in[TEST_VALUES], out[TEST_VALUES];
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec)
+		+ (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+static void fill_input(const struct approximation *a)
+{
+	int i;
+
+	for (i = 0; i < TEST_VALUES; i++) {
+		double t = (double)i / (TEST_VALUES - 1);
+		if (a->log_scale)
+			in[i] = a->lo * pow(a->hi / a->lo, t);
+		else
+			in[i] = a->lo + (a->hi - a->lo) * t;
+	}
+}
+
+/* Prints the largest error of each version of an approximation. Returns the
+ * number of versions worse than the bound. */
+static int test_approximation(const struct approximation *a)
+{
+	int v, i, errors = 0;
+
+	fill_input(a);
+	for (v = 0; v < 3; v++) {
+		double max_error = 0;
+		float worst = in[0];
+
+		a->versions[v](in, out, TEST_VALUES);
+		for (i = 0; i < TEST_VALUES; i++) {
+			double slow = a->slow(in[i]);
+			double error = fabs(out[i] - slow);
+			if (a->relative)
+				error /= fabs(slow);
+			/* A NaN error counts as the worst. */
+			if (!(error <= max_error)) {
+				max_error = error;
+				worst = in[i];
+			}
+		}
+		printf("%-18s %-6s max %s error %9.3g at %-11g %s\n",
+		       a->name, version_names[v],
+		       a->relative ? "relative" : "absolute", max_error,
+		       worst, max_error <= a->max_error ? "" : "FAILED");
+		if (!(max_error <= a->max_error))
+			errors++;
+	}
+	return errors;
+}
+
+/* Checks the values linear_to_decibels() gives outside its domain. Returns
+ * the number of errors. */
+static int test_linear_to_decibels_special(void)
+{
+	const float special[8] = { 0, -0.0f, -1, -INFINITY,
+				   INFINITY, NAN, 1, 1e-30f };
+	float out8[8];
+	int i, errors = 0;
+
+	linear_to_decibels_8(special, out8, 8);
+	for (i = 0; i < 8; i++) {
+		float scalar = linear_to_decibels(special[i]);
+		int same = isnan(scalar) ? isnan(out8[i]) :
+			fabsf(out8[i] - scalar) <= 1e-4f;
+		if (!same) {
+			printf("linear_to_decibels(%g): %g != %g\n",
+			       special[i], out8[i], scalar);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+static void bench_approximation(const struct approximation *a)
+{
+	struct timespec tp1, tp2;
+	double t[3];
+	int v, i;
+
+	fill_input(a);
+	for (v = 0; v < 3; v++) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &tp1);
+		for (i = 0; i < BENCH_LOOPS; i++)
+			a->versions[v](in, out, TEST_VALUES);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &tp2);
+		t[v] = tp_diff(&tp2, &tp1) * 1e9 / BENCH_LOOPS / TEST_VALUES;
+	}
+	printf("%-18s ns per value: scalar %.2f, x4 %.2f, x8 %.2f\n",
+	       a->name, t[0], t[1], t[2]);
+}
+
+int main(int argc, char **argv)
+{
+	int n = sizeof(approximations) / sizeof(approximations[0]);
+	int i, errors = 0;
+
+	drc_math_init();
+	for (i = 0; i < n; i++)
+		errors += test_approximation(&approximations[i]);
+	errors += test_linear_to_decibels_special();
+	printf("%d errors\n", errors);
+
+	for (i = 0; i < n; i++)
+		bench_approximation(&approximations[i]);
+
+	return errors ? 1 : 0;
+}
@@ -48,11 +48,16 @@ int main(int argc, char **argv)
 	struct drc *drc;
 	size_t frames;
 	float *buf;
+	int detector = DK_DETECTOR_LINKED;
+	int i;
 
-	if (argc != 3) {
-		printf("Usage: drc_test input.raw output.raw\n");
+	if (argc != 3 && argc != 4) {
+		printf("Usage: drc_test input.raw output.raw [detector]\n");
+		printf("detector: 0 linked, 1 unlinked, 2 rms, 3 mid/side\n");
 		return 1;
 	}
+	if (argc == 4)
+		detector = atoi(argv[3]);
 
 	dsp_enable_flush_denormal_to_zero();
 	dsp_util_clear_fp_exceptions();
@@ -86,6 +91,9 @@ int main(int argc, char **argv)
 	drc_set_param(drc, 2, PARAM_RELEASE, 1);
 	drc_set_param(drc, 2, PARAM_POST_GAIN, 0);
 
+	for (i = 0; i < DRC_NUM_KERNELS; i++)
+		drc_set_param(drc, i, PARAM_DETECTOR, detector);
+
 	drc_init(drc);
 	buf = read_raw(argv[1], &frames);
 	process(drc, buf, frames);
@@ -0,0 +1,582 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Benchmarks the DSP kernels, and optionally a whole pipeline from an ini
+ * file, on synthetic signals at each rate and block size. The results are
+ * printed as JSON, which can be stored and passed back with -b to fail on
+ * kernels which have become slower.
+ *
+ *    dsp_bench -i speakerdsp.ini > baseline.json
+ *    dsp_bench -i speakerdsp.ini -b baseline.json
+ *    dsp_bench -c sse3 > sse3.json
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cras_dsp_ini.h"
+#include "cras_dsp_pipeline.h"
+#include "cras_expr.h"
+#include "crossover.h"
+#include "crossover2.h"
+#include "drc.h"
+#include "dsp_kernels.h"
+#include "dsp_util.h"
+#include "eq.h"
+#include "eq2.h"
+
+/* The length of the signal each measurement processes, and the number of
+ * times it is processed. The fastest time is kept, since the others are
+ * slowed down by the rest of the system. */
+#define BENCH_SECONDS 1
+#define BENCH_RUNS 5
+
+/* The number of channel buffers. The crossovers write three bands for each
+ * of the two channels. */
+#define BENCH_BUFFERS 6
+
+/* The slowdown from the baseline allowed before a result is a regression,
+ * in percent. */
+#define DEFAULT_TOLERANCE 25
+
+#define MAX_RESULTS 256
+#define MAX_NAME 32
+
+static const int rates[] = { 44100, 48000 };
+static const int blocks[] = { 32, 64, 128, 256, 512, 1024, 2048 };
+
+/* The signals and the state of a kernel. The channel buffers and the
+ * interleaved S16 samples hold the same signal, and process() is given the
+ * part of them for one block. */
+struct bench {
+	int rate;
+	int block;
+	const char *ini_file;
+	void *state;
+};
+
+struct kernel {
+	const char *name;
+	/* Returns the state of the kernel, or NULL if it cannot run. */
+	void *(*create)(struct bench *bench);
+	void (*process)(void *state, float **data, int16_t *s16, int frames);
+	void (*destroy)(void *state);
+};
+
+struct result {
+	char kernel[MAX_NAME];
+	int rate;
+	int block;
+	double ns_per_frame;
+	double realtime;
+};
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec)
+		+ (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+/* Fills the left channel with a logarithmic sweep from 20 Hz to 20 kHz, and
+ * the right one with noise in bursts, which go from loud to quiet every
+ * 100 ms so a compressor both attacks and releases. */
+static void make_signal(float *left, float *right, int frames, int rate)
+{
+	double k = log(20000.0 / 20.0);
+	double seconds = (double)frames / rate;
+	unsigned int seed = 1;
+	float lp = 0;
+	int i;
+
+	for (i = 0; i < frames; i++) {
+		double t = (double)i / rate;
+		float white;
+
+		left[i] = 0.5 * sin(2 * M_PI * 20 * seconds / k *
+				    (exp(t / seconds * k) - 1));
+		seed = seed * 1103515245 + 12345;
+		white = (float)(seed >> 8) / (1 << 24) - 0.5f;
+		lp += 0.3f * (white - lp);
+		right[i] = ((i / (rate / 10)) % 2 ? 0.05f : 0.8f) * lp * 2;
+	}
+}
+
+static void set_eq(struct eq *eq, int rate)
+{
+	float nyquist = rate / 2.0f;
+
+	eq_append_biquad(eq, BQ_HIGHPASS, 80 / nyquist, 0, 0);
+	eq_append_biquad(eq, BQ_PEAKING, 1000 / nyquist, 1, 3);
+	eq_append_biquad(eq, BQ_PEAKING, 3000 / nyquist, 2, -4);
+	eq_append_biquad(eq, BQ_HIGHSHELF, 8000 / nyquist, 0, -2);
+}
+
+static void *eq_create(struct bench *bench)
+{
+	struct eq **eq = calloc(2, sizeof(*eq));
+
+	eq[0] = eq_new();
+	eq[1] = eq_new();
+	set_eq(eq[0], bench->rate);
+	set_eq(eq[1], bench->rate);
+	return eq;
+}
+
+static void eq_run(void *state, float **data, int16_t *s16, int frames)
+{
+	struct eq **eq = state;
+
+	eq_process(eq[0], data[0], frames);
+	eq_process(eq[1], data[1], frames);
+}
+
+static void eq_destroy(void *state)
+{
+	struct eq **eq = state;
+
+	eq_free(eq[0]);
+	eq_free(eq[1]);
+	free(eq);
+}
+
+static void *eq2_create(struct bench *bench)
+{
+	struct eq2 *eq2 = eq2_new();
+	float nyquist = bench->rate / 2.0f;
+	int channel;
+
+	for (channel = 0; channel < 2; channel++) {
+		eq2_append_biquad(eq2, channel, BQ_HIGHPASS, 80 / nyquist, 0,
+				  0);
+		eq2_append_biquad(eq2, channel, BQ_PEAKING, 1000 / nyquist, 1,
+				  3);
+		eq2_append_biquad(eq2, channel, BQ_PEAKING, 3000 / nyquist, 2,
+				  -4);
+		eq2_append_biquad(eq2, channel, BQ_HIGHSHELF, 8000 / nyquist,
+				  0, -2);
+	}
+	return eq2;
+}
+
+static void eq2_run(void *state, float **data, int16_t *s16, int frames)
+{
+	eq2_process(state, data[0], data[1], frames);
+}
+
+static void eq2_destroy(void *state)
+{
+	eq2_free(state);
+}
+
+static void *crossover_create(struct bench *bench)
+{
+	struct crossover *xo = calloc(2, sizeof(*xo));
+	float nyquist = bench->rate / 2.0f;
+
+	crossover_init(&xo[0], 200 / nyquist, 2000 / nyquist);
+	crossover_init(&xo[1], 200 / nyquist, 2000 / nyquist);
+	return xo;
+}
+
+static void crossover_run(void *state, float **data, int16_t *s16,
+			  int frames)
+{
+	struct crossover *xo = state;
+
+	crossover_process(&xo[0], frames, data[0], data[2], data[3]);
+	crossover_process(&xo[1], frames, data[1], data[4], data[5]);
+}
+
+static void *crossover2_create(struct bench *bench)
+{
+	struct crossover2 *xo2 = calloc(1, sizeof(*xo2));
+	float nyquist = bench->rate / 2.0f;
+
+	crossover2_init(xo2, 200 / nyquist, 2000 / nyquist);
+	return xo2;
+}
+
+static void crossover2_run(void *state, float **data, int16_t *s16,
+			   int frames)
+{
+	crossover2_process(state, frames, data[0], data[1], data[2], data[3],
+			   data[4], data[5]);
+}
+
+/* The three band compressor of drc_test. */
+static void *drc_create(struct bench *bench)
+{
+	struct drc *drc = drc_new(bench->rate);
+	float nyquist = bench->rate / 2.0f;
+
+	drc->emphasis_disabled = 0;
+
+	drc_set_param(drc, 0, PARAM_CROSSOVER_LOWER_FREQ, 0);
+	drc_set_param(drc, 0, PARAM_ENABLED, 1);
+	drc_set_param(drc, 0, PARAM_THRESHOLD, -29);
+	drc_set_param(drc, 0, PARAM_KNEE, 3);
+	drc_set_param(drc, 0, PARAM_RATIO, 6.677);
+	drc_set_param(drc, 0, PARAM_ATTACK, 0.02);
+	drc_set_param(drc, 0, PARAM_RELEASE, 0.2);
+	drc_set_param(drc, 0, PARAM_POST_GAIN, -7);
+
+	drc_set_param(drc, 1, PARAM_CROSSOVER_LOWER_FREQ, 200 / nyquist);
+	drc_set_param(drc, 1, PARAM_ENABLED, 1);
+	drc_set_param(drc, 1, PARAM_THRESHOLD, -32);
+	drc_set_param(drc, 1, PARAM_KNEE, 23);
+	drc_set_param(drc, 1, PARAM_RATIO, 12);
+	drc_set_param(drc, 1, PARAM_ATTACK, 0.02);
+	drc_set_param(drc, 1, PARAM_RELEASE, 0.2);
+	drc_set_param(drc, 1, PARAM_POST_GAIN, 0.7);
+
+	drc_set_param(drc, 2, PARAM_CROSSOVER_LOWER_FREQ, 1200 / nyquist);
+	drc_set_param(drc, 2, PARAM_ENABLED, 1);
+	drc_set_param(drc, 2, PARAM_THRESHOLD, -24);
+	drc_set_param(drc, 2, PARAM_KNEE, 30);
+	drc_set_param(drc, 2, PARAM_RATIO, 1);
+	drc_set_param(drc, 2, PARAM_ATTACK, 0.001);
+	drc_set_param(drc, 2, PARAM_RELEASE, 1);
+	drc_set_param(drc, 2, PARAM_POST_GAIN, 0);
+
+	drc_init(drc);
+	return drc;
+}
+
+static void drc_run(void *state, float **data, int16_t *s16, int frames)
+{
+	drc_process(state, data, frames);
+}
+
+static void drc_destroy(void *state)
+{
+	drc_free(state);
+}
+
+/* Converts the S16 stereo samples to float and back, as the pipeline does
+ * around the modules. */
+static void *interleave_create(struct bench *bench)
+{
+	return bench;
+}
+
+static void interleave_run(void *state, float **data, int16_t *s16,
+			   int frames)
+{
+	dsp_util_deinterleave_format((uint8_t *)s16, data, 2,
+				     DSP_SAMPLE_FORMAT_S16_LE, frames);
+	dsp_util_interleave_format(data, (uint8_t *)s16, 2,
+				   DSP_SAMPLE_FORMAT_S16_LE, frames);
+}
+
+static void interleave_destroy(void *state)
+{
+}
+
+struct bench_pipeline {
+	struct ini *ini;
+	struct cras_expr_env env;
+	struct pipeline *pipeline;
+};
+
+/* Loads the playback pipeline of the ini file, with dsp_name set as for
+ * the speaker, so the speakerdsp.ini pipeline is enabled. */
+static void *pipeline_create(struct bench *bench)
+{
+	struct bench_pipeline *bp;
+
+	if (!bench->ini_file)
+		return NULL;
+
+	bp = calloc(1, sizeof(*bp));
+	bp->ini = cras_dsp_ini_create(bench->ini_file);
+	if (!bp->ini)
+		goto fail;
+	cras_expr_env_install_builtins(&bp->env);
+	cras_expr_env_set_variable_boolean(&bp->env, "disable_eq", 0);
+	cras_expr_env_set_variable_boolean(&bp->env, "disable_drc", 0);
+	cras_expr_env_set_variable_string(&bp->env, "dsp_name", "speaker_eq");
+	bp->pipeline = cras_dsp_pipeline_create(bp->ini, &bp->env,
+						"playback");
+	if (!bp->pipeline)
+		goto fail;
+	cras_dsp_pipeline_set_block_size(bp->pipeline, bench->block);
+	if (cras_dsp_pipeline_load(bp->pipeline) != 0 ||
+	    cras_dsp_pipeline_instantiate(bp->pipeline, bench->rate) != 0 ||
+	    cras_dsp_pipeline_get_num_input_channels(bp->pipeline) != 2)
+		goto fail;
+	return bp;
+
+fail:
+	fprintf(stderr, "cannot load the playback pipeline of %s\n",
+		bench->ini_file);
+	if (bp->pipeline)
+		cras_dsp_pipeline_free(bp->pipeline);
+	if (bp->ini)
+		cras_dsp_ini_free(bp->ini);
+	cras_expr_env_free(&bp->env);
+	free(bp);
+	return NULL;
+}
+
+static void pipeline_run(void *state, float **data, int16_t *s16, int frames)
+{
+	struct bench_pipeline *bp = state;
+
+	cras_dsp_pipeline_apply_format(bp->pipeline, (uint8_t *)s16,
+				       DSP_SAMPLE_FORMAT_S16_LE, frames);
+}
+
+static void pipeline_destroy(void *state)
+{
+	struct bench_pipeline *bp = state;
+
+	cras_dsp_pipeline_free(bp->pipeline);
+	cras_dsp_ini_free(bp->ini);
+	cras_expr_env_free(&bp->env);
+	free(bp);
+}
+
+static const struct kernel kernels[] = {
+	{ "eq", eq_create, eq_run, eq_destroy },
+	{ "eq2", eq2_create, eq2_run, eq2_destroy },
+	{ "crossover", crossover_create, crossover_run, free },
+	{ "crossover2", crossover2_create, crossover2_run, free },
+	{ "drc", drc_create, drc_run, drc_destroy },
+	{ "interleave", interleave_create, interleave_run,
+	  interleave_destroy },
+	{ "pipeline", pipeline_create, pipeline_run, pipeline_destroy },
+};
+
+/* Processes the signal with the kernel BENCH_RUNS times, in blocks, and
+ * returns the fastest time in seconds, or a negative value if the kernel
+ * cannot run. Each run starts from the same signal. The time is the wall
+ * clock time, since a pipeline can run its modules on worker threads. */
+static double time_kernel(const struct kernel *kernel, struct bench *bench,
+			  float *const *signal, const int16_t *signal_s16,
+			  int frames)
+{
+	float *data[BENCH_BUFFERS], *block_data[BENCH_BUFFERS];
+	int16_t *s16;
+	struct timespec tp1, tp2;
+	double best = -1;
+	int run, i, j;
+
+	for (i = 0; i < BENCH_BUFFERS; i++)
+		data[i] = malloc(frames * sizeof(float));
+	s16 = malloc(frames * 2 * sizeof(int16_t));
+
+	for (run = 0; run < BENCH_RUNS; run++) {
+		void *state = kernel->create(bench);
+		double t;
+
+		if (!state)
+			break;
+		for (i = 0; i < BENCH_BUFFERS; i++)
+			memcpy(data[i], signal[i % 2], frames * sizeof(float));
+		memcpy(s16, signal_s16, frames * 2 * sizeof(int16_t));
+
+		clock_gettime(CLOCK_MONOTONIC, &tp1);
+		for (j = 0; j < frames; j += bench->block) {
+			int n = frames - j < bench->block ?
+				frames - j : bench->block;
+			for (i = 0; i < BENCH_BUFFERS; i++)
+				block_data[i] = data[i] + j;
+			kernel->process(state, block_data, s16 + 2 * j, n);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &tp2);
+
+		kernel->destroy(state);
+		t = tp_diff(&tp2, &tp1);
+		if (best < 0 || t < best)
+			best = t;
+	}
+
+	for (i = 0; i < BENCH_BUFFERS; i++)
+		free(data[i]);
+	free(s16);
+	return best;
+}
+
+/* Reads the results from a file printed by this program, which has one
+ * result on each line. Returns the number of results read, or -1 if the
+ * file cannot be opened. */
+static int read_baseline(const char *filename, struct result *results,
+			 int max_results)
+{
+	FILE *fp = fopen(filename, "r");
+	char line[256];
+	int n = 0;
+
+	if (!fp)
+		return -1;
+	while (n < max_results && fgets(line, sizeof(line), fp)) {
+		struct result *r = &results[n];
+		if (sscanf(line, " {\"kernel\": \"%31[^\"]\", \"rate\": %d, "
+			   "\"block\": %d, \"ns_per_frame\": %lf",
+			   r->kernel, &r->rate, &r->block,
+			   &r->ns_per_frame) == 4)
+			n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+static const struct result *find_result(const struct result *results, int n,
+					const struct result *r)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (strcmp(results[i].kernel, r->kernel) == 0 &&
+		    results[i].rate == r->rate && results[i].block == r->block)
+			return &results[i];
+	return NULL;
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"Usage: dsp_bench [-i dsp.ini] [-b baseline.json] "
+		"[-t tolerance] [-k kernel] [-c backend]\n"
+		"  -i  also benchmark the playback pipeline of the ini file\n"
+		"  -b  fail if a result is slower than in the baseline\n"
+		"  -t  the slowdown allowed, in percent (default %d)\n"
+		"  -k  only run the named kernel\n"
+		"  -c  run the kernels of the named backend, like c or sse3,\n"
+		"      instead of the fastest ones\n", DEFAULT_TOLERANCE);
+}
+
+int main(int argc, char **argv)
+{
+	static struct result results[MAX_RESULTS], baseline[MAX_RESULTS];
+	const char *baseline_file = NULL, *only = NULL, *backend = NULL;
+	double tolerance = DEFAULT_TOLERANCE;
+	int num_results = 0, num_baseline = 0, regressions = 0;
+	struct bench bench = { 0 };
+	size_t k, r, b;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "i:b:t:k:c:h")) != -1) {
+		switch (c) {
+		case 'i':
+			bench.ini_file = optarg;
+			break;
+		case 'b':
+			baseline_file = optarg;
+			break;
+		case 't':
+			tolerance = atof(optarg);
+			break;
+		case 'k':
+			only = optarg;
+			break;
+		case 'c':
+			backend = optarg;
+			break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+
+	if (baseline_file) {
+		num_baseline = read_baseline(baseline_file, baseline,
+					     MAX_RESULTS);
+		if (num_baseline < 0) {
+			fprintf(stderr, "cannot read %s\n", baseline_file);
+			return 2;
+		}
+	}
+
+	if (backend) {
+		const struct dsp_backend *be;
+
+		for (be = dsp_backends; be->name; be++)
+			if (strcmp(be->name, backend) == 0)
+				break;
+		if (!be->name || !dsp_backend_supported(be)) {
+			fprintf(stderr, "backend %s is not available\n",
+				backend);
+			return 2;
+		}
+		dsp_kernels_select(be->features);
+	} else {
+		dsp_kernels_select(~0U);
+	}
+
+	dsp_enable_flush_denormal_to_zero();
+
+	for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+		int frames = rates[r] * BENCH_SECONDS;
+		float *signal[2];
+		int16_t *signal_s16 = malloc(frames * 2 * sizeof(int16_t));
+
+		signal[0] = malloc(frames * sizeof(float));
+		signal[1] = malloc(frames * sizeof(float));
+		make_signal(signal[0], signal[1], frames, rates[r]);
+		dsp_util_interleave_format(signal, (uint8_t *)signal_s16, 2,
+					   DSP_SAMPLE_FORMAT_S16_LE, frames);
+
+		for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+			if (only && strcmp(only, kernels[k].name) != 0)
+				continue;
+			for (b = 0; b < sizeof(blocks) / sizeof(blocks[0]);
+			     b++) {
+				struct result *res = &results[num_results];
+				double t;
+
+				bench.rate = rates[r];
+				bench.block = blocks[b];
+				t = time_kernel(&kernels[k], &bench, signal,
+						signal_s16, frames);
+				if (t <= 0)
+					continue;
+				snprintf(res->kernel, MAX_NAME, "%s",
+					 kernels[k].name);
+				res->rate = rates[r];
+				res->block = blocks[b];
+				res->ns_per_frame = t * 1e9 / frames;
+				res->realtime = BENCH_SECONDS / t;
+				num_results++;
+			}
+		}
+
+		free(signal[0]);
+		free(signal[1]);
+		free(signal_s16);
+	}
+
+	printf("{\n  \"seconds\": %d,\n  \"runs\": %d,\n"
+	       "  \"features\": %u,\n  \"results\": [\n",
+	       BENCH_SECONDS, BENCH_RUNS, dsp_get_kernels()->features);
+	for (i = 0; i < num_results; i++) {
+		const struct result *res = &results[i];
+		const struct result *base;
+
+		printf("    {\"kernel\": \"%s\", \"rate\": %d, \"block\": %d, "
+		       "\"ns_per_frame\": %.3f, \"realtime\": %.1f}%s\n",
+		       res->kernel, res->rate, res->block, res->ns_per_frame,
+		       res->realtime, i + 1 < num_results ? "," : "");
+
+		base = find_result(baseline, num_baseline, res);
+		if (base && res->ns_per_frame >
+		    base->ns_per_frame * (1 + tolerance / 100)) {
+			fprintf(stderr, "%s at %d Hz, block %d: %.3f ns/frame, "
+				"baseline %.3f ns/frame\n", res->kernel,
+				res->rate, res->block, res->ns_per_frame,
+				base->ns_per_frame);
+			regressions++;
+		}
+	}
+	printf("  ]\n}\n");
+
+	if (regressions)
+		fprintf(stderr, "%d regressions\n", regressions);
+	return regressions ? 1 : 0;
+}
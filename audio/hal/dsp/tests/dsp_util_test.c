@@ -0,0 +1,310 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dsp_util.h"
+
+#define MAX_CHANNELS 8
+#define TEST_FRAMES 1001
+#define BENCH_FRAMES 4096
+#define BENCH_LOOPS 2000
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec)
+		+ (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+/* The scalar conversions which the SIMD ones are checked against. */
+static void ref_deinterleave(int16_t *input, float *const *output,
+			     int channels, int frames)
+{
+	int i, j;
+
+	for (i = 0; i < frames; i++)
+		for (j = 0; j < channels; j++)
+			output[j][i] = *input++ / 32768.0f;
+}
+
+static void ref_interleave(float *const *input, int16_t *output,
+			   int channels, int frames)
+{
+	int i, j;
+
+	for (i = 0; i < frames; i++)
+		for (j = 0; j < channels; j++) {
+			int16_t i16;
+			float f = input[j][i] * 32768.0f;
+			if (f > 32767)
+				i16 = 32767;
+			else if (f < -32768)
+				i16 = -32768;
+			else
+				i16 = (int16_t) (f > 0 ? f + 0.5f : f - 0.5f);
+			*output++ = i16;
+		}
+}
+
+/* Returns a float sample which is often out of range or exactly half way
+ * between two int16_t values, to test saturation and rounding. */
+static float test_float()
+{
+	switch (rand() % 4) {
+	case 0:
+		return (rand() % 65536 - 32768 + 0.5f) / 32768.0f;
+	case 1:
+		return (rand() % 2 ? 1.5f : -1.5f) * rand() / RAND_MAX +
+			(rand() % 2 ? 1.0f : -1.0f);
+	default:
+		return 2.0f * rand() / RAND_MAX - 1.0f;
+	}
+}
+
+/* Checks dsp_util_deinterleave() and dsp_util_interleave() against the scalar
+ * reference. The stereo kernels round a little differently, so a difference
+ * of one is allowed for two channels. Returns the number of errors. */
+static int test_channels(int channels)
+{
+	int16_t in16[TEST_FRAMES * MAX_CHANNELS];
+	int16_t out16[TEST_FRAMES * MAX_CHANNELS];
+	int16_t ref16[TEST_FRAMES * MAX_CHANNELS];
+	float buf[MAX_CHANNELS][TEST_FRAMES], ref[MAX_CHANNELS][TEST_FRAMES];
+	float *ptr[MAX_CHANNELS], *ref_ptr[MAX_CHANNELS];
+	int i, j, errors = 0;
+	int tolerance = channels == 2 ? 1 : 0;
+
+	for (i = 0; i < channels; i++) {
+		ptr[i] = buf[i];
+		ref_ptr[i] = ref[i];
+	}
+
+	for (i = 0; i < TEST_FRAMES * channels; i++)
+		in16[i] = rand() % 65536 - 32768;
+	in16[0] = -32768;
+	in16[1] = 32767;
+
+	dsp_util_deinterleave(in16, ptr, channels, TEST_FRAMES);
+	ref_deinterleave(in16, ref_ptr, channels, TEST_FRAMES);
+	for (i = 0; i < channels; i++)
+		for (j = 0; j < TEST_FRAMES; j++)
+			if (buf[i][j] != ref[i][j]) {
+				if (errors++ < 10)
+					printf("deinterleave %d ch: channel %d "
+					       "frame %d: %g != %g\n", channels,
+					       i, j, buf[i][j], ref[i][j]);
+			}
+
+	for (i = 0; i < channels; i++)
+		for (j = 0; j < TEST_FRAMES; j++)
+			buf[i][j] = test_float();
+
+	dsp_util_interleave(ptr, out16, channels, TEST_FRAMES);
+	ref_interleave(ptr, ref16, channels, TEST_FRAMES);
+	for (i = 0; i < TEST_FRAMES * channels; i++)
+		if (abs(out16[i] - ref16[i]) > tolerance) {
+			if (errors++ < 10)
+				printf("interleave %d ch: sample %d: "
+				       "%d != %d\n", channels, i, out16[i],
+				       ref16[i]);
+		}
+
+	return errors;
+}
+
+/* Checks dsp_util_copy_channels() from in_channels to out_channels, both
+ * between two buffers and in place when the output is not wider. Returns the
+ * number of errors. */
+static int test_copy_channels(int in_channels, int out_channels)
+{
+	int16_t in16[TEST_FRAMES * MAX_CHANNELS];
+	int16_t out16[TEST_FRAMES * MAX_CHANNELS];
+	int channels = in_channels < out_channels ? in_channels : out_channels;
+	int i, j, pass, errors = 0;
+
+	for (pass = 0; pass < 2; pass++) {
+		int16_t *out = pass ? in16 : out16;
+
+		if (pass && out_channels > in_channels)
+			break;
+		for (i = 0; i < TEST_FRAMES * in_channels; i++)
+			in16[i] = i * 7 + 1;
+		for (i = 0; i < TEST_FRAMES * out_channels; i++)
+			out16[i] = -1;
+
+		dsp_util_copy_channels((uint8_t *)in16, in_channels,
+				       (uint8_t *)out, out_channels, channels,
+				       DSP_SAMPLE_FORMAT_S16_LE, TEST_FRAMES);
+		for (i = 0; i < TEST_FRAMES; i++)
+			for (j = 0; j < out_channels; j++) {
+				int16_t expected = j < channels ?
+					(i * in_channels + j) * 7 + 1 : 0;
+				if (out[i * out_channels + j] == expected)
+					continue;
+				if (errors++ < 10)
+					printf("copy %d to %d ch%s: frame %d "
+					       "channel %d: %d != %d\n",
+					       in_channels, out_channels,
+					       pass ? " in place" : "", i, j,
+					       out[i * out_channels + j],
+					       expected);
+			}
+	}
+
+	return errors;
+}
+
+/* Checks that integer samples go through Q31 and back unchanged, and that
+ * Q31 samples round and saturate to int16_t. Returns the number of
+ * errors. */
+static int test_q31(int channels, enum dsp_sample_format format)
+{
+	int bytes = dsp_util_sample_bytes(format);
+	uint8_t *in = malloc(TEST_FRAMES * MAX_CHANNELS * 4);
+	uint8_t *out = malloc(TEST_FRAMES * MAX_CHANNELS * 4);
+	int32_t *q31[MAX_CHANNELS];
+	int i, j, errors = 0;
+
+	for (i = 0; i < TEST_FRAMES * channels * bytes; i++)
+		in[i] = rand();
+	/* S24_LE ignores the top byte, so keep it the sign extension. */
+	if (format == DSP_SAMPLE_FORMAT_S24_LE)
+		for (i = 0; i < TEST_FRAMES * channels; i++)
+			in[4 * i + 3] = (in[4 * i + 2] & 0x80) ? 0xff : 0;
+	for (j = 0; j < channels; j++)
+		q31[j] = malloc(TEST_FRAMES * sizeof(int32_t));
+
+	dsp_util_deinterleave_q31(in, q31, channels, format, TEST_FRAMES);
+	dsp_util_interleave_q31(q31, out, channels, format, TEST_FRAMES);
+	for (i = 0; i < TEST_FRAMES * channels * bytes; i++)
+		if (in[i] != out[i] && errors++ < 10)
+			printf("q31 %d ch format %d: byte %d: %d != %d\n",
+			       channels, format, i, out[i], in[i]);
+
+	if (format == DSP_SAMPLE_FORMAT_S16_LE) {
+		int16_t *out16 = (int16_t *)out;
+		for (i = 0; i < TEST_FRAMES; i++)
+			for (j = 0; j < channels; j++)
+				q31[j][i] = INT32_MAX - i * 65536 * 9 + j;
+		dsp_util_interleave_q31(q31, out, channels, format,
+					TEST_FRAMES);
+		for (i = 0; i < TEST_FRAMES; i++)
+			for (j = 0; j < channels; j++) {
+				int64_t r = ((int64_t)q31[j][i] + 32768) >> 16;
+				int16_t expected = r > 32767 ? 32767 : r;
+				if (out16[i * channels + j] != expected &&
+				    errors++ < 10)
+					printf("q31 %d ch: frame %d: %d != "
+					       "%d\n", channels, i,
+					       out16[i * channels + j],
+					       expected);
+			}
+	}
+
+	for (j = 0; j < channels; j++)
+		free(q31[j]);
+	free(in);
+	free(out);
+	return errors;
+}
+
+/* Checks the saturation of the Q31 mixing functions, with the outputs in
+ * place of the inputs in swapped order. Returns the number of errors. */
+static int test_q31_mix()
+{
+	static const int32_t a[7] = {INT32_MAX, INT32_MIN, 5, -5, 1 << 30,
+				     INT32_MIN, 0};
+	static const int32_t b[7] = {1, -1, 7, 5, 1 << 30, INT32_MIN,
+				     INT32_MAX};
+	static const int32_t sum[7] = {INT32_MAX, INT32_MIN, 12, 0, INT32_MAX,
+				       INT32_MIN, INT32_MAX};
+	static const int32_t neg[7] = {-INT32_MAX, INT32_MAX, -5, 5,
+				       -(1 << 30), INT32_MAX, 0};
+	int32_t x[7], y[7];
+	int i, errors = 0;
+
+	memcpy(x, a, sizeof(x));
+	memcpy(y, b, sizeof(y));
+	dsp_util_mix_stereo_q31(x, y, y, x, 7);
+	for (i = 0; i < 7; i++)
+		if ((x[i] != sum[i] || y[i] != sum[i]) && errors++ < 10)
+			printf("mix_stereo_q31 %d: %d %d != %d\n", i, x[i],
+			       y[i], sum[i]);
+
+	memcpy(x, a, sizeof(x));
+	memcpy(y, b, sizeof(y));
+	dsp_util_invert_lr_q31(x, y, y, x, 7);
+	for (i = 0; i < 7; i++)
+		if ((y[i] != neg[i] || x[i] != b[i]) && errors++ < 10)
+			printf("invert_lr_q31 %d: %d %d != %d %d\n", i, y[i],
+			       x[i], neg[i], b[i]);
+	return errors;
+}
+
+/* Times the conversions against the scalar reference. */
+static void bench_channels(int channels)
+{
+	static int16_t data16[BENCH_FRAMES * MAX_CHANNELS];
+	static float data[MAX_CHANNELS][BENCH_FRAMES];
+	float *ptr[MAX_CHANNELS];
+	struct timespec tp1, tp2;
+	double t_simd, t_ref;
+	int i;
+
+	for (i = 0; i < channels; i++)
+		ptr[i] = data[i];
+	for (i = 0; i < BENCH_FRAMES * channels; i++)
+		data16[i] = rand() % 65536 - 32768;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		dsp_util_deinterleave(data16, ptr, channels, BENCH_FRAMES);
+		dsp_util_interleave(ptr, data16, channels, BENCH_FRAMES);
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+	t_simd = tp_diff(&tp2, &tp1);
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		ref_deinterleave(data16, ptr, channels, BENCH_FRAMES);
+		ref_interleave(ptr, data16, channels, BENCH_FRAMES);
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+	t_ref = tp_diff(&tp2, &tp1);
+
+	printf("%d channels: dsp_util %g seconds, scalar %g seconds "
+	       "(%.2fx)\n", channels, t_simd, t_ref, t_ref / t_simd);
+}
+
+int main(int argc, char **argv)
+{
+	int channels, errors = 0;
+
+	srand(0);
+	for (channels = 1; channels <= MAX_CHANNELS; channels++)
+		errors += test_channels(channels);
+	errors += test_copy_channels(2, 2);
+	errors += test_copy_channels(2, 4);
+	errors += test_copy_channels(4, 2);
+	errors += test_copy_channels(6, 6);
+	for (channels = 1; channels <= MAX_CHANNELS; channels++) {
+		errors += test_q31(channels, DSP_SAMPLE_FORMAT_S16_LE);
+		errors += test_q31(channels, DSP_SAMPLE_FORMAT_S24_3LE);
+		errors += test_q31(channels, DSP_SAMPLE_FORMAT_S24_LE);
+		errors += test_q31(channels, DSP_SAMPLE_FORMAT_S32_LE);
+	}
+	errors += test_q31_mix();
+	printf("%d errors\n", errors);
+
+	bench_channels(2);
+	bench_channels(4);
+	bench_channels(6);
+	bench_channels(8);
+
+	return errors ? 1 : 0;
+}
@@ -3,6 +3,7 @@
  * found in the LICENSE file.
  */
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -59,6 +60,152 @@ static void test_ir()
 	free(data);
 }
 
+/* Compares the block engine with the serial engine on white noise */
+static void test_engines()
+{
+	int N = 44100 * 10;
+	float *data[2];
+	struct eq *eq[2];
+	double NQ = 44100 / 2; /* nyquist frequency */
+	struct timespec tp1, tp2;
+	float diff, max_diff = 0;
+	int i, j, start;
+
+	for (i = 0; i < 2; i++) {
+		data[i] = malloc(sizeof(float) * N);
+		eq[i] = eq_new_with_engine(i ? EQ_ENGINE_BLOCK4 :
+					   EQ_ENGINE_SERIAL);
+		eq_append_biquad(eq[i], BQ_PEAKING, 380/NQ, 3, -10);
+		eq_append_biquad(eq[i], BQ_PEAKING, 720/NQ, 3, -12);
+		eq_append_biquad(eq[i], BQ_PEAKING, 1705/NQ, 3, -8);
+		eq_append_biquad(eq[i], BQ_HIGHPASS, 218/NQ, 0.7, -10.2);
+		eq_append_biquad(eq[i], BQ_PEAKING, 580/NQ, 6, -8);
+		eq_append_biquad(eq[i], BQ_HIGHSHELF, 8000/NQ, 3, 2);
+	}
+
+	srand(1);
+	for (j = 0; j < N; j++)
+		data[0][j] = data[1][j] = rand() / (float)RAND_MAX - 0.5f;
+
+	for (i = 0; i < 2; i++) {
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+		/* Use an odd chunk size to also run the serial tail. */
+		for (start = 0; start < N; start += 501)
+			eq_process(eq[i], data[i] + start,
+				   min(501, N - start));
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+		printf("%s engine takes %g seconds\n", i ? "block4" : "serial",
+		       tp_diff(&tp2, &tp1));
+		eq_free(eq[i]);
+	}
+
+	for (j = 0; j < N; j++) {
+		diff = fabsf(data[0][j] - data[1][j]);
+		if (diff > max_diff)
+			max_diff = diff;
+	}
+	printf("max difference between engines: %g\n", max_diff);
+
+	free(data[0]);
+	free(data[1]);
+}
+
+/* Compares the fixed point engines with the float serial engine on white
+ * noise at half of full scale. */
+static void test_q31()
+{
+	int N = 44100 * 10;
+	float *ref = malloc(sizeof(float) * N);
+	int32_t *data[2];
+	struct eq *eq[3];
+	double NQ = 44100 / 2; /* nyquist frequency */
+	struct timespec tp1, tp2;
+	double diff, max_diff;
+	int i, j, start;
+
+	for (i = 0; i < 3; i++) {
+		eq[i] = eq_new_with_engine(i == 2 ? EQ_ENGINE_BLOCK4 :
+					   EQ_ENGINE_SERIAL);
+		eq_append_biquad(eq[i], BQ_PEAKING, 380/NQ, 3, -10);
+		eq_append_biquad(eq[i], BQ_PEAKING, 720/NQ, 3, -12);
+		eq_append_biquad(eq[i], BQ_PEAKING, 1705/NQ, 3, -8);
+		eq_append_biquad(eq[i], BQ_HIGHPASS, 218/NQ, 0.7, -10.2);
+		eq_append_biquad(eq[i], BQ_PEAKING, 580/NQ, 6, -8);
+		eq_append_biquad(eq[i], BQ_HIGHSHELF, 8000/NQ, 3, 2);
+	}
+
+	srand(1);
+	data[0] = malloc(sizeof(int32_t) * N);
+	data[1] = malloc(sizeof(int32_t) * N);
+	for (j = 0; j < N; j++) {
+		ref[j] = rand() / (float)RAND_MAX - 0.5f;
+		data[0][j] = data[1][j] = ref[j] * 2147483648.0f;
+	}
+
+	for (start = 0; start < N; start += 501)
+		eq_process(eq[0], ref + start, min(501, N - start));
+	for (i = 0; i < 2; i++) {
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+		for (start = 0; start < N; start += 501)
+			eq_process_q31(eq[i + 1], data[i] + start,
+				       min(501, N - start));
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+
+		max_diff = 0;
+		for (j = 0; j < N; j++) {
+			diff = fabs(ref[j] - data[i][j] / 2147483648.0);
+			if (diff > max_diff)
+				max_diff = diff;
+		}
+		printf("q31 %s engine takes %g seconds, max difference %g\n",
+		       i ? "block4" : "serial", tp_diff(&tp2, &tp1), max_diff);
+	}
+
+	for (i = 0; i < 3; i++)
+		eq_free(eq[i]);
+	free(ref);
+	free(data[0]);
+	free(data[1]);
+}
+
+/* Changes the gain of a high shelf filter in the middle of a low sine, once
+ * at once and once with a fade, and prints the largest second difference of
+ * the output, which is small for the sine and large for a click. */
+static void test_fade()
+{
+	int N = 44100;
+	double NQ = 44100 / 2; /* nyquist frequency */
+	float *data = malloc(sizeof(float) * N);
+	struct eq *eq;
+	float step, max_step;
+	int fade_frames, i, j, start;
+
+	for (i = 0; i < 2; i++) {
+		fade_frames = i ? 2205 : 0;
+		eq = eq_new();
+		eq_append_biquad(eq, BQ_HIGHSHELF, 2000/NQ, 0, -12);
+		for (j = 0; j < N; j++)
+			data[j] = sinf(2 * M_PI * 100 * j / 44100) * 0.25f;
+		for (start = 0; start < N; start += 441) {
+			if (start == N / 2)
+				eq_set_biquad(eq, 0, BQ_HIGHSHELF, 2000/NQ, 0,
+					      12, fade_frames);
+			eq_process(eq, data + start, min(441, N - start));
+		}
+		eq_free(eq);
+
+		max_step = 0;
+		for (j = N / 2; j < N; j++) {
+			step = fabsf(data[j] - 2 * data[j - 1] + data[j - 2]);
+			if (step > max_step)
+				max_step = step;
+		}
+		printf("fade over %d frames, largest change %g\n", fade_frames,
+		       max_step);
+	}
+	free(data);
+}
+
 /* Processes a buffer of data chunk by chunk using eq */
 static void process(struct eq *eq, float *data, int count)
 {
@@ -125,8 +272,12 @@ int main(int argc, char **argv)
 		printf("denormal disabled\n");
 	dsp_util_clear_fp_exceptions();
 
-	if (argc == 1)
+	if (argc == 1) {
 		test_ir();
+		test_engines();
+		test_q31();
+		test_fade();
+	}
 	else if (argc == 3)
 		test_file(argv[1], argv[2]);
 	else
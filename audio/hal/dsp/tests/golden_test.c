@@ -0,0 +1,558 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Runs the DSP kernels on fixed stimuli and compares their outputs with the
+ * golden outputs in tests/golden, which come from the generic C backend.
+ * The test runs the kernels of each backend the CPU has, from the C one, so
+ * every backend is checked against the same outputs. Each kernel has a bound
+ * on the largest error of a sample and on the SNR of the whole output.
+ *
+ *    golden_test [golden_dir]        compares with the golden outputs
+ *    golden_test -g [golden_dir]     writes them, from the generic build only
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crossover2.h"
+#include "drc.h"
+#include "dsp_cpu.h"
+#include "dsp_kernels.h"
+#include "dsp_util.h"
+#include "eq.h"
+#include "eq2.h"
+#include "src.h"
+
+#define GOLDEN_FRAMES 4096
+#define GOLDEN_RATE 44100
+
+/* The most output channels of a kernel, and the most output samples of a
+ * channel. The converter makes more frames than it is given. */
+#define MAX_CHANNELS 6
+#define MAX_FRAMES (GOLDEN_FRAMES * 2)
+
+enum sample_type {
+	SAMPLE_FLOAT,
+	SAMPLE_S16,
+	SAMPLE_S32,
+};
+
+struct golden_kernel {
+	const char *name;
+	enum sample_type type;
+	/* The largest error of a sample, in ULPs of the golden sample for
+	 * float and in LSBs for integers, and the lowest SNR against the
+	 * golden output, in dB. */
+	double max_error;
+	double min_snr;
+	/* The same bounds for the backends which fuse the multiply-adds of
+	 * the filters. */
+	double fused_max_error;
+	double fused_min_snr;
+	/* Runs the kernel on the stimuli and writes its output to out.
+	 * Returns the number of samples written. */
+	int (*run)(void *out);
+};
+
+/* Two channels of noise, which are reproduced exactly on every CPU. The
+ * left channel switches between loud and quiet every 512 frames, so a
+ * compressor attacks and releases, and the right one has a 220 Hz square
+ * wave under the noise. */
+static float stimuli[2][GOLDEN_FRAMES];
+static int16_t stimuli_s16[GOLDEN_FRAMES * MAX_CHANNELS];
+
+static void make_stimuli()
+{
+	unsigned int seed = 1;
+	int i;
+
+	for (i = 0; i < GOLDEN_FRAMES; i++) {
+		float noise[2];
+		int c;
+
+		for (c = 0; c < 2; c++) {
+			seed = seed * 1103515245 + 12345;
+			noise[c] = ((int)(seed >> 8) - (1 << 23)) /
+				(float)(1 << 23);
+		}
+		stimuli[0][i] = (i / 512) % 2 ? noise[0] / 32 : noise[0];
+		stimuli[1][i] = noise[1] / 4 + ((i / 100) % 2 ? 0.25f : -0.25f);
+	}
+	for (i = 0; i < GOLDEN_FRAMES * MAX_CHANNELS; i++) {
+		seed = seed * 1103515245 + 12345;
+		stimuli_s16[i] = seed >> 16;
+	}
+}
+
+static void copy_stimuli(float *out)
+{
+	memcpy(out, stimuli[0], sizeof(stimuli[0]));
+	memcpy(out + GOLDEN_FRAMES, stimuli[1], sizeof(stimuli[1]));
+}
+
+static void set_eq(struct eq *eq)
+{
+	float nyquist = GOLDEN_RATE / 2.0f;
+
+	eq_append_biquad(eq, BQ_HIGHPASS, 80 / nyquist, 0, 0);
+	eq_append_biquad(eq, BQ_PEAKING, 1000 / nyquist, 1, 3);
+	eq_append_biquad(eq, BQ_PEAKING, 3000 / nyquist, 2, -4);
+	eq_append_biquad(eq, BQ_HIGHSHELF, 8000 / nyquist, 0, -2);
+}
+
+static int run_eq_engine(float *out, enum eq_engine engine)
+{
+	int c;
+
+	copy_stimuli(out);
+	for (c = 0; c < 2; c++) {
+		struct eq *eq = eq_new_with_engine(engine);
+		set_eq(eq);
+		eq_process(eq, out + c * GOLDEN_FRAMES, GOLDEN_FRAMES);
+		eq_free(eq);
+	}
+	return 2 * GOLDEN_FRAMES;
+}
+
+static int run_eq(void *out)
+{
+	return run_eq_engine(out, EQ_ENGINE_SERIAL);
+}
+
+static int run_eq_block4(void *out)
+{
+	return run_eq_engine(out, EQ_ENGINE_BLOCK4);
+}
+
+static int run_eq_q31(void *out)
+{
+	int32_t *q31 = out;
+	int c, i;
+
+	for (c = 0; c < 2; c++) {
+		struct eq *eq = eq_new_with_engine(EQ_ENGINE_BLOCK4);
+		int32_t *data = q31 + c * GOLDEN_FRAMES;
+
+		for (i = 0; i < GOLDEN_FRAMES; i++)
+			data[i] = stimuli[c][i] * 2147483648.0f;
+		set_eq(eq);
+		eq_process_q31(eq, data, GOLDEN_FRAMES);
+		eq_free(eq);
+	}
+	return 2 * GOLDEN_FRAMES;
+}
+
+static int run_eq2(void *out)
+{
+	struct eq2 *eq2 = eq2_new();
+	float nyquist = GOLDEN_RATE / 2.0f;
+	float *data = out;
+	int c;
+
+	for (c = 0; c < 2; c++) {
+		eq2_append_biquad(eq2, c, BQ_HIGHPASS, 80 / nyquist, 0, 0);
+		eq2_append_biquad(eq2, c, BQ_PEAKING, 1000 / nyquist, 1, 3);
+		eq2_append_biquad(eq2, c, BQ_PEAKING, 3000 / nyquist, 2, -4);
+		eq2_append_biquad(eq2, c, BQ_HIGHSHELF, 8000 / nyquist, 0, -2);
+	}
+	/* An odd number of biquads on the left channel, so the last one runs
+	 * alone. */
+	eq2_append_biquad(eq2, 0, BQ_LOWSHELF, 200 / nyquist, 0, 4);
+
+	copy_stimuli(data);
+	eq2_process(eq2, data, data + GOLDEN_FRAMES, GOLDEN_FRAMES);
+	eq2_free(eq2);
+	return 2 * GOLDEN_FRAMES;
+}
+
+/* All the biquads an eq2 can hold, so the widest backends run a full
+ * cascade. */
+static int run_eq2_ten(void *out)
+{
+	struct eq2 *eq2 = eq2_new();
+	float nyquist = GOLDEN_RATE / 2.0f;
+	float *data = out;
+	int c, i;
+
+	for (c = 0; c < 2; c++) {
+		eq2_append_biquad(eq2, c, BQ_HIGHPASS, 60 / nyquist, 0, 0);
+		for (i = 0; i < MAX_BIQUADS_PER_EQ2 - 2; i++)
+			eq2_append_biquad(eq2, c, BQ_PEAKING,
+					  (100 << i) / nyquist, 1 + c,
+					  i % 2 ? -3 : 2);
+		eq2_append_biquad(eq2, c, BQ_LOWPASS, 18000 / nyquist, 0, 0);
+	}
+
+	copy_stimuli(data);
+	eq2_process(eq2, data, data + GOLDEN_FRAMES, GOLDEN_FRAMES);
+	eq2_free(eq2);
+	return 2 * GOLDEN_FRAMES;
+}
+
+static int run_crossover2(void *out)
+{
+	struct crossover2 xo2;
+	float *data = out;
+	float nyquist = GOLDEN_RATE / 2.0f;
+
+	crossover2_init(&xo2, 200 / nyquist, 2000 / nyquist);
+	copy_stimuli(data);
+	crossover2_process(&xo2, GOLDEN_FRAMES, data, data + GOLDEN_FRAMES,
+			   data + 2 * GOLDEN_FRAMES, data + 3 * GOLDEN_FRAMES,
+			   data + 4 * GOLDEN_FRAMES, data + 5 * GOLDEN_FRAMES);
+	return 6 * GOLDEN_FRAMES;
+}
+
+/* The three band compressor of drc_test, without the emphasis filters as in
+ * speakerdsp.ini. */
+static int run_drc(void *out)
+{
+	struct drc *drc = drc_new(GOLDEN_RATE);
+	float nyquist = GOLDEN_RATE / 2.0f;
+	float *data = out;
+	int i;
+
+	drc->emphasis_disabled = 1;
+
+	drc_set_param(drc, 0, PARAM_CROSSOVER_LOWER_FREQ, 0);
+	drc_set_param(drc, 0, PARAM_ENABLED, 1);
+	drc_set_param(drc, 0, PARAM_THRESHOLD, -29);
+	drc_set_param(drc, 0, PARAM_KNEE, 3);
+	drc_set_param(drc, 0, PARAM_RATIO, 6.677);
+	drc_set_param(drc, 0, PARAM_ATTACK, 0.02);
+	drc_set_param(drc, 0, PARAM_RELEASE, 0.2);
+	drc_set_param(drc, 0, PARAM_POST_GAIN, -7);
+
+	drc_set_param(drc, 1, PARAM_CROSSOVER_LOWER_FREQ, 200 / nyquist);
+	drc_set_param(drc, 1, PARAM_ENABLED, 1);
+	drc_set_param(drc, 1, PARAM_THRESHOLD, -32);
+	drc_set_param(drc, 1, PARAM_KNEE, 23);
+	drc_set_param(drc, 1, PARAM_RATIO, 12);
+	drc_set_param(drc, 1, PARAM_ATTACK, 0.02);
+	drc_set_param(drc, 1, PARAM_RELEASE, 0.2);
+	drc_set_param(drc, 1, PARAM_POST_GAIN, 0.7);
+
+	drc_set_param(drc, 2, PARAM_CROSSOVER_LOWER_FREQ, 1200 / nyquist);
+	drc_set_param(drc, 2, PARAM_ENABLED, 1);
+	drc_set_param(drc, 2, PARAM_THRESHOLD, -24);
+	drc_set_param(drc, 2, PARAM_KNEE, 30);
+	drc_set_param(drc, 2, PARAM_RATIO, 1);
+	drc_set_param(drc, 2, PARAM_ATTACK, 0.001);
+	drc_set_param(drc, 2, PARAM_RELEASE, 1);
+	drc_set_param(drc, 2, PARAM_POST_GAIN, 0);
+
+	drc_init(drc);
+	copy_stimuli(data);
+	for (i = 0; i < GOLDEN_FRAMES; i += DRC_PROCESS_MAX_FRAMES) {
+		float *channels[2] = { data + i, data + GOLDEN_FRAMES + i };
+		int n = GOLDEN_FRAMES - i < DRC_PROCESS_MAX_FRAMES ?
+			GOLDEN_FRAMES - i : DRC_PROCESS_MAX_FRAMES;
+		drc_process(drc, channels, n);
+	}
+	drc_free(drc);
+	return 2 * GOLDEN_FRAMES;
+}
+
+static int run_src(void *out)
+{
+	struct src *src = src_new(GOLDEN_RATE, 48000, SRC_QUALITY_MEDIUM);
+	float *data = out;
+	int frames;
+
+	frames = src_process(src, stimuli[0], stimuli[1], GOLDEN_FRAMES,
+			     data, data + MAX_FRAMES);
+	memmove(data + frames, data + MAX_FRAMES, frames * sizeof(float));
+	src_free(src);
+	return 2 * frames;
+}
+
+/* Deinterleaves S16 samples of the given number of channels, which have
+ * separate code for stereo. */
+static int run_deinterleave(void *out, int channels)
+{
+	float *data = out;
+	float *output[MAX_CHANNELS];
+	int c;
+
+	for (c = 0; c < channels; c++)
+		output[c] = data + c * GOLDEN_FRAMES;
+	dsp_util_deinterleave_format((uint8_t *)stimuli_s16, output, channels,
+				     DSP_SAMPLE_FORMAT_S16_LE, GOLDEN_FRAMES);
+	return channels * GOLDEN_FRAMES;
+}
+
+static int run_deinterleave_2(void *out)
+{
+	return run_deinterleave(out, 2);
+}
+
+static int run_deinterleave_6(void *out)
+{
+	return run_deinterleave(out, 6);
+}
+
+/* Interleaves the float stimuli, scaled past full scale so the samples
+ * saturate, to S16. */
+static int run_interleave(void *out)
+{
+	float *input[2] = { malloc(sizeof(stimuli[0])),
+			    malloc(sizeof(stimuli[1])) };
+	int c, i;
+
+	for (c = 0; c < 2; c++)
+		for (i = 0; i < GOLDEN_FRAMES; i++)
+			input[c][i] = stimuli[c][i] * 2;
+	dsp_util_interleave_format(input, out, 2, DSP_SAMPLE_FORMAT_S16_LE,
+				   GOLDEN_FRAMES);
+	free(input[0]);
+	free(input[1]);
+	return 2 * GOLDEN_FRAMES;
+}
+
+static int run_q31_round_trip(void *out)
+{
+	int32_t *input[2] = { malloc(GOLDEN_FRAMES * sizeof(int32_t)),
+			      malloc(GOLDEN_FRAMES * sizeof(int32_t)) };
+	int c, i;
+
+	dsp_util_deinterleave_q31((uint8_t *)stimuli_s16, input, 2,
+				  DSP_SAMPLE_FORMAT_S16_LE, GOLDEN_FRAMES);
+	/* Add a little under half an LSB, and make some samples full scale,
+	 * so the rounding and the saturation both matter. */
+	for (c = 0; c < 2; c++)
+		for (i = 0; i < GOLDEN_FRAMES; i++)
+			input[c][i] = i % 7 ? input[c][i] + 0x7fff :
+				INT32_MAX - i;
+	dsp_util_interleave_q31(input, out, 2, DSP_SAMPLE_FORMAT_S16_LE,
+				GOLDEN_FRAMES);
+	free(input[0]);
+	free(input[1]);
+	return 2 * GOLDEN_FRAMES;
+}
+
+/* The filters may sum in another order, and the AVX-512 compressor fuses the
+ * multiply-adds of warp_sinf(), so their bounds allow a few ULPs. Each
+ * backend of eq_block4 sums the eight products of an output in its own order,
+ * which the 80 Hz highpass amplifies. The ASIMD filters fuse their
+ * multiply-adds, which round once instead of twice. The recursive filters
+ * amplify that the same way, though the output is as close to the exact one,
+ * so their fused bounds are the errors of the ASIMD kernels in
+ * golden_test_asimd_emul, which emulates them exactly, with some margin.
+ * golden_test is built with -ffp-contract=off, so the C code is never fused
+ * and keeps the tight bounds. The SSE3 interleave rounds halfway samples to
+ * even rather than away from zero. The other conversions are exact. */
+static const struct golden_kernel kernels[] = {
+	{ "eq", SAMPLE_FLOAT, 64, 100, 64, 100, run_eq },
+	{ "eq_block4", SAMPLE_FLOAT, 1 << 20, 75, 1 << 20, 75,
+	  run_eq_block4 },
+	{ "eq_q31", SAMPLE_S32, 256, 100, 256, 100, run_eq_q31 },
+	{ "eq2", SAMPLE_FLOAT, 64, 100, 1 << 20, 78, run_eq2 },
+	{ "eq2_ten", SAMPLE_FLOAT, 64, 100, 1 << 20, 75, run_eq2_ten },
+	{ "crossover2", SAMPLE_FLOAT, 64, 100, 1 << 19, 90, run_crossover2 },
+	{ "drc", SAMPLE_FLOAT, 64, 100, 1 << 19, 84, run_drc },
+	{ "src", SAMPLE_FLOAT, 64, 100, 64, 100, run_src },
+	{ "deinterleave_2", SAMPLE_FLOAT, 0, INFINITY, 0, INFINITY,
+	  run_deinterleave_2 },
+	{ "deinterleave_6", SAMPLE_FLOAT, 0, INFINITY, 0, INFINITY,
+	  run_deinterleave_6 },
+	{ "interleave", SAMPLE_S16, 1, 100, 1, 100, run_interleave },
+	{ "q31_round_trip", SAMPLE_S16, 0, INFINITY, 0, INFINITY,
+	  run_q31_round_trip },
+};
+
+/* Returns 1 if the filters of a backend fuse their multiply-adds, 0
+ * otherwise. */
+static int backend_fuses(const struct dsp_backend *backend)
+{
+	return (backend->features & DSP_CPU_ASIMD) != 0;
+}
+
+static size_t sample_size(enum sample_type type)
+{
+	switch (type) {
+	case SAMPLE_S16:
+		return sizeof(int16_t);
+	case SAMPLE_S32:
+		return sizeof(int32_t);
+	default:
+		return sizeof(float);
+	}
+}
+
+static double sample_value(enum sample_type type, const void *data, int i)
+{
+	switch (type) {
+	case SAMPLE_S16:
+		return ((const int16_t *)data)[i];
+	case SAMPLE_S32:
+		return ((const int32_t *)data)[i];
+	default:
+		return ((const float *)data)[i];
+	}
+}
+
+/* Returns the error of a sample in ULPs of the golden sample, or in LSBs
+ * for integers. Float samples quieter than -60 dBFS count as -60 dBFS, so
+ * a tiny error near zero is not a huge number of ULPs. */
+static double sample_error(enum sample_type type, double value,
+			   double golden)
+{
+	int exp;
+
+	if (type != SAMPLE_FLOAT)
+		return fabs(value - golden);
+	frexp(fmax(fabs(golden), 1.0 / 1024), &exp);
+	return fabs(value - golden) / ldexp(1, exp - 24);
+}
+
+/* Returns the number of samples in a golden file, which are read to data,
+ * or -1 if it cannot be read. */
+static int read_golden(const char *filename, enum sample_type type,
+		       void *data, int max_samples)
+{
+	FILE *fp = fopen(filename, "rb");
+	int n;
+
+	if (!fp)
+		return -1;
+	n = fread(data, sample_size(type), max_samples, fp);
+	fclose(fp);
+	return n;
+}
+
+static int write_golden(const char *filename, enum sample_type type,
+			const void *data, int samples)
+{
+	FILE *fp = fopen(filename, "wb");
+	int n;
+
+	if (!fp)
+		return -1;
+	n = fwrite(data, sample_size(type), samples, fp);
+	fclose(fp);
+	return n == samples ? 0 : -1;
+}
+
+/* Compares the output of a kernel with its golden output, with the fused
+ * bounds if fused is set. Returns 1 if it is out of the bounds, 0 otherwise.
+ */
+static int check_kernel(const struct golden_kernel *kernel, int fused,
+			const void *out, const void *golden, int samples)
+{
+	double max_error = 0, signal = 0, noise = 0, snr;
+	double bound = fused ? kernel->fused_max_error : kernel->max_error;
+	double min_snr = fused ? kernel->fused_min_snr : kernel->min_snr;
+	int i;
+
+	for (i = 0; i < samples; i++) {
+		double v = sample_value(kernel->type, out, i);
+		double g = sample_value(kernel->type, golden, i);
+		double e = sample_error(kernel->type, v, g);
+
+		if (e > max_error)
+			max_error = e;
+		signal += g * g;
+		noise += (v - g) * (v - g);
+	}
+	snr = noise > 0 ? 10 * log10(signal / noise) : INFINITY;
+
+	printf("%-16s max error %8.1f %s, snr %6.1f dB", kernel->name,
+	       max_error, kernel->type == SAMPLE_FLOAT ? "ulp" : "lsb", snr);
+	if (max_error > bound || snr < min_snr) {
+		printf("  FAIL (max %.1f, snr %.1f dB)\n", bound, min_snr);
+		return 1;
+	}
+	printf("\n");
+	return 0;
+}
+
+/* Runs all the kernels, and writes their outputs to dir or compares them
+ * with the golden outputs there, with the fused bounds if fused is set.
+ * Returns:
+ *    The number of kernels which failed.
+ */
+static int run_kernels(const char *dir, int generate, int fused, void *out,
+		       void *golden, size_t max_bytes)
+{
+	char filename[256];
+	int errors = 0;
+	size_t k;
+
+	for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+		const struct golden_kernel *kernel = &kernels[k];
+		int samples, golden_samples;
+
+		memset(out, 0, max_bytes);
+		samples = kernel->run(out);
+		snprintf(filename, sizeof(filename), "%s/%s.raw", dir,
+			 kernel->name);
+
+		if (generate) {
+			if (write_golden(filename, kernel->type, out,
+					 samples) != 0) {
+				printf("cannot write %s\n", filename);
+				errors++;
+			}
+			continue;
+		}
+
+		golden_samples = read_golden(filename, kernel->type, golden,
+					     MAX_CHANNELS * MAX_FRAMES);
+		if (golden_samples < 0) {
+			printf("cannot read %s\n", filename);
+			errors++;
+		} else if (golden_samples != samples) {
+			printf("%s: %d samples, golden has %d\n", kernel->name,
+			       samples, golden_samples);
+			errors++;
+		} else {
+			errors += check_kernel(kernel, fused, out, golden,
+					       samples);
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "golden";
+	int generate = 0, errors = 0;
+	size_t max_bytes = MAX_CHANNELS * MAX_FRAMES * sizeof(float);
+	void *out = malloc(max_bytes);
+	void *golden = malloc(max_bytes);
+	const struct dsp_backend *b;
+
+	if (argc > 1 && strcmp(argv[1], "-g") == 0) {
+		generate = 1;
+		argc--;
+		argv++;
+	}
+	if (argc > 1)
+		dir = argv[1];
+
+	dsp_enable_flush_denormal_to_zero();
+	make_stimuli();
+
+	for (b = dsp_backends; b->name; b++) {
+		if (!dsp_backend_supported(b))
+			continue;
+		dsp_kernels_select(b->features);
+		printf("%s:\n", b->name);
+		errors += run_kernels(dir, generate, backend_fuses(b), out,
+				      golden, max_bytes);
+		/* The golden outputs come from the C backend. */
+		if (generate)
+			break;
+	}
+	dsp_kernels_select(~0U);
+
+	free(out);
+	free(golden);
+	printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
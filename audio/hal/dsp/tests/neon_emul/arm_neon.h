@@ -0,0 +1,375 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* The AArch64 intrinsics the ASIMD kernels use, emulated with the vector
+ * extensions of GCC and clang, so golden_test_asimd_emul can run those
+ * kernels on a host. Each intrinsic gives the same result as on the device,
+ * bit for bit: the fused multiply-adds round once through fmaf(), and the
+ * conversions round and saturate like the instructions. Only the intrinsics
+ * the kernels use are here. The 32-bit NEON kernels are mostly inline
+ * assembly, so only the device golden_test runs them.
+ */
+
+#ifndef ARM_NEON_EMUL_H_
+#define ARM_NEON_EMUL_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef float float32x2_t __attribute__((vector_size(8)));
+typedef float float32x4_t __attribute__((vector_size(16)));
+typedef int16_t int16x4_t __attribute__((vector_size(8)));
+typedef int16_t int16x8_t __attribute__((vector_size(16)));
+typedef int32_t int32x4_t __attribute__((vector_size(16)));
+typedef uint32_t uint32x4_t __attribute__((vector_size(16)));
+
+typedef struct { float32x4_t val[2]; } float32x4x2_t;
+typedef struct { int16x8_t val[2]; } int16x8x2_t;
+typedef struct { int16x8_t val[3]; } int16x8x3_t;
+typedef struct { int16x8_t val[4]; } int16x8x4_t;
+
+/* Lanes, loads and stores */
+
+static inline float32x4_t vdupq_n_f32(float f)
+{
+	return (float32x4_t){ f, f, f, f };
+}
+
+static inline float32x2_t vdup_n_f32(float f)
+{
+	return (float32x2_t){ f, f };
+}
+
+#define vset_lane_f32(f, v, lane) ({		\
+	float32x2_t _v = (v);			\
+	_v[lane] = (f);				\
+	_v; })
+#define vgetq_lane_f32(v, lane) ((v)[lane])
+#define vget_lane_f32(v, lane) ((v)[lane])
+
+static inline float32x4_t vcombine_f32(float32x2_t a, float32x2_t b)
+{
+	return (float32x4_t){ a[0], a[1], b[0], b[1] };
+}
+
+static inline float32x2_t vget_low_f32(float32x4_t a)
+{
+	return (float32x2_t){ a[0], a[1] };
+}
+
+static inline float32x2_t vget_high_f32(float32x4_t a)
+{
+	return (float32x2_t){ a[2], a[3] };
+}
+
+static inline int16x8_t vcombine_s16(int16x4_t a, int16x4_t b)
+{
+	return (int16x8_t){ a[0], a[1], a[2], a[3], b[0], b[1], b[2], b[3] };
+}
+
+static inline int16x4_t vget_low_s16(int16x8_t a)
+{
+	return (int16x4_t){ a[0], a[1], a[2], a[3] };
+}
+
+static inline int16x4_t vget_high_s16(int16x8_t a)
+{
+	return (int16x4_t){ a[4], a[5], a[6], a[7] };
+}
+
+static inline float32x4_t vld1q_f32(const float *p)
+{
+	float32x4_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void vst1q_f32(float *p, float32x4_t v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline int32x4_t vld1q_s32(const int32_t *p)
+{
+	int32x4_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void vst1q_s32(int32_t *p, int32x4_t v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline float32x4x2_t vld2q_f32(const float *p)
+{
+	float32x4x2_t v;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		v.val[0][i] = p[2 * i];
+		v.val[1][i] = p[2 * i + 1];
+	}
+	return v;
+}
+
+static inline void vst2q_f32(float *p, float32x4x2_t v)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		p[2 * i] = v.val[0][i];
+		p[2 * i + 1] = v.val[1][i];
+	}
+}
+
+/* Loads and stores 8 frames of n interleaved int16_t channels. */
+#define DEFINE_LDN_STN_S16(n)						\
+	static inline int16x8x##n##_t vld##n##q_s16(const int16_t *p)	\
+	{								\
+		int16x8x##n##_t v;					\
+		int i, k;						\
+									\
+		for (i = 0; i < 8; i++)					\
+			for (k = 0; k < n; k++)				\
+				v.val[k][i] = p[n * i + k];		\
+		return v;						\
+	}								\
+	static inline void vst##n##q_s16(int16_t *p, int16x8x##n##_t v)	\
+	{								\
+		int i, k;						\
+									\
+		for (i = 0; i < 8; i++)					\
+			for (k = 0; k < n; k++)				\
+				p[n * i + k] = v.val[k][i];		\
+	}
+
+DEFINE_LDN_STN_S16(2)
+DEFINE_LDN_STN_S16(3)
+DEFINE_LDN_STN_S16(4)
+
+static inline int16x8x2_t vuzpq_s16(int16x8_t a, int16x8_t b)
+{
+	int16x8x2_t v;
+	int16_t t[16];
+	int i;
+
+	memcpy(t, &a, sizeof(a));
+	memcpy(t + 8, &b, sizeof(b));
+	for (i = 0; i < 8; i++) {
+		v.val[0][i] = t[2 * i];
+		v.val[1][i] = t[2 * i + 1];
+	}
+	return v;
+}
+
+static inline int16x8x2_t vzipq_s16(int16x8_t a, int16x8_t b)
+{
+	int16x8x2_t v;
+	int16_t t[16];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		t[2 * i] = a[i];
+		t[2 * i + 1] = b[i];
+	}
+	memcpy(&v.val[0], t, sizeof(v.val[0]));
+	memcpy(&v.val[1], t + 8, sizeof(v.val[1]));
+	return v;
+}
+
+/* Arithmetic */
+
+static inline float32x4_t vaddq_f32(float32x4_t a, float32x4_t b)
+{
+	return a + b;
+}
+
+static inline float32x4_t vsubq_f32(float32x4_t a, float32x4_t b)
+{
+	return a - b;
+}
+
+static inline float32x4_t vmulq_f32(float32x4_t a, float32x4_t b)
+{
+	return a * b;
+}
+
+static inline float32x4_t vmulq_n_f32(float32x4_t a, float b)
+{
+	return a * b;
+}
+
+/* a + b * c, rounded once. */
+static inline float32x4_t vfmaq_f32(float32x4_t a, float32x4_t b,
+				    float32x4_t c)
+{
+	float32x4_t r;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = fmaf(b[i], c[i], a[i]);
+	return r;
+}
+
+/* a - b * c, rounded once. */
+static inline float32x4_t vfmsq_f32(float32x4_t a, float32x4_t b,
+				    float32x4_t c)
+{
+	float32x4_t r;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = fmaf(-b[i], c[i], a[i]);
+	return r;
+}
+
+static inline int32x4_t vqaddq_s32(int32x4_t a, int32x4_t b)
+{
+	int32x4_t r;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		int64_t sum = (int64_t)a[i] + b[i];
+		r[i] = sum > INT32_MAX ? INT32_MAX :
+			sum < INT32_MIN ? INT32_MIN : sum;
+	}
+	return r;
+}
+
+static inline int32x4_t vqnegq_s32(int32x4_t a)
+{
+	int32x4_t r;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = a[i] == INT32_MIN ? INT32_MAX : -a[i];
+	return r;
+}
+
+static inline float32x2_t vpadd_f32(float32x2_t a, float32x2_t b)
+{
+	return (float32x2_t){ a[0] + a[1], b[0] + b[1] };
+}
+
+/* Adds the pairs first, as the instruction does. */
+static inline float vaddvq_f32(float32x4_t a)
+{
+	return (a[0] + a[1]) + (a[2] + a[3]);
+}
+
+static inline float32x4_t vabsq_f32(float32x4_t a)
+{
+	float32x4_t r;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = fabsf(a[i]);
+	return r;
+}
+
+static inline float32x4_t vmaxq_f32(float32x4_t a, float32x4_t b)
+{
+	float32x4_t r;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = a[i] > b[i] ? a[i] : b[i];
+	return r;
+}
+
+static inline float32x4_t vminq_f32(float32x4_t a, float32x4_t b)
+{
+	float32x4_t r;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = a[i] < b[i] ? a[i] : b[i];
+	return r;
+}
+
+/* Comparisons and selection */
+
+static inline uint32x4_t vcgtq_f32(float32x4_t a, float32x4_t b)
+{
+	return (uint32x4_t)(a > b);
+}
+
+static inline uint32x4_t vmvnq_u32(uint32x4_t a)
+{
+	return ~a;
+}
+
+/* The bits of a where mask is set, and of b elsewhere. */
+static inline float32x4_t vbslq_f32(uint32x4_t mask, float32x4_t a,
+				    float32x4_t b)
+{
+	uint32x4_t ua, ub;
+
+	memcpy(&ua, &a, sizeof(a));
+	memcpy(&ub, &b, sizeof(b));
+	ua = (ua & mask) | (ub & ~mask);
+	memcpy(&a, &ua, sizeof(a));
+	return a;
+}
+
+/* Conversions */
+
+static inline int32x4_t vmovl_s16(int16x4_t a)
+{
+	return (int32x4_t){ a[0], a[1], a[2], a[3] };
+}
+
+static inline int16x4_t vmovn_s32(int32x4_t a)
+{
+	return (int16x4_t){ (int16_t)a[0], (int16_t)a[1], (int16_t)a[2],
+			    (int16_t)a[3] };
+}
+
+#define vshll_n_s16(a, n) ({					\
+	int16x4_t _a = (a);					\
+	int32x4_t _r;						\
+	int _i;							\
+	for (_i = 0; _i < 4; _i++)				\
+		_r[_i] = (int32_t)_a[_i] << (n);		\
+	_r; })
+
+/* Shifts right by n with rounding, and saturates to int16_t. */
+#define vqrshrn_n_s32(a, n) ({					\
+	int32x4_t _a = (a);					\
+	int16x4_t _r;						\
+	int _i;							\
+	for (_i = 0; _i < 4; _i++) {				\
+		int64_t _v = ((int64_t)_a[_i] +			\
+			      (1LL << ((n) - 1))) >> (n);	\
+		_r[_i] = _v > INT16_MAX ? INT16_MAX :		\
+			_v < INT16_MIN ? INT16_MIN : _v;	\
+	}							\
+	_r; })
+
+/* Fixed point with n fraction bits to float. */
+#define vcvtq_n_f32_s32(a, n) ({				\
+	int32x4_t _a = (a);					\
+	float32x4_t _r;						\
+	int _i;							\
+	for (_i = 0; _i < 4; _i++)				\
+		_r[_i] = _a[_i] / (float)(1 << (n));		\
+	_r; })
+
+/* Rounds toward zero. The kernels only convert values in range. */
+static inline int32x4_t vcvtq_s32_f32(float32x4_t a)
+{
+	int32x4_t r;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = (int32_t)a[i];
+	return r;
+}
+
+#endif /* ARM_NEON_EMUL_H_ */
@@ -0,0 +1,222 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "src.h"
+
+#define TEST_SECONDS 1
+#define BENCH_LOOPS 20
+
+static const char *quality_names[SRC_QUALITY_LAST] = {
+	"low", "medium", "high"
+};
+
+/* The lowest passband SNR and stopband attenuation each quality must
+ * reach, in dB. */
+static const double min_snr[SRC_QUALITY_LAST] = { 55, 80, 100 };
+static const double min_stop[SRC_QUALITY_LAST] = { 50, 70, 80 };
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec)
+		+ (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+/* Converts a sine of the given frequency in blocks of odd sizes, and checks
+ * that the number of output frames follows the ratio. Returns the number
+ * of output frames, which are written to out0 and out1. */
+static int convert_sine(struct src *src, int in_rate, double freq,
+			float *out0, float *out1)
+{
+	int frames = in_rate * TEST_SECONDS;
+	float *in = malloc(frames * sizeof(float));
+	int i, done = 0, out_frames = 0, block = 1;
+
+	for (i = 0; i < frames; i++)
+		in[i] = 0.5 * sin(2 * M_PI * freq * i / in_rate);
+
+	while (done < frames) {
+		int n = block < frames - done ? block : frames - done;
+		int expected = src_get_output_frames(src, n);
+		int got = src_process(src, in + done, in + done, n,
+				      out0 + out_frames, out1 + out_frames);
+		if (got != expected)
+			printf("block of %d frames: %d frames, expected %d\n",
+			       n, got, expected);
+		out_frames += got;
+		done += n;
+		block = (block * 7 + 3) % 1000 + 1;
+	}
+	free(in);
+	return out_frames;
+}
+
+/* Fits a sine of the frequency to the samples by least squares. Returns
+ * the power of the sine, and the power of the rest in residual. */
+static double fit_sine(const float *y, int frames, double freq, int rate,
+		       double *residual)
+{
+	double cc = 0, ss = 0, cs = 0, yc = 0, ys = 0, det, a, b;
+	double fitted = 0;
+	int i;
+
+	for (i = 0; i < frames; i++) {
+		double w = 2 * M_PI * freq * i / rate;
+		cc += cos(w) * cos(w);
+		ss += sin(w) * sin(w);
+		cs += cos(w) * sin(w);
+		yc += y[i] * cos(w);
+		ys += y[i] * sin(w);
+	}
+	det = cc * ss - cs * cs;
+	a = (yc * ss - ys * cs) / det;
+	b = (ys * cc - yc * cs) / det;
+
+	*residual = 0;
+	for (i = 0; i < frames; i++) {
+		double w = 2 * M_PI * freq * i / rate;
+		double f = a * cos(w) + b * sin(w);
+		fitted += f * f;
+		*residual += (y[i] - f) * (y[i] - f);
+	}
+	*residual /= frames;
+	return fitted / frames;
+}
+
+/* Returns the ratio of the power of a sine of the frequency in the samples
+ * to the power of the rest, in dB. */
+static double sine_snr(const float *y, int frames, double freq, int rate)
+{
+	double residual, power = fit_sine(y, frames, freq, rate, &residual);
+
+	return 10 * log10(power / fmax(residual, 1e-30));
+}
+
+/* Returns how far below the input sine of amplitude 0.5 a sine of the
+ * frequency in the samples is, in dB. */
+static double sine_attenuation(const float *y, int frames, double freq,
+			       int rate)
+{
+	double residual, power = fit_sine(y, frames, freq, rate, &residual);
+
+	return -10 * log10(fmax(power, 1e-30) / 0.125);
+}
+
+static int test_rates(int in_rate, int out_rate, int quality)
+{
+	int max_out = (int64_t)out_rate * TEST_SECONDS + 2;
+	float *out0 = malloc(max_out * sizeof(float));
+	float *out1 = malloc(max_out * sizeof(float));
+	int low = out_rate;
+	int errors = 0;
+	struct src *src;
+	int frames, delay, skip;
+	double snr, stop;
+
+	src = src_new(in_rate, out_rate, quality);
+	if (!src) {
+		printf("%d -> %d %s: not supported\n", in_rate, out_rate,
+		       quality_names[quality]);
+		free(out0);
+		free(out1);
+		return 1;
+	}
+	delay = src_get_delay(src);
+	/* Leave out the start of the filter, where it is still filled. */
+	skip = 4 * delay + 64;
+
+	/* A tone well inside the passband. */
+	frames = convert_sine(src, in_rate, 1000, out0, out1);
+	if (abs(frames - out_rate * TEST_SECONDS) > 1) {
+		printf("%d -> %d: %d frames\n", in_rate, out_rate, frames);
+		errors++;
+	}
+	snr = sine_snr(out0 + skip, frames - skip, 1000, out_rate);
+	if (snr < min_snr[quality])
+		errors++;
+	src_free(src);
+
+	/* When the rate goes up, a tone near half the input rate has an
+	 * image above it, which must be filtered out. When it goes down, a
+	 * tone above half the output rate must be filtered out before it
+	 * aliases. */
+	src = src_new(in_rate, out_rate, quality);
+	if (in_rate < out_rate) {
+		frames = convert_sine(src, in_rate, 0.3 * in_rate, out0, out1);
+		stop = sine_attenuation(out0 + skip, frames - skip,
+					0.7 * in_rate, out_rate);
+	} else {
+		double freq = fmin(0.55 * low, (low + in_rate) / 4.0);
+		frames = convert_sine(src, in_rate, freq, out0, out1);
+		stop = sine_attenuation(out0 + skip, frames - skip,
+					out_rate - freq, out_rate);
+	}
+	if (stop < min_stop[quality])
+		errors++;
+	src_free(src);
+
+	printf("%5d -> %5d %-6s: delay %3d, snr %5.1f dB, "
+	       "stopband %5.1f dB%s\n", in_rate, out_rate,
+	       quality_names[quality], delay, snr, stop, errors ? " FAIL" : "");
+	free(out0);
+	free(out1);
+	return errors;
+}
+
+static void bench_rates(int in_rate, int out_rate, int quality)
+{
+	int frames = in_rate * TEST_SECONDS;
+	float *in = calloc(frames, sizeof(float));
+	float *out0 = malloc((out_rate * TEST_SECONDS + 2) * sizeof(float));
+	float *out1 = malloc((out_rate * TEST_SECONDS + 2) * sizeof(float));
+	struct src *src = src_new(in_rate, out_rate, quality);
+	struct timespec tp1, tp2;
+	int i, j;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+	for (i = 0; i < BENCH_LOOPS; i++)
+		for (j = 0; j < frames; j += 512)
+			src_process(src, in + j, in + j,
+				    frames - j < 512 ? frames - j : 512,
+				    out0, out1);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+	printf("%5d -> %5d %-6s: %.2f%% of a core for two channels\n",
+	       in_rate, out_rate, quality_names[quality],
+	       100 * tp_diff(&tp2, &tp1) / (BENCH_LOOPS * TEST_SECONDS));
+
+	src_free(src);
+	free(in);
+	free(out0);
+	free(out1);
+}
+
+int main(int argc, char **argv)
+{
+	static const int rates[][2] = {
+		{ 44100, 48000 }, { 48000, 44100 },
+		{ 48000, 16000 }, { 16000, 48000 },
+		{ 48000, 8000 }, { 8000, 48000 },
+	};
+	int i, quality, errors = 0;
+
+	for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+		for (quality = 0; quality < SRC_QUALITY_LAST; quality++)
+			errors += test_rates(rates[i][0], rates[i][1],
+					     quality);
+	if (src_new(44100, 44099, SRC_QUALITY_LOW)) {
+		printf("44100 -> 44099 should not be supported\n");
+		errors++;
+	}
+	printf("%d errors\n", errors);
+
+	for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+		bench_rates(rates[i][0], rates[i][1], SRC_QUALITY_MEDIUM);
+
+	return errors ? 1 : 0;
+}
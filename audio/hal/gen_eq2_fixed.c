@@ -0,0 +1,248 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Host tool which generates the eq2_fixed_table (see dsp/eq2_fixed.h) from the
+ * eq2 plugins in an ini file. The generated C source is written to stdout.
+ *
+ * Usage: gen_eq2_fixed ini_file [sample_rate ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cras_dsp_ini.h"
+#include "eq2_fixed.h"
+
+/* The sample rates to generate for if none is given on the command line. */
+static const int default_rates[] = { 44100, 48000 };
+
+/* Two ports for input and two for output come before the parameters. */
+#define EQ2_FIRST_PARAM_PORT 4
+
+/* Collects the parameters of an eq2 plugin. Returns the number of parameters,
+ * or -1 if the plugin cannot be specialized because some parameter is not a
+ * constant. */
+static int get_params(struct plugin *plugin, float *params)
+{
+	struct port *port;
+	int i, n = 0;
+
+	FOR_ARRAY_ELEMENT(&plugin->ports, i, port) {
+		if (i < EQ2_FIRST_PARAM_PORT)
+			continue;
+		if (port->type != PORT_CONTROL ||
+		    port->direction != PORT_INPUT ||
+		    port->flow_id != INVALID_FLOW_ID)
+			return -1;
+		if (n == EQ2_FIXED_MAX_PARAMS)
+			return -1;
+		params[n++] = port->init_value;
+	}
+
+	/* The eq2 module reads the parameters in groups of eight. */
+	if (n % 8)
+		return -1;
+	return n;
+}
+
+/* Returns 1 if the biquad does nothing, so it can be left out. */
+static int is_identity(const struct biquad *bq)
+{
+	return bq->b0 == 1 && bq->b1 == 0 && bq->b2 == 0 &&
+		bq->a1 == 0 && bq->a2 == 0;
+}
+
+/* Prints a float constant which reads back to the same value. */
+static void print_float(float f)
+{
+	printf("%.8ef", f);
+}
+
+/* Prints a two channel vector constant. */
+static void print_vector(const char *name, int k, float l, float r)
+{
+	printf("\tconst eq2_fixed_v2 %s%d = { ", name, k);
+	print_float(l);
+	printf(", ");
+	print_float(r);
+	printf(" };\n");
+}
+
+/* Generates the process function for one eq2 plugin at one sample rate. The
+ * biquads are computed the same way as eq2_run() in cras_dsp_mod_builtin.c
+ * does, so the coefficients are the same as the generic eq2 uses.
+ *
+ * The two channels are processed as one two-lane vector. Biquads which do
+ * nothing are left out, and the channel with fewer biquads is padded with
+ * identity biquads (which do not change the samples). */
+static void gen_process(int index, const char *title, int sample_rate,
+			const float *params, int num_params)
+{
+	struct biquad bq[2][MAX_BIQUADS_PER_EQ2];
+	int n[2] = {0, 0};
+	float nyquist = sample_rate / 2;
+	int i, c, k, stages;
+
+	for (i = 0; i < num_params; i += 8) {
+		for (c = 0; c < 2; c++) {
+			const float *p = &params[i + c * 4];
+			struct biquad b;
+			biquad_set(&b, (int)p[0], p[1] / nyquist, p[2], p[3]);
+			if (!is_identity(&b))
+				bq[c][n[c]++] = b;
+		}
+	}
+
+	stages = n[0] > n[1] ? n[0] : n[1];
+	for (c = 0; c < 2; c++)
+		for (k = n[c]; k < stages; k++)
+			biquad_set(&bq[c][k], BQ_NONE, 0, 0, 0);
+
+	printf("\n/* [%s] at %d Hz */\n", title, sample_rate);
+	printf("static void eq2_fixed_process_%d(float *s, float *data0, "
+	       "float *data1,\n\t\t\t\t int count)\n{\n", index);
+
+	/* The coefficients. The feedback ones are negated, so every term is
+	 * added. */
+	for (k = 0; k < stages; k++) {
+		print_vector("b0_", k, bq[0][k].b0, bq[1][k].b0);
+		print_vector("b1_", k, bq[0][k].b1, bq[1][k].b1);
+		print_vector("b2_", k, bq[0][k].b2, bq[1][k].b2);
+		print_vector("a1_", k, -bq[0][k].a1, -bq[1][k].a1);
+		print_vector("a2_", k, -bq[0][k].a2, -bq[1][k].a2);
+	}
+
+	/* Load the state. Signal 0 is the input, signal k is the output of the
+	 * k-th biquad. */
+	for (k = 0; k <= stages; k++)
+		printf("\teq2_fixed_v2 x%d_1 = { s[%d], s[%d] }, "
+		       "x%d_2 = { s[%d], s[%d] };\n",
+		       k, 4 * k, 4 * k + 1, k, 4 * k + 2, 4 * k + 3);
+	printf("\tint j;\n\n");
+
+	printf("\tfor (j = 0; j < count; j++) {\n");
+	printf("\t\teq2_fixed_v2 x0 = { data0[j], data1[j] };\n");
+	for (k = 0; k < stages; k++)
+		printf("\t\teq2_fixed_v2 x%d = b0_%d * x%d"
+		       " + b1_%d * x%d_1 + b2_%d * x%d_2\n"
+		       "\t\t\t+ a1_%d * x%d_1 + a2_%d * x%d_2;\n",
+		       k + 1, k, k, k, k, k, k, k, k + 1, k, k + 1);
+	for (k = 0; k <= stages; k++) {
+		printf("\t\tx%d_2 = x%d_1;\n", k, k);
+		printf("\t\tx%d_1 = x%d;\n", k, k);
+	}
+	printf("\t\tdata0[j] = x%d[0];\n", stages);
+	printf("\t\tdata1[j] = x%d[1];\n", stages);
+	printf("\t}\n\n");
+
+	for (k = 0; k <= stages; k++)
+		printf("\ts[%d] = x%d_1[0];\n\ts[%d] = x%d_1[1];\n"
+		       "\ts[%d] = x%d_2[0];\n\ts[%d] = x%d_2[1];\n",
+		       4 * k, k, 4 * k + 1, k, 4 * k + 2, k, 4 * k + 3, k);
+	printf("}\n");
+}
+
+static void gen_params(int index, const float *params, int num_params)
+{
+	int i;
+
+	printf("\nstatic const float eq2_fixed_params_%d[] = {", index);
+	for (i = 0; i < num_params; i++) {
+		printf(i % 4 ? " " : "\n\t");
+		print_float(params[i]);
+		printf(",");
+	}
+	printf("\n};\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct ini *ini;
+	struct plugin *plugin;
+	const int *rates = default_rates;
+	int num_rates = sizeof(default_rates) / sizeof(default_rates[0]);
+	int *arg_rates = NULL;
+	float params[EQ2_FIXED_MAX_PARAMS];
+	int num_params;
+	int i, r, count = 0;
+	uint32_t *hashes;
+	int *entry_rates, *entry_params;
+	const char *base;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: gen_eq2_fixed ini_file "
+			"[sample_rate ...]\n");
+		return 1;
+	}
+
+	if (argc > 2) {
+		num_rates = argc - 2;
+		arg_rates = calloc(num_rates, sizeof(int));
+		for (r = 0; r < num_rates; r++)
+			arg_rates[r] = atoi(argv[r + 2]);
+		rates = arg_rates;
+	}
+
+	ini = cras_dsp_ini_create(argv[1]);
+	if (!ini) {
+		fprintf(stderr, "cannot read ini file %s\n", argv[1]);
+		return 1;
+	}
+
+	hashes = calloc(ARRAY_COUNT(&ini->plugins) * num_rates,
+			sizeof(uint32_t));
+	entry_rates = calloc(ARRAY_COUNT(&ini->plugins) * num_rates,
+			     sizeof(int));
+	entry_params = calloc(ARRAY_COUNT(&ini->plugins) * num_rates,
+			      sizeof(int));
+
+	base = strrchr(argv[1], '/');
+	printf("/* Generated by gen_eq2_fixed from %s. Do not edit. */\n\n",
+	       base ? base + 1 : argv[1]);
+	printf("#include <stddef.h>\n\n#include \"eq2_fixed.h\"\n\n");
+	printf("typedef float eq2_fixed_v2 __attribute__ ((vector_size (8)));\n");
+
+	FOR_ARRAY_ELEMENT(&ini->plugins, i, plugin) {
+		if (strcmp(plugin->library, "builtin") != 0 ||
+		    strcmp(plugin->label, "eq2") != 0)
+			continue;
+
+		num_params = get_params(plugin, params);
+		if (num_params < 0) {
+			fprintf(stderr, "skip [%s]: parameters not constant\n",
+				plugin->title);
+			continue;
+		}
+
+		gen_params(i, params, num_params);
+		for (r = 0; r < num_rates; r++) {
+			gen_process(count, plugin->title, rates[r], params,
+				    num_params);
+			hashes[count] = eq2_fixed_hash(rates[r], params,
+						       num_params);
+			entry_rates[count] = rates[r];
+			entry_params[count] = i;
+			count++;
+		}
+	}
+
+	printf("\nconst struct eq2_fixed eq2_fixed_table[] = {\n");
+	for (i = 0; i < count; i++) {
+		plugin = ARRAY_ELEMENT(&ini->plugins, entry_params[i]);
+		printf("\t{ 0x%08xU, %d, %d, eq2_fixed_params_%d, "
+		       "eq2_fixed_process_%d },\n", hashes[i], entry_rates[i],
+		       get_params(plugin, params), entry_params[i], i);
+	}
+	printf("\t{ 0, 0, 0, NULL, NULL },\n");
+	printf("};\n");
+
+	free(hashes);
+	free(entry_rates);
+	free(entry_params);
+	free(arg_rates);
+	cras_dsp_ini_free(ini);
+	return 0;
+}
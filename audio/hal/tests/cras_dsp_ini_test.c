@@ -0,0 +1,191 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Checks that the tunings of a plugin are read from the ini, that the right
+ * one is found for a volume, and that a running pipeline moves to the port
+ * values of a tuning when the volume crosses its threshold.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cras_dsp_ini.h"
+#include "cras_dsp_pipeline.h"
+#include "cras_expr.h"
+#include "dsp_util.h"
+
+#define RATE 48000
+/* Longer than the fade of a control change, so the output has settled. */
+#define SETTLE_FRAMES 4800
+#define DC 0.5f
+
+/* A mono low shelf whose gain is -3 dB below the volume 0.25, -9 dB up to
+ * 0.75 and -15 dB from there up. The shelf reaches past the whole band, so
+ * it scales a constant input by its gain. The tunings are out of order, to
+ * check they are sorted. */
+static const char ini_text[] =
+	"[source]\n"
+	"library=builtin\n"
+	"label=source\n"
+	"purpose=playback\n"
+	"output_0={a}\n"
+	"[shelf]\n"
+	"library=builtin\n"
+	"label=eq\n"
+	"input_0={a}\n"
+	"output_1={b}\n"
+	"input_2=4\n"
+	"input_3=20000\n"
+	"input_4=0\n"
+	"input_5=-3\n"
+	"tuning_0_volume=0.75\n"
+	"tuning_0_input_5=-15\n"
+	"tuning_1_volume=0.25\n"
+	"tuning_1_input_5=-9\n"
+	"[sink]\n"
+	"library=builtin\n"
+	"label=sink\n"
+	"purpose=playback\n"
+	"input_0={b}\n";
+
+static int errors;
+
+static void check(int ok, const char *what)
+{
+	if (!ok) {
+		printf("FAILED: %s\n", what);
+		errors++;
+	}
+}
+
+static struct ini *create_ini(void)
+{
+	char filename[] = "/tmp/cras_dsp_ini_test.XXXXXX";
+	struct ini *ini;
+	int fd = mkstemp(filename);
+
+	if (fd < 0)
+		return NULL;
+	if (write(fd, ini_text, strlen(ini_text)) != (ssize_t)strlen(ini_text))
+		ini = NULL;
+	else
+		ini = cras_dsp_ini_create(filename);
+	close(fd);
+	unlink(filename);
+	return ini;
+}
+
+static void test_find_tuning(struct ini *ini)
+{
+	struct plugin *plugin = ARRAY_ELEMENT(&ini->plugins, 1);
+	struct tuning *tuning;
+
+	check(ARRAY_COUNT(&plugin->tunings) == 2, "two tunings");
+	if (ARRAY_COUNT(&plugin->tunings) != 2)
+		return;
+
+	/* Sorted by volume, with the ports they do not set as in the ini. */
+	tuning = ARRAY_ELEMENT(&plugin->tunings, 0);
+	check(tuning->volume == 0.25f && tuning->values[5] == -9,
+	      "first tuning is the lowest");
+	check(tuning->values[2] == 4 && tuning->values[3] == 20000,
+	      "unset ports keep their value");
+	tuning = ARRAY_ELEMENT(&plugin->tunings, 1);
+	check(tuning->volume == 0.75f && tuning->values[5] == -15,
+	      "second tuning is the highest");
+
+	/* A tuning starts at its volume. */
+	check(cras_dsp_ini_find_tuning(plugin, 0) == -1, "volume 0");
+	check(cras_dsp_ini_find_tuning(plugin, 0.2499f) == -1,
+	      "just below the first tuning");
+	check(cras_dsp_ini_find_tuning(plugin, 0.25f) == 0,
+	      "at the first tuning");
+	check(cras_dsp_ini_find_tuning(plugin, 0.7499f) == 0,
+	      "just below the second tuning");
+	check(cras_dsp_ini_find_tuning(plugin, 0.75f) == 1,
+	      "at the second tuning");
+	check(cras_dsp_ini_find_tuning(plugin, 1) == 1, "volume 1");
+
+	/* A plugin without tunings always uses its ports. */
+	plugin = ARRAY_ELEMENT(&ini->plugins, 0);
+	check(cras_dsp_ini_find_tuning(plugin, 1) == -1, "no tunings");
+}
+
+/* Sets the volume and returns the output for a constant input once the
+ * pipeline has faded to the tuning. */
+static float settle(struct pipeline *pipeline, float volume)
+{
+	static float buf[SETTLE_FRAMES];
+	int i;
+
+	cras_dsp_pipeline_set_volume(pipeline, volume);
+	for (i = 0; i < SETTLE_FRAMES; i++)
+		buf[i] = DC;
+	cras_dsp_pipeline_apply_format(pipeline, (uint8_t *)buf,
+				       DSP_SAMPLE_FORMAT_FLOAT_LE,
+				       SETTLE_FRAMES);
+	return buf[SETTLE_FRAMES - 1];
+}
+
+static void check_gain(struct pipeline *pipeline, float volume, float db)
+{
+	float expected = DC * powf(10, db / 20);
+	float out = settle(pipeline, volume);
+	char what[64];
+
+	snprintf(what, sizeof(what), "volume %g gives %g, not %g", volume,
+		 out, expected);
+	check(fabsf(out - expected) < 1e-3f * expected, what);
+}
+
+static void test_switch(struct ini *ini)
+{
+	struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+	struct pipeline *pipeline;
+
+	cras_expr_env_install_builtins(&env);
+	pipeline = cras_dsp_pipeline_create(ini, &env, "playback");
+	check(pipeline != NULL, "pipeline created");
+	if (!pipeline)
+		goto done;
+	if (cras_dsp_pipeline_load(pipeline) != 0 ||
+	    cras_dsp_pipeline_instantiate(pipeline, RATE) != 0) {
+		check(0, "pipeline instantiated");
+		goto done;
+	}
+
+	/* Down across both thresholds, then onto and just below them. */
+	check_gain(pipeline, 1, -3 - 12);
+	check_gain(pipeline, 0.5f, -9);
+	check_gain(pipeline, 0.1f, -3);
+	check_gain(pipeline, 0.25f, -9);
+	check_gain(pipeline, 0.2499f, -3);
+	check_gain(pipeline, 0.75f, -15);
+	check_gain(pipeline, 0.7499f, -9);
+
+done:
+	if (pipeline)
+		cras_dsp_pipeline_free(pipeline);
+	cras_expr_env_free(&env);
+}
+
+int main(int argc, char **argv)
+{
+	struct ini *ini = create_ini();
+
+	if (!ini) {
+		printf("cannot read the ini\n");
+		return 1;
+	}
+	test_find_tuning(ini);
+	test_switch(ini);
+	cras_dsp_ini_free(ini);
+
+	printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+/* Copyright (c) 2016 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Checks the pipelines the dsp contexts load: that a change of a variable
+ * loads the pipeline again and switches it into and out of bypass, and that
+ * a reload frees the old pipeline only after every thread which holds it
+ * has released it.
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cras_dsp.h"
+
+#define RATE 48000
+#define READERS 2
+/* How long to give a reload to free a pipeline it must not free. */
+#define RELOAD_WAIT_US 100000
+
+/* A mono eq which the variable eq_mode disables, which leaves the source
+ * connected straight to the sink. */
+static const char ini_text[] =
+	"[source]\n"
+	"library=builtin\n"
+	"label=source\n"
+	"purpose=playback\n"
+	"output_0={a}\n"
+	"[eq]\n"
+	"library=builtin\n"
+	"label=eq\n"
+	"disable=(equal? eq_mode \"off\")\n"
+	"input_0={a}\n"
+	"output_1={b}\n"
+	"input_2=6\n"
+	"input_3=1000\n"
+	"input_4=1\n"
+	"input_5=-6\n"
+	"[sink]\n"
+	"library=builtin\n"
+	"label=sink\n"
+	"purpose=playback\n"
+	"input_0={b}\n";
+
+static int errors;
+
+static void check(int ok, const char *what)
+{
+	if (!ok) {
+		printf("FAILED: %s\n", what);
+		errors++;
+	}
+}
+
+/* Waits for the loads and returns the pipeline of the context, and if it
+ * is bypassed. */
+static struct pipeline *sync_pipeline(struct cras_dsp_context *ctx,
+				      int *bypassed)
+{
+	struct pipeline *pipeline;
+
+	cras_dsp_sync();
+	pipeline = cras_dsp_get_pipeline(ctx);
+	*bypassed = pipeline ? cras_dsp_pipeline_is_bypassed(pipeline) : -1;
+	cras_dsp_put_pipeline(ctx);
+	return pipeline;
+}
+
+static void test_variable_bypass(void)
+{
+	struct cras_dsp_context *ctx;
+	struct pipeline *pipeline, *last;
+	int bypassed;
+
+	ctx = cras_dsp_context_new(RATE, "playback");
+	cras_dsp_set_variable(ctx, "eq_mode", "on");
+	cras_dsp_load_pipeline(ctx);
+	last = sync_pipeline(ctx, &bypassed);
+	check(last != NULL, "pipeline loaded");
+	check(bypassed == 0, "eq on runs the pipeline");
+
+	cras_dsp_set_variable(ctx, "eq_mode", "off");
+	pipeline = sync_pipeline(ctx, &bypassed);
+	check(pipeline != last, "eq off loads the pipeline again");
+	check(bypassed == 1, "eq off bypasses the pipeline");
+	last = pipeline;
+
+	cras_dsp_set_variable(ctx, "eq_mode", "off");
+	pipeline = sync_pipeline(ctx, &bypassed);
+	check(pipeline == last, "the same value does not load the pipeline");
+
+	cras_dsp_set_variable(ctx, "eq_mode", "on");
+	pipeline = sync_pipeline(ctx, &bypassed);
+	check(pipeline != last, "eq on loads the pipeline again");
+	check(bypassed == 0, "eq on leaves bypass");
+
+	cras_dsp_context_free(ctx);
+}
+
+struct reader {
+	struct cras_dsp_context *ctx;
+	struct pipeline *pipeline;
+	sem_t held;
+	sem_t release;
+};
+
+/* Holds the pipeline of the context until told to release it. */
+static void *reader_thread(void *arg)
+{
+	struct reader *reader = (struct reader *)arg;
+
+	reader->pipeline = cras_dsp_get_pipeline(reader->ctx);
+	sem_post(&reader->held);
+	sem_wait(&reader->release);
+	/* Still valid, which ASan would report otherwise. */
+	if (reader->pipeline)
+		cras_dsp_pipeline_get_num_input_channels(reader->pipeline);
+	cras_dsp_put_pipeline(reader->ctx);
+	return NULL;
+}
+
+static volatile int synced;
+
+static void *sync_thread(void *arg)
+{
+	cras_dsp_sync();
+	synced = 1;
+	return NULL;
+}
+
+static void test_readers(void)
+{
+	struct cras_dsp_context *ctx;
+	struct reader readers[READERS];
+	pthread_t threads[READERS], syncer;
+	int i;
+
+	ctx = cras_dsp_context_new(RATE, "playback");
+	cras_dsp_load_pipeline(ctx);
+	cras_dsp_sync();
+
+	for (i = 0; i < READERS; i++) {
+		readers[i].ctx = ctx;
+		sem_init(&readers[i].held, 0, 0);
+		sem_init(&readers[i].release, 0, 0);
+		pthread_create(&threads[i], NULL, reader_thread, &readers[i]);
+		sem_wait(&readers[i].held);
+	}
+
+	/* The reload publishes a new pipeline at once, but the old one is
+	 * only freed, and the load finished, when no reader is left. */
+	synced = 0;
+	cras_dsp_set_variable(ctx, "eq_mode", "off");
+	pthread_create(&syncer, NULL, sync_thread, NULL);
+	for (i = 0; i < READERS; i++) {
+		usleep(RELOAD_WAIT_US);
+		check(!synced, "the old pipeline is kept while it is held");
+		sem_post(&readers[i].release);
+		pthread_join(threads[i], NULL);
+	}
+	pthread_join(syncer, NULL);
+	check(readers[0].pipeline != NULL &&
+	      readers[0].pipeline == readers[READERS - 1].pipeline,
+	      "the readers held the same pipeline");
+
+	for (i = 0; i < READERS; i++) {
+		sem_destroy(&readers[i].held);
+		sem_destroy(&readers[i].release);
+	}
+	cras_dsp_context_free(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	char filename[] = "/tmp/cras_dsp_test.XXXXXX";
+	int fd = mkstemp(filename);
+
+	if (fd < 0 ||
+	    write(fd, ini_text, strlen(ini_text)) != (ssize_t)strlen(ini_text)) {
+		printf("cannot write the ini\n");
+		return 1;
+	}
+	close(fd);
+	cras_dsp_init(filename);
+	unlink(filename);
+
+	test_variable_bypass();
+	test_readers();
+
+	cras_dsp_stop();
+	printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}